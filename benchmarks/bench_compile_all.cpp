@@ -0,0 +1,103 @@
+#include "cppexprpars.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cppexprpars;
+
+// Bulk compilation of generated formulas: expressions per second of a plain
+// `Parser` loop, then of `compile_all` at 1, 2, 4, ... threads up to the
+// hardware concurrency (or the second argument), each with its own
+// `ThreadPool`. The last column checks that every expression compiled the
+// same way as in the loop.
+//
+//      bench_compile_all [formulas] [max threads]
+
+static const char* const variables[] = { "x", "y", "z", "w" };
+static const char* const functions[] = { "sin", "cos", "sqrt", "abs", "exp", "log" };
+static const char* const operators[] = { " + ", " - ", " * ", " / " };
+
+// A formula of 4 to 11 terms, each a variable, a constant or a function of a
+// variable, joined by arithmetic; every 10th one has an unknown variable.
+static std::string generate(size_t index, unsigned& seed) {
+    auto next = [&seed]() { seed = seed * 1103515245u + 12345u; return seed >> 16; };
+    std::string formula;
+    const unsigned terms = 4 + next() % 8;
+    for (unsigned t = 0; t < terms; ++t) {
+        if (t > 0)
+            formula += operators[next() % 4];
+        switch (next() % 3) {
+            case 0: formula += variables[next() % 4]; break;
+            case 1: formula += std::to_string(1 + next() % 999) + "." + std::to_string(next() % 10); break;
+            case 2: formula += std::string(functions[next() % 6]) + "(" + variables[next() % 4] + ")"; break;
+        }
+    }
+    if (index % 10 == 9)
+        formula += " * missing";
+    return formula;
+}
+
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+    size_t max_threads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+    max_threads = std::max<size_t>(1, max_threads);
+
+    EvaluationContext context;
+    for (const char* name : variables)
+        context.set_variable(name, 1.5);
+    const FunctionRegistry registry = FunctionRegistry::default_registry();
+
+    unsigned seed = 42;
+    std::vector<std::string> sources;
+    sources.reserve(count);
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sources.push_back(generate(i, seed));
+        bytes += sources.back().size();
+    }
+
+    // The baseline, timing compilation only like `compile_all`; the values
+    // are computed afterwards for the comparison
+    std::vector<CompiledExpr> compiled(count);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        try {
+            Parser parser(Tokenizer(sources[i]), &context, &registry);
+            compiled[i] = parser.compile();
+        } catch (const std::exception&) {
+        }
+    }
+    auto stop = std::chrono::steady_clock::now();
+    const double single = count / std::chrono::duration<double>(stop - start).count() / 1e3;
+
+    std::vector<ExprFloat> expected(count);
+    for (size_t i = 0; i < count; ++i)
+        expected[i] = compiled[i].valid() ? compiled[i].evaluate() : -1.0;
+    compiled.clear();
+
+    std::vector<size_t> thread_counts;
+    for (size_t threads = 1; threads < max_threads; threads *= 2)
+        thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+
+    std::printf("%zu formulas, %.1f bytes on average\n", count, static_cast<double>(bytes) / count);
+    std::printf("%-10s %-14s %-8s %s\n", "threads", "Kexprs/s", "speedup", "identical");
+    std::printf("%-10s %-14.1f %-8.2f %s\n", "loop", single, 1.0, "-");
+    for (size_t threads : thread_counts) {
+        ThreadPool pool(threads);
+        start = std::chrono::steady_clock::now();
+        const std::vector<CompileResult> results = compile_all(sources, &context, &registry, {}, pool);
+        stop = std::chrono::steady_clock::now();
+
+        bool identical = true;
+        for (size_t i = 0; i < count; ++i) {
+            const ExprFloat value = results[i].ok() ? results[i].expression.evaluate() : -1.0;
+            identical = identical && value == expected[i];
+        }
+        const double rate = count / std::chrono::duration<double>(stop - start).count() / 1e3;
+        std::printf("%-10zu %-14.1f %-8.2f %s\n", threads, rate, rate / single, identical ? "yes" : "NO");
+    }
+}
@@ -0,0 +1,307 @@
+#include "cppexprpars.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace cppexprpars;
+
+// The regression suite: tokenizer throughput, parse latency of small and
+// huge expressions, loading from a binary image, evaluation cost per node,
+// function-call overhead and variable-lookup cost, over a corpus of
+// formulas as they are written in practice. Every benchmark reports the
+// time, heap allocations and bytes allocated per operation as JSON, so runs
+// of two releases can be diffed:
+//
+//     bench_cppexprpars [--output FILE] [--filter TEXT] [--min-time MS]
+//
+// Each benchmark repeats its operation until it has run for at least
+// `--min-time` milliseconds (100 by default), and keeps the best of three
+// such runs. "op" is one call of the operation unless `unit` says otherwise.
+
+
+// Counts every allocation made through the global operator new, which is
+// where the library allocates from unless given a memory resource.
+static size_t allocations = 0;
+static size_t allocated_bytes = 0;
+
+void* operator new(size_t size) {
+    ++allocations;
+    allocated_bytes += size;
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+
+
+static const char* const corpus[] = {
+    "0.5 * m * v ^ 2 + m * g * h",
+    "p * (1 + r / n) ^ (n * t)",
+    "sqrt((bx - ax) ^ 2 + (by - ay) ^ 2)",
+    "exp(-(x - mu) ^ 2 / (2 * sigma ^ 2)) / (sigma * sqrt(2 * 3.141592653589793))",
+    "a * sin(w * t + phi) * exp(-k * t)",
+    "max(s - k, 0) * exp(-r * t)",
+    "(-b + sqrt(b * b - 4 * a * c)) / (2 * a)",
+    "min(max(x, lo), hi) * scale + offset",
+    "c0 + c1 * x + c2 * x ^ 2 + c3 * x ^ 3",
+    "abs(x - y) / (abs(x) + abs(y) + 1e-12)",
+    "log(1 + exp(x)) - 0.5 * x",
+    "(t % 24) * 60 + tan(theta) * d",
+};
+
+struct Result {
+    std::string name;
+    std::string unit;
+    size_t      iterations;
+    double      ns_per_op;
+    double      allocs_per_op;
+    double      bytes_per_op;
+};
+
+class Suite {
+public:
+    Suite(const char* filter, double min_time_ns) : filter_(filter), min_time_ns_(min_time_ns) {}
+
+    // Times `op`, which performs `ops` operations per call.
+    template <typename F>
+    void run(const std::string& name, const std::string& unit, double ops, F&& op) {
+        if (filter_ && name.find(filter_) == std::string::npos)
+            return;
+
+        op();     // Warm up caches and any lazily built state
+        size_t iterations = 1;
+        Result best = { name, unit, 0, 0.0, 0.0, 0.0 };
+        for (int round = 0; round < 3;) {
+            const size_t allocations_before = allocations, bytes_before = allocated_bytes;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < iterations; ++i)
+                op();
+            auto stop = std::chrono::steady_clock::now();
+            const double elapsed = std::chrono::duration<double, std::nano>(stop - start).count();
+            if (elapsed < min_time_ns_) {
+                const double factor = elapsed > 0 ? std::max(2.0, std::min(min_time_ns_ / elapsed * 1.2, 100.0)) : 100.0;
+                iterations = static_cast<size_t>(static_cast<double>(iterations) * factor);
+                continue;
+            }
+
+            const double count = ops * static_cast<double>(iterations);
+            if (round++ == 0 || elapsed / count < best.ns_per_op) {
+                best.iterations    = iterations;
+                best.ns_per_op     = elapsed / count;
+                best.allocs_per_op = (allocations - allocations_before) / count;
+                best.bytes_per_op  = (allocated_bytes - bytes_before) / count;
+            }
+        }
+        results_.push_back(best);
+    }
+
+    void write(std::FILE* out) const {
+        static const char* const simd_levels[] = { "scalar", "sse2", "avx2", "avx512" };
+        std::fprintf(out, "{\n  \"library\": \"cppexprpars\",\n  \"cplusplus\": %ld,\n  \"simd_level\": \"%s\",\n",
+                     static_cast<long>(__cplusplus), simd_levels[static_cast<int>(get_simd_level())]);
+        std::fprintf(out, "  \"jit\": %s,\n  \"profiling\": %s,\n  \"benchmarks\": [\n",
+                     JitExpr::available() ? "true" : "false", profiling_enabled() ? "true" : "false");
+        for (size_t i = 0; i < results_.size(); ++i) {
+            const Result& r = results_[i];
+            std::fprintf(out,
+                "    {\"name\": \"%s\", \"unit\": \"%s\", \"iterations\": %zu, "
+                "\"ns_per_op\": %.3f, \"allocs_per_op\": %.3f, \"bytes_per_op\": %.1f}%s\n",
+                r.name.c_str(), r.unit.c_str(), r.iterations, r.ns_per_op, r.allocs_per_op, r.bytes_per_op,
+                i + 1 < results_.size() ? "," : "");
+        }
+        std::fprintf(out, "  ]\n}\n");
+    }
+
+private:
+    const char*         filter_;
+    double              min_time_ns_;
+    std::vector<Result> results_;
+};
+
+// Declares every identifier not followed by an opening parenthesis.
+static void declare_variables(const std::string& source, EvaluationContext& context) {
+    for (Tokenizer tokenizer(source); tokenizer.current().type != TokenType::End;) {
+        const Token token = tokenizer.current();
+        tokenizer.next_token();
+        if (token.type == TokenType::Identifier && tokenizer.current().type != TokenType::LeftParen &&
+            !context.has_variable(token.text.to_string()))
+            context.set_variable(token.text.to_string(), 1.25);
+    }
+}
+
+static volatile ExprFloat sink;
+
+static ExprFloat identity(ExprFloat x) { return x; }
+
+int main(int argc, char** argv) {
+    const char* output = nullptr;
+    const char* filter = nullptr;
+    double min_time_ms = 100.0;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--output") && i + 1 < argc)
+            output = argv[++i];
+        else if (!std::strcmp(argv[i], "--filter") && i + 1 < argc)
+            filter = argv[++i];
+        else if (!std::strcmp(argv[i], "--min-time") && i + 1 < argc)
+            min_time_ms = std::atof(argv[++i]);
+        else {
+            std::fprintf(stderr, "usage: %s [--output FILE] [--filter TEXT] [--min-time MS]\n", argv[0]);
+            return 2;
+        }
+    }
+    Suite suite(filter, min_time_ms * 1e6);
+
+    FunctionRegistry registry = FunctionRegistry::default_registry();
+    registry.register_function("identity", identity);
+    registry.register_function("identity_args", [](const ExprFloat* args, size_t) { return args[0]; }, 1);
+    registry.register_function("identity_vector", [](const std::vector<ExprFloat>& args) { return args[0]; }, 1);
+
+    EvaluationContext context;
+    std::vector<std::string> sources(std::begin(corpus), std::end(corpus));
+    for (const std::string& source : sources)
+        declare_variables(source, context);
+
+    // A single expression of about 100 KB, all of the corpus many times over
+    std::string huge;
+    for (size_t i = 0; i < 200; ++i)
+        for (const std::string& source : sources)
+            huge.append("(").append(source).append(") + ");
+    huge.append("1");
+
+    // Tokenizer: one op is one token
+    size_t tokens = 0;
+    for (Tokenizer tokenizer(huge); tokenizer.current().type != TokenType::End; tokenizer.next_token())
+        ++tokens;
+    suite.run("tokenize/huge", "token", static_cast<double>(tokens), [&] {
+        Tokenizer tokenizer(huge);
+        while (tokenizer.current().type != TokenType::End)
+            tokenizer.next_token();
+    });
+
+    // Parsing into a tree, and compiling (parse, optimize, lower)
+    const double corpus_size = static_cast<double>(sources.size());
+    suite.run("parse/small", "expression", corpus_size, [&] {
+        for (const std::string& source : sources) {
+            Parser parser(Tokenizer(source), &context, &registry);
+            ExprNodePtr tree = parser.parse();
+        }
+    });
+    Arena arena;
+    suite.run("parse/small_arena", "expression", corpus_size, [&] {
+        for (const std::string& source : sources) {
+            Parser parser(Tokenizer(source), &context, &registry);
+            parser.set_memory_resource(&arena);
+            ExprNodePtr tree = parser.parse();
+        }
+        arena.release();
+    });
+    suite.run("parse/huge", "expression", 1.0, [&] {
+        Parser parser(Tokenizer(huge), &context, &registry);
+        ExprNodePtr tree = parser.parse();
+    });
+    suite.run("compile/small", "expression", corpus_size, [&] {
+        for (const std::string& source : sources) {
+            Parser parser(Tokenizer(source), &context, &registry);
+            parser.compile();
+        }
+    });
+    suite.run("compile/huge", "expression", 1.0, [&] {
+        Parser parser(Tokenizer(huge), &context, &registry);
+        parser.compile();
+    });
+
+    // Loading the compiled corpus back from a binary image
+    ExpressionImageWriter writer;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        Parser parser(Tokenizer(sources[i]), &context, &registry);
+        writer.add(std::to_string(i), parser.compile());
+    }
+    const std::string image_data = writer.data();
+    std::vector<uint64_t> image_buffer((image_data.size() + 7) / 8);
+    std::memcpy(image_buffer.data(), image_data.data(), image_data.size());
+    const ExpressionImage image(image_buffer.data(), image_data.size());
+    suite.run("image/load", "expression", corpus_size, [&] {
+        for (size_t i = 0; i < image.size(); ++i)
+            image.load(i, context, registry);
+    });
+
+    // Evaluation: one op is one node of the unoptimized trees
+    std::vector<CompiledExpr> compiled;
+    double nodes = 0.0;
+    for (const std::string& source : sources) {
+        Parser parser(Tokenizer(source), &context, &registry);
+        compiled.push_back(parser.compile({ OptimizationLevel::None }));
+        nodes += static_cast<double>(Optimizer::node_count(compiled.back().root()));
+    }
+    suite.run("evaluate/tree", "node", nodes, [&] {
+        for (const CompiledExpr& expr : compiled)
+            sink = expr.evaluate_tree();
+    });
+    suite.run("evaluate/bytecode", "node", nodes, [&] {
+        for (const CompiledExpr& expr : compiled)
+            sink = expr.evaluate();
+    });
+
+    // Function calls, against the same expression without the call; one op
+    // is one evaluation
+    const char* calls[][2] = {
+        { "call/none",            "x + 1" },
+        { "call/builtin",         "abs(x) + 1" },
+        { "call/registered",      "identity(x) + 1" },
+        { "call/registered_args", "identity_args(x) + 1" },
+        { "call/vector_args",     "identity_vector(x) + 1" },
+    };
+    for (const auto& call : calls) {
+        Parser parser(Tokenizer(call[1]), &context, &registry);
+        const CompiledExpr expr = parser.compile();
+        suite.run(call[0], "evaluation", 1.0, [&] { sink = expr.evaluate(); });
+    }
+
+    // Updating a variable and evaluating `x + 1`, by name, by slot and
+    // through a bound pointer
+    {
+        Parser parser(Tokenizer("x + 1"), &context, &registry);
+        const CompiledExpr expr = parser.compile();
+        const size_t slot = context.slot_of("x");
+        ExprFloat value = 0.0;
+        suite.run("variable/lookup", "lookup", 1.0, [&] { sink = context.get_variable("x"); });
+        suite.run("variable/set_by_name", "evaluation", 1.0, [&] {
+            context.set_variable("x", value += 1.0);
+            sink = expr.evaluate();
+        });
+        suite.run("variable/set_by_slot", "evaluation", 1.0, [&] {
+            context.set_value(slot, value += 1.0);
+            sink = expr.evaluate();
+        });
+        context.bind("x", &value);
+        Parser bound(Tokenizer("x + 1"), &context, &registry);
+        const CompiledExpr bound_expr = bound.compile();
+        suite.run("variable/bound", "evaluation", 1.0, [&] {
+            value += 1.0;
+            sink = bound_expr.evaluate();
+        });
+        context.unbind("x");
+    }
+
+    std::FILE* out = output ? std::fopen(output, "w") : stdout;
+    if (!out) {
+        std::fprintf(stderr, "cannot open %s\n", output);
+        return 1;
+    }
+    suite.write(out);
+    if (out != stdout)
+        std::fclose(out);
+}
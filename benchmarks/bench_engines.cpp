@@ -0,0 +1,164 @@
+#include "cppexprpars.hpp"
+#if __cplusplus >= 201703L
+#include "cppexprpars_static.hpp"
+#endif
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace cppexprpars;
+
+// Compares the tree-walking evaluator with the bytecode engine on the same
+// compiled expressions. Both read the same variables, so any difference is
+// the cost of dispatch and memory layout. The batch column is the per-row
+// cost of evaluating the same formula over whole columns with
+// `evaluate_batch`, and the last two columns are the same two measurements
+// with the code generated by `JitExpr`.
+//
+// The second table runs the bytecode engine on formulas full of constant
+// subterms at each optimization level, and the third one compares formulas
+// with repeated subterms with and without sharing them. When built as
+// C++17, the last one compares `JitExpr` with formulas parsed at compile
+// time by `CPPEXPRPARS_EXPR`.
+
+static const char* const formulas[] = {
+    "x + y",
+    "2 * x * x + 3 * y - 7",
+    "sin(x) * cos(y) + sqrt(x * x + y * y)",
+    "((x + 1) * (y - 2) + (x - 3) * (y + 4)) / (x * y + 5) - x ^ 2",
+    "min(x, y) + max(x * 2, y / 3) - (x - y) * (x + y) * 0.5 + 1.25 * x - 4 / (y + 10)",
+};
+
+static const char* const constant_heavy[] = {
+    "2 * 3.14159 * x * 1 + sqrt(16) * y - 0",
+    "x * 2 * 3 / 4 + -(-y) ^ 1 + cos(0) * exp(1) * x",
+    "0.5 + 1.2 * x - 0.3 * x ^ 2 + 0.04 * x ^ 3 - 0.002 * x ^ 4 + y * 3",
+};
+
+static const char* const repetitive[] = {
+    "sin(2 * x + y) * sin(2 * x + y) + cos(sin(2 * x + y)) - sin(2 * x + y) / (1 + sin(2 * x + y) ^ 2)",
+    "sqrt(x * x + y * y) + exp(-sqrt(x * x + y * y)) * sqrt(x * x + y * y)",
+};
+
+template <typename F>
+static double time_ns_per_eval(ExprFloat& x, size_t iterations, F&& eval) {
+    volatile ExprFloat sink = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        x = static_cast<ExprFloat>(i % 100) * 0.01;
+        sink = sink + eval();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / iterations;
+}
+
+template <typename Expr>
+static double time_batch_ns_per_row(const Expr& expr, const std::vector<std::string>& variables, size_t rows, size_t repeats) {
+    std::vector<ExprFloat> xs(rows), ys(rows), out(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        xs[i] = static_cast<ExprFloat>(i % 100) * 0.01;
+        ys[i] = 2.0;
+    }
+    std::vector<const ExprFloat*> columns;
+    for (const std::string& name : variables)
+        columns.push_back(name == "x" ? xs.data() : ys.data());
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < repeats; ++r)
+        expr.evaluate_batch(columns.data(), rows, out.data());
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / (rows * repeats);
+}
+
+#if __cplusplus >= 201703L
+template <class Static>
+static void compare_static(const Static& fixed, size_t iterations) {
+    const std::string formula(fixed.text());
+    ExprParser parser;
+    parser.set_expression(formula);
+    parser.set_variable("x", 1.0);
+    parser.set_variable("y", 2.0);
+    const CompiledExpr& expr = parser.compile();
+    const JitExpr jit(expr.bytecode(), formula);
+
+    std::vector<ExprFloat> vars(expr.variables().size(), 2.0);
+    double native = time_ns_per_eval(vars[0], iterations, [&] { return jit.execute(vars.data()); });
+    double native_batch = time_batch_ns_per_row(jit, expr.variables(), 100000, 10);
+    double inlined = time_ns_per_eval(vars[0], iterations, [&] { return fixed.evaluate(vars.data()); });
+    double inlined_batch = time_batch_ns_per_row(fixed, expr.variables(), 100000, 10);
+    std::printf("%-8.2f %-12.2f %-10.2f %-14.2f %s\n", native, native_batch, inlined, inlined_batch, formula.c_str());
+}
+#endif
+
+int main(void) {
+    const size_t iterations = 1000000;
+
+    std::printf("%-12s %-12s %-8s %-12s %-8s %-12s %s\n", "tree ns", "bytecode ns", "speedup", "batch ns/row", "jit ns", "jit ns/row", "expression");
+    for (const char* formula : formulas) {
+        ExprFloat x = 1.0;
+        ExprParser parser;
+        parser.set_expression(formula);
+        parser.bind("x", &x);
+        parser.set_variable("y", 2.0);
+        const CompiledExpr& expr = parser.compile();
+
+        double tree = time_ns_per_eval(x, iterations, [&] { return expr.evaluate_tree(); });
+        double code = time_ns_per_eval(x, iterations, [&] { return expr.evaluate(); });
+        double batch = time_batch_ns_per_row(expr, expr.variables(), 100000, 10);
+
+        // The generated code takes the variables in slot order
+        const JitExpr jit(expr.bytecode(), formula);
+        std::vector<ExprFloat> vars(expr.variables().size(), 2.0);
+        ExprFloat& jit_x = vars[0];
+        double native = time_ns_per_eval(jit_x, iterations, [&] { return jit.execute(vars.data()); });
+        double native_batch = time_batch_ns_per_row(jit, expr.variables(), 100000, 10);
+        std::printf("%-12.2f %-12.2f %-8.2f %-12.2f %-8.2f %-12.2f %s\n", tree, code, tree / code, batch, native, native_batch, formula);
+    }
+
+    const OptimizationLevel levels[] = { OptimizationLevel::None, OptimizationLevel::Safe, OptimizationLevel::FastMath };
+    std::printf("\n%-12s %-12s %-12s %s\n", "none ns", "safe ns", "fast ns", "expression");
+    for (const char* formula : constant_heavy) {
+        ExprFloat x = 1.0;
+        ExprParser parser;
+        parser.set_expression(formula);
+        parser.bind("x", &x);
+        parser.set_variable("y", 2.0);
+
+        double ns[3];
+        for (size_t i = 0; i < 3; ++i) {
+            parser.set_compile_options({ levels[i] });
+            const CompiledExpr& expr = parser.compile();
+            ns[i] = time_ns_per_eval(x, iterations, [&] { return expr.evaluate(); });
+        }
+        std::printf("%-12.2f %-12.2f %-12.2f %s\n", ns[0], ns[1], ns[2], formula);
+    }
+
+    std::printf("\n%-12s %-12s %-14s %-14s %-8s %s\n", "plain ns", "shared ns", "plain ns/row", "shared ns/row", "deduped", "expression");
+    for (const char* formula : repetitive) {
+        ExprFloat x = 1.0;
+        ExprParser parser;
+        parser.set_expression(formula);
+        parser.bind("x", &x);
+        parser.set_variable("y", 2.0);
+
+        double ns[2], batch[2];
+        size_t deduplicated = 0;
+        for (size_t i = 0; i < 2; ++i) {
+            CompileOptions options;
+            options.share_subexpressions = (i == 1);
+            parser.set_compile_options(options);
+            const CompiledExpr& expr = parser.compile();
+            ns[i] = time_ns_per_eval(x, iterations, [&] { return expr.evaluate(); });
+            batch[i] = time_batch_ns_per_row(expr, expr.variables(), 100000, 10);
+            deduplicated = expr.deduplicated_nodes();
+        }
+        std::printf("%-12.2f %-12.2f %-14.2f %-14.2f %-8zu %s\n", ns[0], ns[1], batch[0], batch[1], deduplicated, formula);
+    }
+
+#if __cplusplus >= 201703L
+    std::printf("\n%-8s %-12s %-10s %-14s %s\n", "jit ns", "jit ns/row", "static ns", "static ns/row", "expression");
+    compare_static(CPPEXPRPARS_EXPR("2 * x * x + 3 * y - 7"), iterations);
+    compare_static(CPPEXPRPARS_EXPR("sin(x) * cos(y) + sqrt(x * x + y * y)"), iterations);
+    compare_static(CPPEXPRPARS_EXPR("min(x, y) + max(x * 2, y / 3) - (x - y) * (x + y) * 0.5 + 1.25 * x - 4 / (y + 10)"), iterations);
+#endif
+}
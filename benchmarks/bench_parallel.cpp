@@ -0,0 +1,73 @@
+#include "cppexprpars.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace cppexprpars;
+
+// Scaling of `evaluate_parallel` over a large table: rows per second at 1, 2,
+// 4, ... threads up to the hardware concurrency (or the second argument),
+// each with its own work-stealing `ThreadPool`. The last column checks that
+// the results are bit-identical to a single-threaded `evaluate_batch`.
+//
+//      bench_parallel [rows] [max threads]
+
+static const char* const formulas[] = {
+    "x * 0.3 + y * 0.7 - 1",
+    "sin(x) * cos(y) + sqrt(x * x + y * y)",
+    "exp(-abs(x - y) / 4) * log(1 + y * y) + min(x, y) ^ 2",
+};
+
+int main(int argc, char** argv) {
+    const size_t rows = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 8000000;
+    size_t max_threads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+    max_threads = std::max<size_t>(1, max_threads);
+
+    std::vector<ExprFloat> xs(rows), ys(rows), expected(rows), out(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        xs[i] = static_cast<ExprFloat>(i % 1000) * 0.01 - 5.0;
+        ys[i] = static_cast<ExprFloat>(i % 777) * 0.02 + 0.5;
+    }
+
+    std::vector<size_t> thread_counts;
+    for (size_t threads = 1; threads < max_threads; threads *= 2)
+        thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+
+    std::printf("%zu rows\n", rows);
+    std::printf("%-8s %-14s %-8s %-10s %s\n", "threads", "Mrows/s", "speedup", "identical", "expression");
+    for (const char* formula : formulas) {
+        ExprParser parser;
+        parser.set_expression(formula);
+        parser.set_variable("x", 0.0);
+        parser.set_variable("y", 0.0);
+        const CompiledExpr& expr = parser.compile();
+
+        std::vector<const ExprFloat*> columns;
+        for (const std::string& name : expr.variables())
+            columns.push_back(name == "x" ? xs.data() : ys.data());
+        expr.evaluate_batch(columns.data(), rows, expected.data());
+
+        double single = 0.0;
+        for (size_t threads : thread_counts) {
+            ThreadPool pool(threads);
+            expr.evaluate_parallel(columns.data(), rows, out.data(), pool);    // Warm up
+
+            const size_t repeats = 3;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t r = 0; r < repeats; ++r)
+                expr.evaluate_parallel(columns.data(), rows, out.data(), pool);
+            auto stop = std::chrono::steady_clock::now();
+
+            const double seconds = std::chrono::duration<double>(stop - start).count() / repeats;
+            const double rate = rows / seconds / 1e6;
+            if (threads == 1)
+                single = rate;
+            const bool identical = std::memcmp(expected.data(), out.data(), rows * sizeof(ExprFloat)) == 0;
+            std::printf("%-8zu %-14.1f %-8.2f %-10s %s\n", threads, rate, rate / single, identical ? "yes" : "NO", formula);
+        }
+    }
+}
@@ -29,8 +29,10 @@
 //  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 //  THE SOFTWARE.
 
+#ifndef CPPEXPRPARS_HPP
+#define CPPEXPRPARS_HPP
 
-
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -39,6 +41,17 @@
 #include <functional>
 #include <cmath>
 #include <cctype>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <exception>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define CPPEXPRPARS_HAS_PMR 1
+#endif
+#endif
 
 
 namespace cppexprpars {
@@ -47,7 +60,13 @@ using ExprFloat = double;
 using ExprInt   = uint64_t;
 
 using Function             = std::function<ExprFloat(const std::vector<ExprFloat>&)>;
+using ArgsFunction         = std::function<ExprFloat(const ExprFloat* args, size_t nargs)>;
+using UnaryFunction        = ExprFloat (*)(ExprFloat);
+using BinaryFunction       = ExprFloat (*)(ExprFloat, ExprFloat);
+using UnaryArrayFunction  = void (*)(const ExprFloat* in, ExprFloat* out, size_t n);
+using BinaryArrayFunction = void (*)(const ExprFloat* lhs, const ExprFloat* rhs, ExprFloat* out, size_t n);
 using ArityMismatchHandler = std::function<void(const std::string& func_name, size_t expected, size_t received)>;
+using DerivativeFunction   = std::function<void(const ExprFloat* args, size_t nargs, ExprFloat* partials)>;
 using VariableResolver     = std::function<ExprFloat(const std::string&)>;
 
 
@@ -79,10 +98,11 @@ enum class TokenType {
     End,
     Number,
     Identifier,
-    Plus, Minus, Star, Slash,
+    Plus, Minus, Star, Slash, Percent,
     Caret,
     LeftParen, RightParen,
     Comma,
+    Assign, Semicolon,
     Invalid
 };
 
@@ -90,20 +110,159 @@ enum class TokenType {
 //     "End",
 //     "Number",
 //     "Identifier",
-//     "Plus", "Minus", "Star", "Slash",
+//     "Plus", "Minus", "Star", "Slash", "Percent",
 //     "Caret",
 //     "LeftParen", "RightParen",
 //     "Comma",
+//     "Assign", "Semicolon",
 //     "Invalid"
 // };
 
+// Where expression trees get their memory from. Same interface as
+// std::pmr::memory_resource, which needs C++17.
+class MemoryResource {
+public:
+    virtual ~MemoryResource() = default;
+
+    inline void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+        return do_allocate(bytes, alignment);
+    }
+    inline void deallocate(void* ptr, size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+        do_deallocate(ptr, bytes, alignment);
+    }
+
+protected:
+    virtual void* do_allocate(size_t bytes, size_t alignment) = 0;
+    virtual void do_deallocate(void* ptr, size_t bytes, size_t alignment) = 0;
+};
+
+// Plain operator new and delete.
+MemoryResource* new_delete_resource();
+
+// Bump allocator: allocation advances a pointer through blocks obtained from
+// `upstream`, deallocation does nothing, and `release` hands every block
+// back at once. Block sizes double as the arena grows. Not thread-safe.
+class Arena : public MemoryResource {
+public:
+    explicit Arena(size_t initial_block_size = 1024, MemoryResource* upstream = new_delete_resource()) :
+        upstream_(upstream),
+        initial_block_size_(initial_block_size),
+        next_block_size_(initial_block_size) {}
+    ~Arena() override { release(); }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Everything allocated from the arena must be destroyed beforehand.
+    // Growth starts over from the initial block size.
+    void release();
+
+    inline size_t bytes_allocated() const { return allocated_; }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+
+private:
+    struct Block {
+        Block* next;
+        size_t size;
+    };
+
+    MemoryResource* upstream_;
+    size_t          initial_block_size_;
+    size_t          next_block_size_;
+    Block*          blocks_    = nullptr;
+    char*           cursor_    = nullptr;
+    char*           end_       = nullptr;
+    size_t          allocated_ = 0;
+};
+
+#ifdef CPPEXPRPARS_HAS_PMR
+// Forwards to a standard memory resource, e.g. a
+// std::pmr::monotonic_buffer_resource over a stack buffer.
+class StdMemoryResource : public MemoryResource {
+public:
+    explicit StdMemoryResource(std::pmr::memory_resource* resource) : resource_(resource) {}
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        return resource_->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override {
+        resource_->deallocate(ptr, bytes, alignment);
+    }
+
+private:
+    std::pmr::memory_resource* resource_;
+};
+#endif
+
+// Standard allocator drawing from a `MemoryResource`, for containers owned
+// by tree nodes. A null resource means `new_delete_resource()`.
+template <typename T>
+class PolymorphicAllocator {
+public:
+    using value_type = T;
+
+    PolymorphicAllocator(MemoryResource* resource = nullptr) :
+        resource_(resource ? resource : new_delete_resource()) {}
+
+    template <typename U>
+    PolymorphicAllocator(const PolymorphicAllocator<U>& other) : resource_(other.resource()) {}
+
+    inline T* allocate(size_t n) {
+        return static_cast<T*>(resource_->allocate(n * sizeof(T), alignof(T)));
+    }
+    inline void deallocate(T* ptr, size_t n) {
+        resource_->deallocate(ptr, n * sizeof(T), alignof(T));
+    }
+
+    inline MemoryResource* resource() const { return resource_; }
+
+private:
+    MemoryResource* resource_;
+};
+
+template <typename T, typename U>
+inline bool operator==(const PolymorphicAllocator<T>& a, const PolymorphicAllocator<U>& b) {
+    return a.resource() == b.resource();
+}
+
+template <typename T, typename U>
+inline bool operator!=(const PolymorphicAllocator<T>& a, const PolymorphicAllocator<U>& b) {
+    return !(a == b);
+}
+
+
+
+// Every node records the resource it was allocated from just in front of
+// itself, so a tree built in an arena is destroyed like any other: the
+// owning `ExprNodePtr` deletes it, and the arena's deallocation is a no-op.
+// `new Node(...)` and `std::make_unique` use the heap as before;
+// `make_node` takes a resource.
 class ExprNode {
 public:
     virtual ~ExprNode() = default;
     virtual ExprFloat evaluate() const = 0;
+    virtual ExprNodeType type() const = 0;
+
+    static void* operator new(size_t size);
+    static void* operator new(size_t size, MemoryResource* resource);
+    static void operator delete(void* ptr, size_t size);
+    static void operator delete(void* ptr, MemoryResource* resource);
 };
 
-using ExprNodePtr = std::unique_ptr<ExprNode>;
+using ExprNodePtr  = std::unique_ptr<ExprNode>;
+using ExprNodeList = std::vector<ExprNodePtr, PolymorphicAllocator<ExprNodePtr>>;
+
+// Allocates a node from `resource` (the heap when null).
+template <typename Node, typename... Args>
+inline std::unique_ptr<Node> make_node(MemoryResource* resource, Args&&... args) {
+    return std::unique_ptr<Node>(new (resource) Node(std::forward<Args>(args)...));
+}
+
+class Optimizer;
 
 
 
@@ -120,11 +279,18 @@ public:
         right_(std::move(right)) {}
 
     ExprFloat evaluate() const override;
+    inline ExprNodeType type() const override { return ExprNodeType::Binary; }
+
+    inline BinaryOp op() const { return op_; }
+    inline const ExprNode& left() const { return *left_; }
+    inline const ExprNode& right() const { return *right_; }
 
 protected:
     static BinaryOp charToBinaryOp(char op_char);
 
 private:
+    friend class Optimizer;
+
     BinaryOp    op_;
     ExprNodePtr left_;
     ExprNodePtr right_;
@@ -143,63 +309,259 @@ public:
         operand_(std::move(operand)) {}
 
     ExprFloat evaluate() const override;
+    inline ExprNodeType type() const override { return ExprNodeType::Unary; }
+
+    inline UnaryOp op() const { return op_; }
+    inline const ExprNode& operand() const { return *operand_; }
 
 protected:
     static UnaryOp charToUnaryOp(char op_char);
 
 private:
+    friend class Optimizer;
+
     UnaryOp     op_;
     ExprNodePtr operand_;
 };
 
 
 
+// A registered function together with the cheapest way to call it. Exactly
+// one of `unary`, `binary`, `args_fn` and `vector_fn` is set. Entries are
+// immutable once registered, so parsed expressions hold on to them directly
+// and never look a function up by name while evaluating.
+//
+// Unary and binary functions may also have an array entry point, used by
+// batch evaluation, whose results are within `array_max_ulp` units in the
+// last place of the scalar entry point (0 means bit-identical).
+//
+// A `pure` function always returns the same result for the same arguments
+// and has no side effects, so calls with constant arguments can be folded
+// at compile time.
+//
+// `derivative`, when set, writes the partial derivative with respect to each
+// of the `nargs` arguments to `partials`; `CompiledGradient` needs it to
+// differentiate through a call.
+struct FunctionEntry {
+    std::string          name;
+    size_t               nargs = 0;
+    bool                 pure  = false;
+    UnaryFunction        unary  = nullptr;
+    BinaryFunction       binary = nullptr;
+    ArgsFunction         args_fn;
+    Function             vector_fn;
+    ArityMismatchHandler on_invalid_args;
+    DerivativeFunction   derivative;
+
+    UnaryArrayFunction  unary_array  = nullptr;
+    BinaryArrayFunction binary_array = nullptr;
+    unsigned             array_max_ulp = 0;
+
+    // `args` must hold exactly `nargs` values.
+    inline ExprFloat call(const ExprFloat* args) const {
+        if (unary)
+            return unary(args[0]);
+        if (binary)
+            return binary(args[0], args[1]);
+        if (args_fn)
+            return args_fn(args, nargs);
+        return call_vector(args);
+    }
+
+    // Reports a call with the wrong number of arguments through
+    // `on_invalid_args` (or throws without one) and returns NaN.
+    ExprFloat invalid_call(size_t received) const;
+
+private:
+    ExprFloat call_vector(const ExprFloat* args) const;
+};
+
+using FunctionEntryPtr = std::shared_ptr<const FunctionEntry>;
+
 class FunctionRegistry {
 public:
+    FunctionRegistry();
+
     void register_function(
         const std::string& name,
         Function fn,
         size_t nargs,
-        ArityMismatchHandler on_invalid_args = {}
+        ArityMismatchHandler on_invalid_args = {},
+        DerivativeFunction derivative = {}
     );
 
+    // Allocation-free calling conventions: arguments are passed as a pointer
+    // to a buffer owned by the caller, or directly for plain 1- and 2-ary
+    // function pointers.
+    void register_function(
+        const std::string& name,
+        ArgsFunction fn,
+        size_t nargs,
+        ArityMismatchHandler on_invalid_args = {},
+        DerivativeFunction derivative = {}
+    );
+    void register_function(const std::string& name, UnaryFunction fn, DerivativeFunction derivative = {});
+    void register_function(const std::string& name, BinaryFunction fn, DerivativeFunction derivative = {});
+
+    // Scalar entry point plus an array entry point for batch evaluation,
+    // accurate to within `max_ulp` of the scalar one.
+    void register_function(const std::string& name, UnaryFunction fn, UnaryArrayFunction array_fn, unsigned max_ulp);
+    void register_function(const std::string& name, BinaryFunction fn, BinaryArrayFunction array_fn, unsigned max_ulp);
+
+    // Marks an already registered function as pure (see `FunctionEntry`).
+    // The built-in functions are pure.
+    void set_pure(const std::string& name, bool pure = true);
+
+    // Sets the derivative of an already registered function (see
+    // `FunctionEntry`).
+    void set_derivative(const std::string& name, DerivativeFunction derivative);
+
     Function get_function(const std::string& name) const;
 
+    // Null when no function is registered under `name`.
+    FunctionEntryPtr find_function(const std::string& name) const;
+
     static FunctionRegistry default_registry();
 
+    // Changes with every registration, and is unique across registries
+    // except for copies, which hold the same functions. Identifies the
+    // registry's contents in `ExpressionCache` keys.
+    inline uint64_t revision() const { return revision_; }
+
 private:
-    std::unordered_map<std::string, Function> functions_;
+    std::unordered_map<std::string, FunctionEntryPtr> functions_;
+    uint64_t                                          revision_;
+
+    void touch();
 };
 
+// The default registry and context are immutable snapshots, used by nodes
+// and parsers that are not given one explicitly. `set_default_*` publishes a
+// copy of its argument as the new snapshot; trees built earlier keep the
+// snapshot they were built against, which is why every snapshot stays alive
+// until the program exits. Both functions may be called while other threads
+// parse or evaluate, but each call keeps a copy, so they are meant for
+// configuration rather than for passing values (see `EvaluationContext`).
 void set_default_registry(const FunctionRegistry* registry);
-FunctionRegistry* get_default_registry();
+const FunctionRegistry* get_default_registry();
 
 
 
+// Array versions of the built-in functions, registered as their array entry
+// points. They process 4 (AVX2) or 8 (AVX-512) lanes at a time and fall back
+// to <cmath> on other CPUs and for arguments outside the documented ranges.
+//
+// The `*_max_ulp` constants bound the error relative to <cmath>, as measured
+// over millions of random arguments per range:
+//
+//      sqrt, abs, min, max     exact (bit-identical)
+//      sin, cos, tan           |x| < 2^22
+//      exp                     results in the normal range
+//      log                     positive normal arguments
+//      pow                     positive normal bases, results in the normal range
+namespace vector_math {
+
+constexpr unsigned sin_max_ulp = 3;
+constexpr unsigned cos_max_ulp = 3;
+constexpr unsigned tan_max_ulp = 3;
+constexpr unsigned exp_max_ulp = 2;
+constexpr unsigned log_max_ulp = 1;
+constexpr unsigned pow_max_ulp = 6;
+
+void sin(const ExprFloat* in, ExprFloat* out, size_t n);
+void cos(const ExprFloat* in, ExprFloat* out, size_t n);
+void tan(const ExprFloat* in, ExprFloat* out, size_t n);
+void exp(const ExprFloat* in, ExprFloat* out, size_t n);
+void log(const ExprFloat* in, ExprFloat* out, size_t n);
+void sqrt(const ExprFloat* in, ExprFloat* out, size_t n);
+void abs(const ExprFloat* in, ExprFloat* out, size_t n);
+void pow(const ExprFloat* base, const ExprFloat* exponent, ExprFloat* out, size_t n);
+void min(const ExprFloat* lhs, const ExprFloat* rhs, ExprFloat* out, size_t n);
+void max(const ExprFloat* lhs, const ExprFloat* rhs, ExprFloat* out, size_t n);
+
+}   // namespace vector_math
+
+
+
+// Names of the variables known to a context, each mapped to a fixed slot.
+// Slots are only ever appended, so a slot resolved at parse time stays valid
+// for the lifetime of the context. `id` is unique to each layout object.
+struct VariableLayout {
+    std::unordered_map<std::string, size_t> slots;
+    std::vector<std::string>                names;
+    uint64_t                                id = 0;
+};
+
+// Contexts are not synchronized: several threads may read one, but none may
+// modify it meanwhile. Copying a context is cheap (the names are shared), so
+// to evaluate one expression from many threads, give each thread its own
+// copy of the context it was compiled against and pass it to
+// `CompiledExpr::evaluate(context)`.
 class EvaluationContext {
 public:
+    EvaluationContext();
+
     void set_variable(const std::string& name, ExprFloat value);
     ExprFloat get_variable(const std::string& name) const;
+    bool has_variable(const std::string& name) const;
+
+    // Reads the variable straight from caller memory instead of a stored
+    // copy. With a non-zero `stride` (in bytes), row `i` of a row-wise
+    // evaluation reads `*(value + i * stride)`, which lets an expression walk
+    // a field of an array of structs.
+    void bind(const std::string& name, const ExprFloat* value, size_t stride = 0);
+    void unbind(const std::string& name);
+
+    // Slot of a known variable; throws for unknown names.
+    size_t slot_of(const std::string& name) const;
+    inline size_t slot_count() const { return values_.size(); }
+    inline const std::vector<std::string>& names() const { return layout_->names; }
+
+    // Shared by copies of a context until one of them adds a name; contexts
+    // with the same id agree on every slot.
+    inline uint64_t layout_id() const { return layout_->id; }
+
+    inline ExprFloat value(size_t slot, size_t row = 0) const {
+        const Binding& b = bindings_[slot];
+        if (!b.value)
+            return values_[slot];
+        return *reinterpret_cast<const ExprFloat*>(reinterpret_cast<const char*>(b.value) + row * b.stride);
+    }
+
+    inline void set_value(size_t slot, ExprFloat value) {
+        values_[slot] = value;
+        bindings_[slot] = {};
+    }
 
     static const EvaluationContext& default_context();
 
 private:
-    std::unordered_map<std::string, ExprFloat> variables_;
+    struct Binding {
+        const ExprFloat* value  = nullptr;
+        size_t           stride = 0;
+    };
+
+    // Copies of a context share their layout until one of them adds a name.
+    std::shared_ptr<VariableLayout> layout_;
+    std::vector<ExprFloat>          values_;
+    std::vector<Binding>            bindings_;
+
+    size_t define(const std::string& name);
 };
 
 void set_default_context(const EvaluationContext* context);
-EvaluationContext* get_default_context();
+const EvaluationContext* get_default_context();
 
 
 
 class VariableExprNode : public ExprNode {
 public:
-    // Use predefined context
+    // Use predefined context. The name is resolved to a slot right away, so
+    // unknown variables are rejected here rather than during evaluation.
     VariableExprNode(std::string name, const EvaluationContext* context = get_default_context()) :
         name_(std::move(name)),
-        resolver_([context](const std::string& varName) {
-            return context->get_variable(varName);
-        }) {}
+        context_(context),
+        slot_(context->slot_of(name_)) {}
 
     // Advanced use case: custom resolver
     VariableExprNode(std::string name, VariableResolver resolver) :
@@ -207,37 +569,71 @@ public:
         resolver_(std::move(resolver)) {}
 
     ExprFloat evaluate() const override;
+    inline ExprNodeType type() const override { return ExprNodeType::Variable; }
+
+    inline const std::string& name() const { return name_; }
+
+    // Null when the variable is read through a custom resolver.
+    inline const EvaluationContext* context() const { return context_; }
+    inline size_t slot() const { return slot_; }
 
-    inline void set_context(const EvaluationContext* context);
-    inline void set_context_as_default();
+    void set_context(const EvaluationContext* context);
+    void set_context_as_default();
 
 private:
-    std::string      name_;
-    VariableResolver resolver_;
+    std::string              name_;
+    const EvaluationContext* context_ = nullptr;
+    size_t                   slot_    = 0;
+    VariableResolver         resolver_;
 };
 
 
 
 class FuncExprNode : public ExprNode {
 public:
+    // The function is looked up and its arity checked right away: unknown
+    // functions throw here, and so does an arity mismatch unless the function
+    // has an `ArityMismatchHandler`, which is then invoked on evaluation.
     FuncExprNode(
         std::string name,
-        std::vector<ExprNodePtr> args,
+        ExprNodeList args,
         const FunctionRegistry* registry = get_default_registry()
     ) :
         name_(std::move(name)),
-        args_(std::move(args)),
-        registry_(registry) {}
+        args_(std::move(args)) {
+        set_registry(registry);
+    }
+
+    FuncExprNode(
+        std::string name,
+        std::vector<ExprNodePtr> args,
+        const FunctionRegistry* registry = get_default_registry()
+    ) :
+        FuncExprNode(std::move(name), ExprNodeList(std::make_move_iterator(args.begin()), std::make_move_iterator(args.end())), registry) {}
 
     ExprFloat evaluate() const override;
+    inline ExprNodeType type() const override { return ExprNodeType::Function; }
+
+    inline const std::string& name() const { return name_; }
+    inline const ExprNodeList& args() const { return args_; }
+    inline const FunctionRegistry* registry() const { return registry_; }
+    inline const FunctionEntryPtr& function() const { return function_; }
+    inline bool arity_matches() const { return args_.size() == function_->nargs; }
 
-    inline void set_registry(const FunctionRegistry* registry);
-    inline void set_registry_as_default();
+    void set_registry(const FunctionRegistry* registry);
+    void set_registry_as_default();
+
+    // Calls with more arguments than this spill their argument buffer to
+    // the heap.
+    static constexpr size_t max_inline_args = 8;
 
 private:
+    friend class Optimizer;
+
     std::string              name_;
-    std::vector<ExprNodePtr> args_;
-    const FunctionRegistry*  registry_;
+    ExprNodeList             args_;
+    const FunctionRegistry*  registry_ = nullptr;
+    FunctionEntryPtr         function_;
 };
 
 
@@ -247,6 +643,9 @@ public:
     explicit ConstantExprNode(ExprFloat value) : value_(value) {}
 
     ExprFloat evaluate() const override;
+    inline ExprNodeType type() const override { return ExprNodeType::Constant; }
+
+    inline ExprFloat value() const { return value_; }
 
 private:
     ExprFloat value_;
@@ -254,43 +653,94 @@ private:
 
 
 
-struct Token {
-    TokenType   type;
-    std::string text;
-    ExprFloat   number_value = 0.0;
+// Non-owning view of a run of characters (std::string_view needs C++17).
+class StringView {
+public:
+    constexpr StringView() : data_(nullptr), size_(0) {}
+    constexpr StringView(const char* data, size_t size) : data_(data), size_(size) {}
+    StringView(const char* str) : data_(str), size_(std::char_traits<char>::length(str)) {}
+    StringView(const std::string& str) : data_(str.data()), size_(str.size()) {}
+
+    constexpr const char* data() const { return data_; }
+    constexpr size_t size() const { return size_; }
+    constexpr bool empty() const { return size_ == 0; }
+    constexpr const char* begin() const { return data_; }
+    constexpr const char* end() const { return data_ + size_; }
+    constexpr char operator[](size_t i) const { return data_[i]; }
+
+    inline StringView substr(size_t pos, size_t count) const {
+        return StringView(data_ + pos, std::min(count, size_ - pos));
+    }
 
-    Token() : type(TokenType::Invalid), text(""), number_value(0.0) {}
+    inline std::string to_string() const { return std::string(data_, size_); }
+    inline explicit operator std::string() const { return to_string(); }
 
-    Token(TokenType t, const std::string& txt = "", ExprFloat val = 0.0) :
-        type(t), text(txt), number_value(val) {}
+private:
+    const char* data_;
+    size_t      size_;
+};
+
+inline bool operator==(StringView a, StringView b) {
+    return a.size() == b.size() && std::char_traits<char>::compare(a.data(), b.data(), a.size()) == 0;
+}
+
+inline bool operator!=(StringView a, StringView b) {
+    return !(a == b);
+}
+
+inline std::string operator+(const std::string& a, StringView b) {
+    return std::string(a).append(b.data(), b.size());
+}
+
+inline std::string operator+(std::string&& a, StringView b) {
+    return std::move(a.append(b.data(), b.size()));
+}
 
-    Token& operator=(const Token& other) = default;
 
-    // If needed in the future, the `=` operator overload will have to be like this:
-    // Token& operator=(const Token& other) {
-    //     type = other.type;
-    //     text = other.text;
-    //     number_value = other.number_value;
-    //     return *this;
-    // }
+
+// `text` points into the tokenizer's input; operators are identified by
+// `type` alone.
+struct Token {
+    TokenType  type;
+    StringView text;
+    ExprFloat  number_value = 0.0;
+
+    Token() : type(TokenType::Invalid), number_value(0.0) {}
+
+    Token(TokenType t, StringView txt = StringView(), ExprFloat val = 0.0) :
+        type(t), text(txt), number_value(val) {}
 };
 
 
 
+// Converts a decimal number such as `-12.5e-3` to the nearest ExprFloat, as
+// the tokenizer does: without allocating and independently of the C locale.
+// `text` must hold the number alone, with an optional sign. Returns false if
+// it is not such a number or is out of range.
+bool parse_decimal(StringView text, ExprFloat& value);
+
+// Splits caller-owned text into tokens without copying it: the input must
+// outlive the tokenizer and its tokens. Numbers are parsed without
+// allocating and independently of the C locale.
 class Tokenizer {
 public:
-    explicit Tokenizer(const std::string& input) : input_(input), pos_(0) {
+    explicit Tokenizer(StringView input) : input_(input), pos_(0) {
         next_token();
     }
 
+    explicit Tokenizer(const char* input) : Tokenizer(StringView(input)) {}
+
+    // Would leave the tokenizer pointing at a destroyed string.
+    explicit Tokenizer(std::string&& input) = delete;
+
     inline const Token& current() const { return current_token_; }
     void next_token();
 
 
 private:
-    std::string input_;
-    size_t      pos_;
-    Token       current_token_;
+    StringView input_;
+    size_t     pos_;
+    Token      current_token_;
 
     void skip_whitespace();
     void parse_number();
@@ -300,66 +750,1094 @@ private:
 
 
 
+// Binary operators come in three forms: the right operand is either popped
+// from the stack, an inline constant (`value`) or a variable slot (`arg`).
+// The last two spare the push/pop of the most common leaf operands.
+enum class OpCode : uint8_t {
+    Constant,       // push `value`
+    Variable,       // push variable slot `arg`
+    Add,      AddConstant,      AddVariable,
+    Subtract, SubtractConstant, SubtractVariable,
+    Multiply, MultiplyConstant, MultiplyVariable,
+    Divide,   DivideConstant,   DivideVariable,
+    Modulo,   ModuloConstant,   ModuloVariable,
+    Power,    PowerConstant,    PowerVariable,
+    Negate,
+    CallUnary,      // replace the top with function `arg` applied to it
+    CallBinary,     // pop two arguments, push function `arg` applied to them
+    Call,           // pop `count` arguments, push function `arg` applied to them
+    Store,          // copy the top into temporary slot `arg`, leaving it in place
+    MultiplyAdd,    // pop `c`, `b`, `a`, push fma(a, b, c)
+    MultiplyConstantAdd,            // pop `c`, `a`, push fma(a, `value`, c)
+    MultiplyVariableAddConstant,    // replace the top with fma(top, variable `arg`, `value`)
+    StorePop        // move the top into temporary slot `arg`
+};
+
+// 16 bytes, so four instructions share a cache line.
+struct Instruction {
+    OpCode    op;
+    uint16_t  count = 0;
+    uint32_t  arg   = 0;
+    ExprFloat value = 0.0;
+
+    Instruction(OpCode o, uint32_t a = 0, uint16_t c = 0, ExprFloat v = 0.0) :
+        op(o), count(c), arg(a), value(v) {}
+};
+
+// Read-only view of a contiguous array of instructions, either owned by a
+// `Bytecode` or inside an image it was loaded from (see `ExpressionImage`).
+class InstructionView {
+public:
+    constexpr InstructionView() : data_(nullptr), size_(0) {}
+    constexpr InstructionView(const Instruction* data, size_t size) : data_(data), size_(size) {}
+
+    constexpr const Instruction* data() const { return data_; }
+    constexpr size_t size() const { return size_; }
+    constexpr bool empty() const { return size_ == 0; }
+    constexpr const Instruction* begin() const { return data_; }
+    constexpr const Instruction* end() const { return data_ + size_; }
+    constexpr const Instruction& operator[](size_t i) const { return data_[i]; }
+
+private:
+    const Instruction* data_;
+    size_t             size_;
+};
+
+// What went wrong while evaluating one row, for the overloads that report
+// problems instead of throwing. Names, functions and arity are all checked
+// when the expression is parsed, so what is left can only depend on the
+// values: those overloads follow IEEE arithmetic and flag the row instead.
+//
+//  - `DivisionByZero`: a divisor was zero, giving ±inf (NaN for 0 / 0), or
+//    the divisor of `%` truncated to zero, giving NaN.
+//  - `FunctionError`: a function (or variable resolver) threw; the row is
+//    NaN.
+//  - `NotFinite`: the result is infinite or NaN, whatever the cause.
+//  - `EmptyExpression`: there was nothing to evaluate; the result is NaN.
+enum class EvalStatus : uint32_t {
+    Ok              = 0,
+    DivisionByZero  = 1,
+    FunctionError   = 2,
+    NotFinite       = 4,
+    EmptyExpression = 8
+};
+
+inline EvalStatus operator|(EvalStatus a, EvalStatus b) {
+    return static_cast<EvalStatus>(static_cast<uint32_t>(a) | static_cast<uint32_t>(b));
+}
+
+inline EvalStatus operator&(EvalStatus a, EvalStatus b) {
+    return static_cast<EvalStatus>(static_cast<uint32_t>(a) & static_cast<uint32_t>(b));
+}
+
+inline EvalStatus& operator|=(EvalStatus& a, EvalStatus b) {
+    return a = a | b;
+}
+
+
+
+// Instruction sets used by batch evaluation. The best one supported by the
+// running CPU is picked at startup; `set_simd_level` can lower it (e.g. to
+// compare results), but never raise it above what the CPU supports. `AVX2`
+// also requires FMA.
+enum class SimdLevel {
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+SimdLevel detected_simd_level();
+SimdLevel get_simd_level();
+void set_simd_level(SimdLevel level);
+
+// Batch evaluation only uses a function's array entry point when its error
+// bound (`FunctionEntry::array_max_ulp`) is within this many ULP, and the
+// `^` operator only uses the vectorized pow when `vector_math::pow_max_ulp`
+// is. The default of 0 keeps batch results bit-identical to the scalar
+// engines; raising it trades that for speed.
+unsigned get_vector_math_tolerance();
+void set_vector_math_tolerance(unsigned max_ulp);
+
+
+
+// Runs a set of independent tasks, possibly in parallel. Implement it to
+// evaluate on your own threads instead of the built-in `ThreadPool`.
+class Executor {
+public:
+    using Task = std::function<void(size_t index, size_t worker)>;
+
+    virtual ~Executor() = default;
+
+    // Number of workers; `run` only passes worker indices below it.
+    virtual size_t concurrency() const = 0;
+
+    // Calls `task(i, worker)` once for every `i` in [0, count) and returns
+    // when all calls have finished. Calls with the same `worker` never
+    // overlap. If a call throws, the remaining ones may be skipped and the
+    // first exception is rethrown.
+    virtual void run(size_t count, const Task& task) = 0;
+};
+
+// Work-stealing thread pool. Each worker starts with an equal share of the
+// indices and, once out of work, steals half of what is left from another
+// worker, so uneven tasks still keep every worker busy. The thread calling
+// `run` is worker 0; one call runs at a time, and nested calls from inside a
+// task run inline on the calling worker.
+class ThreadPool : public Executor {
+public:
+    // `threads` counts the calling thread; 0 uses every hardware thread.
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool() override;
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t concurrency() const override;
+    void run(size_t count, const Task& task) override;
+
+    // Process-wide pool with one worker per hardware thread.
+    static ThreadPool& global();
+
+private:
+    struct State;
+
+    std::unique_ptr<State> state_;
+};
+
+
+
+// One statement of a program (see `Parser::compile_program`): `name` is
+// assigned the value of `expression`, which may read the names assigned by
+// earlier statements. Temporaries (`let name = ...`) are not outputs.
+struct Statement {
+    std::string name;
+    ExprNodePtr expression;
+    bool        output = true;
+};
+
+
+
+// Flat, postfix form of an expression tree. Lowering walks the tree once and
+// emits one contiguous instruction array, so evaluation is a single loop over
+// that array instead of a chain of virtual calls through scattered nodes.
+//
+// With `share_subexpressions`, structurally identical subtrees are
+// hash-consed into a DAG first. Each shared subtree is then computed once
+// per evaluation and stored in a temporary slot, which its other
+// occurrences read like a variable. Temporary slots follow the variable
+// slots in the per-evaluation scratch buffer. Calls to functions that are
+// not pure are never shared.
+class Bytecode {
+public:
+    Bytecode() = default;
+
+    static Bytecode compile(const ExprNode& root, bool share_subexpressions = false);
+
+    // Lowers a whole program into one pass. Each statement's value goes to
+    // its own slot after the variables, which later statements read like a
+    // variable; `locals` is the context their references were resolved
+    // against. With `share_subexpressions`, subtrees repeated across
+    // statements are computed once too. The statements are lowered one on
+    // top of the other, so each one adds a level to the stack.
+    static Bytecode compile(
+        const std::vector<Statement>& statements,
+        const EvaluationContext* locals,
+        bool share_subexpressions = false
+    );
+
+    // Reads variables from the contexts they were resolved against; `row`
+    // selects the element of variables bound with a stride.
+    ExprFloat evaluate(size_t row = 0) const;
+
+    // Reads variables from `context` instead, which must share the layout
+    // of the context they were resolved against (see
+    // `EvaluationContext::layout_id`); throws otherwise.
+    ExprFloat evaluate(const EvaluationContext& context, size_t row = 0) const;
+
+    // Runs the program with `vars[i]` bound to variable slot `i`.
+    ExprFloat execute(const ExprFloat* vars) const;
+
+    // Same as `evaluate(row)` and `execute(vars)`, but never throw: `status`
+    // is set to what went wrong (see `EvalStatus`), or to `Ok`.
+    ExprFloat evaluate(size_t row, EvalStatus& status) const noexcept;
+    ExprFloat execute(const ExprFloat* vars, EvalStatus& status) const noexcept;
+
+    // Write every output of a program to `out`, in order, reading variables
+    // like `execute` and `evaluate` respectively; a single expression has
+    // one output, its value. On a program, the overloads returning a value
+    // return its last statement.
+    void execute(const ExprFloat* vars, ExprFloat* out) const;
+    void evaluate_outputs(ExprFloat* out, size_t row = 0) const;
+
+    // Evaluates `n` rows at once: `columns[i]` holds the `n` values of
+    // variable slot `i`, and row `r` is written to `out[r]`. A null column
+    // reads the variable from its context instead (honouring its stride).
+    // Each instruction runs as a vectorized loop over a block of rows, and
+    // the results match `evaluate` bit for bit: on a program, the value of
+    // its last statement.
+    void evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* out) const;
+
+    // Same, writing output `i` of a program to column `out[i]`.
+    void evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* const* out) const;
+
+    // Same as `evaluate_batch`, with the rows split into chunks of
+    // `chunk_rows` (0 picks a size that keeps a chunk in L2) spread over
+    // `executor`'s workers, each with its own scratch blocks. Chunks start
+    // on block boundaries, so the results are identical to `evaluate_batch`
+    // whatever the number of threads. Functions and variable resolvers are
+    // called from several threads at once.
+    void evaluate_parallel(
+        const ExprFloat* const* columns,
+        size_t n,
+        ExprFloat* out,
+        Executor& executor = ThreadPool::global(),
+        size_t chunk_rows = 0
+    ) const;
+    void evaluate_parallel(
+        const ExprFloat* const* columns,
+        size_t n,
+        ExprFloat* const* out,
+        Executor& executor = ThreadPool::global(),
+        size_t chunk_rows = 0
+    ) const;
+
+    // Same, writing the status of row `r` to `status[r]` instead of
+    // throwing; only a failure to allocate scratch memory still throws. Rows
+    // that evaluate cleanly match the overloads above bit for bit.
+    void evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* out, EvalStatus* status) const;
+    void evaluate_parallel(
+        const ExprFloat* const* columns,
+        size_t n,
+        ExprFloat* out,
+        EvalStatus* status,
+        Executor& executor = ThreadPool::global(),
+        size_t chunk_rows = 0
+    ) const;
+
+    inline InstructionView instructions() const {
+        return image_code_ ? InstructionView(image_code_, image_size_) : InstructionView(code_.data(), code_.size());
+    }
+    inline const std::vector<std::string>& variables() const { return variable_names_; }
+    inline size_t variable_count() const { return variables_.size(); }
+    inline size_t max_stack_depth() const { return max_depth_; }
+    inline size_t temporary_count() const { return temporaries_; }
+
+    // Slots holding the outputs of a program once it has run; empty for a
+    // single expression, whose only output is the value it returns.
+    inline const std::vector<uint32_t>& outputs() const { return outputs_; }
+    inline size_t output_count() const { return outputs_.empty() ? 1 : outputs_.size(); }
+
+    // Functions called by `CallUnary`, `CallBinary` and `Call`, by `arg`.
+    inline const std::vector<FunctionEntryPtr>& functions() const { return functions_; }
+
+    // Tree nodes that were merged into an identical one; 0 unless compiled
+    // with `share_subexpressions`.
+    inline size_t deduplicated_nodes() const { return deduplicated_; }
+
+private:
+    friend class ExpressionImage;
+
+    struct Lowering;
+    struct BatchState;
+
+    struct VariableSource {
+        const EvaluationContext* context;
+        size_t                   slot;
+        const VariableExprNode*  node;      // Used when there is no context
+    };
+
+    std::vector<Instruction>    code_;
+    std::vector<VariableSource> variables_;
+    std::vector<std::string>    variable_names_;
+    std::vector<FunctionEntryPtr> functions_;
+    std::vector<uint32_t>       outputs_;
+    size_t                      max_depth_    = 0;
+    size_t                      temporaries_  = 0;
+    size_t                      deduplicated_ = 0;
+    uint64_t                    layout_id_    = 0;      // 0 when variables come from several layouts
+
+    // Set when loaded from an image: the instructions are read in place, and
+    // `image_` keeps the image alive if it owns its memory.
+    const Instruction*          image_code_ = nullptr;
+    size_t                      image_size_ = 0;
+    std::shared_ptr<const void> image_;
+
+    uint32_t variable_slot(const VariableExprNode& var, Lowering& state);
+    void collect_variables(const ExprNode& node, Lowering& state);
+    ExprFloat run(ExprFloat* frame, ExprFloat* stack) const;
+    ExprFloat run(ExprFloat* frame, ExprFloat* stack, EvalStatus& status) const noexcept;
+    template <typename Arithmetic>
+    ExprFloat interpret(ExprFloat* frame, ExprFloat* stack, Arithmetic& arithmetic) const;
+    void evaluate_rows(
+        const ExprFloat* const* columns,
+        size_t begin,
+        size_t end,
+        ExprFloat* const* out,
+        bool every_output,
+        EvalStatus* status,
+        BatchState& state
+    ) const;
+    void parallel_rows(
+        const ExprFloat* const* columns,
+        size_t n,
+        ExprFloat* const* out,
+        bool every_output,
+        EvalStatus* status,
+        Executor& executor,
+        size_t chunk_rows
+    ) const;
+    void compute_layout_id();
+
+    void lower(const ExprNode& node, size_t depth, Lowering& state);
+};
+
+
+
+// How aggressively `Optimizer` rewrites a parsed tree.
+//
+//  - `None` keeps the tree exactly as written.
+//  - `Safe` folds constant subtrees (including calls to pure functions) and
+//    applies identities that give bit-identical results for every input,
+//    such as `x * 1`, `x - 0`, `-(-x)` or dividing by a power of two.
+//  - `FastMath` also applies rewrites that are not IEEE-exact: `x + 0` and
+//    `x * 0` (wrong for -0, NaN and infinities), reassociating constant
+//    chains such as `x * 2 * 3`, dividing by a reciprocal, small integer
+//    powers of a variable as products (`x ^ 3` as `x * x * x`), sums of
+//    powers of one variable with constant coefficients in Horner form, and
+//    `a * b + c` as `fma(a, b, c)`.
+enum class OptimizationLevel {
+    None,
+    Safe,
+    FastMath
+};
+
+struct CompileOptions {
+    OptimizationLevel optimization = OptimizationLevel::Safe;
+
+    // Compute repeated subexpressions once per evaluation (see `Bytecode`).
+    bool share_subexpressions = false;
+};
+
+// Simplifies a parsed expression tree before it is lowered. Subtrees that
+// would throw when evaluated (division by zero) are left alone, so errors
+// are still reported at evaluation time.
+class Optimizer {
+public:
+    explicit Optimizer(OptimizationLevel level = OptimizationLevel::Safe) : level_(level) {}
+
+    ExprNodePtr optimize(ExprNodePtr node) const;
+
+    // Number of nodes in a tree, to measure what a pass removed.
+    static size_t node_count(const ExprNode& node);
+
+private:
+    OptimizationLevel level_;
+
+    // `in_sum` when `node` is an operand of `+`, `-` or unary minus, whose
+    // polynomial was already looked for from the top of the sum.
+    ExprNodePtr optimize(ExprNodePtr node, bool in_sum) const;
+    ExprNodePtr optimize_binary(std::unique_ptr<BinaryExprNode> node) const;
+    ExprNodePtr optimize_unary(std::unique_ptr<UnaryExprNode> node) const;
+    ExprNodePtr optimize_function(std::unique_ptr<FuncExprNode> node) const;
+};
+
+
+
+// Statistics of one compiled expression. The counters and timings are only
+// gathered when the library is built with `CPPEXPRPARS_PROFILING` (the CMake
+// option of the same name); otherwise their hooks compile to nothing and a
+// profile only has the node counts and subtree shapes.
+//
+// Every value computed is an evaluation, each row of a batch included.
+// Function calls follow from that: the bytecode calls each function left
+// in it once per evaluation, and the tree every call it holds. Every
+// `profiling_sample_period()` evaluations, the root and the subtrees up to
+// three levels below it are timed once with the tree evaluator. They read
+// the context the expression was compiled against, so the timing waits for
+// the next evaluation of that context (`evaluate()`, `evaluate_at(0)` or
+// `evaluate_tree()`); batches and other contexts are only counted. Subtrees
+// calling functions not marked pure are never evaluated again, so they are
+// not timed.
+struct SubtreeProfile {
+    size_t       depth = 0;      // 0 for the root
+    ExprNodeType type  = ExprNodeType::Constant;
+    std::string  label;          // Operator, function or variable name, or value
+    size_t       nodes = 0;
+    uint64_t     samples  = 0;
+    uint64_t     total_ns = 0;   // Including the subtrees below it
+
+    inline double mean_ns() const { return samples ? static_cast<double>(total_ns) / samples : 0.0; }
+};
+
+struct ExpressionProfile {
+    uint64_t parse_ns = 0;
+    size_t   node_counts[5] = {};    // Indexed by `ExprNodeType`
+    uint64_t evaluations = 0;        // Through the bytecode
+    uint64_t tree_evaluations = 0;   // Through `evaluate_tree()`
+
+    // Calls of each function named in the tree, in order of appearance.
+    // Calls folded into constants or into instructions (`fma`) are not made.
+    std::vector<std::pair<std::string, uint64_t>> function_calls;
+
+    // In pre-order, so the root comes first and every subtree is followed by
+    // its own subtrees.
+    std::vector<SubtreeProfile> subtrees;
+
+    std::string to_json() const;
+};
+
+// Whether the library was built with `CPPEXPRPARS_PROFILING`.
+constexpr bool profiling_enabled() {
+#ifdef CPPEXPRPARS_PROFILING
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Evaluations between two subtree timings (1024 by default); 0 turns timing
+// off. Shared by all expressions.
+void set_profiling_sample_period(uint64_t period);
+uint64_t profiling_sample_period();
+
+class ExpressionProfiler;
+
+
+
+// Owns a parsed expression tree so it can be evaluated many times without
+// tokenizing and parsing the source again. Variables are read from the
+// context the expression was compiled against, so updating that context
+// between calls is enough to evaluate the same formula with new values.
+//
+// The tree stays the front end; `evaluate()` runs the bytecode lowered from
+// it, while `evaluate_tree()` walks the tree itself.
+//
+// A compiled expression is never modified by evaluating it, so any number of
+// threads may evaluate it at once as long as nothing it reads changes
+// meanwhile. Threads that need their own values evaluate against their own
+// copy of the context, or pass values directly through `bytecode()`.
+class CompiledExpr {
+public:
+    CompiledExpr() = default;
+    explicit CompiledExpr(ExprNodePtr root, const CompileOptions& options = {});
+
+    ExprFloat evaluate() const;
+    ExprFloat evaluate_at(size_t row) const;
+    ExprFloat evaluate_tree() const;
+
+    // Reads variables from `context`, a copy of the context the expression
+    // was compiled against (see `Bytecode::evaluate`).
+    ExprFloat evaluate(const EvaluationContext& context, size_t row = 0) const;
+
+    // Structure-of-arrays evaluation; `columns` follows `variables()`.
+    void evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* out) const;
+    void evaluate_parallel(
+        const ExprFloat* const* columns,
+        size_t n,
+        ExprFloat* out,
+        Executor& executor = ThreadPool::global(),
+        size_t chunk_rows = 0
+    ) const;
+
+    // Never throwing forms of the above, reporting through `EvalStatus`
+    // (see `Bytecode`). An empty expression evaluates to NaN.
+    ExprFloat evaluate(EvalStatus& status) const noexcept;
+    ExprFloat evaluate_at(size_t row, EvalStatus& status) const noexcept;
+    void evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* out, EvalStatus* status) const;
+    void evaluate_parallel(
+        const ExprFloat* const* columns,
+        size_t n,
+        ExprFloat* out,
+        EvalStatus* status,
+        Executor& executor = ThreadPool::global(),
+        size_t chunk_rows = 0
+    ) const;
+
+    inline const std::vector<std::string>& variables() const { return bytecode_.variables(); }
+    inline size_t deduplicated_nodes() const { return bytecode_.deduplicated_nodes(); }
+
+    inline bool valid() const { return root_ != nullptr; }
+    inline explicit operator bool() const { return valid(); }
+
+    inline const ExprNode& root() const { return *root_; }
+    inline const Bytecode& bytecode() const { return bytecode_; }
+
+    // A snapshot of the statistics gathered so far (see `ExpressionProfile`).
+    ExpressionProfile profile() const;
+
+private:
+    friend class Parser;
+
+    ExprNodePtr root_;
+    Bytecode    bytecode_;
+    std::shared_ptr<ExpressionProfiler> profiler_;   // Null unless profiling
+};
+
+
+
+// A compiled program: several named outputs computed in a single pass, so
+// the terms they share are evaluated once. Every method writes one value
+// per output, in the order of `outputs()`; batch evaluation takes one
+// column per output. Like `CompiledExpr`, it reads variables from the
+// context it was compiled against and can be evaluated by many threads.
+class CompiledProgram {
+public:
+    CompiledProgram() = default;
+    CompiledProgram(
+        std::vector<Statement> statements,
+        std::unique_ptr<EvaluationContext> locals,
+        const CompileOptions& options = {}
+    );
+
+    void evaluate(ExprFloat* out, size_t row = 0) const;
+
+    void evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* const* out) const;
+    void evaluate_parallel(
+        const ExprFloat* const* columns,
+        size_t n,
+        ExprFloat* const* out,
+        Executor& executor = ThreadPool::global(),
+        size_t chunk_rows = 0
+    ) const;
+
+    inline const std::vector<std::string>& outputs() const { return outputs_; }
+    inline const std::vector<std::string>& variables() const { return bytecode_.variables(); }
+
+    inline bool valid() const { return !statements_.empty(); }
+    inline explicit operator bool() const { return valid(); }
+
+    inline const std::vector<Statement>& statements() const { return statements_; }
+    inline const Bytecode& bytecode() const { return bytecode_; }
+
+private:
+    std::vector<Statement>             statements_;
+    std::unique_ptr<EvaluationContext> locals_;         // Resolves the assigned names
+    std::vector<std::string>           outputs_;
+    Bytecode                           bytecode_;
+};
+
+
+
+// Saves compiled expressions in a binary image, which `ExpressionImage`
+// loads without tokenizing or parsing anything again. The image holds each
+// expression's bytecode as it runs, with its constants inline, and refers
+// to variables and functions by name; every offset in it is relative to
+// its start, so it can be mapped at any address.
+class ExpressionImageWriter {
+public:
+    // Adds `bytecode` under `name`, which must not have been added yet, and
+    // returns its index in the image.
+    size_t add(StringView name, const Bytecode& bytecode);
+    inline size_t add(StringView name, const CompiledExpr& expr) { return add(name, expr.bytecode()); }
+
+    inline size_t size() const { return expressions_.size(); }
+
+    // The image, e.g. to write to a file.
+    std::string data() const;
+
+    // Writes the image to `path`; throws if it cannot.
+    void write(const std::string& path) const;
+
+private:
+    // Where each expression's parts start in the tables below.
+    struct Expression {
+        uint32_t name;
+        uint32_t code_first,   code_size;
+        uint32_t symbol_first, variable_count, function_count;
+        uint32_t output_first, output_count;
+        uint32_t max_depth,    temporaries;
+    };
+
+    std::vector<Expression>  expressions_;
+    std::vector<Instruction> code_;
+    std::vector<uint32_t>    symbol_refs_;     // Indices into `symbols_`
+    std::vector<uint32_t>    outputs_;
+    std::vector<std::pair<uint32_t, uint32_t>> symbols_;   // Offset and length in `strings_`
+    std::string              strings_;
+    std::unordered_map<std::string, uint32_t> symbol_ids_;
+    std::vector<bool>        named_;           // Symbols naming an expression
+
+    uint32_t symbol(StringView text);
+};
+
+// A read-only view of an image written by `ExpressionImageWriter`.
+// Construction checks its header and tables; `load` checks one expression
+// and resolves its names, but never copies its instructions: the bytecode
+// it returns runs straight from the image. Images are in the byte order of
+// the machine that wrote them, and are rejected by one with another.
+//
+// Evaluating a loaded expression allocates nothing per instruction, so
+// loading is linear in the number of names it refers to and the number of
+// instructions checked.
+class ExpressionImage {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    ExpressionImage() = default;
+
+    // Views the `size` bytes at `data`, which must be 8-byte aligned and
+    // outlive this object and every bytecode loaded from it.
+    ExpressionImage(const void* data, size_t size);
+
+    // Maps the file at `path` read-only (or reads it where memory mapping
+    // is not available). The mapping lives as long as the image or any
+    // bytecode loaded from it.
+    static ExpressionImage map_file(const std::string& path);
+
+    inline size_t size() const { return count_; }
+    StringView name(size_t index) const;
+
+    // Index of the expression called `name`, or `npos`.
+    size_t find(StringView name) const;
+
+    // Names of the variables expression `index` reads, in slot order.
+    std::vector<std::string> variables(size_t index) const;
+
+    // The bytecode of expression `index`, reading its variables from the
+    // slots of the same names in `context` and calling the functions of the
+    // same names in `registry`. Throws for an unknown name, for a function
+    // that no longer takes the arguments it was compiled for, or for a
+    // malformed expression.
+    Bytecode load(size_t index, const EvaluationContext& context, const FunctionRegistry& registry) const;
+
+private:
+    std::shared_ptr<const void> storage_;   // Null when the caller owns the memory
+    const char*                 data_  = nullptr;
+    size_t                      size_  = 0;
+    size_t                      count_ = 0;
+
+    StringView symbol(uint32_t id) const;
+};
+
+
+
+// Value and gradient of an expression with respect to the variables in
+// `wrt`, by automatic differentiation of its tree: exact up to rounding,
+// unlike finite differences. The tree is flattened once into a tape.
+// `evaluate` runs the tape forward for the value, then backward for the
+// whole gradient (reverse mode), whatever the number of variables;
+// `evaluate_forward` carries one directional derivative along with the
+// value instead (forward mode).
+//
+// Operators and built-in functions all have derivatives; a call to a custom
+// function whose arguments depend on `wrt` needs one registered with it, or
+// construction throws. `%` counts as piecewise constant, `x ^ y` has no
+// derivative in `y` for `x <= 0`, and at the kinks of `abs`, `min` and
+// `max` the derivative of the branch taken is used. Variables are read
+// like `Bytecode` reads them, in the order of `variables()`; a name in
+// `wrt` the expression does not read has a zero derivative.
+//
+// The tape does not refer to the tree, and evaluating it changes nothing,
+// so many threads may use one instance at once.
+class CompiledGradient {
+public:
+    CompiledGradient() = default;
+    CompiledGradient(const ExprNode& root, std::vector<std::string> wrt);
+    CompiledGradient(const CompiledExpr& expr, std::vector<std::string> wrt) :
+        CompiledGradient(expr.root(), std::move(wrt)) {}
+
+    // Returns the value and writes its derivative with respect to `wrt[i]`
+    // to `gradient[i]`.
+    ExprFloat evaluate(ExprFloat* gradient, size_t row = 0) const;
+
+    // Same, with `vars[i]` bound to `variables()[i]`.
+    ExprFloat execute(const ExprFloat* vars, ExprFloat* gradient) const;
+
+    // Returns the value and sets `derivative` to its derivative along
+    // `direction`, which has one entry per variable in `wrt`.
+    ExprFloat evaluate_forward(const ExprFloat* direction, ExprFloat& derivative, size_t row = 0) const;
+
+    // `n` rows at once, with `columns` as in `Bytecode::evaluate_batch`: the
+    // value of row `r` goes to `values[r]` and its derivative with respect
+    // to `wrt[i]` to `gradient[i][r]`. Matches `evaluate` bit for bit.
+    void evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* values, ExprFloat* const* gradient) const;
+
+    inline const std::vector<std::string>& variables() const { return variable_names_; }
+    inline const std::vector<std::string>& wrt() const { return wrt_; }
+    inline size_t tape_size() const { return tape_.size(); }
+
+private:
+    enum class StepKind : uint8_t {
+        Constant, Variable,
+        Add, Subtract, Multiply, Divide, Modulo, Power,
+        Negate, Call
+    };
+
+    // One node of the tree; its operands are `operands_[first, first + count)`.
+    struct Step {
+        StepKind  kind;
+        bool      active = false;   // Depends on a variable in `wrt`
+        uint32_t  arg    = 0;       // Variable: its index; Call: its function
+        uint32_t  first  = 0;
+        uint32_t  count  = 0;
+        ExprFloat value  = 0.0;
+    };
+
+    struct Source {
+        const EvaluationContext*                context;
+        size_t                                  slot;
+        std::shared_ptr<const VariableExprNode> node;   // Used when there is no context
+    };
+
+    std::vector<Step>             tape_;
+    std::vector<uint32_t>         operands_;
+    std::vector<FunctionEntryPtr> functions_;
+    std::vector<Source>           sources_;
+    std::vector<std::string>      variable_names_;
+    std::vector<int32_t>          wrt_index_;   // Per variable: its index in `wrt_`, or -1
+    std::vector<std::string>      wrt_;
+    size_t                        max_operands_ = 2;
+
+    uint32_t record(const ExprNode& node);
+    ExprFloat read(size_t variable, size_t row) const;
+    void partials(const Step& step, const ExprFloat* values, size_t len, size_t j, ExprFloat* args, ExprFloat* out) const;
+    void forward(const ExprFloat* const* inputs, size_t len, ExprFloat* values, ExprFloat* args) const;
+    void reverse(const ExprFloat* values, size_t len, ExprFloat* adjoints, ExprFloat* args, ExprFloat* const* gradient, size_t offset) const;
+};
+
+
+
+// Native x86-64 code generated from a `Bytecode` program, in executable
+// memory owned by the instance: a scalar function taking the variables in
+// slot order (as `Bytecode::execute`), and a batch function taking one
+// column per variable (as `Bytecode::evaluate_batch`, but with every column
+// supplied). The batch function processes 2 (SSE2) or 4 (AVX) rows at a
+// time, as chosen by `get_simd_level()` when it is generated, and both give
+// the same results as the interpreter bit for bit. For the bytecode of a
+// `CompiledProgram`, both return the value of its last statement.
+//
+// Where the interpreter throws, the native functions stop and return NaN
+// (or leave the remaining rows untouched), keeping the exception for
+// `take_error()`; `execute` and `evaluate_batch` rethrow it. On other
+// platforms, or when built with CPPEXPRPARS_NO_JIT, no code is generated
+// and both fall back to the interpreter.
+//
+// With `set_jit_perf_map(true)`, or CPPEXPRPARS_PERF_MAP=1 in the
+// environment, each function is listed in /tmp/perf-<pid>.map so `perf`
+// can attribute samples to it.
+class JitExpr {
+public:
+    using ScalarFunction = ExprFloat (*)(const ExprFloat* vars);
+    using BatchFunction  = void (*)(const ExprFloat* const* columns, size_t n, ExprFloat* out);
+
+    JitExpr() = default;
+
+    // `name` labels the functions in the perf map.
+    explicit JitExpr(const Bytecode& code, const std::string& name = "expr");
+    ~JitExpr();
+
+    JitExpr(JitExpr&& other) noexcept;
+    JitExpr& operator=(JitExpr&& other) noexcept;
+    JitExpr(const JitExpr&) = delete;
+    JitExpr& operator=(const JitExpr&) = delete;
+
+    // Whether this build can generate native code.
+    static bool available();
+
+    // Null when no code was generated.
+    inline ScalarFunction function() const { return function_; }
+    inline BatchFunction batch_function() const { return batch_; }
+    inline bool native() const { return function_ != nullptr; }
+    inline const Bytecode& bytecode() const { return bytecode_; }
+
+    ExprFloat execute(const ExprFloat* vars) const;
+
+    // A null column reads the variable from its context, which only the
+    // interpreter does.
+    void evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* out) const;
+
+    // The error that stopped the last native call on this thread, if it
+    // has not been taken yet.
+    static std::exception_ptr take_error();
+
+private:
+    Bytecode       bytecode_;       // Fallback, and keeps the called functions alive
+    void*          memory_   = nullptr;
+    size_t         size_     = 0;
+    ScalarFunction function_ = nullptr;
+    BatchFunction  batch_    = nullptr;
+};
+
+void set_jit_perf_map(bool enabled);
+
+
+
 class Parser {
 public:
+    // Uses the default context and registry current when parsing starts.
     explicit Parser(Tokenizer tokenizer) :
         tokenizer_(std::move(tokenizer)),
-        context_(cppexprpars::get_default_context()),
-        registry_(cppexprpars::get_default_registry()) {}
+        context_(nullptr),
+        registry_(nullptr) {}
 
-    explicit Parser(Tokenizer tokenizer, EvaluationContext* context, FunctionRegistry* registry) :
+    explicit Parser(Tokenizer tokenizer, const EvaluationContext* context, const FunctionRegistry* registry) :
         tokenizer_(std::move(tokenizer)),
         context_(context),
         registry_(registry) {}
 
     std::unique_ptr<ExprNode> parse();
 
-    inline void set_context(EvaluationContext* context) {
+    // Parses, runs the optimizer over the tree and lowers it.
+    CompiledExpr compile(const CompileOptions& options = {});
+
+    // Same for a program: statements `name = expression` separated by `;`,
+    // e.g. `t = a * b + c; out1 = sin(t); out2 = t ^ 2`. An expression can
+    // read the names assigned before it, which shadow the context's
+    // variables; `let name = expression` assigns a temporary that is not an
+    // output. A name can only be assigned once.
+    CompiledProgram compile_program(const CompileOptions& options = {});
+
+    inline void set_context(const EvaluationContext* context) {
         this->context_ = context;
     }
 
-    inline void set_registry(FunctionRegistry* registry) {
+    inline void set_registry(const FunctionRegistry* registry) {
         this->registry_ = registry;
     }
 
+    // Nodes and argument lists are allocated from `resource` (the heap when
+    // null), which must outlive the trees built from it.
+    inline void set_memory_resource(MemoryResource* resource) {
+        this->resource_ = resource;
+    }
+
+    // Time the last `parse()` took, when built with `CPPEXPRPARS_PROFILING`.
+    inline uint64_t parse_ns() const { return parse_ns_; }
+
 private:
-    Tokenizer          tokenizer_;
-    EvaluationContext* context_;
-    FunctionRegistry*  registry_;
+    Tokenizer                tokenizer_;
+    const EvaluationContext* context_;
+    const FunctionRegistry*  registry_;
+    MemoryResource*          resource_ = nullptr;
+    const EvaluationContext* locals_   = nullptr;   // Names assigned so far by a program
+    uint64_t                 parse_ns_ = 0;
 
     std::unique_ptr<ExprNode> parse_expression(int precedence = 0);
     std::unique_ptr<ExprNode> parse_primary();
 
     int get_precedence(TokenType type) const;
     bool is_right_associative(TokenType type) const;
+    static BinaryOp binary_op(TokenType type);
 };
 
+// Outcome of one expression of `compile_all`: the compiled expression, or
+// the message of the error that stopped it.
+struct CompileResult {
+    CompiledExpr expression;
+    std::string  error;
 
+    inline bool ok() const { return expression.valid(); }
+};
 
+// Compiles many expressions at once, spread over `executor`'s workers, and
+// returns their results in the order of `sources`. An expression that fails
+// does not stop the others. All of them read variables from `context` and
+// call functions from `registry` (the defaults when null, taken once for
+// the whole set), which are shared between the workers: neither may change
+// until this returns, and both must outlive the results.
+std::vector<CompileResult> compile_all(
+    const StringView* sources,
+    size_t count,
+    const EvaluationContext* context = nullptr,
+    const FunctionRegistry* registry = nullptr,
+    const CompileOptions& options = {},
+    Executor& executor = ThreadPool::global()
+);
+std::vector<CompileResult> compile_all(
+    const std::vector<std::string>& sources,
+    const EvaluationContext* context = nullptr,
+    const FunctionRegistry* registry = nullptr,
+    const CompileOptions& options = {},
+    Executor& executor = ThreadPool::global()
+);
+
+
+
+// Counters of an `ExpressionCache`, summed over its shards.
+struct CacheStats {
+    uint64_t hits      = 0;
+    uint64_t misses    = 0;
+    uint64_t evictions = 0;
+    size_t   size      = 0;
+};
+
+// Concurrent, bounded cache of compiled expressions, for many threads
+// evaluating the same formulas. Entries are keyed by the normalized source
+// text (whitespace only kept between two words, so `x+y` and `x + y` match), the
+// registry's revision and the compile options, and are split over shards,
+// each an LRU list behind its own mutex.
+//
+// Cached expressions are immutable and shared, so they do not read any
+// caller's context: each one owns a context defining exactly its variables.
+// Pass the values per call with `bytecode().execute(vars)`, or per column
+// with `evaluate_batch`, ordered as in `variables()`. Both are safe to call
+// from many threads at once. The registry must not be modified while it is
+// being used to compile, and must outlive the entries compiled from it.
+class ExpressionCache {
+public:
+    explicit ExpressionCache(size_t capacity = 4096, size_t shards = 16);
+    ~ExpressionCache();
+
+    ExpressionCache(const ExpressionCache&) = delete;
+    ExpressionCache& operator=(const ExpressionCache&) = delete;
+
+    // Compiles on a miss; compilation errors propagate and are not cached.
+    std::shared_ptr<const CompiledExpr> get(
+        StringView expression,
+        const FunctionRegistry& registry = *get_default_registry(),
+        const CompileOptions& options = {}
+    );
+
+    CacheStats stats() const;
+    void clear();
+    inline size_t capacity() const { return capacity_; }
+
+    // Process-wide instance with the default capacity.
+    static ExpressionCache& global();
+
+private:
+    struct Shard;
+
+    size_t                   capacity_;
+    size_t                   shard_count_;
+    std::unique_ptr<Shard[]> shards_;
+};
+
+
+
+// Many formulas over a shared set of variables, kept up to date
+// incrementally. The formulas are stored as one DAG in which identical
+// subexpressions, within a formula and across formulas, are a single node
+// whose value is cached. `set_variable` marks stale only the nodes that
+// read the variable, directly or through other nodes, and `update` (or
+// `value`) recomputes just those, children first; everything else keeps its
+// cached value. Calls to impure functions are recomputed on every update.
+//
+// Variables a formula reads before they are set start as NaN. The registry
+// must outlive the set. Not for concurrent use.
+class ExpressionSet {
+public:
+    explicit ExpressionSet(
+        const FunctionRegistry& registry = *get_default_registry(),
+        OptimizationLevel optimization = OptimizationLevel::Safe
+    );
+    ~ExpressionSet();
+
+    ExpressionSet(const ExpressionSet&) = delete;
+    ExpressionSet& operator=(const ExpressionSet&) = delete;
+
+    // Parses and optimizes `expression`, returning its index; it is
+    // evaluated on the next update.
+    size_t add(StringView expression);
+
+    // A no-op when the value is unchanged, bit for bit.
+    void set_variable(const std::string& name, ExprFloat value);
+    ExprFloat get_variable(const std::string& name) const;
+
+    // Recomputes the stale nodes and returns how many were evaluated. If one
+    // throws, it and the nodes after it stay stale and the next update
+    // retries them.
+    size_t update();
+
+    // Value of formula `index`, updating first if it is stale.
+    ExprFloat value(size_t index);
+    bool is_stale(size_t index) const;
+
+    // The variables formula `index` reads, in order of first appearance.
+    const std::vector<std::string>& dependencies(size_t index) const;
+    const std::string& expression(size_t index) const;
+
+    size_t size() const;
+    size_t node_count() const;      // After sharing identical subexpressions
+
+private:
+    struct Node;
+    struct Formula;
+
+    uint32_t intern(const ExprNode& node, std::vector<std::string>& dependencies);
+    uint32_t add_node(Node node);
+    void mark_dependents_stale(uint32_t id);
+    void evaluate(Node& node);
+
+    const FunctionRegistry*                   registry_;
+    OptimizationLevel                         optimization_;
+    EvaluationContext                         context_;       // Names only, for parsing
+    std::vector<Node>                         nodes_;         // Children before parents
+    std::vector<Formula>                      formulas_;
+    std::unordered_map<std::string, uint32_t> dag_;
+    std::unordered_map<std::string, uint32_t> variables_;     // Name -> node
+    std::vector<uint32_t>                     stale_;
+    std::vector<uint32_t>                     impure_;
+};
+
+
+
+// Owns its expression, context and registry, and compiles lazily on first
+// evaluation, so unlike `CompiledExpr` an instance must not be used by
+// several threads at once. Use one per thread, or share compiled
+// expressions through `ExpressionCache`.
 class ExprParser {
 public:
     ExprParser() :
         context_(EvaluationContext::default_context()),
         registry_(FunctionRegistry::default_registry()) {}
 
+    // The compiled tree points at this instance's context and registry, so
+    // copies and moves start with an empty cache and compile on demand.
+    ExprParser(const ExprParser& other);
+    ExprParser(ExprParser&& other);
+    ExprParser& operator=(const ExprParser& other);
+    ExprParser& operator=(ExprParser&& other);
+
     void set_expression(const std::string& expr);
 
     void set_variable(const std::string& name, ExprFloat value);
     ExprFloat get_variable(const std::string& name) const;
 
+    void bind(const std::string& name, const ExprFloat* value, size_t stride = 0);
+    void unbind(const std::string& name);
+
     void register_function(
         const std::string& name,
         Function fn,
         size_t nargs,
         ArityMismatchHandler on_invalid_args = {}
     );
+    void register_function(
+        const std::string& name,
+        ArgsFunction fn,
+        size_t nargs,
+        ArityMismatchHandler on_invalid_args = {}
+    );
+    void register_function(const std::string& name, UnaryFunction fn);
+    void register_function(const std::string& name, BinaryFunction fn);
+
+    // Applies to the next compilation; invalidates the cached one.
+    void set_compile_options(const CompileOptions& options);
+
+    // Builds the compiled tree in `resource` from now on (see `Parser`);
+    // invalidates the cached one.
+    void set_memory_resource(MemoryResource* resource);
+    inline const CompileOptions& compile_options() const { return options_; }
+
+    // Parses the current expression once and caches the result until
+    // `set_expression`, `register_function` or `set_compile_options`
+    // invalidates it.
+    const CompiledExpr& compile();
 
     ExprFloat evaluate();
+    ExprFloat evaluate_at(size_t row);
 
 private:
     std::string       expression_;
     EvaluationContext context_;
     FunctionRegistry  registry_;
+    CompileOptions    options_;
+    MemoryResource*   resource_ = nullptr;
+    CompiledExpr      compiled_;
 };
 
 }   // namespace cppexprpars
+
+#endif  // CPPEXPRPARS_HPP
@@ -0,0 +1,765 @@
+//  cppexprpars_static.hpp - Lightweight C++ Expression Parser (Compile-Time Expressions)
+//
+//  This header parses expressions known when the program is built, at
+//  compile time, into expression templates the compiler can inline and
+//  vectorize like hand-written code. It requires C++17.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+#ifndef CPPEXPRPARS_STATIC_HPP
+#define CPPEXPRPARS_STATIC_HPP
+
+#if __cplusplus < 201703L && !(defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#error "cppexprpars_static.hpp requires C++17 (configure with -DCPPEXPRPARS_CXX_STANDARD=17)"
+#endif
+
+#include "cppexprpars.hpp"
+#include <algorithm>
+#include <array>
+#include <string_view>
+
+
+// Parses `source`, a string literal, at compile time and yields a
+// `cppexprpars::static_expr::StaticExpr` for it:
+//
+//     constexpr auto area = CPPEXPRPARS_EXPR("pi * r ^ 2");
+//     double a = area(3.14159, 2.0);      // pi, r: order of first appearance
+//
+// The grammar and precedence are the ones of `Parser`; invalid syntax,
+// unknown functions and wrong argument counts are compile errors. Only the
+// built-in functions of the default registry can be called.
+#define CPPEXPRPARS_EXPR(source)                                                        \
+    ([] {                                                                               \
+        struct Source {                                                                 \
+            static constexpr std::string_view text() { return source; }                 \
+        };                                                                              \
+        return ::cppexprpars::static_expr::StaticExpr<Source>();                        \
+    }())
+
+
+namespace cppexprpars {
+
+namespace static_expr {
+
+// The functions of `FunctionRegistry::default_registry()`.
+enum class Builtin { Sin, Cos, Tan, Exp, Log, Sqrt, Abs, Pow, Min, Max };
+
+enum class NodeKind { Constant, Variable, Negate, Binary, Call };
+
+struct Node {
+    NodeKind  kind        = NodeKind::Constant;
+    ExprFloat value       = 0.0;            // Constant
+    size_t    slot        = 0;              // Variable
+    BinaryOp  op          = BinaryOp::Add;  // Binary
+    Builtin   function    = Builtin::Sin;   // Call
+    size_t    arity       = 0;
+    size_t    operands[2] = {0, 0};
+};
+
+constexpr size_t max_nodes     = 256;
+constexpr size_t max_variables = 64;
+
+// An expression parsed at compile time: a flat tree of nodes, and the
+// variables in order of first appearance.
+struct Program {
+    Node             nodes[max_nodes]         = {};
+    size_t           node_count               = 0;
+    size_t           root                     = 0;
+    std::string_view variables[max_variables] = {};
+    size_t           variable_count           = 0;
+};
+
+
+namespace detail {
+
+// Not constexpr, so reaching it while parsing at compile time makes the
+// compiler stop and quote the message. At run time, it throws like `Parser`.
+inline void expression_error(const char* message) {
+    throw std::runtime_error(message);
+}
+
+constexpr bool is_digit(char ch) {
+    return ch >= '0' && ch <= '9';
+}
+
+constexpr bool is_alpha(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+constexpr bool is_space(char ch) {
+    return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+// Just enough arbitrary precision to round decimal numbers correctly.
+class BigInt {
+public:
+    static constexpr size_t max_words = 160;
+
+    constexpr bool is_zero() const { return size_ == 0; }
+
+    constexpr void multiply_add(uint32_t factor, uint32_t addend) {
+        uint64_t carry = addend;
+        for (size_t i = 0; i < size_; ++i) {
+            const uint64_t product = uint64_t(words_[i]) * factor + carry;
+            words_[i] = static_cast<uint32_t>(product);
+            carry = product >> 32;
+        }
+        if (carry)
+            push(static_cast<uint32_t>(carry));
+    }
+
+    constexpr void shift_left(size_t bits) {
+        if (is_zero() || bits == 0)
+            return;
+        const size_t words = bits / 32, rest = bits % 32;
+        if (size_ + words + 1 > max_words)
+            expression_error("Number literal too long");
+        words_[size_ + words] = 0;
+        for (size_t i = size_; i-- > 0;) {
+            words_[i + words + 1] |= rest ? words_[i] >> (32 - rest) : 0;
+            words_[i + words] = words_[i] << rest;
+        }
+        for (size_t i = 0; i < words; ++i)
+            words_[i] = 0;
+        size_ += words + 1;
+        trim();
+    }
+
+    constexpr size_t bit_length() const {
+        if (is_zero())
+            return 0;
+        size_t bits = 32 * (size_ - 1);
+        for (uint32_t top = words_[size_ - 1]; top; top >>= 1)
+            ++bits;
+        return bits;
+    }
+
+    constexpr int compare(const BigInt& other) const {
+        if (size_ != other.size_)
+            return size_ < other.size_ ? -1 : 1;
+        for (size_t i = size_; i-- > 0;)
+            if (words_[i] != other.words_[i])
+                return words_[i] < other.words_[i] ? -1 : 1;
+        return 0;
+    }
+
+    // Requires `*this >= other`.
+    constexpr void subtract(const BigInt& other) {
+        int64_t borrow = 0;
+        for (size_t i = 0; i < size_; ++i) {
+            int64_t difference = int64_t(words_[i]) - borrow - (i < other.size_ ? int64_t(other.words_[i]) : 0);
+            borrow = difference < 0 ? 1 : 0;
+            words_[i] = static_cast<uint32_t>(difference + (borrow << 32));
+        }
+        trim();
+    }
+
+private:
+    constexpr void push(uint32_t word) {
+        if (size_ == max_words)
+            expression_error("Number literal too long");
+        words_[size_++] = word;
+    }
+
+    constexpr void trim() {
+        while (size_ > 0 && words_[size_ - 1] == 0)
+            --size_;
+    }
+
+    uint32_t words_[max_words] = {};
+    size_t   size_             = 0;
+};
+
+// floor(num / den), given that it fits in 64 bits; `num` keeps the remainder.
+constexpr uint64_t divide(BigInt& num, const BigInt& den) {
+    uint64_t quotient = 0;
+    const size_t num_bits = num.bit_length(), den_bits = den.bit_length();
+    for (size_t bit = num_bits > den_bits ? num_bits - den_bits : 0; bit + 1 > 0; --bit) {
+        BigInt shifted = den;
+        shifted.shift_left(bit);
+        if (shifted.compare(num) <= 0) {
+            num.subtract(shifted);
+            quotient |= uint64_t(1) << bit;
+        }
+    }
+    return quotient;
+}
+
+constexpr ExprFloat scale_by_power_of_two(ExprFloat value, int exponent) {
+    for (; exponent > 0; --exponent)
+        value *= 2.0;
+    for (; exponent < 0; ++exponent)
+        value *= 0.5;
+    return value;
+}
+
+constexpr ExprFloat exact_power_of_ten(int exponent) {
+    ExprFloat power = 1.0;
+    for (int i = 0; i < exponent; ++i)
+        power *= 10.0;
+    return power;
+}
+
+// The decimal number in `text`, as scanned by the tokenizer, correctly
+// rounded like the run-time parser. False if it is not finite.
+constexpr bool parse_decimal(std::string_view text, ExprFloat& value) {
+    BigInt   digits_value;
+    uint64_t significand = 0;
+    int      digits      = 0;           // Significant digits seen
+    int      exponent    = 0;
+    bool     any_digit   = false;
+
+    size_t p = 0;
+    for (bool fraction = false; p < text.size() && (is_digit(text[p]) || text[p] == '.'); ++p) {
+        if (text[p] == '.') {
+            fraction = true;
+            continue;
+        }
+        any_digit = true;
+        const uint32_t digit = static_cast<uint32_t>(text[p] - '0');
+        if (digits > 0 || digit != 0) {
+            digits_value.multiply_add(10, digit);
+            significand = digits < 19 ? significand * 10 + digit : significand;
+            ++digits;
+        }
+        if (fraction)
+            --exponent;
+    }
+    if (!any_digit)
+        return false;
+
+    if (p < text.size()) {              // Exponent
+        ++p;
+        bool negative = false;
+        if (text[p] == '+' || text[p] == '-')
+            negative = (text[p++] == '-');
+        int e = 0;
+        for (; p < text.size(); ++p)
+            e = std::min(e * 10 + (text[p] - '0'), 100000);
+        exponent += negative ? -e : e;
+    }
+
+    if (digits == 0) {
+        value = 0.0;
+        return true;
+    }
+    if (digits <= 19 && significand <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+        const ExprFloat m = static_cast<ExprFloat>(significand);
+        value = exponent < 0 ? m / exact_power_of_ten(-exponent) : m * exact_power_of_ten(exponent);
+        return true;
+    }
+    if (digits + exponent > 310)
+        return false;
+    if (digits + exponent < -325) {
+        value = 0.0;
+        return true;
+    }
+
+    // value = num / den * 2^-shift, with the quotient scaled to 53 bits
+    // (fewer for subnormal results) and rounded half to even.
+    BigInt num = digits_value, den;
+    den.multiply_add(1, 1);
+    for (int i = 0; i < (exponent < 0 ? -exponent : exponent); ++i)
+        (exponent < 0 ? den : num).multiply_add(10, 0);
+
+    int shift = 53 - (static_cast<int>(num.bit_length()) - static_cast<int>(den.bit_length()));
+    shift = std::min(shift, 1074);
+    uint64_t quotient = 0;
+    BigInt remainder;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        remainder = num;
+        BigInt divisor = den;
+        if (shift > 0)
+            remainder.shift_left(static_cast<size_t>(shift));
+        else
+            divisor.shift_left(static_cast<size_t>(-shift));
+        quotient = divide(remainder, divisor);
+        if (quotient < (uint64_t(1) << 53))
+            break;
+        --shift;
+    }
+
+    BigInt twice = remainder, divisor = den;
+    twice.shift_left(1);
+    if (shift < 0)
+        divisor.shift_left(static_cast<size_t>(-shift));
+    const int half = twice.compare(divisor);
+    if (half > 0 || (half == 0 && (quotient & 1)))
+        ++quotient;
+
+    value = scale_by_power_of_two(static_cast<ExprFloat>(quotient), -shift);
+    return value - value == 0.0;        // Finite
+}
+
+struct Lexeme {
+    TokenType        type   = TokenType::End;
+    std::string_view text   = {};
+    ExprFloat        number = 0.0;
+};
+
+struct BuiltinInfo {
+    std::string_view name;
+    Builtin          function;
+    size_t           arity;
+};
+
+constexpr BuiltinInfo builtins[] = {
+    {"sin", Builtin::Sin, 1}, {"cos",  Builtin::Cos,  1}, {"tan", Builtin::Tan, 1},
+    {"exp", Builtin::Exp, 1}, {"log",  Builtin::Log,  1}, {"sqrt", Builtin::Sqrt, 1},
+    {"abs", Builtin::Abs, 1}, {"pow",  Builtin::Pow,  2}, {"min", Builtin::Min, 2},
+    {"max", Builtin::Max, 2},
+};
+
+// The recursive descent of `Parser`, building a `Program` instead of a
+// tree of nodes.
+class ProgramBuilder {
+public:
+    constexpr explicit ProgramBuilder(std::string_view text) : text_(text) {
+        next_token();
+    }
+
+    constexpr Program build() {
+        program_.root = parse_expression(0);
+        if (current_.type != TokenType::End)
+            expression_error("Unexpected token after expression");
+        return program_;
+    }
+
+private:
+    constexpr void next_token() {
+        while (pos_ < text_.size() && is_space(text_[pos_]))
+            ++pos_;
+        if (pos_ >= text_.size()) {
+            current_ = {TokenType::End};
+            return;
+        }
+
+        const size_t start = pos_;
+        const char ch = text_[pos_];
+        if (is_digit(ch) || ch == '.') {
+            bool has_dot = false;
+            while (pos_ < text_.size() && (is_digit(text_[pos_]) || text_[pos_] == '.')) {
+                if (text_[pos_] == '.') {
+                    if (has_dot) break;
+                    has_dot = true;
+                }
+                ++pos_;
+            }
+            if (pos_ < text_.size() && (text_[pos_] == 'e' || text_[pos_] == 'E')) {
+                size_t end = pos_ + 1;
+                if (end < text_.size() && (text_[end] == '+' || text_[end] == '-'))
+                    ++end;
+                if (end < text_.size() && is_digit(text_[end])) {
+                    while (end < text_.size() && is_digit(text_[end]))
+                        ++end;
+                    pos_ = end;
+                }
+            }
+            current_ = {TokenType::Number, text_.substr(start, pos_ - start)};
+            if (!parse_decimal(current_.text, current_.number))
+                current_.type = TokenType::Invalid;
+        } else if (is_alpha(ch) || ch == '_') {
+            while (pos_ < text_.size() && (is_alpha(text_[pos_]) || is_digit(text_[pos_]) || text_[pos_] == '_'))
+                ++pos_;
+            current_ = {TokenType::Identifier, text_.substr(start, pos_ - start)};
+        } else {
+            TokenType type = TokenType::Invalid;
+            switch (ch) {
+                case '+': type = TokenType::Plus; break;
+                case '-': type = TokenType::Minus; break;
+                case '*': type = TokenType::Star; break;
+                case '/': type = TokenType::Slash; break;
+                case '%': type = TokenType::Percent; break;
+                case '^': type = TokenType::Caret; break;
+                case '(': type = TokenType::LeftParen; break;
+                case ')': type = TokenType::RightParen; break;
+                case ',': type = TokenType::Comma; break;
+                default: break;
+            }
+            current_ = {type, text_.substr(pos_++, 1)};
+        }
+    }
+
+    constexpr size_t add(const Node& node) {
+        if (program_.node_count == max_nodes)
+            expression_error("Expression too long for compile-time parsing");
+        program_.nodes[program_.node_count] = node;
+        return program_.node_count++;
+    }
+
+    constexpr size_t variable_slot(std::string_view name) {
+        for (size_t i = 0; i < program_.variable_count; ++i)
+            if (program_.variables[i] == name)
+                return i;
+        if (program_.variable_count == max_variables)
+            expression_error("Too many variables for compile-time parsing");
+        program_.variables[program_.variable_count] = name;
+        return program_.variable_count++;
+    }
+
+    static constexpr int get_precedence(TokenType type) {
+        switch (type) {
+            case TokenType::Plus:
+            case TokenType::Minus: return 1;
+            case TokenType::Star:
+            case TokenType::Slash:
+            case TokenType::Percent: return 2;
+            case TokenType::Caret: return 3;
+            default: return -1;
+        }
+    }
+
+    static constexpr BinaryOp binary_op(TokenType type) {
+        switch (type) {
+            case TokenType::Plus:    return BinaryOp::Add;
+            case TokenType::Minus:   return BinaryOp::Subtract;
+            case TokenType::Star:    return BinaryOp::Multiply;
+            case TokenType::Slash:   return BinaryOp::Divide;
+            case TokenType::Percent: return BinaryOp::Modulo;
+            default:                 return BinaryOp::Power;
+        }
+    }
+
+    constexpr size_t parse_expression(int precedence) {
+        size_t lhs = parse_primary();
+
+        while (true) {
+            const TokenType type = current_.type;
+            const int token_prec = get_precedence(type);
+            if (token_prec < precedence) break;
+
+            next_token();
+            const int next_prec = token_prec + (type == TokenType::Caret ? 0 : 1);
+            const size_t rhs = parse_expression(next_prec);
+
+            Node node;
+            node.kind = NodeKind::Binary;
+            node.op = binary_op(type);
+            node.arity = 2;
+            node.operands[0] = lhs;
+            node.operands[1] = rhs;
+            lhs = add(node);
+        }
+
+        return lhs;
+    }
+
+    constexpr size_t parse_primary() {
+        const Lexeme token = current_;
+        next_token();
+
+        Node node;
+        switch (token.type) {
+            case TokenType::Number:
+                node.kind = NodeKind::Constant;
+                node.value = token.number;
+                return add(node);
+
+            case TokenType::Identifier:
+                if (current_.type == TokenType::LeftParen) {
+                    next_token();
+                    node.kind = NodeKind::Call;
+                    size_t arity = 0;
+                    if (current_.type != TokenType::RightParen) {
+                        while (true) {
+                            const size_t arg = parse_expression(0);
+                            if (arity < 2)
+                                node.operands[arity] = arg;
+                            ++arity;
+                            if (current_.type == TokenType::Comma)
+                                next_token();
+                            else
+                                break;
+                        }
+                    }
+                    if (current_.type != TokenType::RightParen)
+                        expression_error("Expected ')' after function arguments");
+                    next_token();
+
+                    const BuiltinInfo* info = nullptr;
+                    for (const BuiltinInfo& builtin : builtins)
+                        if (builtin.name == token.text)
+                            info = &builtin;
+                    if (!info)
+                        expression_error("Unknown function");
+                    if (info->arity != arity)
+                        expression_error("Wrong number of arguments in function call");
+                    node.function = info->function;
+                    node.arity = arity;
+                    return add(node);
+                }
+                node.kind = NodeKind::Variable;
+                node.slot = variable_slot(token.text);
+                return add(node);
+
+            case TokenType::LeftParen: {
+                const size_t expr = parse_expression(0);
+                if (current_.type != TokenType::RightParen)
+                    expression_error("Expected ')' after expression");
+                next_token();
+                return expr;
+            }
+
+            case TokenType::Minus:
+                node.kind = NodeKind::Negate;
+                node.arity = 1;
+                node.operands[0] = parse_expression(3); // high precedence for unary minus
+                return add(node);
+
+            default:
+                expression_error("Unexpected token");
+                return 0;
+        }
+    }
+
+    std::string_view text_;
+    size_t           pos_     = 0;
+    Lexeme           current_ = {};
+    Program          program_ = {};
+};
+
+}   // namespace detail
+
+constexpr Program parse(std::string_view text) {
+    return detail::ProgramBuilder(text).build();
+}
+
+template <class Source>
+constexpr Program program = parse(Source::text());
+
+
+
+// The expression templates. Each node evaluates a row through `row[slot]`
+// and sets `failed` to 1 when it divides by zero, which the caller turns
+// into the exception `Parser`'s trees throw. Keeping the check out of the
+// arithmetic lets the batch loop vectorize; the flag is a double selected
+// like the values because GCC does not vectorize integer or `bool` flags
+// next to them without SSE4.1.
+namespace detail {
+
+template <size_t Slot>
+struct Variable {
+    template <class Row>
+    static constexpr ExprFloat evaluate(const Row& row, ExprFloat&) {
+        return row[Slot];
+    }
+};
+
+template <class Source, size_t Index>
+struct Constant {
+    static constexpr ExprFloat value = program<Source>.nodes[Index].value;
+
+    template <class Row>
+    static constexpr ExprFloat evaluate(const Row&, ExprFloat&) {
+        return value;
+    }
+};
+
+template <class Operand>
+struct Negate {
+    template <class Row>
+    static constexpr ExprFloat evaluate(const Row& row, ExprFloat& failed) {
+        return -Operand::evaluate(row, failed);
+    }
+};
+
+template <BinaryOp Op, class Left, class Right>
+struct Binary {
+    template <class Row>
+    static constexpr ExprFloat evaluate(const Row& row, ExprFloat& failed) {
+        const ExprFloat lhs = Left::evaluate(row, failed);
+        const ExprFloat rhs = Right::evaluate(row, failed);
+
+        if constexpr (Op == BinaryOp::Add) {
+            return lhs + rhs;
+        } else if constexpr (Op == BinaryOp::Subtract) {
+            return lhs - rhs;
+        } else if constexpr (Op == BinaryOp::Multiply) {
+            return lhs * rhs;
+        } else if constexpr (Op == BinaryOp::Divide) {
+            failed = rhs == 0.0 ? 1.0 : failed;
+            return lhs / rhs;
+        } else if constexpr (Op == BinaryOp::Modulo) {
+            // A divisor that truncates to zero fails too, instead of being
+            // undefined behavior
+            const ExprInt divisor = static_cast<ExprInt>(rhs);
+            failed = divisor == 0 ? 1.0 : failed;
+            return static_cast<ExprFloat>(divisor ? static_cast<ExprInt>(lhs) % divisor : 0);
+        } else {
+            return std::pow(lhs, rhs);
+        }
+    }
+};
+
+constexpr ExprFloat call_builtin(Builtin function, ExprFloat x) {
+    switch (function) {
+        case Builtin::Sin:  return std::sin(x);
+        case Builtin::Cos:  return std::cos(x);
+        case Builtin::Tan:  return std::tan(x);
+        case Builtin::Exp:  return std::exp(x);
+        case Builtin::Log:  return std::log(x);
+        case Builtin::Sqrt: return std::sqrt(x);
+        default:            return std::abs(x);
+    }
+}
+
+constexpr ExprFloat call_builtin(Builtin function, ExprFloat x, ExprFloat y) {
+    switch (function) {
+        case Builtin::Min: return std::min(x, y);
+        case Builtin::Max: return std::max(x, y);
+        default:           return std::pow(x, y);
+    }
+}
+
+template <Builtin Function, class... Args>
+struct Call {
+    template <class Row>
+    static constexpr ExprFloat evaluate(const Row& row, ExprFloat& failed) {
+        return call_builtin(Function, Args::evaluate(row, failed)...);
+    }
+};
+
+template <class Source, size_t Index, NodeKind Kind = program<Source>.nodes[Index].kind,
+          size_t Arity = program<Source>.nodes[Index].arity>
+struct Build;
+
+template <class Source, size_t Index>
+using build_t = typename Build<Source, Index>::type;
+
+template <class Source, size_t Index>
+struct Build<Source, Index, NodeKind::Constant, 0> {
+    using type = Constant<Source, Index>;
+};
+
+template <class Source, size_t Index>
+struct Build<Source, Index, NodeKind::Variable, 0> {
+    using type = Variable<program<Source>.nodes[Index].slot>;
+};
+
+template <class Source, size_t Index>
+struct Build<Source, Index, NodeKind::Negate, 1> {
+    using type = Negate<build_t<Source, program<Source>.nodes[Index].operands[0]>>;
+};
+
+template <class Source, size_t Index>
+struct Build<Source, Index, NodeKind::Binary, 2> {
+    using type = Binary<program<Source>.nodes[Index].op,
+                        build_t<Source, program<Source>.nodes[Index].operands[0]>,
+                        build_t<Source, program<Source>.nodes[Index].operands[1]>>;
+};
+
+template <class Source, size_t Index>
+struct Build<Source, Index, NodeKind::Call, 1> {
+    using type = Call<program<Source>.nodes[Index].function,
+                      build_t<Source, program<Source>.nodes[Index].operands[0]>>;
+};
+
+template <class Source, size_t Index>
+struct Build<Source, Index, NodeKind::Call, 2> {
+    using type = Call<program<Source>.nodes[Index].function,
+                      build_t<Source, program<Source>.nodes[Index].operands[0]>,
+                      build_t<Source, program<Source>.nodes[Index].operands[1]>>;
+};
+
+struct ValueRow {
+    const ExprFloat* values;
+
+    constexpr ExprFloat operator[](size_t slot) const { return values[slot]; }
+};
+
+template <size_t Count>
+struct ColumnRow {
+    std::array<const ExprFloat*, Count> columns;
+    size_t                              row;
+
+    ExprFloat operator[](size_t slot) const { return columns[slot][row]; }
+};
+
+}   // namespace detail
+
+
+
+// An expression parsed at compile time, usually created with
+// `CPPEXPRPARS_EXPR`. Its variables are bound by position, in order of first
+// appearance, which matches `CompiledExpr::variables()` for the same text
+// unless the optimizer removes one. Evaluation gives the same results as
+// the interpreter and throws `std::runtime_error` on division by zero; with
+// arithmetic only, it can also be evaluated in constant expressions.
+template <class Source>
+class StaticExpr {
+public:
+    using Root = detail::build_t<Source, program<Source>.root>;
+
+    static constexpr size_t variable_count = program<Source>.variable_count;
+
+    static constexpr std::string_view text() { return Source::text(); }
+
+    static constexpr std::array<std::string_view, variable_count> variables() {
+        std::array<std::string_view, variable_count> names = {};
+        for (size_t i = 0; i < variable_count; ++i)
+            names[i] = program<Source>.variables[i];
+        return names;
+    }
+
+    template <typename... Values>
+    constexpr ExprFloat operator()(Values... values) const {
+        static_assert(sizeof...(Values) == variable_count, "Expected one value per variable of the expression");
+        const std::array<ExprFloat, sizeof...(Values)> vars = {{ static_cast<ExprFloat>(values)... }};
+        return evaluate(vars.data());
+    }
+
+    // `vars` follows `variables()`.
+    constexpr ExprFloat evaluate(const ExprFloat* vars) const {
+        ExprFloat failed = 0.0;
+        const ExprFloat result = Root::evaluate(detail::ValueRow{vars}, failed);
+        if (failed != 0.0)
+            throw std::runtime_error("Division by zero");
+        return result;
+    }
+
+    // Structure-of-arrays evaluation, like `CompiledExpr::evaluate_batch`;
+    // `columns` follows `variables()`.
+    void evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* out) const {
+        detail::ColumnRow<variable_count> row = {};
+        for (size_t i = 0; i < variable_count; ++i)
+            row.columns[i] = columns[i];
+
+        ExprFloat failed = 0.0;
+        for (row.row = 0; row.row < n; ++row.row)
+            out[row.row] = Root::evaluate(row, failed);
+        if (failed != 0.0)
+            throw std::runtime_error("Division by zero");
+    }
+};
+
+}   // namespace static_expr
+
+}   // namespace cppexprpars
+
+#endif  // CPPEXPRPARS_STATIC_HPP
@@ -0,0 +1,397 @@
+//  autodiff.cpp - Lightweight C++ Expression Parser (Automatic Differentiation)
+//
+//  This file implements the tape that computes the value and the gradient of
+//  an expression in forward and reverse mode.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+#include "cppexprpars.hpp"
+#include "scratch.hpp"
+
+
+namespace cppexprpars {
+
+namespace {
+
+// Rows per block of batch evaluation. Every step of the tape keeps a value
+// and an adjoint per row, so blocks are smaller than the interpreter's.
+constexpr size_t gradient_block = 64;
+
+inline ExprFloat modulo(ExprFloat lhs, ExprFloat rhs) {
+    return (ExprFloat)((ExprInt)lhs % (ExprInt)rhs);
+}
+
+inline void check_divisor(const ExprFloat* rhs, size_t len) {
+    bool zero = false;
+    for (size_t j = 0; j < len; ++j)
+        zero |= (rhs[j] == 0.0);
+    if (zero)
+        throw std::runtime_error("Division by zero");
+}
+
+// Same for `%`, whose divisor traps when it truncates to zero.
+inline void check_modulus(const ExprFloat* rhs, size_t len) {
+    bool zero = false;
+    for (size_t j = 0; j < len; ++j)
+        zero |= (rhs[j] == 0.0 || (ExprInt)rhs[j] == 0);
+    if (zero)
+        throw std::runtime_error("Division by zero");
+}
+
+}   // namespace
+
+
+
+CompiledGradient::CompiledGradient(const ExprNode& root, std::vector<std::string> wrt) :
+    wrt_(std::move(wrt)) {
+    record(root);
+}
+
+// Appends `node` after its operands, so the tape is in evaluation order and
+// the root is its last step.
+uint32_t CompiledGradient::record(const ExprNode& node) {
+    Step step;
+    std::vector<uint32_t> operands;
+
+    switch (node.type()) {
+        case ExprNodeType::Constant:
+            step.kind  = StepKind::Constant;
+            step.value = static_cast<const ConstantExprNode&>(node).value();
+            break;
+
+        case ExprNodeType::Variable: {
+            const auto& var = static_cast<const VariableExprNode&>(node);
+            auto it = std::find(variable_names_.begin(), variable_names_.end(), var.name());
+            if (it == variable_names_.end()) {
+                Source source{var.context(), var.context() ? var.slot() : 0, nullptr};
+                if (!var.context())
+                    source.node = std::make_shared<VariableExprNode>(var);
+                sources_.push_back(std::move(source));
+                variable_names_.push_back(var.name());
+                auto w = std::find(wrt_.begin(), wrt_.end(), var.name());
+                wrt_index_.push_back(w == wrt_.end() ? -1 : static_cast<int32_t>(w - wrt_.begin()));
+                it = variable_names_.end() - 1;
+            }
+            step.kind   = StepKind::Variable;
+            step.arg    = static_cast<uint32_t>(it - variable_names_.begin());
+            step.active = wrt_index_[step.arg] >= 0;
+            break;
+        }
+
+        case ExprNodeType::Unary: {
+            const auto& unary = static_cast<const UnaryExprNode&>(node);
+            if (unary.op() == UnaryOp::Plus)
+                return record(unary.operand());
+            step.kind = StepKind::Negate;
+            operands.push_back(record(unary.operand()));
+            break;
+        }
+
+        case ExprNodeType::Binary: {
+            const auto& binary = static_cast<const BinaryExprNode&>(node);
+            switch (binary.op()) {
+                case BinaryOp::Add:      step.kind = StepKind::Add; break;
+                case BinaryOp::Subtract: step.kind = StepKind::Subtract; break;
+                case BinaryOp::Multiply: step.kind = StepKind::Multiply; break;
+                case BinaryOp::Divide:   step.kind = StepKind::Divide; break;
+                case BinaryOp::Modulo:   step.kind = StepKind::Modulo; break;
+                case BinaryOp::Power:    step.kind = StepKind::Power; break;
+                default:
+                    throw std::runtime_error("Unknown binary operation");
+            }
+            operands.push_back(record(binary.left()));
+            operands.push_back(record(binary.right()));
+            break;
+        }
+
+        case ExprNodeType::Function: {
+            const auto& func = static_cast<const FuncExprNode&>(node);
+            step.kind = StepKind::Call;
+            step.arg  = static_cast<uint32_t>(functions_.size());
+            functions_.push_back(func.function());
+            for (const ExprNodePtr& arg : func.args())
+                operands.push_back(record(*arg));
+            max_operands_ = std::max(max_operands_, operands.size());
+            break;
+        }
+
+        default:
+            throw std::runtime_error("Unknown expression node");
+    }
+
+    for (uint32_t operand : operands)
+        step.active = step.active || tape_[operand].active;
+    if (step.kind == StepKind::Call && step.active && !functions_[step.arg]->derivative)
+        throw std::runtime_error("Function " + functions_[step.arg]->name + " has no derivative");
+
+    step.first = static_cast<uint32_t>(operands_.size());
+    step.count = static_cast<uint32_t>(operands.size());
+    operands_.insert(operands_.end(), operands.begin(), operands.end());
+    tape_.push_back(step);
+    return static_cast<uint32_t>(tape_.size() - 1);
+}
+
+ExprFloat CompiledGradient::read(size_t variable, size_t row) const {
+    const Source& source = sources_[variable];
+    return source.context ? source.context->value(source.slot, row) : source.node->evaluate();
+}
+
+// Values of every step for `len` rows; step `s` of row `j` goes to
+// `values[s * len + j]`, and `inputs[i]` holds the rows of variable `i`.
+void CompiledGradient::forward(const ExprFloat* const* inputs, size_t len, ExprFloat* values, ExprFloat* args) const {
+    for (size_t s = 0; s < tape_.size(); ++s) {
+        const Step& step = tape_[s];
+        const uint32_t* ops = operands_.data() + step.first;
+        const ExprFloat* a = step.count > 0 ? values + ops[0] * len : nullptr;
+        const ExprFloat* b = step.count > 1 ? values + ops[1] * len : nullptr;
+        ExprFloat* v = values + s * len;
+
+        switch (step.kind) {
+            case StepKind::Constant:
+                std::fill_n(v, len, step.value);
+                break;
+            case StepKind::Variable:
+                std::copy_n(inputs[step.arg], len, v);
+                break;
+            case StepKind::Add:
+                for (size_t j = 0; j < len; ++j) v[j] = a[j] + b[j];
+                break;
+            case StepKind::Subtract:
+                for (size_t j = 0; j < len; ++j) v[j] = a[j] - b[j];
+                break;
+            case StepKind::Multiply:
+                for (size_t j = 0; j < len; ++j) v[j] = a[j] * b[j];
+                break;
+            case StepKind::Divide:
+                check_divisor(b, len);
+                for (size_t j = 0; j < len; ++j) v[j] = a[j] / b[j];
+                break;
+            case StepKind::Modulo:
+                check_modulus(b, len);
+                for (size_t j = 0; j < len; ++j) v[j] = modulo(a[j], b[j]);
+                break;
+            case StepKind::Power:
+                for (size_t j = 0; j < len; ++j) v[j] = std::pow(a[j], b[j]);
+                break;
+            case StepKind::Negate:
+                for (size_t j = 0; j < len; ++j) v[j] = -a[j];
+                break;
+            case StepKind::Call: {
+                const FunctionEntry& fn = *functions_[step.arg];
+                for (size_t j = 0; j < len; ++j) {
+                    for (size_t k = 0; k < step.count; ++k)
+                        args[k] = values[ops[k] * len + j];
+                    v[j] = step.count == fn.nargs ? fn.call(args) : fn.invalid_call(step.count);
+                }
+                break;
+            }
+        }
+    }
+}
+
+// Partial derivatives of `step` with respect to each of its operands, at
+// row `j`, written to `out`. `args` is scratch for calls.
+void CompiledGradient::partials(const Step& step, const ExprFloat* values, size_t len, size_t j, ExprFloat* args, ExprFloat* out) const {
+    const uint32_t* ops = operands_.data() + step.first;
+    const ExprFloat a = step.count > 0 ? values[ops[0] * len + j] : 0.0;
+    const ExprFloat b = step.count > 1 ? values[ops[1] * len + j] : 0.0;
+
+    switch (step.kind) {
+        case StepKind::Add:      out[0] = 1.0; out[1] = 1.0; break;
+        case StepKind::Subtract: out[0] = 1.0; out[1] = -1.0; break;
+        case StepKind::Multiply: out[0] = b;   out[1] = a; break;
+        case StepKind::Divide:   out[0] = 1.0 / b; out[1] = -(a / b) / b; break;
+        case StepKind::Modulo:   out[0] = 0.0; out[1] = 0.0; break;
+        case StepKind::Power:
+            out[0] = b == 0.0 ? 0.0 : b * std::pow(a, b - 1.0);
+            out[1] = a > 0.0 ? std::pow(a, b) * std::log(a) : 0.0;
+            break;
+        case StepKind::Negate:
+            out[0] = -1.0;
+            break;
+        case StepKind::Call: {
+            const FunctionEntry& fn = *functions_[step.arg];
+            if (step.count != fn.nargs || !fn.derivative) {
+                std::fill_n(out, step.count, std::numeric_limits<ExprFloat>::quiet_NaN());
+                break;
+            }
+            for (size_t k = 0; k < step.count; ++k)
+                args[k] = values[ops[k] * len + j];
+            fn.derivative(args, step.count, out);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Propagates the adjoints from the root down to the variables, adding the
+// derivative with respect to `wrt_[i]` of row `j` to `gradient[i][offset + j]`.
+// Steps that do not depend on `wrt_` are skipped.
+void CompiledGradient::reverse(
+    const ExprFloat* values,
+    size_t len,
+    ExprFloat* adjoints,
+    ExprFloat* args,
+    ExprFloat* const* gradient,
+    size_t offset
+) const {
+    std::fill_n(adjoints, tape_.size() * len, 0.0);
+    std::fill_n(adjoints + (tape_.size() - 1) * len, len, 1.0);
+    ExprFloat* d = args + max_operands_;
+
+    for (size_t s = tape_.size(); s-- > 0;) {
+        const Step& step = tape_[s];
+        if (!step.active)
+            continue;
+        const ExprFloat* g = adjoints + s * len;
+
+        if (step.kind == StepKind::Variable) {
+            ExprFloat* dst = gradient[wrt_index_[step.arg]] + offset;
+            for (size_t j = 0; j < len; ++j)
+                dst[j] += g[j];
+            continue;
+        }
+
+        const uint32_t* ops = operands_.data() + step.first;
+        for (size_t j = 0; j < len; ++j) {
+            partials(step, values, len, j, args, d);
+            for (size_t k = 0; k < step.count; ++k)
+                if (tape_[ops[k]].active)
+                    adjoints[ops[k] * len + j] += g[j] * d[k];
+        }
+    }
+}
+
+ExprFloat CompiledGradient::evaluate(ExprFloat* gradient, size_t row) const {
+    ScratchBuffer<16> vars(sources_.size());
+    for (size_t i = 0; i < sources_.size(); ++i)
+        vars.data()[i] = read(i, row);
+    return execute(vars.data(), gradient);
+}
+
+ExprFloat CompiledGradient::execute(const ExprFloat* vars, ExprFloat* gradient) const {
+    if (tape_.empty())
+        throw std::runtime_error("Evaluating an empty gradient");
+
+    ScratchBuffer<16, const ExprFloat*> inputs(sources_.size());
+    for (size_t i = 0; i < sources_.size(); ++i)
+        inputs.data()[i] = vars + i;
+    ScratchBuffer<16, ExprFloat*> columns(wrt_.size());
+    for (size_t i = 0; i < wrt_.size(); ++i) {
+        gradient[i] = 0.0;
+        columns.data()[i] = gradient + i;
+    }
+
+    ScratchBuffer<128> scratch(2 * tape_.size() + 2 * max_operands_);
+    ExprFloat* values   = scratch.data();
+    ExprFloat* adjoints = values + tape_.size();
+    ExprFloat* args     = adjoints + tape_.size();
+    forward(inputs.data(), 1, values, args);
+    reverse(values, 1, adjoints, args, columns.data(), 0);
+    return values[tape_.size() - 1];
+}
+
+// The tangent of each step is the sum of its partials times the tangents of
+// its operands, seeded with `direction` at the variables.
+ExprFloat CompiledGradient::evaluate_forward(const ExprFloat* direction, ExprFloat& derivative, size_t row) const {
+    if (tape_.empty())
+        throw std::runtime_error("Evaluating an empty gradient");
+
+    ScratchBuffer<16> vars(sources_.size());
+    ScratchBuffer<16, const ExprFloat*> inputs(sources_.size());
+    for (size_t i = 0; i < sources_.size(); ++i) {
+        vars.data()[i] = read(i, row);
+        inputs.data()[i] = vars.data() + i;
+    }
+
+    ScratchBuffer<128> scratch(2 * tape_.size() + 2 * max_operands_);
+    ExprFloat* values   = scratch.data();
+    ExprFloat* tangents = values + tape_.size();
+    ExprFloat* args     = tangents + tape_.size();
+    ExprFloat* d        = args + max_operands_;
+    forward(inputs.data(), 1, values, args);
+
+    for (size_t s = 0; s < tape_.size(); ++s) {
+        const Step& step = tape_[s];
+        tangents[s] = 0.0;
+        if (!step.active)
+            continue;
+        if (step.kind == StepKind::Variable) {
+            tangents[s] = direction[wrt_index_[step.arg]];
+            continue;
+        }
+        const uint32_t* ops = operands_.data() + step.first;
+        partials(step, values, 1, 0, args, d);
+        for (size_t k = 0; k < step.count; ++k)
+            if (tape_[ops[k]].active)
+                tangents[s] += d[k] * tangents[ops[k]];
+    }
+    derivative = tangents[tape_.size() - 1];
+    return values[tape_.size() - 1];
+}
+
+void CompiledGradient::evaluate_batch(
+    const ExprFloat* const* columns,
+    size_t n,
+    ExprFloat* values,
+    ExprFloat* const* gradient
+) const {
+    if (tape_.empty())
+        throw std::runtime_error("Evaluating an empty gradient");
+
+    std::vector<ExprFloat> scratch((2 * tape_.size() + sources_.size()) * gradient_block + 2 * max_operands_);
+    ExprFloat* step_values = scratch.data();
+    ExprFloat* adjoints    = step_values + tape_.size() * gradient_block;
+    ExprFloat* gathered    = adjoints + tape_.size() * gradient_block;
+    ExprFloat* args        = gathered + sources_.size() * gradient_block;
+    std::vector<const ExprFloat*> inputs(sources_.size());
+
+    for (size_t base = 0; base < n; base += gradient_block) {
+        const size_t len = std::min(gradient_block, n - base);
+        for (size_t i = 0; i < sources_.size(); ++i) {
+            if (columns && columns[i]) {
+                inputs[i] = columns[i] + base;
+                continue;
+            }
+            ExprFloat* dst = gathered + i * gradient_block;
+            for (size_t j = 0; j < len; ++j)
+                dst[j] = read(i, base + j);
+            inputs[i] = dst;
+        }
+
+        forward(inputs.data(), len, step_values, args);
+        std::copy_n(step_values + (tape_.size() - 1) * len, len, values + base);
+        for (size_t i = 0; i < wrt_.size(); ++i)
+            std::fill_n(gradient[i] + base, len, 0.0);
+        reverse(step_values, len, adjoints, args, gradient, base);
+    }
+}
+
+}   // namespace cppexprpars
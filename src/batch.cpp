@@ -0,0 +1,644 @@
+//  batch.cpp - Lightweight C++ Expression Parser (Batch Evaluation)
+//
+//  This file implements columnar evaluation of bytecode over blocks of rows,
+//  with SSE2/AVX2/AVX-512 kernels chosen at runtime and a scalar fallback.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+#include "cppexprpars.hpp"
+#include <atomic>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPPEXPRPARS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+
+namespace cppexprpars {
+
+namespace {
+
+// Rows processed per instruction. Small enough that a handful of stack
+// levels stay in L1, large enough to amortise the dispatch per block.
+constexpr size_t block_size = 256;
+
+using VectorKernel = void (*)(ExprFloat* out, const ExprFloat* a, const ExprFloat* b, size_t n);
+using ScalarKernel = void (*)(ExprFloat* out, const ExprFloat* a, ExprFloat b, size_t n);
+using FmaKernel    = void (*)(ExprFloat* out, const ExprFloat* a, const ExprFloat* b, const ExprFloat* c, size_t n);
+using FmaScalarKernel = void (*)(ExprFloat* out, const ExprFloat* a, const ExprFloat* b, ExprFloat c, size_t n);
+using FmaFactorKernel = void (*)(ExprFloat* out, const ExprFloat* a, ExprFloat b, const ExprFloat* c, size_t n);
+
+// Kernels for Add, Subtract, Multiply and Divide, in that order, with the
+// right operand either a block (`vv`) or a broadcast scalar (`vs`), and
+// for fused multiply-adds with the second factor or the addend a scalar.
+struct Kernels {
+    VectorKernel    vv[4];
+    ScalarKernel    vs[4];
+    FmaKernel       fma_vvv;
+    FmaScalarKernel fma_vvs;
+    FmaFactorKernel fma_vsv;
+};
+
+#define CPPEXPRPARS_SCALAR_KERNELS(NAME, SYM)                                                   \
+    static void NAME##_vv_scalar(ExprFloat* out, const ExprFloat* a, const ExprFloat* b, size_t n) { \
+        for (size_t i = 0; i < n; ++i) out[i] = a[i] SYM b[i];                                \
+    }                                                                                       \
+    static void NAME##_vs_scalar(ExprFloat* out, const ExprFloat* a, ExprFloat b, size_t n) {   \
+        for (size_t i = 0; i < n; ++i) out[i] = a[i] SYM b;                                   \
+    }
+
+CPPEXPRPARS_SCALAR_KERNELS(add, +)
+CPPEXPRPARS_SCALAR_KERNELS(sub, -)
+CPPEXPRPARS_SCALAR_KERNELS(mul, *)
+CPPEXPRPARS_SCALAR_KERNELS(div, /)
+
+#undef CPPEXPRPARS_SCALAR_KERNELS
+
+static void fma_vvv_scalar(ExprFloat* out, const ExprFloat* a, const ExprFloat* b, const ExprFloat* c, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = std::fma(a[i], b[i], c[i]);
+}
+static void fma_vvs_scalar(ExprFloat* out, const ExprFloat* a, const ExprFloat* b, ExprFloat c, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = std::fma(a[i], b[i], c);
+}
+static void fma_vsv_scalar(ExprFloat* out, const ExprFloat* a, ExprFloat b, const ExprFloat* c, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = std::fma(a[i], b, c[i]);
+}
+
+const Kernels scalar_kernels = {
+    { add_vv_scalar, sub_vv_scalar, mul_vv_scalar, div_vv_scalar },
+    { add_vs_scalar, sub_vs_scalar, mul_vs_scalar, div_vs_scalar },
+    fma_vvv_scalar,
+    fma_vvs_scalar,
+    fma_vsv_scalar,
+};
+
+#ifdef CPPEXPRPARS_X86_SIMD
+
+// `P` is the intrinsic prefix of the instruction set (`_mm_`, `_mm256_`,
+// `_mm512_`), whose add/sub/mul/div are IEEE-exact like their scalar forms.
+#define CPPEXPRPARS_SIMD_KERNELS(ISA, TARGET, VEC, P, WIDTH, NAME, SYM)                          \
+    __attribute__((target(TARGET)))                                                             \
+    static void NAME##_vv_##ISA(ExprFloat* out, const ExprFloat* a, const ExprFloat* b, size_t n) { \
+        size_t i = 0;                                                                           \
+        for (; i + WIDTH <= n; i += WIDTH)                                                      \
+            P##storeu_pd(out + i, P##NAME##_pd(P##loadu_pd(a + i), P##loadu_pd(b + i)));        \
+        for (; i < n; ++i) out[i] = a[i] SYM b[i];                                              \
+    }                                                                                           \
+    __attribute__((target(TARGET)))                                                             \
+    static void NAME##_vs_##ISA(ExprFloat* out, const ExprFloat* a, ExprFloat b, size_t n) {       \
+        const VEC vb = P##set1_pd(b);                                                           \
+        size_t i = 0;                                                                           \
+        for (; i + WIDTH <= n; i += WIDTH)                                                      \
+            P##storeu_pd(out + i, P##NAME##_pd(P##loadu_pd(a + i), vb));                        \
+        for (; i < n; ++i) out[i] = a[i] SYM b;                                                 \
+    }
+
+// Fused multiply-adds round once, like `std::fma`. SSE2 has no such
+// instruction, so that level keeps the scalar kernels.
+#define CPPEXPRPARS_FMA_KERNELS(ISA, TARGET, VEC, P, WIDTH)                                      \
+    __attribute__((target(TARGET)))                                                             \
+    static void fma_vvv_##ISA(ExprFloat* out, const ExprFloat* a, const ExprFloat* b, const ExprFloat* c, size_t n) { \
+        size_t i = 0;                                                                           \
+        for (; i + WIDTH <= n; i += WIDTH)                                                      \
+            P##storeu_pd(out + i, P##fmadd_pd(P##loadu_pd(a + i), P##loadu_pd(b + i), P##loadu_pd(c + i))); \
+        for (; i < n; ++i) out[i] = std::fma(a[i], b[i], c[i]);                                 \
+    }                                                                                           \
+    __attribute__((target(TARGET)))                                                             \
+    static void fma_vvs_##ISA(ExprFloat* out, const ExprFloat* a, const ExprFloat* b, ExprFloat c, size_t n) { \
+        const VEC vc = P##set1_pd(c);                                                           \
+        size_t i = 0;                                                                           \
+        for (; i + WIDTH <= n; i += WIDTH)                                                      \
+            P##storeu_pd(out + i, P##fmadd_pd(P##loadu_pd(a + i), P##loadu_pd(b + i), vc));      \
+        for (; i < n; ++i) out[i] = std::fma(a[i], b[i], c);                                    \
+    }                                                                                           \
+    __attribute__((target(TARGET)))                                                             \
+    static void fma_vsv_##ISA(ExprFloat* out, const ExprFloat* a, ExprFloat b, const ExprFloat* c, size_t n) { \
+        const VEC vb = P##set1_pd(b);                                                           \
+        size_t i = 0;                                                                           \
+        for (; i + WIDTH <= n; i += WIDTH)                                                      \
+            P##storeu_pd(out + i, P##fmadd_pd(P##loadu_pd(a + i), vb, P##loadu_pd(c + i)));      \
+        for (; i < n; ++i) out[i] = std::fma(a[i], b, c[i]);                                    \
+    }
+
+#define CPPEXPRPARS_SIMD_KERNEL_SET(ISA, TARGET, VEC, P, WIDTH, FMA)            \
+    CPPEXPRPARS_SIMD_KERNELS(ISA, TARGET, VEC, P, WIDTH, add, +)                  \
+    CPPEXPRPARS_SIMD_KERNELS(ISA, TARGET, VEC, P, WIDTH, sub, -)                  \
+    CPPEXPRPARS_SIMD_KERNELS(ISA, TARGET, VEC, P, WIDTH, mul, *)                  \
+    CPPEXPRPARS_SIMD_KERNELS(ISA, TARGET, VEC, P, WIDTH, div, /)                  \
+    const Kernels ISA##_kernels = {                                             \
+        { add_vv_##ISA, sub_vv_##ISA, mul_vv_##ISA, div_vv_##ISA },             \
+        { add_vs_##ISA, sub_vs_##ISA, mul_vs_##ISA, div_vs_##ISA },             \
+        fma_vvv_##FMA, fma_vvs_##FMA, fma_vsv_##FMA,                            \
+    };
+
+CPPEXPRPARS_FMA_KERNELS(avx2,   "avx2,fma", __m256d, _mm256_, 4)
+CPPEXPRPARS_FMA_KERNELS(avx512, "avx512f",  __m512d, _mm512_, 8)
+
+CPPEXPRPARS_SIMD_KERNEL_SET(sse2,   "sse2",    __m128d, _mm_,    2, scalar)
+CPPEXPRPARS_SIMD_KERNEL_SET(avx2,   "avx2",    __m256d, _mm256_, 4, avx2)
+CPPEXPRPARS_SIMD_KERNEL_SET(avx512, "avx512f", __m512d, _mm512_, 8, avx512)
+
+#undef CPPEXPRPARS_SIMD_KERNEL_SET
+#undef CPPEXPRPARS_FMA_KERNELS
+#undef CPPEXPRPARS_SIMD_KERNELS
+
+#endif
+
+SimdLevel detect_simd_level() {
+#ifdef CPPEXPRPARS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SimdLevel::SSE2;
+#endif
+    return SimdLevel::Scalar;
+}
+
+const SimdLevel detected_level = detect_simd_level();
+std::atomic<SimdLevel> active_level(detected_level);
+std::atomic<unsigned> vector_math_tolerance(0);
+
+const Kernels& kernels_for(SimdLevel level) {
+    switch (level) {
+#ifdef CPPEXPRPARS_X86_SIMD
+        case SimdLevel::AVX512: return avx512_kernels;
+        case SimdLevel::AVX2:   return avx2_kernels;
+        case SimdLevel::SSE2:   return sse2_kernels;
+#endif
+        default:                return scalar_kernels;
+    }
+}
+
+inline bool any_zero(const ExprFloat* b, size_t n) {
+    bool zero = false;
+    for (size_t i = 0; i < n; ++i)
+        zero |= (b[i] == 0.0);
+    return zero;
+}
+
+// Whether any value is infinite or NaN, i.e. has an all-ones exponent.
+// Adding one to the exponent then carries into the sign bit. Unlike
+// `std::isfinite` this is integer arithmetic only, so the loop vectorizes.
+inline bool any_not_finite(const ExprFloat* v, size_t n) {
+    static_assert(sizeof(ExprFloat) == sizeof(uint64_t), "ExprFloat must be a double");
+    const uint64_t exponent = 0x7ff0000000000000u;
+    uint64_t carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t bits;
+        std::memcpy(&bits, &v[i], sizeof(bits));
+        carry |= (bits & exponent) + 0x0010000000000000u;
+    }
+    return (carry >> 63) != 0;
+}
+
+// Whether a divisor of `%` truncates to zero, which would trap: the same
+// test as the interpreter's, so magnitudes beyond `ExprInt` count as well.
+inline bool truncates_to_zero(ExprFloat b) {
+    return b == 0.0 || (ExprInt)b == 0;
+}
+
+inline bool any_truncated_zero(const ExprFloat* b, size_t n) {
+    bool zero = false;
+    for (size_t i = 0; i < n; ++i)
+        zero |= truncates_to_zero(b[i]);
+    return zero;
+}
+
+inline ExprFloat modulo(ExprFloat lhs, ExprFloat rhs) {
+    return (ExprFloat)((ExprInt)lhs % (ExprInt)rhs);
+}
+
+// `modulo` for the rows that report their status: NaN, instead of a trap,
+// for a divisor that truncates to zero or an operand that is not finite.
+inline ExprFloat modulo(ExprFloat lhs, ExprFloat rhs, EvalStatus& status) {
+    if (!std::isfinite(lhs) || !std::isfinite(rhs))
+        return std::numeric_limits<ExprFloat>::quiet_NaN();
+    if ((ExprInt)rhs == 0) {
+        status |= EvalStatus::DivisionByZero;
+        return std::numeric_limits<ExprFloat>::quiet_NaN();
+    }
+    return (ExprFloat)((ExprInt)lhs % (ExprInt)rhs);
+}
+
+// Sets `dst[j]` to `call(j)` for each of `len` rows. With `flags`, a row
+// whose call throws is NaN and flagged instead.
+template <typename Call>
+inline void call_rows(ExprFloat* dst, size_t len, EvalStatus* flags, Call&& call) {
+    if (!flags) {
+        for (size_t j = 0; j < len; ++j)
+            dst[j] = call(j);
+        return;
+    }
+    for (size_t j = 0; j < len; ++j) {
+        try {
+            dst[j] = call(j);
+        } catch (...) {
+            dst[j] = std::numeric_limits<ExprFloat>::quiet_NaN();
+            flags[j] |= EvalStatus::FunctionError;
+        }
+    }
+}
+
+}   // namespace
+
+
+
+SimdLevel detected_simd_level() {
+    return detected_level;
+}
+
+SimdLevel get_simd_level() {
+    return active_level.load(std::memory_order_relaxed);
+}
+
+void set_simd_level(SimdLevel level) {
+    active_level.store(std::min(level, detected_level), std::memory_order_relaxed);
+}
+
+unsigned get_vector_math_tolerance() {
+    return vector_math_tolerance.load(std::memory_order_relaxed);
+}
+
+void set_vector_math_tolerance(unsigned max_ulp) {
+    vector_math_tolerance.store(max_ulp, std::memory_order_relaxed);
+}
+
+
+
+// Scratch of one thread evaluating blocks of rows, plus the settings read
+// once per call so every block of the call is evaluated the same way.
+struct Bytecode::BatchState {
+    SimdLevel simd_level;
+    unsigned  tolerance;
+
+    std::vector<ExprFloat>        blocks;
+    std::vector<const ExprFloat*> regs;
+    std::vector<ExprFloat>        call_args;
+
+    BatchState(const Bytecode& code, SimdLevel level, unsigned max_ulp) :
+        simd_level(level),
+        tolerance(max_ulp),
+        blocks((code.max_depth_ + 1 + code.temporaries_) * block_size),
+        regs(code.max_depth_ + 1) {}
+};
+
+void Bytecode::evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* out) const {
+    BatchState state(*this, get_simd_level(), get_vector_math_tolerance());
+    evaluate_rows(columns, 0, n, &out, false, nullptr, state);
+}
+
+void Bytecode::evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* const* out) const {
+    BatchState state(*this, get_simd_level(), get_vector_math_tolerance());
+    evaluate_rows(columns, 0, n, out, true, nullptr, state);
+}
+
+void Bytecode::evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* out, EvalStatus* status) const {
+    BatchState state(*this, get_simd_level(), get_vector_math_tolerance());
+    evaluate_rows(columns, 0, n, &out, false, status, state);
+}
+
+void Bytecode::evaluate_parallel(
+    const ExprFloat* const* columns,
+    size_t n,
+    ExprFloat* out,
+    Executor& executor,
+    size_t chunk_rows
+) const {
+    parallel_rows(columns, n, &out, false, nullptr, executor, chunk_rows);
+}
+
+void Bytecode::evaluate_parallel(
+    const ExprFloat* const* columns,
+    size_t n,
+    ExprFloat* const* out,
+    Executor& executor,
+    size_t chunk_rows
+) const {
+    parallel_rows(columns, n, out, true, nullptr, executor, chunk_rows);
+}
+
+void Bytecode::evaluate_parallel(
+    const ExprFloat* const* columns,
+    size_t n,
+    ExprFloat* out,
+    EvalStatus* status,
+    Executor& executor,
+    size_t chunk_rows
+) const {
+    parallel_rows(columns, n, &out, false, status, executor, chunk_rows);
+}
+
+void Bytecode::parallel_rows(
+    const ExprFloat* const* columns,
+    size_t n,
+    ExprFloat* const* out,
+    bool every_output,
+    EvalStatus* status,
+    Executor& executor,
+    size_t chunk_rows
+) const {
+    if (n == 0)
+        return;
+
+    const size_t workers = std::max<size_t>(1, executor.concurrency());
+    if (chunk_rows == 0) {
+        // Keep a chunk's columns and results within 256 KiB, a common L2
+        // size per core, but cut at least 4 chunks per worker so stealing
+        // can even out the load.
+        const size_t row_bytes = (variables_.size() + (every_output ? output_count() : 1)) * sizeof(ExprFloat);
+        chunk_rows = std::min(256 * 1024 / row_bytes, (n + 4 * workers - 1) / (4 * workers));
+    }
+    chunk_rows = std::max<size_t>(1, (chunk_rows + block_size - 1) / block_size) * block_size;
+
+    const SimdLevel level = get_simd_level();
+    const unsigned tolerance = get_vector_math_tolerance();
+    std::vector<std::unique_ptr<BatchState>> states(workers);
+    executor.run((n + chunk_rows - 1) / chunk_rows, [&](size_t chunk, size_t worker) {
+        std::unique_ptr<BatchState>& state = states.at(worker);
+        if (!state)
+            state.reset(new BatchState(*this, level, tolerance));
+        const size_t begin = chunk * chunk_rows;
+        evaluate_rows(columns, begin, std::min(n, begin + chunk_rows), out, every_output, status, *state);
+    });
+}
+
+// Mirrors `Bytecode::run`, except that every stack entry is a block of rows.
+// `regs[i]` points at the values of stack entry `i`: either straight into a
+// caller column or into `blocks`, the scratch block owned by level `i`. The
+// level just above the top doubles as a buffer for gathered operands.
+//
+// Evaluates rows [begin, end); `columns`, `out` and `status` are indexed
+// by row. With `every_output`, `out` has one column per output; otherwise
+// it has one, receiving the value left on the stack (the last statement of
+// a program). Without `status`, errors
+// throw; with it, each row is flagged instead. Anything else that throws
+// (a function's array entry point, a variable resolver) fails the whole
+// block.
+void Bytecode::evaluate_rows(
+    const ExprFloat* const* columns,
+    size_t begin,
+    size_t end,
+    ExprFloat* const* out,
+    bool every_output,
+    EvalStatus* status,
+    BatchState& state
+) const {
+    const Kernels& k = kernels_for(state.simd_level);
+    const unsigned tolerance = state.tolerance;
+    const bool vector_pow = vector_math::pow_max_ulp <= tolerance;
+    const size_t levels = max_depth_ + 1;
+    const size_t out_columns = every_output ? output_count() : 1;
+
+    std::vector<const ExprFloat*>& regs = state.regs;
+    auto block = [&](size_t level) { return state.blocks.data() + level * block_size; };
+    auto temporary = [&](size_t slot) { return block(levels + slot - variables_.size()); };
+    std::vector<ExprFloat>& call_args = state.call_args;
+
+    for (size_t base = begin; base < end; base += block_size) {
+        const size_t len = std::min(block_size, end - base);
+        size_t sp = 0;      // Number of entries on the stack
+        EvalStatus* flags = status ? status + base : nullptr;
+        if (flags)
+            std::fill_n(flags, len, EvalStatus::Ok);
+
+        // Flags the rows dividing by zero, or throws when not reporting.
+        auto zero_divisor = [&](const ExprFloat* rhs) {
+            if (!flags)
+                throw std::runtime_error("Division by zero");
+            for (size_t j = 0; j < len; ++j)
+                if (!rhs || rhs[j] == 0.0)
+                    flags[j] |= EvalStatus::DivisionByZero;
+        };
+
+        // Column of variable `slot` for the current block, gathered into
+        // `level`'s block when the caller did not supply one.
+        auto variable = [&](uint32_t slot, size_t level) -> const ExprFloat* {
+            if (slot >= variables_.size())
+                return temporary(slot);
+            if (columns && columns[slot])
+                return columns[slot] + base;
+            const VariableSource& var = variables_[slot];
+            ExprFloat* dst = block(level);
+            for (size_t j = 0; j < len; ++j)
+                dst[j] = var.context ? var.context->value(var.slot, base + j) : var.node->evaluate();
+            return dst;
+        };
+
+        try {
+            for (const Instruction& ins : instructions()) {
+                switch (ins.op) {
+                    case OpCode::Constant:
+                        std::fill_n(block(sp), len, ins.value);
+                        regs[sp] = block(sp);
+                        ++sp;
+                        break;
+                    case OpCode::Variable:
+                        regs[sp] = variable(ins.arg, sp);
+                        ++sp;
+                        break;
+
+                    case OpCode::Add:
+                    case OpCode::Subtract:
+                    case OpCode::Multiply:
+                    case OpCode::Divide: {
+                        const size_t op = (static_cast<size_t>(ins.op) - static_cast<size_t>(OpCode::Add)) / 3;
+                        const ExprFloat* rhs = regs[sp - 1];
+                        if (ins.op == OpCode::Divide && any_zero(rhs, len))
+                            zero_divisor(rhs);
+                        --sp;
+                        k.vv[op](block(sp - 1), regs[sp - 1], rhs, len);
+                        regs[sp - 1] = block(sp - 1);
+                        break;
+                    }
+                    case OpCode::AddVariable:
+                    case OpCode::SubtractVariable:
+                    case OpCode::MultiplyVariable:
+                    case OpCode::DivideVariable: {
+                        const size_t op = (static_cast<size_t>(ins.op) - static_cast<size_t>(OpCode::Add)) / 3;
+                        const ExprFloat* rhs = variable(ins.arg, sp);
+                        if (ins.op == OpCode::DivideVariable && any_zero(rhs, len))
+                            zero_divisor(rhs);
+                        k.vv[op](block(sp - 1), regs[sp - 1], rhs, len);
+                        regs[sp - 1] = block(sp - 1);
+                        break;
+                    }
+                    case OpCode::AddConstant:
+                    case OpCode::SubtractConstant:
+                    case OpCode::MultiplyConstant:
+                    case OpCode::DivideConstant: {
+                        const size_t op = (static_cast<size_t>(ins.op) - static_cast<size_t>(OpCode::Add)) / 3;
+                        if (ins.op == OpCode::DivideConstant && ins.value == 0.0)
+                            zero_divisor(nullptr);
+                        k.vs[op](block(sp - 1), regs[sp - 1], ins.value, len);
+                        regs[sp - 1] = block(sp - 1);
+                        break;
+                    }
+
+                    case OpCode::Modulo:
+                    case OpCode::ModuloConstant:
+                    case OpCode::ModuloVariable:
+                    case OpCode::Power:
+                    case OpCode::PowerConstant:
+                    case OpCode::PowerVariable: {
+                        // No vector form; same scalar operation as the other engines.
+                        const bool power = ins.op >= OpCode::Power;
+                        const ExprFloat* rhs = nullptr;
+                        ExprFloat scalar = ins.value;
+                        if (ins.op == OpCode::Modulo || ins.op == OpCode::Power)
+                            rhs = regs[--sp];
+                        else if (ins.op == OpCode::ModuloVariable || ins.op == OpCode::PowerVariable)
+                            rhs = variable(ins.arg, sp);
+
+                        const ExprFloat* lhs = regs[sp - 1];
+                        ExprFloat* dst = block(sp - 1);
+                        if (!power && !flags && (rhs ? any_truncated_zero(rhs, len) : truncates_to_zero(scalar)))
+                            throw std::runtime_error("Division by zero");
+                        if (power && vector_pow) {
+                            if (!rhs) {
+                                std::fill_n(block(sp), len, scalar);
+                                rhs = block(sp);
+                            }
+                            vector_math::pow(lhs, rhs, dst, len);
+                            regs[sp - 1] = dst;
+                            break;
+                        }
+                        for (size_t j = 0; j < len; ++j) {
+                            const ExprFloat r = rhs ? rhs[j] : scalar;
+                            if (power)
+                                dst[j] = std::pow(lhs[j], r);
+                            else
+                                dst[j] = flags ? modulo(lhs[j], r, flags[j]) : modulo(lhs[j], r);
+                        }
+                        regs[sp - 1] = dst;
+                        break;
+                    }
+
+                    case OpCode::Negate: {
+                        const ExprFloat* src = regs[sp - 1];
+                        ExprFloat* dst = block(sp - 1);
+                        for (size_t j = 0; j < len; ++j)
+                            dst[j] = -src[j];
+                        regs[sp - 1] = dst;
+                        break;
+                    }
+
+                    case OpCode::CallUnary: {
+                        const FunctionEntry& fn = *functions_[ins.arg];
+                        const ExprFloat* src = regs[sp - 1];
+                        ExprFloat* dst = block(sp - 1);
+                        if (fn.unary_array && fn.array_max_ulp <= tolerance) {
+                            fn.unary_array(src, dst, len);
+                        } else {
+                            call_rows(dst, len, flags, [&](size_t j) { return fn.unary(src[j]); });
+                        }
+                        regs[sp - 1] = dst;
+                        break;
+                    }
+                    case OpCode::CallBinary: {
+                        const FunctionEntry& fn = *functions_[ins.arg];
+                        const ExprFloat* rhs = regs[--sp];
+                        const ExprFloat* lhs = regs[sp - 1];
+                        ExprFloat* dst = block(sp - 1);
+                        if (fn.binary_array && fn.array_max_ulp <= tolerance) {
+                            fn.binary_array(lhs, rhs, dst, len);
+                        } else {
+                            call_rows(dst, len, flags, [&](size_t j) { return fn.binary(lhs[j], rhs[j]); });
+                        }
+                        regs[sp - 1] = dst;
+                        break;
+                    }
+                    case OpCode::Call: {
+                        const FunctionEntry& fn = *functions_[ins.arg];
+                        sp -= ins.count;
+                        call_args.resize(ins.count);
+                        ExprFloat* dst = block(sp);
+                        call_rows(dst, len, flags, [&](size_t j) {
+                            for (size_t a = 0; a < ins.count; ++a)
+                                call_args[a] = regs[sp + a][j];
+                            return ins.count == fn.nargs ? fn.call(call_args.data()) : fn.invalid_call(ins.count);
+                        });
+                        regs[sp++] = dst;
+                        break;
+                    }
+                    case OpCode::Store:
+                        std::copy_n(regs[sp - 1], len, temporary(ins.arg));
+                        break;
+                    case OpCode::StorePop:
+                        std::copy_n(regs[--sp], len, temporary(ins.arg));
+                        break;
+
+                    case OpCode::MultiplyAdd: {
+                        sp -= 2;
+                        k.fma_vvv(block(sp - 1), regs[sp - 1], regs[sp], regs[sp + 1], len);
+                        regs[sp - 1] = block(sp - 1);
+                        break;
+                    }
+                    case OpCode::MultiplyConstantAdd:
+                        --sp;
+                        k.fma_vsv(block(sp - 1), regs[sp], ins.value, regs[sp - 1], len);
+                        regs[sp - 1] = block(sp - 1);
+                        break;
+                    case OpCode::MultiplyVariableAddConstant:
+                        k.fma_vvs(block(sp - 1), regs[sp - 1], variable(ins.arg, sp), ins.value, len);
+                        regs[sp - 1] = block(sp - 1);
+                        break;
+                }
+            }
+        } catch (...) {
+            if (!flags)
+                throw;
+            for (size_t i = 0; i < out_columns; ++i)
+                std::fill_n(out[i] + base, len, std::numeric_limits<ExprFloat>::quiet_NaN());
+            std::fill_n(flags, len, EvalStatus::FunctionError | EvalStatus::NotFinite);
+            continue;
+        }
+
+        if (!every_output || outputs_.empty()) {
+            std::copy_n(regs[0], len, out[0] + base);
+        } else {
+            for (size_t i = 0; i < outputs_.size(); ++i)
+                std::copy_n(temporary(outputs_[i]), len, out[i] + base);
+        }
+        if (flags) {
+            for (size_t i = 0; i < out_columns; ++i) {
+                if (!any_not_finite(out[i] + base, len))
+                    continue;
+                for (size_t j = 0; j < len; ++j)
+                    if (!std::isfinite(out[i][base + j]))
+                        flags[j] |= EvalStatus::NotFinite;
+            }
+        }
+    }
+}
+
+}   // namespace cppexprpars
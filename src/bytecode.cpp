@@ -0,0 +1,643 @@
+//  bytecode.cpp - Lightweight C++ Expression Parser (Bytecode Engine)
+//
+//  This file lowers parsed expression trees into flat postfix bytecode and
+//  implements the stack machine that evaluates it.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+#include "cppexprpars.hpp"
+#include "scratch.hpp"
+
+
+namespace cppexprpars {
+
+// Opcode of the stack form of `op`; the constant and variable forms follow
+// it directly in `OpCode`.
+static OpCode binary_opcode(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::Add:      return OpCode::Add;
+        case BinaryOp::Subtract: return OpCode::Subtract;
+        case BinaryOp::Multiply: return OpCode::Multiply;
+        case BinaryOp::Divide:   return OpCode::Divide;
+        case BinaryOp::Modulo:   return OpCode::Modulo;
+        case BinaryOp::Power:    return OpCode::Power;
+        default:
+            throw std::runtime_error("Unknown binary operation");
+    }
+}
+
+static inline OpCode operand_form(OpCode op, int form) {
+    return static_cast<OpCode>(static_cast<uint8_t>(op) + form);
+}
+
+namespace {
+
+// How `Bytecode::interpret` divides. `Checked` throws on a zero divisor (a
+// divisor of `%` that truncates to zero included, which would otherwise
+// trap); `Reported` follows IEEE arithmetic and flags the status instead.
+struct Checked {
+    inline ExprFloat divide(ExprFloat lhs, ExprFloat rhs) {
+        if (rhs == 0.0) throw std::runtime_error("Division by zero");
+        return lhs / rhs;
+    }
+
+    inline ExprFloat modulo(ExprFloat lhs, ExprFloat rhs) {
+        if (rhs == 0.0 || (ExprInt)rhs == 0) throw std::runtime_error("Division by zero");
+        return (ExprFloat)((ExprInt)lhs % (ExprInt)rhs);
+    }
+};
+
+struct Reported {
+    EvalStatus& status;
+
+    inline ExprFloat divide(ExprFloat lhs, ExprFloat rhs) {
+        if (rhs == 0.0) status |= EvalStatus::DivisionByZero;
+        return lhs / rhs;
+    }
+
+    // Operands that do not convert to an integer give NaN as well.
+    inline ExprFloat modulo(ExprFloat lhs, ExprFloat rhs) {
+        if (!std::isfinite(lhs) || !std::isfinite(rhs))
+            return std::numeric_limits<ExprFloat>::quiet_NaN();
+        if ((ExprInt)rhs == 0) {
+            status |= EvalStatus::DivisionByZero;
+            return std::numeric_limits<ExprFloat>::quiet_NaN();
+        }
+        return (ExprFloat)((ExprInt)lhs % (ExprInt)rhs);
+    }
+};
+
+}   // namespace
+
+// Whether `func` calls the built-in `fma`, which has instructions of its own.
+static bool is_builtin_fma(const FuncExprNode& func) {
+    using Fma = ExprFloat (*)(const ExprFloat*, size_t);
+    static const Fma builtin = *FunctionRegistry::default_registry().find_function("fma")->args_fn.target<Fma>();
+    const Fma* fn = func.function()->args_fn.target<Fma>();
+    return fn && *fn == builtin && func.arity_matches();
+}
+
+
+
+// State of one lowering: the slot of each variable name and, when sharing
+// subexpressions, the hash-consed DAG of the tree. Every tree node maps to
+// the id of its structural class; `uses` counts the references to each id
+// from other DAG nodes, so a subtree repeated inside a shared subtree is
+// only counted once.
+//
+// In a program, variables of `locals` are the values of earlier statements,
+// held in the slots from `first_local` on.
+struct Bytecode::Lowering {
+    std::unordered_map<std::string, uint32_t> slots;
+    const EvaluationContext*                  locals      = nullptr;
+    uint32_t                                  first_local = 0;
+
+    bool                                          share = false;
+    std::unordered_map<std::string, uint32_t>     dag;
+    std::unordered_map<const ExprNode*, uint32_t> ids;
+    std::vector<uint32_t>                         uses;
+    std::vector<uint32_t>                         temporaries;    // Slot + 1 once computed
+    size_t                                        nodes = 0;
+    uint32_t                                      next_temporary = 0;
+
+    uint32_t intern(const ExprNode& node);
+
+    inline bool is_shared(const ExprNode& node) const {
+        if (!share || node.type() == ExprNodeType::Constant || node.type() == ExprNodeType::Variable)
+            return false;
+        return uses[ids.at(&node)] > 1;
+    }
+
+    // Slot of the temporary already holding `node`'s value, if any.
+    inline bool stored(const ExprNode& node, uint32_t& slot) const {
+        if (!is_shared(node))
+            return false;
+        const uint32_t temporary = temporaries[ids.at(&node)];
+        slot = temporary - 1;
+        return temporary != 0;
+    }
+};
+
+// Interns `node` and its subtrees, returning its DAG id. Two nodes share an
+// id when they have the same kind and payload and their children share ids.
+uint32_t Bytecode::Lowering::intern(const ExprNode& node) {
+    ++nodes;
+
+    std::string key(1, static_cast<char>(node.type()));
+    auto append = [&key](const void* data, size_t size) {
+        key.append(static_cast<const char*>(data), size);
+    };
+    auto append_self = [&] {
+        const ExprNode* self = &node;
+        append(&self, sizeof self);
+    };
+
+    std::vector<uint32_t> children;
+    switch (node.type()) {
+        case ExprNodeType::Constant: {
+            const ExprFloat value = static_cast<const ConstantExprNode&>(node).value();
+            append(&value, sizeof value);
+            break;
+        }
+        case ExprNodeType::Variable: {
+            const auto& var = static_cast<const VariableExprNode&>(node);
+            if (var.context()) {
+                const EvaluationContext* context = var.context();
+                const size_t slot = var.slot();
+                append(&context, sizeof context);
+                append(&slot, sizeof slot);
+            } else {
+                append_self();      // A custom resolver may not be pure
+            }
+            break;
+        }
+        case ExprNodeType::Unary: {
+            const auto& unary = static_cast<const UnaryExprNode&>(node);
+            const UnaryOp op = unary.op();
+            append(&op, sizeof op);
+            children.push_back(intern(unary.operand()));
+            break;
+        }
+        case ExprNodeType::Binary: {
+            const auto& binary = static_cast<const BinaryExprNode&>(node);
+            const BinaryOp op = binary.op();
+            append(&op, sizeof op);
+            children.push_back(intern(binary.left()));
+            children.push_back(intern(binary.right()));
+            break;
+        }
+        case ExprNodeType::Function: {
+            const auto& func = static_cast<const FuncExprNode&>(node);
+            const FunctionEntry* fn = func.function().get();
+            append(&fn, sizeof fn);
+            if (!fn->pure || !func.arity_matches())
+                append_self();
+            for (const ExprNodePtr& arg : func.args())
+                children.push_back(intern(*arg));
+            break;
+        }
+    }
+    for (uint32_t child : children)
+        append(&child, sizeof child);
+
+    auto inserted = dag.emplace(std::move(key), static_cast<uint32_t>(uses.size()));
+    const uint32_t id = inserted.first->second;
+    if (inserted.second) {
+        uses.push_back(0);
+        for (uint32_t child : children)
+            ++uses[child];
+    }
+    ids[&node] = id;
+    return id;
+}
+
+Bytecode Bytecode::compile(const ExprNode& root, bool share_subexpressions) {
+    Bytecode bytecode;
+    Lowering state;
+    if (share_subexpressions) {
+        state.share = true;
+        state.intern(root);
+        state.temporaries.assign(state.uses.size(), 0);
+        bytecode.deduplicated_ = state.nodes - state.uses.size();
+
+        // Temporaries go after the variables, so all variable slots must be
+        // known before the first one is handed out.
+        bytecode.collect_variables(root, state);
+        state.next_temporary = static_cast<uint32_t>(bytecode.variables_.size());
+    }
+    bytecode.lower(root, 0, state);
+    bytecode.temporaries_ = state.next_temporary ? state.next_temporary - bytecode.variables_.size() : 0;
+    bytecode.compute_layout_id();
+    return bytecode;
+}
+
+// The value of statement `i` is stored to slot `first_local + i`, right
+// after the variables; shared subexpressions follow. A root repeated across
+// statements counts as a use, so it is computed once as well.
+Bytecode Bytecode::compile(
+    const std::vector<Statement>& statements,
+    const EvaluationContext* locals,
+    bool share_subexpressions
+) {
+    Bytecode bytecode;
+    Lowering state;
+    state.locals = locals;
+    if (share_subexpressions) {
+        state.share = true;
+        for (const Statement& statement : statements)
+            ++state.uses[state.intern(*statement.expression)];
+        state.temporaries.assign(state.uses.size(), 0);
+        bytecode.deduplicated_ = state.nodes - state.uses.size();
+    }
+
+    for (const Statement& statement : statements)
+        bytecode.collect_variables(*statement.expression, state);
+    state.first_local    = static_cast<uint32_t>(bytecode.variables_.size());
+    state.next_temporary = static_cast<uint32_t>(state.first_local + statements.size());
+
+    // Every statement but the last moves its value off the stack into its
+    // slot, so all of them start from an empty stack. The last one keeps
+    // its value on top, which is what the program returns.
+    for (size_t i = 0; i < statements.size(); ++i) {
+        const uint32_t slot = static_cast<uint32_t>(state.first_local + i);
+        const bool last = i + 1 == statements.size();
+        bytecode.lower(*statements[i].expression, 0, state);
+        bytecode.code_.emplace_back(last ? OpCode::Store : OpCode::StorePop, slot);
+        if (statements[i].output)
+            bytecode.outputs_.push_back(slot);
+    }
+    bytecode.temporaries_ = state.next_temporary - bytecode.variables_.size();
+    bytecode.compute_layout_id();
+    return bytecode;
+}
+
+void Bytecode::compute_layout_id() {
+    for (const VariableSource& var : variables_) {
+        const uint64_t id = var.context ? var.context->layout_id() : 0;
+        if (&var == &variables_.front())
+            layout_id_ = id;
+        else if (id != layout_id_)
+            layout_id_ = 0;
+    }
+}
+
+uint32_t Bytecode::variable_slot(const VariableExprNode& var, Lowering& state) {
+    if (state.locals && var.context() == state.locals)
+        return static_cast<uint32_t>(state.first_local + var.slot());
+    auto it = state.slots.find(var.name());
+    if (it == state.slots.end()) {
+        it = state.slots.emplace(var.name(), static_cast<uint32_t>(variables_.size())).first;
+        variables_.push_back({var.context(), var.slot(), &var});
+        variable_names_.push_back(var.name());
+    }
+    return it->second;
+}
+
+// Assigns variable slots in the same order as `lower` would.
+void Bytecode::collect_variables(const ExprNode& node, Lowering& state) {
+    switch (node.type()) {
+        case ExprNodeType::Variable:
+            variable_slot(static_cast<const VariableExprNode&>(node), state);
+            break;
+        case ExprNodeType::Unary:
+            collect_variables(static_cast<const UnaryExprNode&>(node).operand(), state);
+            break;
+        case ExprNodeType::Binary: {
+            const auto& binary = static_cast<const BinaryExprNode&>(node);
+            collect_variables(binary.left(), state);
+            collect_variables(binary.right(), state);
+            break;
+        }
+        case ExprNodeType::Function:
+            for (const ExprNodePtr& arg : static_cast<const FuncExprNode&>(node).args())
+                collect_variables(*arg, state);
+            break;
+        default:
+            break;
+    }
+}
+
+void Bytecode::lower(const ExprNode& node, size_t depth, Lowering& state) {
+    uint32_t temporary;
+    if (state.stored(node, temporary)) {
+        code_.emplace_back(OpCode::Variable, temporary);
+        max_depth_ = std::max(max_depth_, depth + 1);
+        return;
+    }
+
+    switch (node.type()) {
+        case ExprNodeType::Constant:
+            code_.emplace_back(OpCode::Constant, 0, 0, static_cast<const ConstantExprNode&>(node).value());
+            break;
+
+        case ExprNodeType::Variable:
+            code_.emplace_back(OpCode::Variable, variable_slot(static_cast<const VariableExprNode&>(node), state));
+            break;
+
+        case ExprNodeType::Unary: {
+            const auto& unary = static_cast<const UnaryExprNode&>(node);
+            lower(unary.operand(), depth, state);
+            if (unary.op() == UnaryOp::Minus)
+                code_.emplace_back(OpCode::Negate);
+            break;
+        }
+
+        case ExprNodeType::Binary: {
+            const auto& binary = static_cast<const BinaryExprNode&>(node);
+            const ExprNode& rhs = binary.right();
+            OpCode op = binary_opcode(binary.op());
+
+            lower(binary.left(), depth, state);
+            if (rhs.type() == ExprNodeType::Constant) {
+                code_.emplace_back(operand_form(op, 1), 0, 0, static_cast<const ConstantExprNode&>(rhs).value());
+            } else if (rhs.type() == ExprNodeType::Variable) {
+                code_.emplace_back(operand_form(op, 2), variable_slot(static_cast<const VariableExprNode&>(rhs), state));
+            } else if (state.stored(rhs, temporary)) {
+                code_.emplace_back(operand_form(op, 2), temporary);
+            } else {
+                lower(rhs, depth + 1, state);
+                code_.emplace_back(op);
+            }
+            break;
+        }
+
+        case ExprNodeType::Function: {
+            const auto& func = static_cast<const FuncExprNode&>(node);
+            const auto& args = func.args();
+            if (is_builtin_fma(func)) {
+                // The product is exact before rounding, so the factors can
+                // be swapped to fold a variable or a constant into the
+                // instruction. With a constant factor the addend is computed
+                // first, so only it has to be spilled.
+                const ExprNode* a = args[0].get();
+                const ExprNode* b = args[1].get();
+                const ExprNode* c = args[2].get();
+                if (c->type() == ExprNodeType::Constant) {
+                    if (a->type() == ExprNodeType::Variable && b->type() != ExprNodeType::Variable)
+                        std::swap(a, b);
+                    if (b->type() == ExprNodeType::Variable) {
+                        lower(*a, depth, state);
+                        code_.emplace_back(
+                            OpCode::MultiplyVariableAddConstant,
+                            variable_slot(static_cast<const VariableExprNode&>(*b), state),
+                            0,
+                            static_cast<const ConstantExprNode&>(*c).value()
+                        );
+                        break;
+                    }
+                } else {
+                    if (a->type() == ExprNodeType::Constant)
+                        std::swap(a, b);
+                    if (b->type() == ExprNodeType::Constant) {
+                        lower(*c, depth, state);
+                        lower(*a, depth + 1, state);
+                        code_.emplace_back(OpCode::MultiplyConstantAdd, 0, 0, static_cast<const ConstantExprNode&>(*b).value());
+                        break;
+                    }
+                }
+                lower(*a, depth, state);
+                lower(*b, depth + 1, state);
+                lower(*c, depth + 2, state);
+                code_.emplace_back(OpCode::MultiplyAdd);
+                break;
+            }
+            if (args.size() > std::numeric_limits<uint16_t>::max())
+                throw std::runtime_error("Too many arguments to function " + func.name());
+            for (size_t i = 0; i < args.size(); ++i)
+                lower(*args[i], depth + i, state);
+
+            OpCode op = OpCode::Call;
+            if (func.arity_matches() && func.function()->unary)
+                op = OpCode::CallUnary;
+            else if (func.arity_matches() && func.function()->binary)
+                op = OpCode::CallBinary;
+
+            code_.emplace_back(op, static_cast<uint32_t>(functions_.size()), static_cast<uint16_t>(args.size()));
+            functions_.push_back(func.function());
+            max_depth_ = std::max(max_depth_, depth + args.size());
+            break;
+        }
+
+        default:
+            throw std::runtime_error("Unknown expression node");
+    }
+
+    if (state.is_shared(node)) {
+        temporary = state.next_temporary++;
+        state.temporaries[state.ids.at(&node)] = temporary + 1;
+        code_.emplace_back(OpCode::Store, temporary);
+    }
+
+    max_depth_ = std::max(max_depth_, depth + 1);
+}
+
+// One buffer holds the gathered variables, the temporaries and the
+// evaluation stack.
+ExprFloat Bytecode::evaluate(size_t row) const {
+    const size_t frame_size = variables_.size() + temporaries_;
+    ScratchBuffer<48> scratch(frame_size + max_depth_ + 1);
+    ExprFloat* vars = scratch.data();
+    for (size_t i = 0; i < variables_.size(); ++i) {
+        const VariableSource& var = variables_[i];
+        vars[i] = var.context ? var.context->value(var.slot, row) : var.node->evaluate();
+    }
+    return run(vars, vars + frame_size);
+}
+
+ExprFloat Bytecode::evaluate(const EvaluationContext& context, size_t row) const {
+    if (!variables_.empty() && (layout_id_ == 0 || context.layout_id() != layout_id_))
+        throw std::runtime_error("Context does not share the variable layout the expression was compiled against");
+
+    const size_t frame_size = variables_.size() + temporaries_;
+    ScratchBuffer<48> scratch(frame_size + max_depth_ + 1);
+    ExprFloat* vars = scratch.data();
+    for (size_t i = 0; i < variables_.size(); ++i)
+        vars[i] = context.value(variables_[i].slot, row);
+    return run(vars, vars + frame_size);
+}
+
+void Bytecode::evaluate_outputs(ExprFloat* out, size_t row) const {
+    const size_t frame_size = variables_.size() + temporaries_;
+    ScratchBuffer<48> scratch(frame_size + max_depth_ + 1);
+    ExprFloat* vars = scratch.data();
+    for (size_t i = 0; i < variables_.size(); ++i) {
+        const VariableSource& var = variables_[i];
+        vars[i] = var.context ? var.context->value(var.slot, row) : var.node->evaluate();
+    }
+    const ExprFloat value = run(vars, vars + frame_size);
+    if (outputs_.empty())
+        out[0] = value;
+    for (size_t i = 0; i < outputs_.size(); ++i)
+        out[i] = vars[outputs_[i]];
+}
+
+void Bytecode::execute(const ExprFloat* vars, ExprFloat* out) const {
+    if (outputs_.empty()) {
+        out[0] = execute(vars);
+        return;
+    }
+
+    const size_t frame_size = variables_.size() + temporaries_;
+    ScratchBuffer<48> scratch(frame_size + max_depth_ + 1);
+    std::copy_n(vars, variables_.size(), scratch.data());
+    run(scratch.data(), scratch.data() + frame_size);
+    for (size_t i = 0; i < outputs_.size(); ++i)
+        out[i] = scratch.data()[outputs_[i]];
+}
+
+ExprFloat Bytecode::execute(const ExprFloat* vars) const {
+    if (temporaries_ == 0) {
+        // Without temporaries nothing is ever written to the frame.
+        ScratchBuffer<32> stack(max_depth_ + 1);
+        return run(const_cast<ExprFloat*>(vars), stack.data());
+    }
+
+    const size_t frame_size = variables_.size() + temporaries_;
+    ScratchBuffer<48> scratch(frame_size + max_depth_ + 1);
+    std::copy_n(vars, variables_.size(), scratch.data());
+    return run(scratch.data(), scratch.data() + frame_size);
+}
+
+ExprFloat Bytecode::evaluate(size_t row, EvalStatus& status) const noexcept {
+    try {
+        const size_t frame_size = variables_.size() + temporaries_;
+        ScratchBuffer<48> scratch(frame_size + max_depth_ + 1);
+        ExprFloat* vars = scratch.data();
+        for (size_t i = 0; i < variables_.size(); ++i) {
+            const VariableSource& var = variables_[i];
+            vars[i] = var.context ? var.context->value(var.slot, row) : var.node->evaluate();
+        }
+        return run(vars, vars + frame_size, status);
+    } catch (...) {
+        status = EvalStatus::FunctionError | EvalStatus::NotFinite;
+        return std::numeric_limits<ExprFloat>::quiet_NaN();
+    }
+}
+
+ExprFloat Bytecode::execute(const ExprFloat* vars, EvalStatus& status) const noexcept {
+    try {
+        if (temporaries_ == 0) {
+            ScratchBuffer<32> stack(max_depth_ + 1);
+            return run(const_cast<ExprFloat*>(vars), stack.data(), status);
+        }
+
+        const size_t frame_size = variables_.size() + temporaries_;
+        ScratchBuffer<48> scratch(frame_size + max_depth_ + 1);
+        std::copy_n(vars, variables_.size(), scratch.data());
+        return run(scratch.data(), scratch.data() + frame_size, status);
+    } catch (...) {
+        status = EvalStatus::FunctionError | EvalStatus::NotFinite;
+        return std::numeric_limits<ExprFloat>::quiet_NaN();
+    }
+}
+
+// The top of the stack is kept in `acc`, so most instructions never touch
+// memory; `stack` only holds the values underneath it. The very first push
+// spills an uninitialised `acc`, which is why the stack needs one entry more
+// than the program's depth.
+//
+// `vars` is the frame: variable slots followed by temporary slots.
+template <typename Arithmetic>
+ExprFloat Bytecode::interpret(ExprFloat* vars, ExprFloat* stack, Arithmetic& arithmetic) const {
+    ExprFloat* sp = stack;      // One past the value underneath `acc`
+    ExprFloat acc = 0.0;
+
+#define CPPEXPRPARS_BINARY_CASES(NAME, EXPR)                                            \
+            case OpCode::NAME:           { ExprFloat lhs = *--sp, rhs = acc;            acc = (EXPR); break; } \
+            case OpCode::NAME##Constant: { ExprFloat lhs = acc,   rhs = ins.value;       acc = (EXPR); break; } \
+            case OpCode::NAME##Variable: { ExprFloat lhs = acc,   rhs = vars[ins.arg];   acc = (EXPR); break; }
+
+    for (const Instruction& ins : instructions()) {
+        switch (ins.op) {
+            case OpCode::Constant:
+                *sp++ = acc;
+                acc = ins.value;
+                break;
+            case OpCode::Variable:
+                *sp++ = acc;
+                acc = vars[ins.arg];
+                break;
+
+            CPPEXPRPARS_BINARY_CASES(Add,      lhs + rhs)
+            CPPEXPRPARS_BINARY_CASES(Subtract, lhs - rhs)
+            CPPEXPRPARS_BINARY_CASES(Multiply, lhs * rhs)
+            CPPEXPRPARS_BINARY_CASES(Divide,   arithmetic.divide(lhs, rhs))
+            CPPEXPRPARS_BINARY_CASES(Modulo,   arithmetic.modulo(lhs, rhs))
+            CPPEXPRPARS_BINARY_CASES(Power,    std::pow(lhs, rhs))
+
+            case OpCode::Negate:
+                acc = -acc;
+                break;
+            case OpCode::CallUnary:
+                acc = functions_[ins.arg]->unary(acc);
+                break;
+            case OpCode::CallBinary: {
+                ExprFloat lhs = *--sp;
+                acc = functions_[ins.arg]->binary(lhs, acc);
+                break;
+            }
+            case OpCode::Call: {
+                // Arguments are already contiguous on the stack once the
+                // accumulator is spilled, so they are passed in place.
+                const FunctionEntry& fn = *functions_[ins.arg];
+                *sp++ = acc;
+                sp -= ins.count;
+                acc = ins.count == fn.nargs ? fn.call(sp) : fn.invalid_call(ins.count);
+                break;
+            }
+            case OpCode::Store:
+                vars[ins.arg] = acc;
+                break;
+            case OpCode::StorePop:
+                vars[ins.arg] = acc;
+                acc = *--sp;
+                break;
+            case OpCode::MultiplyAdd: {
+                ExprFloat b = *--sp;
+                ExprFloat a = *--sp;
+                acc = std::fma(a, b, acc);
+                break;
+            }
+            case OpCode::MultiplyConstantAdd:
+                acc = std::fma(acc, ins.value, *--sp);
+                break;
+            case OpCode::MultiplyVariableAddConstant:
+                acc = std::fma(acc, vars[ins.arg], ins.value);
+                break;
+        }
+    }
+
+#undef CPPEXPRPARS_BINARY_CASES
+
+    return acc;
+}
+
+ExprFloat Bytecode::run(ExprFloat* vars, ExprFloat* stack) const {
+    Checked arithmetic;
+    return interpret(vars, stack, arithmetic);
+}
+
+// A function that throws abandons the evaluation, so the whole result is
+// NaN rather than just that call's.
+ExprFloat Bytecode::run(ExprFloat* vars, ExprFloat* stack, EvalStatus& status) const noexcept {
+    status = EvalStatus::Ok;
+    ExprFloat value;
+    try {
+        Reported arithmetic{status};
+        value = interpret(vars, stack, arithmetic);
+    } catch (...) {
+        status |= EvalStatus::FunctionError;
+        value = std::numeric_limits<ExprFloat>::quiet_NaN();
+    }
+    if (!std::isfinite(value))
+        status |= EvalStatus::NotFinite;
+    return value;
+}
+
+}   // namespace cppexprpars
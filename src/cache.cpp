@@ -0,0 +1,187 @@
+//  cache.cpp - Lightweight C++ Expression Parser (Expression Cache)
+//
+//  This file implements the concurrent cache of compiled expressions shared
+//  between threads.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+#include "cppexprpars.hpp"
+#include <atomic>
+#include <list>
+#include <mutex>
+
+
+namespace cppexprpars {
+
+namespace {
+
+// A compiled expression together with the context its variables were
+// resolved against, kept alive by the pointers handed out for it.
+struct CachedExpression {
+    EvaluationContext context;
+    CompiledExpr      compiled;
+};
+
+inline bool is_word_char(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_' || ch == '.';
+}
+
+inline bool is_blank(char ch) {
+    return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+// Drops whitespace, except a single space where it separates two words
+// (`1 2` must not become `12`), so formatting differences share an entry.
+void normalize(StringView expression, std::string& out) {
+    out.reserve(expression.size() + 16);
+    bool pending_space = false;
+    for (char ch : expression) {
+        if (is_blank(ch)) {
+            pending_space = true;
+            continue;
+        }
+        if (pending_space && !out.empty() && is_word_char(out.back()) && is_word_char(ch))
+            out += ' ';
+        pending_space = false;
+        out += ch;
+    }
+}
+
+}   // namespace
+
+struct ExpressionCache::Shard {
+    using Entry = std::pair<std::string, std::shared_ptr<const CompiledExpr>>;
+
+    std::mutex                                                  mutex;
+    std::list<Entry>                                            lru;    // Most recent first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t                                                      capacity = 0;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+};
+
+ExpressionCache::ExpressionCache(size_t capacity, size_t shards) :
+    capacity_(capacity),
+    shard_count_(std::max<size_t>(1, std::min(shards, capacity))),
+    shards_(new Shard[shard_count_]) {
+    // Spread the capacity so the shards add up to exactly `capacity`
+    for (size_t i = 0; i < shard_count_; ++i)
+        shards_[i].capacity = capacity / shard_count_ + (i < capacity % shard_count_ ? 1 : 0);
+}
+
+ExpressionCache::~ExpressionCache() = default;
+
+ExpressionCache& ExpressionCache::global() {
+    static ExpressionCache cache;
+    return cache;
+}
+
+std::shared_ptr<const CompiledExpr> ExpressionCache::get(
+    StringView expression,
+    const FunctionRegistry& registry,
+    const CompileOptions& options
+) {
+    std::string key;
+    normalize(expression, key);
+    const uint64_t revision = registry.revision();
+    key += '\0';
+    key.append(reinterpret_cast<const char*>(&revision), sizeof revision);
+    key += static_cast<char>(options.optimization);
+    key += static_cast<char>(options.share_subexpressions);
+
+    Shard& shard = shards_[std::hash<std::string>()(key) % shard_count_];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            shard.hits.fetch_add(1, std::memory_order_relaxed);
+            return it->second->second;
+        }
+    }
+    shard.misses.fetch_add(1, std::memory_order_relaxed);
+
+    // Compile without holding the lock; if another thread got there first,
+    // its entry wins and this one is dropped. The variables are the
+    // identifiers not followed by an opening parenthesis.
+    auto owned = std::make_shared<CachedExpression>();
+    for (Tokenizer tokenizer(expression); tokenizer.current().type != TokenType::End;) {
+        const Token token = tokenizer.current();
+        tokenizer.next_token();
+        if (token.type == TokenType::Identifier && tokenizer.current().type != TokenType::LeftParen)
+            owned->context.set_variable(token.text.to_string(), std::numeric_limits<ExprFloat>::quiet_NaN());
+    }
+    Parser parser(Tokenizer(expression), &owned->context, &registry);
+    owned->compiled = parser.compile(options);
+    std::shared_ptr<const CompiledExpr> compiled(owned, &owned->compiled);
+
+    if (shard.capacity == 0)
+        return compiled;
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return it->second->second;
+    }
+    if (shard.lru.size() >= shard.capacity) {
+        shard.index.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+        shard.evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    shard.lru.emplace_front(key, compiled);
+    shard.index.emplace(std::move(key), shard.lru.begin());
+    return compiled;
+}
+
+CacheStats ExpressionCache::stats() const {
+    CacheStats stats;
+    for (size_t i = 0; i < shard_count_; ++i) {
+        Shard& shard = shards_[i];
+        stats.hits      += shard.hits.load(std::memory_order_relaxed);
+        stats.misses    += shard.misses.load(std::memory_order_relaxed);
+        stats.evictions += shard.evictions.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.size += shard.lru.size();
+    }
+    return stats;
+}
+
+void ExpressionCache::clear() {
+    for (size_t i = 0; i < shard_count_; ++i) {
+        Shard& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.index.clear();
+        shard.lru.clear();
+    }
+}
+
+}   // namespace cppexprpars
@@ -32,74 +32,168 @@
 
 
 #include "cppexprpars.hpp"
+#include "profile.hpp"
+#include <deque>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
 
 
 namespace cppexprpars {
 
-static FunctionRegistry default_registry_ = FunctionRegistry::default_registry();
+namespace {
+
+// Readers load the current snapshot without locking. Replaced snapshots are
+// kept, since trees built against them may still point at them.
+template <typename T>
+class DefaultSnapshot {
+public:
+    explicit DefaultSnapshot(const T* initial) : current_(initial) {}
+
+    inline const T* get() const {
+        return current_.load(std::memory_order_acquire);
+    }
+
+    void set(const T& value) {
+        std::unique_ptr<const T> snapshot(new T(value));
+        std::lock_guard<std::mutex> lock(mutex_);
+        snapshots_.push_back(std::move(snapshot));
+        current_.store(snapshots_.back().get(), std::memory_order_release);
+    }
+
+private:
+    std::atomic<const T*>                 current_;
+    std::mutex                            mutex_;
+    std::vector<std::unique_ptr<const T>> snapshots_;
+};
+
+DefaultSnapshot<FunctionRegistry>& default_registry_snapshot() {
+    static const FunctionRegistry builtin = FunctionRegistry::default_registry();
+    static DefaultSnapshot<FunctionRegistry> snapshot(&builtin);
+    return snapshot;
+}
+
+DefaultSnapshot<EvaluationContext>& default_context_snapshot() {
+    static DefaultSnapshot<EvaluationContext> snapshot(&EvaluationContext::default_context());
+    return snapshot;
+}
+
+}   // namespace
 
 void set_default_registry(const FunctionRegistry* registry) {
-    default_registry_ = *registry;
+    default_registry_snapshot().set(*registry);
 }
 
-FunctionRegistry* get_default_registry() {
-    return &default_registry_;
+const FunctionRegistry* get_default_registry() {
+    return default_registry_snapshot().get();
 }
 
 void FuncExprNode::set_registry(const FunctionRegistry* registry) {
+    FunctionEntryPtr function = registry->find_function(name_);
+    if (!function)
+        throw std::runtime_error("Unknown function: " + name_);
+    if (args_.size() != function->nargs && !function->on_invalid_args)
+        throw std::runtime_error(name_ + " expects " + std::to_string(function->nargs) + " arguments");
+
     this->registry_ = registry;
+    this->function_ = std::move(function);
 }
 
 void FuncExprNode::set_registry_as_default() {
-    set_registry(&default_registry_);
+    set_registry(get_default_registry());
 }
 
 
 
-static EvaluationContext default_context_ = EvaluationContext::default_context();
-
 void set_default_context(const EvaluationContext* context) {
-    default_context_ = *context;
+    default_context_snapshot().set(*context);
 }
 
-EvaluationContext* get_default_context() {
-    return &default_context_;
+const EvaluationContext* get_default_context() {
+    return default_context_snapshot().get();
 }
 
 void VariableExprNode::set_context(const EvaluationContext* context) {
-    this->resolver_ = [context](const std::string& varName) {
-        return context->get_variable(varName);
-    };
+    this->slot_ = context->slot_of(name_);
+    this->context_ = context;
+    this->resolver_ = nullptr;
 }
 
 void VariableExprNode::set_context_as_default() {
-    set_context(&default_context_);
+    set_context(get_default_context());
 }
 
 
 
-FunctionRegistry FunctionRegistry::default_registry() {
-    FunctionRegistry reg;
+static ExprFloat builtin_sin(ExprFloat x) { return std::sin(x); }
+static ExprFloat builtin_cos(ExprFloat x) { return std::cos(x); }
+static ExprFloat builtin_tan(ExprFloat x) { return std::tan(x); }
+static ExprFloat builtin_exp(ExprFloat x) { return std::exp(x); }
+static ExprFloat builtin_log(ExprFloat x) { return std::log(x); }
+static ExprFloat builtin_sqrt(ExprFloat x) { return std::sqrt(x); }
+static ExprFloat builtin_abs(ExprFloat x) { return std::abs(x); }
+static ExprFloat builtin_pow(ExprFloat x, ExprFloat y) { return std::pow(x, y); }
+static ExprFloat builtin_min(ExprFloat x, ExprFloat y) { return std::min(x, y); }
+static ExprFloat builtin_max(ExprFloat x, ExprFloat y) { return std::max(x, y); }
+static ExprFloat builtin_fma(const ExprFloat* args, size_t) { return std::fma(args[0], args[1], args[2]); }
+
+// Partial derivatives of the built-ins. `min` and `max` follow the argument
+// `std::min` and `std::max` return, so ties go to the first one.
+static void derivative_sin(const ExprFloat* x, size_t, ExprFloat* d) { d[0] = std::cos(x[0]); }
+static void derivative_cos(const ExprFloat* x, size_t, ExprFloat* d) { d[0] = -std::sin(x[0]); }
+static void derivative_tan(const ExprFloat* x, size_t, ExprFloat* d) { const ExprFloat t = std::tan(x[0]); d[0] = 1.0 + t * t; }
+static void derivative_exp(const ExprFloat* x, size_t, ExprFloat* d) { d[0] = std::exp(x[0]); }
+static void derivative_log(const ExprFloat* x, size_t, ExprFloat* d) { d[0] = 1.0 / x[0]; }
+static void derivative_sqrt(const ExprFloat* x, size_t, ExprFloat* d) { d[0] = 0.5 / std::sqrt(x[0]); }
+static void derivative_abs(const ExprFloat* x, size_t, ExprFloat* d) { d[0] = x[0] > 0.0 ? 1.0 : x[0] < 0.0 ? -1.0 : 0.0; }
+static void derivative_min(const ExprFloat* x, size_t, ExprFloat* d) { d[0] = x[1] < x[0] ? 0.0 : 1.0; d[1] = 1.0 - d[0]; }
+static void derivative_max(const ExprFloat* x, size_t, ExprFloat* d) { d[0] = x[0] < x[1] ? 0.0 : 1.0; d[1] = 1.0 - d[0]; }
+
+static void derivative_fma(const ExprFloat* x, size_t, ExprFloat* d) { d[0] = x[1]; d[1] = x[0]; d[2] = 1.0; }
+
+static void derivative_pow(const ExprFloat* x, size_t, ExprFloat* d) {
+    d[0] = x[1] == 0.0 ? 0.0 : x[1] * std::pow(x[0], x[1] - 1.0);
+    d[1] = x[0] > 0.0 ? std::pow(x[0], x[1]) * std::log(x[0]) : 0.0;
+}
 
-    reg.register_function("sin", [](const std::vector<double>& args) {
-        return std::sin(args[0]);
-    }, 1);
+static std::atomic<uint64_t> registry_revisions(0);
 
-    reg.register_function("cos", [](const std::vector<double>& args) {
-        return std::cos(args[0]);
-    }, 1);
+FunctionRegistry::FunctionRegistry() {
+    touch();
+}
 
-    reg.register_function("sqrt", [](const std::vector<double>& args) {
-        return std::sqrt(args[0]);
-    }, 1);
+void FunctionRegistry::touch() {
+    revision_ = ++registry_revisions;
+}
 
-    reg.register_function("min", [](const std::vector<double>& args) {
-        return std::min(args[0], args[1]);
-    }, 2);
+FunctionRegistry FunctionRegistry::default_registry() {
+    FunctionRegistry reg;
 
-    reg.register_function("max", [](const std::vector<double>& args) {
-        return std::max(args[0], args[1]);
-    }, 2);
+    reg.register_function("sin", builtin_sin, vector_math::sin, vector_math::sin_max_ulp);
+    reg.register_function("cos", builtin_cos, vector_math::cos, vector_math::cos_max_ulp);
+    reg.register_function("tan", builtin_tan, vector_math::tan, vector_math::tan_max_ulp);
+    reg.register_function("exp", builtin_exp, vector_math::exp, vector_math::exp_max_ulp);
+    reg.register_function("log", builtin_log, vector_math::log, vector_math::log_max_ulp);
+    reg.register_function("sqrt", builtin_sqrt, vector_math::sqrt, 0);
+    reg.register_function("abs", builtin_abs, vector_math::abs, 0);
+    reg.register_function("pow", builtin_pow, vector_math::pow, vector_math::pow_max_ulp);
+    reg.register_function("min", builtin_min, vector_math::min, 0);
+    reg.register_function("max", builtin_max, vector_math::max, 0);
+    reg.register_function("fma", builtin_fma, 3, {}, derivative_fma);
+
+    for (const char* name : { "sin", "cos", "tan", "exp", "log", "sqrt", "abs", "pow", "min", "max", "fma" })
+        reg.set_pure(name);
+
+    reg.set_derivative("sin", derivative_sin);
+    reg.set_derivative("cos", derivative_cos);
+    reg.set_derivative("tan", derivative_tan);
+    reg.set_derivative("exp", derivative_exp);
+    reg.set_derivative("log", derivative_log);
+    reg.set_derivative("sqrt", derivative_sqrt);
+    reg.set_derivative("abs", derivative_abs);
+    reg.set_derivative("pow", derivative_pow);
+    reg.set_derivative("min", derivative_min);
+    reg.set_derivative("max", derivative_max);
 
     // TODO: Add more functions
 
@@ -110,36 +204,199 @@ void FunctionRegistry::register_function(
     const std::string& name,
     Function fn,
     size_t nargs,
-    ArityMismatchHandler on_invalid_args
+    ArityMismatchHandler on_invalid_args,
+    DerivativeFunction derivative
 ) {
-    functions_[name] = [fn = std::move(fn), nargs, name, on_invalid_args = std::move(on_invalid_args)]
-                       (const std::vector<ExprFloat>& args) -> ExprFloat
-    {
-        if (args.size() == nargs)
-            return fn(args);
-        if (!on_invalid_args)
-            throw std::runtime_error(name + " expects " + std::to_string(nargs) + " arguments");
-        on_invalid_args(name, nargs, args.size());
-        return std::numeric_limits<ExprFloat>::quiet_NaN();     // THINK: What is better here?
-    };
+    auto entry = std::make_shared<FunctionEntry>();
+    entry->name            = name;
+    entry->nargs           = nargs;
+    entry->vector_fn       = std::move(fn);
+    entry->on_invalid_args = std::move(on_invalid_args);
+    entry->derivative      = std::move(derivative);
+    functions_[name] = std::move(entry);
+    touch();
 }
 
-Function FunctionRegistry::get_function(const std::string& name) const {
+void FunctionRegistry::register_function(
+    const std::string& name,
+    ArgsFunction fn,
+    size_t nargs,
+    ArityMismatchHandler on_invalid_args,
+    DerivativeFunction derivative
+) {
+    auto entry = std::make_shared<FunctionEntry>();
+    entry->name            = name;
+    entry->nargs           = nargs;
+    entry->args_fn         = std::move(fn);
+    entry->on_invalid_args = std::move(on_invalid_args);
+    entry->derivative      = std::move(derivative);
+    functions_[name] = std::move(entry);
+    touch();
+}
+
+void FunctionRegistry::register_function(const std::string& name, UnaryFunction fn, DerivativeFunction derivative) {
+    auto entry = std::make_shared<FunctionEntry>();
+    entry->name       = name;
+    entry->nargs      = 1;
+    entry->unary      = fn;
+    entry->derivative = std::move(derivative);
+    functions_[name] = std::move(entry);
+    touch();
+}
+
+void FunctionRegistry::register_function(const std::string& name, BinaryFunction fn, DerivativeFunction derivative) {
+    auto entry = std::make_shared<FunctionEntry>();
+    entry->name       = name;
+    entry->nargs      = 2;
+    entry->binary     = fn;
+    entry->derivative = std::move(derivative);
+    functions_[name] = std::move(entry);
+    touch();
+}
+
+void FunctionRegistry::register_function(const std::string& name, UnaryFunction fn, UnaryArrayFunction array_fn, unsigned max_ulp) {
+    auto entry = std::make_shared<FunctionEntry>();
+    entry->name          = name;
+    entry->nargs         = 1;
+    entry->unary         = fn;
+    entry->unary_array   = array_fn;
+    entry->array_max_ulp = max_ulp;
+    functions_[name] = std::move(entry);
+    touch();
+}
+
+void FunctionRegistry::register_function(const std::string& name, BinaryFunction fn, BinaryArrayFunction array_fn, unsigned max_ulp) {
+    auto entry = std::make_shared<FunctionEntry>();
+    entry->name          = name;
+    entry->nargs         = 2;
+    entry->binary        = fn;
+    entry->binary_array  = array_fn;
+    entry->array_max_ulp = max_ulp;
+    functions_[name] = std::move(entry);
+    touch();
+}
+
+void FunctionRegistry::set_pure(const std::string& name, bool pure) {
     auto it = functions_.find(name);
     if (it == functions_.end())
         throw std::runtime_error("Unknown function: " + name);
-    return it->second;
+
+    // Entries are shared with already parsed expressions; replace, never mutate.
+    auto entry = std::make_shared<FunctionEntry>(*it->second);
+    entry->pure = pure;
+    it->second = std::move(entry);
+    touch();
+}
+
+void FunctionRegistry::set_derivative(const std::string& name, DerivativeFunction derivative) {
+    auto it = functions_.find(name);
+    if (it == functions_.end())
+        throw std::runtime_error("Unknown function: " + name);
+
+    auto entry = std::make_shared<FunctionEntry>(*it->second);
+    entry->derivative = std::move(derivative);
+    it->second = std::move(entry);
+    touch();
+}
+
+Function FunctionRegistry::get_function(const std::string& name) const {
+    FunctionEntryPtr entry = find_function(name);
+    if (!entry)
+        throw std::runtime_error("Unknown function: " + name);
+
+    return [entry](const std::vector<ExprFloat>& args) -> ExprFloat {
+        if (args.size() != entry->nargs)
+            return entry->invalid_call(args.size());
+        return entry->call(args.data());
+    };
+}
+
+FunctionEntryPtr FunctionRegistry::find_function(const std::string& name) const {
+    auto it = functions_.find(name);
+    return it == functions_.end() ? nullptr : it->second;
+}
+
+ExprFloat FunctionEntry::invalid_call(size_t received) const {
+    if (!on_invalid_args)
+        throw std::runtime_error(name + " expects " + std::to_string(nargs) + " arguments");
+    on_invalid_args(name, nargs, received);
+    return std::numeric_limits<ExprFloat>::quiet_NaN();     // THINK: What is better here?
+}
+
+// Functions registered with the `std::vector` convention need their arguments
+// in a vector. Each thread keeps one per nesting level (a function may itself
+// evaluate expressions), so after warm-up these calls do not allocate either.
+ExprFloat FunctionEntry::call_vector(const ExprFloat* args) const {
+    thread_local std::deque<std::vector<ExprFloat>> buffers;
+    thread_local size_t depth = 0;
+
+    if (buffers.size() <= depth)
+        buffers.emplace_back();
+    std::vector<ExprFloat>& buffer = buffers[depth];
+    buffer.assign(args, args + nargs);
+
+    struct DepthGuard {
+        size_t& depth;
+        explicit DepthGuard(size_t& d) : depth(d) { ++depth; }
+        ~DepthGuard() { --depth; }
+    } guard(depth);
+
+    return vector_fn(buffer);
+}
+
+
+
+static std::atomic<uint64_t> layout_ids(0);
+
+EvaluationContext::EvaluationContext() :
+    layout_(std::make_shared<VariableLayout>()) {
+    layout_->id = ++layout_ids;
 }
 
+size_t EvaluationContext::define(const std::string& name) {
+    auto it = layout_->slots.find(name);
+    if (it != layout_->slots.end())
+        return it->second;
 
+    if (layout_.use_count() > 1) {
+        layout_ = std::make_shared<VariableLayout>(*layout_);
+        layout_->id = ++layout_ids;
+    }
+
+    size_t slot = layout_->names.size();
+    layout_->slots.emplace(name, slot);
+    layout_->names.push_back(name);
+    values_.push_back(0.0);
+    bindings_.emplace_back();
+    return slot;
+}
 
 void EvaluationContext::set_variable(const std::string& name, double value) {
-    variables_[name] = value;
+    set_value(define(name), value);
 }
 
 double EvaluationContext::get_variable(const std::string& name) const {
-    auto it = variables_.find(name);
-    if (it == variables_.end()) {
+    return value(slot_of(name));
+}
+
+bool EvaluationContext::has_variable(const std::string& name) const {
+    return layout_->slots.count(name) != 0;
+}
+
+void EvaluationContext::bind(const std::string& name, const ExprFloat* value, size_t stride) {
+    if (!value)
+        throw std::invalid_argument("Cannot bind variable " + name + " to a null pointer");
+    bindings_[define(name)] = {value, stride};
+}
+
+void EvaluationContext::unbind(const std::string& name) {
+    size_t slot = slot_of(name);
+    set_value(slot, value(slot));   // Keep the last bound value
+}
+
+size_t EvaluationContext::slot_of(const std::string& name) const {
+    auto it = layout_->slots.find(name);
+    if (it == layout_->slots.end()) {
         throw std::runtime_error("Unknown variable: " + name);
     }
     return it->second;
@@ -200,17 +457,34 @@ UnaryOp UnaryExprNode::charToUnaryOp(char op_char) {
 
 
 ExprFloat VariableExprNode::evaluate() const {
+    if (context_)
+        return context_->value(slot_);
     return resolver_(name_);
 }
 
 ExprFloat FuncExprNode::evaluate() const {
-    std::vector<ExprFloat> evaluated_args;
-    for (const auto& arg : args_) {
-        evaluated_args.push_back(arg->evaluate());
+    const FunctionEntry& fn = *function_;
+    if (args_.size() != fn.nargs)
+        return fn.invalid_call(args_.size());
+
+    if (fn.unary)
+        return fn.unary(args_[0]->evaluate());
+    if (fn.binary) {
+        const ExprFloat lhs = args_[0]->evaluate();
+        return fn.binary(lhs, args_[1]->evaluate());
+    }
+
+    ExprFloat inline_args[max_inline_args];
+    std::vector<ExprFloat> heap_args;
+    ExprFloat* evaluated_args = inline_args;
+    if (args_.size() > max_inline_args) {
+        heap_args.resize(args_.size());
+        evaluated_args = heap_args.data();
     }
 
-    auto fn = registry_->get_function(name_);
-    return fn(evaluated_args);
+    for (size_t i = 0; i < args_.size(); ++i)
+        evaluated_args[i] = args_[i]->evaluate();
+    return fn.call(evaluated_args);
 }
 
 ExprFloat ConstantExprNode::evaluate() const {
@@ -240,7 +514,7 @@ ExprFloat BinaryExprNode::evaluate() const {
             if (rhs == 0.0) throw std::runtime_error("Division by zero");
             return lhs / rhs;
         case BinaryOp::Modulo:
-            if (rhs == 0.0) throw std::runtime_error("Division by zero");
+            if (rhs == 0.0 || (ExprInt)rhs == 0) throw std::runtime_error("Division by zero");
             return (ExprFloat)((ExprInt)lhs % (ExprInt)rhs);
         case BinaryOp::Power: return std::pow(lhs, rhs);
         default:
@@ -250,17 +524,174 @@ ExprFloat BinaryExprNode::evaluate() const {
 
 
 
+// The character classes below are ASCII-only on purpose: <cctype> depends
+// on the locale and is undefined for negative `char`s.
+static inline bool is_digit(char ch) {
+    return ch >= '0' && ch <= '9';
+}
+
+static inline bool is_alpha(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+static inline bool is_space(char ch) {
+    return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+// Powers of ten that are exact doubles.
+static const ExprFloat exact_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Converts the decimal number in [first, last), as scanned by the tokenizer
+// (digits, at most one '.', an optional exponent), rounding correctly. Most
+// numbers in expressions have few digits and a small exponent, so both the
+// significand and the power of ten are exact doubles and one multiplication
+// or division gives the correctly rounded result. Others fall back to the C
+// library, given the significant digits and a decimal exponent in a fixed
+// buffer, so neither path allocates nor depends on the locale.
+static bool convert_decimal(const char* first, const char* last, ExprFloat& value) {
+    uint64_t significand = 0;
+    int      digits      = 0;       // Significant digits kept in `significand`
+    int      exponent    = 0;
+    int      written_exponent = 0;
+    bool     truncated   = false;
+    bool     any_digit   = false;
+
+    const char* p = first;
+    for (bool fraction = false; p != last && (is_digit(*p) || *p == '.'); ++p) {
+        if (*p == '.') {
+            fraction = true;
+            continue;
+        }
+        any_digit = true;
+        const unsigned digit = static_cast<unsigned>(*p - '0');
+        if (digits < 19) {
+            if (significand != 0 || digit != 0) {
+                significand = significand * 10 + digit;
+                ++digits;
+            }
+            if (fraction)
+                --exponent;
+        } else {
+            truncated |= (digit != 0);
+            if (!fraction)
+                ++exponent;
+        }
+    }
+    if (!any_digit)
+        return false;
+
+    if (p != last) {                // Exponent
+        ++p;
+        bool negative = false;
+        if (*p == '+' || *p == '-')
+            negative = (*p++ == '-');
+        int e = 0;
+        for (; p != last; ++p)
+            e = std::min(e * 10 + (*p - '0'), 100000);
+        written_exponent = negative ? -e : e;
+        exponent += written_exponent;
+    }
+
+    if (significand == 0) {
+        value = 0.0;
+        return true;
+    }
+    if (!truncated && significand <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+        const ExprFloat m = static_cast<ExprFloat>(significand);
+        value = exponent < 0 ? m / exact_powers_of_ten[-exponent] : m * exact_powers_of_ten[exponent];
+        return true;
+    }
+
+    // A decimal halfway between two doubles has at most 767 significant
+    // digits, so the digits after those only matter through whether any of
+    // them is nonzero; a final 1 stands for them.
+    constexpr int max_digits = 768;
+    char buffer[max_digits + 16];
+    int  kept  = 0;
+    long scale = written_exponent;      // Of the last digit kept
+    bool rest  = false;
+    bool fraction = false;
+    for (const char* q = first; q != last && (is_digit(*q) || *q == '.'); ++q) {
+        if (*q == '.') {
+            fraction = true;
+        } else if (kept == 0 && *q == '0') {
+            scale -= fraction;
+        } else if (kept < max_digits) {
+            buffer[kept++] = *q;
+            scale -= fraction;
+        } else {
+            rest |= (*q != '0');
+            scale += !fraction;
+        }
+    }
+    if (rest) {
+        buffer[kept++] = '1';
+        --scale;
+    }
+    buffer[kept++] = 'e';
+    if (scale < 0) {
+        buffer[kept++] = '-';
+        scale = -scale;
+    }
+    char reversed[24];
+    int count = 0;
+    do {
+        reversed[count++] = static_cast<char>('0' + scale % 10);
+        scale /= 10;
+    } while (scale > 0);
+    while (count > 0)
+        buffer[kept++] = reversed[--count];
+    buffer[kept] = '\0';
+    value = std::strtod(buffer, nullptr);
+    return std::isfinite(value);
+}
+
+bool parse_decimal(StringView text, ExprFloat& value) {
+    const char* first = text.begin();
+    const char* last  = text.end();
+    bool negative = false;
+    if (first != last && (*first == '+' || *first == '-'))
+        negative = (*first++ == '-');
+
+    // The same syntax the tokenizer scans: digits with at most one '.',
+    // then an exponent with at least one digit
+    const char* p = first;
+    bool any_digit = false;
+    for (bool dot = false; p != last && (is_digit(*p) || (*p == '.' && !dot)); ++p) {
+        dot |= (*p == '.');
+        any_digit |= (*p != '.');
+    }
+    if (!any_digit)
+        return false;
+    if (p != last && (*p == 'e' || *p == 'E')) {
+        const char* digits = p + 1;
+        if (digits != last && (*digits == '+' || *digits == '-'))
+            ++digits;
+        if (digits == last)
+            return false;
+        for (p = digits; p != last && is_digit(*p); ++p) {}
+    }
+    if (p != last || !convert_decimal(first, last, value))
+        return false;
+    if (negative)
+        value = -value;
+    return true;
+}
+
 void Tokenizer::next_token() {
     skip_whitespace();
     if (pos_ >= input_.size()) {
-        current_token_ = {TokenType::End, ""};
+        current_token_ = {TokenType::End};
         return;
     }
 
     char ch = input_[pos_];
-    if (std::isdigit(ch) || ch == '.') {
+    if (is_digit(ch) || ch == '.') {
         parse_number();
-    } else if (std::isalpha(ch) || ch == '_') {
+    } else if (is_alpha(ch) || ch == '_') {
         parse_identifier();
     } else {
         switch (ch) {
@@ -268,12 +699,15 @@ void Tokenizer::next_token() {
             case '-': make_token(TokenType::Minus); break;
             case '*': make_token(TokenType::Star); break;
             case '/': make_token(TokenType::Slash); break;
+            case '%': make_token(TokenType::Percent); break;
             case '^': make_token(TokenType::Caret); break;
             case '(': make_token(TokenType::LeftParen); break;
             case ')': make_token(TokenType::RightParen); break;
             case ',': make_token(TokenType::Comma); break;
+            case '=': make_token(TokenType::Assign); break;
+            case ';': make_token(TokenType::Semicolon); break;
             default:
-                current_token_ = {TokenType::Invalid, std::string(1, ch)};
+                current_token_ = {TokenType::Invalid, input_.substr(pos_, 1)};
                 ++pos_;
                 break;
         }
@@ -281,7 +715,7 @@ void Tokenizer::next_token() {
 }
 
 void Tokenizer::skip_whitespace() {
-    while (pos_ < input_.size() && std::isspace(input_[pos_]))
+    while (pos_ < input_.size() && is_space(input_[pos_]))
         ++pos_;
 }
 
@@ -290,7 +724,7 @@ void Tokenizer::parse_number() {
     bool has_dot = false;
 
     // Integer and fractional part
-    while (pos_ < input_.size() && (std::isdigit(input_[pos_]) || input_[pos_] == '.')) {
+    while (pos_ < input_.size() && (is_digit(input_[pos_]) || input_[pos_] == '.')) {
         if (input_[pos_] == '.') {
             if (has_dot) break; // Only one dot allowed
             has_dot = true;
@@ -298,45 +732,53 @@ void Tokenizer::parse_number() {
         ++pos_;
     }
 
-    // Scientific notation (e.g. 1.2e-3)
+    // Scientific notation (e.g. 1.2e-3); an `e` without digits is not part
+    // of the number
     if (pos_ < input_.size() && (input_[pos_] == 'e' || input_[pos_] == 'E')) {
-        ++pos_;
-        if (pos_ < input_.size() && (input_[pos_] == '+' || input_[pos_] == '-')) {
-            ++pos_;
-        }
-        while (pos_ < input_.size() && std::isdigit(input_[pos_])) {
-            ++pos_;
+        size_t end = pos_ + 1;
+        if (end < input_.size() && (input_[end] == '+' || input_[end] == '-'))
+            ++end;
+        if (end < input_.size() && is_digit(input_[end])) {
+            while (end < input_.size() && is_digit(input_[end]))
+                ++end;
+            pos_ = end;
         }
     }
 
-    std::string number_text = input_.substr(start, pos_ - start);
-    try {
-        double value = std::stod(number_text);
+    StringView number_text = input_.substr(start, pos_ - start);
+    ExprFloat value;
+    if (convert_decimal(number_text.begin(), number_text.end(), value))
         current_token_ = {TokenType::Number, number_text, value};
-    } catch (...) {
+    else
         current_token_ = {TokenType::Invalid, number_text};
-    }
 }
 
 void Tokenizer::parse_identifier() {
     size_t start = pos_;
-    while (pos_ < input_.size() && (std::isalnum(input_[pos_]) || input_[pos_] == '_'))
+    while (pos_ < input_.size() && (is_alpha(input_[pos_]) || is_digit(input_[pos_]) || input_[pos_] == '_'))
         ++pos_;
     current_token_ = {TokenType::Identifier, input_.substr(start, pos_ - start)};
 }
 
 void Tokenizer::make_token(TokenType type) {
-    current_token_ = {type, std::string(1, input_[pos_])};
+    current_token_ = {type, input_.substr(pos_, 1)};
     ++pos_;
 }
 
 
 
 std::unique_ptr<ExprNode> Parser::parse() {
+    CPPEXPRPARS_PROFILE(const uint64_t start = profile_clock());
+    if (!context_)
+        context_ = get_default_context();
+    if (!registry_)
+        registry_ = get_default_registry();
+
     auto expr = parse_expression();
     if (tokenizer_.current().type != TokenType::End) {
         throw std::runtime_error("Unexpected token after expression: '" + tokenizer_.current().text + "'");
     }
+    CPPEXPRPARS_PROFILE(parse_ns_ = profile_clock() - start);
     return expr;
 }
 
@@ -354,7 +796,7 @@ std::unique_ptr<ExprNode> Parser::parse_expression(int precedence) {
         int next_prec = token_prec + (is_right_associative(op.type) ? 0 : 1);
         auto rhs = parse_expression(next_prec);
 
-        lhs = std::make_unique<BinaryExprNode>(op.text[0], std::move(lhs), std::move(rhs));
+        lhs = make_node<BinaryExprNode>(resource_, binary_op(op.type), std::move(lhs), std::move(rhs));
     }
 
     return lhs;
@@ -366,13 +808,13 @@ std::unique_ptr<ExprNode> Parser::parse_primary() {
 
     switch (token.type) {
         case TokenType::Number:
-            return std::make_unique<ConstantExprNode>(token.number_value);
+            return make_node<ConstantExprNode>(resource_, token.number_value);
 
         case TokenType::Identifier: {
             if (tokenizer_.current().type == TokenType::LeftParen) {
                 // Function call
                 tokenizer_.next_token(); // consume '('
-                std::vector<std::unique_ptr<ExprNode>> args;
+                ExprNodeList args(resource_);
 
                 if (tokenizer_.current().type != TokenType::RightParen) {
                     while (true) {
@@ -390,11 +832,13 @@ std::unique_ptr<ExprNode> Parser::parse_primary() {
                 }
                 tokenizer_.next_token();
 
-                return std::make_unique<FuncExprNode>(token.text, std::move(args), registry_);
+                return make_node<FuncExprNode>(resource_, token.text.to_string(), std::move(args), registry_);
             }
 
-            // Just a variable
-            return std::make_unique<VariableExprNode>(token.text, context_);
+            // Just a variable, unless a program assigned it earlier
+            if (locals_ && locals_->has_variable(token.text.to_string()))
+                return make_node<VariableExprNode>(resource_, token.text.to_string(), locals_);
+            return make_node<VariableExprNode>(resource_, token.text.to_string(), context_);
         }
 
         case TokenType::LeftParen: {
@@ -408,7 +852,7 @@ std::unique_ptr<ExprNode> Parser::parse_primary() {
 
         case TokenType::Minus: {
             auto inner = parse_expression(3); // high precedence for unary minus
-            return std::make_unique<UnaryExprNode>('-', std::move(inner));
+            return make_node<UnaryExprNode>(resource_, '-', std::move(inner));
         }
 
         default:
@@ -421,7 +865,8 @@ int Parser::get_precedence(TokenType type) const {
         case TokenType::Plus:
         case TokenType::Minus: return 1;
         case TokenType::Star:
-        case TokenType::Slash: return 2;
+        case TokenType::Slash:
+        case TokenType::Percent: return 2;
         case TokenType::Caret: return 3;
         default: return -1;
     }
@@ -431,10 +876,310 @@ bool Parser::is_right_associative(TokenType type) const {
     return type == TokenType::Caret;
 }
 
+BinaryOp Parser::binary_op(TokenType type) {
+    switch (type) {
+        case TokenType::Plus:    return BinaryOp::Add;
+        case TokenType::Minus:   return BinaryOp::Subtract;
+        case TokenType::Star:    return BinaryOp::Multiply;
+        case TokenType::Slash:   return BinaryOp::Divide;
+        case TokenType::Percent: return BinaryOp::Modulo;
+        case TokenType::Caret:   return BinaryOp::Power;
+        default:
+            throw std::invalid_argument("Unsupported binary operator");
+    }
+}
+
+CompiledExpr Parser::compile(const CompileOptions& options) {
+    CompiledExpr compiled(Optimizer(options.optimization).optimize(parse()), options);
+    CPPEXPRPARS_PROFILE(compiled.profiler_->parse_ns = parse_ns_);
+    return compiled;
+}
+
+// Each name is added to `locals` once its expression is parsed, so
+// `x = x + 1` reads the input `x` and only later statements see the new one.
+// The slot of a name is the index of the statement assigning it.
+CompiledProgram Parser::compile_program(const CompileOptions& options) {
+    if (!context_)
+        context_ = get_default_context();
+    if (!registry_)
+        registry_ = get_default_registry();
+
+    struct LocalsScope {
+        const EvaluationContext*& locals;
+        ~LocalsScope() { locals = nullptr; }
+    };
+
+    std::unique_ptr<EvaluationContext> locals(new EvaluationContext());
+    LocalsScope scope{locals_};
+    locals_ = locals.get();
+
+    const Optimizer optimizer(options.optimization);
+    std::vector<Statement> statements;
+    bool has_output = false;
+    while (tokenizer_.current().type != TokenType::End) {
+        Statement statement;
+        Token name = tokenizer_.current();
+        if (name.type != TokenType::Identifier)
+            throw std::runtime_error("Expected a name to assign, found '" + name.text + "'");
+        tokenizer_.next_token();
+        if (name.text == StringView("let") && tokenizer_.current().type == TokenType::Identifier) {
+            statement.output = false;
+            name = tokenizer_.current();
+            tokenizer_.next_token();
+        }
+
+        statement.name = name.text.to_string();
+        if (locals->has_variable(statement.name))
+            throw std::runtime_error("'" + statement.name + "' is assigned more than once");
+        if (tokenizer_.current().type != TokenType::Assign)
+            throw std::runtime_error("Expected '=' after '" + statement.name + "'");
+        tokenizer_.next_token();
+
+        statement.expression = optimizer.optimize(parse_expression());
+        locals->set_variable(statement.name, std::numeric_limits<ExprFloat>::quiet_NaN());
+        has_output = has_output || statement.output;
+        statements.push_back(std::move(statement));
+
+        if (tokenizer_.current().type == TokenType::Semicolon)
+            tokenizer_.next_token();
+        else if (tokenizer_.current().type != TokenType::End)
+            throw std::runtime_error("Expected ';' between statements, found '" + tokenizer_.current().text + "'");
+    }
+    if (!has_output)
+        throw std::runtime_error("Program has no outputs");
+
+    return CompiledProgram(std::move(statements), std::move(locals), options);
+}
+
+// Expressions are handed out in runs, so the pool is not asked for each
+// of them; runs are still small enough for stealing to even out the load.
+std::vector<CompileResult> compile_all(
+    const StringView* sources,
+    size_t count,
+    const EvaluationContext* context,
+    const FunctionRegistry* registry,
+    const CompileOptions& options,
+    Executor& executor
+) {
+    if (!context)
+        context = get_default_context();
+    if (!registry)
+        registry = get_default_registry();
+
+    std::vector<CompileResult> results(count);
+    const size_t workers = std::max<size_t>(1, executor.concurrency());
+    const size_t run = std::max<size_t>(1, std::min<size_t>(64, count / (8 * workers)));
+    executor.run((count + run - 1) / run, [&](size_t index, size_t) {
+        for (size_t i = index * run; i < std::min(count, (index + 1) * run); ++i) {
+            try {
+                const StringView source = sources[i];
+                Parser parser(Tokenizer(source), context, registry);
+                results[i].expression = parser.compile(options);
+            } catch (const std::exception& e) {
+                results[i].error = e.what();
+            }
+        }
+    });
+    return results;
+}
 
+std::vector<CompileResult> compile_all(
+    const std::vector<std::string>& sources,
+    const EvaluationContext* context,
+    const FunctionRegistry* registry,
+    const CompileOptions& options,
+    Executor& executor
+) {
+    const std::vector<StringView> views(sources.begin(), sources.end());
+    return compile_all(views.data(), views.size(), context, registry, options, executor);
+}
+
+
+
+CompiledExpr::CompiledExpr(ExprNodePtr root, const CompileOptions& options) :
+    root_(std::move(root)),
+    bytecode_(Bytecode::compile(*root_, options.share_subexpressions)) {
+    CPPEXPRPARS_PROFILE(profiler_ = std::make_shared<ExpressionProfiler>(*root_));
+}
+
+ExprFloat CompiledExpr::evaluate() const {
+    if (!root_)
+        throw std::runtime_error("Evaluating an empty compiled expression");
+    CPPEXPRPARS_PROFILE(profiler_->evaluated_in_context());
+    return bytecode_.evaluate();
+}
+
+ExprFloat CompiledExpr::evaluate_at(size_t row) const {
+    if (!root_)
+        throw std::runtime_error("Evaluating an empty compiled expression");
+    CPPEXPRPARS_PROFILE(row == 0 ? profiler_->evaluated_in_context() : profiler_->evaluated(1));
+    return bytecode_.evaluate(row);
+}
+
+ExprFloat CompiledExpr::evaluate(const EvaluationContext& context, size_t row) const {
+    if (!root_)
+        throw std::runtime_error("Evaluating an empty compiled expression");
+    CPPEXPRPARS_PROFILE(profiler_->evaluated(1));
+    return bytecode_.evaluate(context, row);
+}
+
+void CompiledExpr::evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* out) const {
+    if (!root_)
+        throw std::runtime_error("Evaluating an empty compiled expression");
+    CPPEXPRPARS_PROFILE(profiler_->evaluated(n));
+    bytecode_.evaluate_batch(columns, n, out);
+}
+
+void CompiledExpr::evaluate_parallel(
+    const ExprFloat* const* columns,
+    size_t n,
+    ExprFloat* out,
+    Executor& executor,
+    size_t chunk_rows
+) const {
+    if (!root_)
+        throw std::runtime_error("Evaluating an empty compiled expression");
+    CPPEXPRPARS_PROFILE(profiler_->evaluated(n));
+    bytecode_.evaluate_parallel(columns, n, out, executor, chunk_rows);
+}
+
+ExprFloat CompiledExpr::evaluate(EvalStatus& status) const noexcept {
+    if (!root_) {
+        status = EvalStatus::EmptyExpression | EvalStatus::NotFinite;
+        return std::numeric_limits<ExprFloat>::quiet_NaN();
+    }
+    CPPEXPRPARS_PROFILE(profiler_->evaluated_in_context());
+    return bytecode_.evaluate(0, status);
+}
+
+ExprFloat CompiledExpr::evaluate_at(size_t row, EvalStatus& status) const noexcept {
+    if (!root_) {
+        status = EvalStatus::EmptyExpression | EvalStatus::NotFinite;
+        return std::numeric_limits<ExprFloat>::quiet_NaN();
+    }
+    CPPEXPRPARS_PROFILE(row == 0 ? profiler_->evaluated_in_context() : profiler_->evaluated(1));
+    return bytecode_.evaluate(row, status);
+}
+
+void CompiledExpr::evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* out, EvalStatus* status) const {
+    if (!root_) {
+        std::fill_n(out, n, std::numeric_limits<ExprFloat>::quiet_NaN());
+        std::fill_n(status, n, EvalStatus::EmptyExpression | EvalStatus::NotFinite);
+        return;
+    }
+    CPPEXPRPARS_PROFILE(profiler_->evaluated(n));
+    bytecode_.evaluate_batch(columns, n, out, status);
+}
+
+void CompiledExpr::evaluate_parallel(
+    const ExprFloat* const* columns,
+    size_t n,
+    ExprFloat* out,
+    EvalStatus* status,
+    Executor& executor,
+    size_t chunk_rows
+) const {
+    if (!root_) {
+        std::fill_n(out, n, std::numeric_limits<ExprFloat>::quiet_NaN());
+        std::fill_n(status, n, EvalStatus::EmptyExpression | EvalStatus::NotFinite);
+        return;
+    }
+    CPPEXPRPARS_PROFILE(profiler_->evaluated(n));
+    bytecode_.evaluate_parallel(columns, n, out, status, executor, chunk_rows);
+}
+
+ExprFloat CompiledExpr::evaluate_tree() const {
+    if (!root_)
+        throw std::runtime_error("Evaluating an empty compiled expression");
+    CPPEXPRPARS_PROFILE(profiler_->evaluated_in_context(true));
+    return root_->evaluate();
+}
+
+
+
+CompiledProgram::CompiledProgram(
+    std::vector<Statement> statements,
+    std::unique_ptr<EvaluationContext> locals,
+    const CompileOptions& options
+) :
+    statements_(std::move(statements)),
+    locals_(std::move(locals)),
+    bytecode_(Bytecode::compile(statements_, locals_.get(), options.share_subexpressions)) {
+    for (const Statement& statement : statements_)
+        if (statement.output)
+            outputs_.push_back(statement.name);
+}
+
+void CompiledProgram::evaluate(ExprFloat* out, size_t row) const {
+    if (!valid())
+        throw std::runtime_error("Evaluating an empty compiled program");
+    bytecode_.evaluate_outputs(out, row);
+}
+
+void CompiledProgram::evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* const* out) const {
+    if (!valid())
+        throw std::runtime_error("Evaluating an empty compiled program");
+    bytecode_.evaluate_batch(columns, n, out);
+}
+
+void CompiledProgram::evaluate_parallel(
+    const ExprFloat* const* columns,
+    size_t n,
+    ExprFloat* const* out,
+    Executor& executor,
+    size_t chunk_rows
+) const {
+    if (!valid())
+        throw std::runtime_error("Evaluating an empty compiled program");
+    bytecode_.evaluate_parallel(columns, n, out, executor, chunk_rows);
+}
+
+
+
+ExprParser::ExprParser(const ExprParser& other) :
+    expression_(other.expression_),
+    context_(other.context_),
+    registry_(other.registry_),
+    options_(other.options_),
+    resource_(other.resource_) {}
+
+ExprParser::ExprParser(ExprParser&& other) :
+    expression_(std::move(other.expression_)),
+    context_(std::move(other.context_)),
+    registry_(std::move(other.registry_)),
+    options_(other.options_),
+    resource_(other.resource_) {
+    other.compiled_ = CompiledExpr();
+}
+
+ExprParser& ExprParser::operator=(const ExprParser& other) {
+    if (this != &other) {
+        expression_ = other.expression_;
+        context_    = other.context_;
+        registry_   = other.registry_;
+        options_    = other.options_;
+        resource_   = other.resource_;
+        compiled_   = CompiledExpr();
+    }
+    return *this;
+}
+
+ExprParser& ExprParser::operator=(ExprParser&& other) {
+    if (this != &other) {
+        expression_ = std::move(other.expression_);
+        context_    = std::move(other.context_);
+        registry_   = std::move(other.registry_);
+        options_    = other.options_;
+        resource_   = other.resource_;
+        compiled_   = CompiledExpr();
+        other.compiled_ = CompiledExpr();
+    }
+    return *this;
+}
 
 void ExprParser::set_expression(const std::string& expr) {
     expression_ = expr;
+    compiled_ = CompiledExpr();
 }
 
 void ExprParser::set_variable(const std::string& name, ExprFloat value) {
@@ -445,6 +1190,14 @@ ExprFloat ExprParser::get_variable(const std::string& name) const {
     return context_.get_variable(name);
 }
 
+void ExprParser::bind(const std::string& name, const ExprFloat* value, size_t stride) {
+    context_.bind(name, value, stride);
+}
+
+void ExprParser::unbind(const std::string& name) {
+    context_.unbind(name);
+}
+
 void ExprParser::register_function(
     const std::string& name,
     Function fn,
@@ -452,18 +1205,59 @@ void ExprParser::register_function(
     ArityMismatchHandler on_invalid_args
 ) {
     registry_.register_function(name, fn, nargs, on_invalid_args);
+    compiled_ = CompiledExpr();
+}
+
+void ExprParser::register_function(
+    const std::string& name,
+    ArgsFunction fn,
+    size_t nargs,
+    ArityMismatchHandler on_invalid_args
+) {
+    registry_.register_function(name, fn, nargs, on_invalid_args);
+    compiled_ = CompiledExpr();
+}
+
+void ExprParser::register_function(const std::string& name, UnaryFunction fn) {
+    registry_.register_function(name, fn);
+    compiled_ = CompiledExpr();
+}
+
+void ExprParser::register_function(const std::string& name, BinaryFunction fn) {
+    registry_.register_function(name, fn);
+    compiled_ = CompiledExpr();
+}
+
+void ExprParser::set_compile_options(const CompileOptions& options) {
+    options_ = options;
+    compiled_ = CompiledExpr();
+}
+
+void ExprParser::set_memory_resource(MemoryResource* resource) {
+    resource_ = resource;
+    compiled_ = CompiledExpr();
+}
+
+const CompiledExpr& ExprParser::compile() {
+    if (!compiled_.valid()) {
+        Tokenizer tokenizer(expression_);
+        Parser parser(
+            std::move(tokenizer),
+            &context_,
+            &registry_
+        );
+        parser.set_memory_resource(resource_);
+        compiled_ = parser.compile(options_);
+    }
+    return compiled_;
 }
 
 ExprFloat ExprParser::evaluate() {
-    Tokenizer tokenizer(expression_);
-    Parser parser(
-        std::move(tokenizer),
-        &context_,
-        &registry_
-    );
-
-    auto node = parser.parse();
-    return node->evaluate();
+    return compile().evaluate();
+}
+
+ExprFloat ExprParser::evaluate_at(size_t row) {
+    return compile().evaluate_at(row);
 }
 
 }   // namespace cppexprpars
@@ -0,0 +1,317 @@
+//  expression_set.cpp - Lightweight C++ Expression Parser (Expression Sets)
+//
+//  This file implements sets of formulas over shared variables that are
+//  re-evaluated incrementally when some of the variables change.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+
+#include "cppexprpars.hpp"
+#include <cstring>
+
+
+namespace cppexprpars {
+
+struct ExpressionSet::Node {
+    ExprNodeType          type      = ExprNodeType::Constant;
+    UnaryOp               unary_op  = UnaryOp::Plus;
+    BinaryOp              binary_op = BinaryOp::Add;
+    FunctionEntryPtr      function;
+    std::vector<uint32_t> children;     // Arguments, repeats included
+    std::vector<uint32_t> parents;      // Distinct
+    ExprFloat             value     = 0.0;
+    bool                  stale     = false;
+};
+
+struct ExpressionSet::Formula {
+    std::string              text;
+    uint32_t                 root = 0;
+    std::vector<std::string> dependencies;
+};
+
+ExpressionSet::ExpressionSet(const FunctionRegistry& registry, OptimizationLevel optimization) :
+    registry_(&registry),
+    optimization_(optimization) {}
+
+ExpressionSet::~ExpressionSet() = default;
+
+size_t ExpressionSet::add(StringView expression) {
+    // The parser rejects unknown variables, so define every identifier not
+    // followed by an opening parenthesis first
+    for (Tokenizer tokenizer(expression); tokenizer.current().type != TokenType::End;) {
+        const Token token = tokenizer.current();
+        tokenizer.next_token();
+        if (token.type == TokenType::Identifier && tokenizer.current().type != TokenType::LeftParen) {
+            const std::string name = token.text.to_string();
+            if (!context_.has_variable(name))
+                context_.set_variable(name, std::numeric_limits<ExprFloat>::quiet_NaN());
+        }
+    }
+    Parser parser(Tokenizer(expression), &context_, registry_);
+    const ExprNodePtr root = Optimizer(optimization_).optimize(parser.parse());
+
+    Formula formula;
+    formula.text = expression.to_string();
+    formula.root = intern(*root, formula.dependencies);
+    formulas_.push_back(std::move(formula));
+    return formulas_.size() - 1;
+}
+
+// Returns the id of the DAG node computing `node`, adding the missing ones.
+// Nodes are keyed like `Bytecode` keys shared subexpressions, except that
+// variables are keyed by name.
+uint32_t ExpressionSet::intern(const ExprNode& node, std::vector<std::string>& dependencies) {
+    std::string key(1, static_cast<char>(node.type()));
+    auto append = [&key](const void* data, size_t size) {
+        key.append(static_cast<const char*>(data), size);
+    };
+
+    Node entry;
+    entry.type = node.type();
+    bool pure = true;
+    switch (node.type()) {
+        case ExprNodeType::Constant:
+            entry.value = static_cast<const ConstantExprNode&>(node).value();
+            append(&entry.value, sizeof entry.value);
+            break;
+        case ExprNodeType::Variable: {
+            const std::string& name = static_cast<const VariableExprNode&>(node).name();
+            if (std::find(dependencies.begin(), dependencies.end(), name) == dependencies.end())
+                dependencies.push_back(name);
+            auto it = variables_.find(name);
+            if (it != variables_.end())
+                return it->second;
+            entry.value = context_.get_variable(name);
+            const uint32_t id = add_node(std::move(entry));
+            variables_.emplace(name, id);
+            return id;
+        }
+        case ExprNodeType::Unary: {
+            const auto& unary = static_cast<const UnaryExprNode&>(node);
+            entry.unary_op = unary.op();
+            append(&entry.unary_op, sizeof entry.unary_op);
+            entry.children.push_back(intern(unary.operand(), dependencies));
+            break;
+        }
+        case ExprNodeType::Binary: {
+            const auto& binary = static_cast<const BinaryExprNode&>(node);
+            entry.binary_op = binary.op();
+            append(&entry.binary_op, sizeof entry.binary_op);
+            entry.children.push_back(intern(binary.left(), dependencies));
+            entry.children.push_back(intern(binary.right(), dependencies));
+            break;
+        }
+        case ExprNodeType::Function: {
+            const auto& func = static_cast<const FuncExprNode&>(node);
+            entry.function = func.function();
+            const FunctionEntry* fn = entry.function.get();
+            append(&fn, sizeof fn);
+            pure = fn->pure && func.arity_matches();
+            for (const ExprNodePtr& arg : func.args())
+                entry.children.push_back(intern(*arg, dependencies));
+            break;
+        }
+    }
+    for (uint32_t child : entry.children)
+        append(&child, sizeof child);
+
+    if (pure) {
+        auto it = dag_.find(key);
+        if (it != dag_.end())
+            return it->second;
+    }
+    entry.stale = (entry.type != ExprNodeType::Constant);
+    const uint32_t id = add_node(std::move(entry));
+    if (pure)
+        dag_.emplace(std::move(key), id);
+    else
+        impure_.push_back(id);
+    return id;
+}
+
+uint32_t ExpressionSet::add_node(Node node) {
+    const uint32_t id = static_cast<uint32_t>(nodes_.size());
+    for (size_t i = 0; i < node.children.size(); ++i) {
+        const uint32_t child = node.children[i];
+        if (std::find(node.children.begin(), node.children.begin() + i, child) == node.children.begin() + i)
+            nodes_[child].parents.push_back(id);
+    }
+    if (node.stale)
+        stale_.push_back(id);
+    nodes_.push_back(std::move(node));
+    return id;
+}
+
+// Marks every node reading `id`, directly or not. A stale node's dependents
+// are always stale already, so the walk stops there; the nodes it marks are
+// appended to `stale_`, which doubles as its work list.
+void ExpressionSet::mark_dependents_stale(uint32_t id) {
+    size_t next = stale_.size();
+    for (uint32_t current = id;; current = stale_[next++]) {
+        for (uint32_t parent : nodes_[current].parents) {
+            if (!nodes_[parent].stale) {
+                nodes_[parent].stale = true;
+                stale_.push_back(parent);
+            }
+        }
+        if (next == stale_.size())
+            break;
+    }
+}
+
+void ExpressionSet::set_variable(const std::string& name, ExprFloat value) {
+    auto it = variables_.find(name);
+    if (it == variables_.end()) {
+        context_.set_variable(name, value);
+        Node entry;
+        entry.type  = ExprNodeType::Variable;
+        entry.value = value;
+        variables_.emplace(name, add_node(std::move(entry)));
+        return;
+    }
+
+    Node& node = nodes_[it->second];
+    if (std::memcmp(&node.value, &value, sizeof value) == 0)
+        return;
+    node.value = value;
+    mark_dependents_stale(it->second);
+}
+
+ExprFloat ExpressionSet::get_variable(const std::string& name) const {
+    auto it = variables_.find(name);
+    if (it == variables_.end())
+        throw std::runtime_error("Unknown variable: " + name);
+    return nodes_[it->second].value;
+}
+
+void ExpressionSet::evaluate(Node& node) {
+    switch (node.type) {
+        case ExprNodeType::Unary: {
+            const ExprFloat operand = nodes_[node.children[0]].value;
+            node.value = node.unary_op == UnaryOp::Minus ? -operand : operand;
+            break;
+        }
+        case ExprNodeType::Binary: {
+            const ExprFloat lhs = nodes_[node.children[0]].value;
+            const ExprFloat rhs = nodes_[node.children[1]].value;
+            switch (node.binary_op) {
+                case BinaryOp::Add:      node.value = lhs + rhs; break;
+                case BinaryOp::Subtract: node.value = lhs - rhs; break;
+                case BinaryOp::Multiply: node.value = lhs * rhs; break;
+                case BinaryOp::Divide:
+                    if (rhs == 0.0) throw std::runtime_error("Division by zero");
+                    node.value = lhs / rhs;
+                    break;
+                case BinaryOp::Modulo:
+                    if (rhs == 0.0 || (ExprInt)rhs == 0) throw std::runtime_error("Division by zero");
+                    node.value = (ExprFloat)((ExprInt)lhs % (ExprInt)rhs);
+                    break;
+                case BinaryOp::Power:    node.value = std::pow(lhs, rhs); break;
+            }
+            break;
+        }
+        case ExprNodeType::Function: {
+            const FunctionEntry& fn = *node.function;
+            const size_t count = node.children.size();
+            if (count != fn.nargs) {
+                node.value = fn.invalid_call(count);
+                break;
+            }
+            ExprFloat inline_args[FuncExprNode::max_inline_args];
+            std::vector<ExprFloat> heap_args;
+            ExprFloat* args = inline_args;
+            if (count > FuncExprNode::max_inline_args) {
+                heap_args.resize(count);
+                args = heap_args.data();
+            }
+            for (size_t i = 0; i < count; ++i)
+                args[i] = nodes_[node.children[i]].value;
+            node.value = fn.call(args);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+size_t ExpressionSet::update() {
+    for (uint32_t id : impure_) {
+        if (!nodes_[id].stale) {
+            nodes_[id].stale = true;
+            stale_.push_back(id);
+        }
+        mark_dependents_stale(id);
+    }
+
+    // Ids are assigned children first, so ascending order is a valid
+    // evaluation order
+    std::sort(stale_.begin(), stale_.end());
+    size_t done = 0;
+    try {
+        for (; done < stale_.size(); ++done) {
+            Node& node = nodes_[stale_[done]];
+            evaluate(node);
+            node.stale = false;
+        }
+    } catch (...) {
+        stale_.erase(stale_.begin(), stale_.begin() + done);
+        throw;
+    }
+    stale_.clear();
+    return done;
+}
+
+ExprFloat ExpressionSet::value(size_t index) {
+    const Node& root = nodes_[formulas_.at(index).root];
+    if (root.stale)
+        update();
+    return root.value;
+}
+
+bool ExpressionSet::is_stale(size_t index) const {
+    return nodes_[formulas_.at(index).root].stale;
+}
+
+const std::vector<std::string>& ExpressionSet::dependencies(size_t index) const {
+    return formulas_.at(index).dependencies;
+}
+
+const std::string& ExpressionSet::expression(size_t index) const {
+    return formulas_.at(index).text;
+}
+
+size_t ExpressionSet::size() const {
+    return formulas_.size();
+}
+
+size_t ExpressionSet::node_count() const {
+    return nodes_.size();
+}
+
+}   // namespace cppexprpars
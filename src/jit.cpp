@@ -0,0 +1,1004 @@
+//  jit.cpp - Lightweight C++ Expression Parser (JIT Compiler)
+//
+//  This file implements the backend that translates bytecode programs into
+//  x86-64 machine code.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+
+#include "cppexprpars.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#if defined(__x86_64__) && !defined(_WIN32) && !defined(CPPEXPRPARS_NO_JIT)
+#define CPPEXPRPARS_JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+namespace cppexprpars {
+
+namespace {
+
+// Errors of native calls are kept here instead of being thrown, since the
+// generated code has no unwind information to throw through.
+thread_local bool               error_pending = false;
+thread_local std::exception_ptr pending_error;
+
+void record_error(std::exception_ptr error) {
+    if (!error_pending) {
+        pending_error = std::move(error);
+        error_pending = true;
+    }
+}
+
+std::atomic<int> perf_map_enabled(-1);     // -1 until the environment is read
+
+bool perf_map_wanted() {
+    int enabled = perf_map_enabled.load(std::memory_order_relaxed);
+    if (enabled < 0) {
+        const char* value = std::getenv("CPPEXPRPARS_PERF_MAP");
+        enabled = value && *value && std::strcmp(value, "0") != 0;
+        perf_map_enabled.store(enabled, std::memory_order_relaxed);
+    }
+    return enabled != 0;
+}
+
+}   // namespace
+
+void set_jit_perf_map(bool enabled) {
+    perf_map_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+std::exception_ptr JitExpr::take_error() {
+    std::exception_ptr error = std::move(pending_error);
+    pending_error = nullptr;
+    error_pending = false;
+    return error;
+}
+
+
+
+#ifdef CPPEXPRPARS_JIT_X86_64
+
+namespace {
+
+// Helpers called from generated code. Those that can fail return the value
+// in xmm0 and a failure flag in rax, per the System V ABI for this struct.
+struct CallResult {
+    ExprFloat value;
+    uint64_t  failed;
+};
+
+CallResult failure(std::exception_ptr error) {
+    record_error(std::move(error));
+    return { std::numeric_limits<ExprFloat>::quiet_NaN(), 1 };
+}
+
+CallResult jit_unary(UnaryFunction fn, ExprFloat x) {
+    try {
+        return { fn(x), 0 };
+    } catch (...) {
+        return failure(std::current_exception());
+    }
+}
+
+CallResult jit_binary(BinaryFunction fn, ExprFloat x, ExprFloat y) {
+    try {
+        return { fn(x, y), 0 };
+    } catch (...) {
+        return failure(std::current_exception());
+    }
+}
+
+CallResult jit_call(const FunctionEntry* fn, const ExprFloat* args, size_t count) {
+    try {
+        return { count == fn->nargs ? fn->call(args) : fn->invalid_call(count), 0 };
+    } catch (...) {
+        return failure(std::current_exception());
+    }
+}
+
+CallResult jit_modulo(ExprFloat lhs, ExprFloat rhs) {
+    // Like the interpreter, a divisor that truncates to 0 is reported too
+    // rather than trapping.
+    if (rhs == 0.0 || (ExprInt)rhs == 0)
+        return failure(std::make_exception_ptr(std::runtime_error("Division by zero")));
+    return { (ExprFloat)((ExprInt)lhs % (ExprInt)rhs), 0 };
+}
+
+ExprFloat jit_pow(ExprFloat x, ExprFloat y) {
+    return std::pow(x, y);
+}
+
+// Packed forms, one call per group of `width` rows: each lane of `lhs` is
+// replaced by the result for that row. Call arguments are stack entries,
+// 4 lanes apart.
+CallResult jit_unary_lanes(UnaryFunction fn, ExprFloat* lhs, size_t width) {
+    try {
+        for (size_t i = 0; i < width; ++i)
+            lhs[i] = fn(lhs[i]);
+        return { 0.0, 0 };
+    } catch (...) {
+        return failure(std::current_exception());
+    }
+}
+
+CallResult jit_binary_lanes(BinaryFunction fn, ExprFloat* lhs, const ExprFloat* rhs, size_t width) {
+    try {
+        for (size_t i = 0; i < width; ++i)
+            lhs[i] = fn(lhs[i], rhs[i]);
+        return { 0.0, 0 };
+    } catch (...) {
+        return failure(std::current_exception());
+    }
+}
+
+CallResult jit_modulo_lanes(ExprFloat* lhs, const ExprFloat* rhs, size_t width) {
+    for (size_t i = 0; i < width; ++i) {
+        const CallResult result = jit_modulo(lhs[i], rhs[i]);
+        if (result.failed)
+            return result;
+        lhs[i] = result.value;
+    }
+    return { 0.0, 0 };
+}
+
+CallResult jit_pow_lanes(ExprFloat* lhs, const ExprFloat* rhs, size_t width) {
+    for (size_t i = 0; i < width; ++i)
+        lhs[i] = std::pow(lhs[i], rhs[i]);
+    return { 0.0, 0 };
+}
+
+CallResult jit_call_lanes(const FunctionEntry* fn, const ExprFloat* stack, size_t count, ExprFloat* out, size_t width) {
+    ExprFloat inline_args[FuncExprNode::max_inline_args];
+    std::vector<ExprFloat> spilled;
+    ExprFloat* args = inline_args;
+    if (count > FuncExprNode::max_inline_args) {
+        spilled.resize(count);
+        args = spilled.data();
+    }
+
+    for (size_t lane = 0; lane < width; ++lane) {
+        for (size_t i = 0; i < count; ++i)
+            args[i] = stack[i * 4 + lane];
+        const CallResult result = jit_call(fn, args, count);
+        if (result.failed)
+            return result;
+        out[lane] = result.value;
+    }
+    return { 0.0, 0 };
+}
+
+void jit_division_by_zero() {
+    record_error(std::make_exception_ptr(std::runtime_error("Division by zero")));
+}
+
+// Built-in functions with an exact instruction equivalent, recognised by
+// their entry points: sqrtsd is correctly rounded like std::sqrt, and
+// minsd/maxsd pick the same operand as std::min/std::max for NaN and zeros
+// when given the arguments in the right order.
+struct Builtins {
+    UnaryFunction  sqrt;
+    UnaryFunction  abs;
+    BinaryFunction min;
+    BinaryFunction max;
+};
+
+const Builtins& builtins() {
+    static const Builtins functions = [] {
+        const FunctionRegistry registry = FunctionRegistry::default_registry();
+        return Builtins{
+            registry.find_function("sqrt")->unary,
+            registry.find_function("abs")->unary,
+            registry.find_function("min")->binary,
+            registry.find_function("max")->binary,
+        };
+    }();
+    return functions;
+}
+
+enum Register { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+enum Condition : uint8_t { AboveOrEqual = 0x3, NotEqual = 0x5, Above = 0x7 };
+
+// `base + index + disp`, or entry `pool` of the constant pool.
+struct Mem {
+    int     base  = RSP;
+    int     index = -1;
+    int32_t disp  = 0;
+    int     pool  = -1;
+};
+
+inline Mem at(int base, int32_t disp = 0) {
+    Mem m;
+    m.base = base;
+    m.disp = disp;
+    return m;
+}
+
+inline Mem indexed(int base, int index) {
+    Mem m = at(base);
+    m.index = index;
+    return m;
+}
+
+inline Mem constant(int entry) {
+    Mem m;
+    m.pool = entry;
+    return m;
+}
+
+// Just the encodings the code generator needs. Vector registers are xmm0
+// to xmm7 only, and VEX-encoded instructions only address memory through
+// the first eight general registers, so the two-byte VEX form always fits.
+class Assembler {
+public:
+    std::vector<uint8_t> code;
+
+    inline size_t size() const { return code.size(); }
+
+    int label() {
+        labels_.push_back(-1);
+        return static_cast<int>(labels_.size() - 1);
+    }
+
+    void bind(int label) { labels_[label] = static_cast<int64_t>(code.size()); }
+
+    // Entry of four copies of `value`, so packed instructions can use it.
+    int pool_entry(ExprFloat value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof bits);
+        auto it = pool_index_.find(bits);
+        if (it != pool_index_.end())
+            return it->second;
+        pool_.push_back(value);
+        return pool_index_[bits] = static_cast<int>(pool_.size() - 1);
+    }
+
+    // Appends the pool (32-byte aligned, relative to the start of the
+    // code) and resolves every reference.
+    void finish() {
+        while (code.size() % 32)
+            byte(0xCC);
+        const size_t pool_start = code.size();
+        for (ExprFloat value : pool_)
+            for (int copy = 0; copy < 4; ++copy)
+                for (size_t i = 0; i < sizeof value; ++i)
+                    code.push_back(reinterpret_cast<const uint8_t*>(&value)[i]);
+
+        for (const Fixup& f : label_fixups_)
+            patch(f.position, labels_[f.target] - static_cast<int64_t>(f.position + 4));
+        for (const Fixup& f : pool_fixups_)
+            patch(f.position, static_cast<int64_t>(pool_start + f.target * 32) - static_cast<int64_t>(f.position + 4));
+    }
+
+    void byte(uint8_t b) { code.push_back(b); }
+
+    void dword(uint32_t v) {
+        for (int i = 0; i < 4; ++i)
+            byte(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    void qword(uint64_t v) {
+        for (int i = 0; i < 8; ++i)
+            byte(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    // ModRM (and SIB, displacement) for register field `reg` and `m`.
+    void operand(int reg, const Mem& m) {
+        if (m.pool >= 0) {
+            byte(static_cast<uint8_t>(0x05 | (reg & 7) << 3));
+            pool_fixups_.push_back({ code.size(), m.pool });
+            dword(0);
+        } else if (m.index >= 0) {
+            byte(static_cast<uint8_t>(0x84 | (reg & 7) << 3));
+            byte(static_cast<uint8_t>((m.index & 7) << 3 | (m.base & 7)));
+            dword(static_cast<uint32_t>(m.disp));
+        } else {
+            byte(static_cast<uint8_t>(0x80 | (reg & 7) << 3 | (m.base & 7)));
+            if ((m.base & 7) == RSP)
+                byte(0x24);
+            dword(static_cast<uint32_t>(m.disp));
+        }
+    }
+
+    void rex(bool w, int reg, const Mem& m) {
+        const int b = m.pool < 0 && m.base >= 8;
+        const int x = m.pool < 0 && m.index >= 8;
+        const uint8_t prefix = static_cast<uint8_t>(0x40 | w << 3 | (reg >= 8) << 2 | x << 1 | b);
+        if (prefix != 0x40)
+            byte(prefix);
+    }
+
+    void rex_rr(bool w, int reg, int rm) {
+        const uint8_t prefix = static_cast<uint8_t>(0x40 | w << 3 | (reg >= 8) << 2 | (rm >= 8));
+        if (prefix != 0x40)
+            byte(prefix);
+    }
+
+    // Legacy SSE: `prefix 0F op /r`.
+    void sse(uint8_t prefix, uint8_t op, int reg, const Mem& m) {
+        if (prefix)
+            byte(prefix);
+        rex(false, reg, m);
+        byte(0x0F);
+        byte(op);
+        operand(reg, m);
+    }
+
+    void sse_rr(uint8_t prefix, uint8_t op, int reg, int rm) {
+        if (prefix)
+            byte(prefix);
+        byte(0x0F);
+        byte(op);
+        byte(static_cast<uint8_t>(0xC0 | reg << 3 | rm));
+    }
+
+    // Two-byte VEX, 256-bit, 66 prefix: `op reg, src1, m`.
+    void vex(uint8_t op, int reg, int src1, const Mem& m) {
+        byte(0xC5);
+        byte(static_cast<uint8_t>(0x80 | (~src1 & 15) << 3 | 0x04 | 0x01));
+        byte(op);
+        operand(reg, m);
+    }
+
+    void vex_rr(uint8_t op, int reg, int src1, int rm) {
+        byte(0xC5);
+        byte(static_cast<uint8_t>(0x80 | (~src1 & 15) << 3 | 0x04 | 0x01));
+        byte(op);
+        byte(static_cast<uint8_t>(0xC0 | reg << 3 | rm));
+    }
+
+    // Three-byte VEX, 0F38 map, W1, 66 prefix: `op reg, src1, rm` on
+    // registers, 256-bit when `wide`. Used for the FMA3 instructions.
+    void vex38_rr(uint8_t op, int reg, int src1, int rm, bool wide) {
+        byte(0xC4);
+        byte(0xE2);
+        byte(static_cast<uint8_t>(0x80 | (~src1 & 15) << 3 | (wide ? 0x04 : 0) | 0x01));
+        byte(op);
+        byte(static_cast<uint8_t>(0xC0 | reg << 3 | rm));
+    }
+
+    void vzeroupper() { byte(0xC5); byte(0xF8); byte(0x77); }
+
+    void push(int r) { if (r >= 8) byte(0x41); byte(static_cast<uint8_t>(0x50 + (r & 7))); }
+    void pop(int r)  { if (r >= 8) byte(0x41); byte(static_cast<uint8_t>(0x58 + (r & 7))); }
+    void ret() { byte(0xC3); }
+
+    void mov(int dst, int src) {
+        rex_rr(true, src, dst);
+        byte(0x89);
+        byte(static_cast<uint8_t>(0xC0 | (src & 7) << 3 | (dst & 7)));
+    }
+
+    void mov(int dst, uint64_t imm) {
+        byte(static_cast<uint8_t>(0x48 | (dst >= 8)));
+        byte(static_cast<uint8_t>(0xB8 + (dst & 7)));
+        qword(imm);
+    }
+
+    void mov32(int dst, uint32_t imm) {
+        if (dst >= 8) byte(0x41);
+        byte(static_cast<uint8_t>(0xB8 + (dst & 7)));
+        dword(imm);
+    }
+
+    void load(int dst, const Mem& m) {
+        rex(true, dst, m);
+        byte(0x8B);
+        operand(dst, m);
+    }
+
+    void lea(int dst, const Mem& m) {
+        rex(true, dst, m);
+        byte(0x8D);
+        operand(dst, m);
+    }
+
+    void add(int dst, int32_t imm) { rex_rr(true, 0, dst); byte(0x81); byte(static_cast<uint8_t>(0xC0 | (dst & 7))); dword(static_cast<uint32_t>(imm)); }
+    void sub(int dst, int32_t imm) { rex_rr(true, 0, dst); byte(0x81); byte(static_cast<uint8_t>(0xE8 | (dst & 7))); dword(static_cast<uint32_t>(imm)); }
+
+    // Flags of `lhs - rhs`.
+    void cmp(int lhs, int rhs) {
+        rex_rr(true, lhs, rhs);
+        byte(0x3B);
+        byte(static_cast<uint8_t>(0xC0 | (lhs & 7) << 3 | (rhs & 7)));
+    }
+
+    void zero(int r) {
+        rex_rr(false, r, r);
+        byte(0x31);
+        byte(static_cast<uint8_t>(0xC0 | (r & 7) << 3 | (r & 7)));
+    }
+
+    void test_rax() { byte(0x48); byte(0x85); byte(0xC0); }
+    void test_eax() { byte(0x85); byte(0xC0); }
+
+    void call(const void* fn) {
+        mov(RAX, reinterpret_cast<uint64_t>(fn));
+        byte(0xFF);
+        byte(0xD0);
+    }
+
+    void jmp(int label) {
+        byte(0xE9);
+        label_fixups_.push_back({ code.size(), label });
+        dword(0);
+    }
+
+    void jcc(Condition condition, int label) {
+        byte(0x0F);
+        byte(static_cast<uint8_t>(0x80 | condition));
+        label_fixups_.push_back({ code.size(), label });
+        dword(0);
+    }
+
+private:
+    struct Fixup {
+        size_t position;
+        int    target;
+    };
+
+    std::vector<int64_t>         labels_;
+    std::vector<Fixup>           label_fixups_;
+    std::vector<Fixup>           pool_fixups_;
+    std::vector<ExprFloat>       pool_;
+    std::map<uint64_t, int>      pool_index_;
+
+    void patch(size_t position, int64_t value) {
+        const uint32_t v = static_cast<uint32_t>(static_cast<int32_t>(value));
+        for (int i = 0; i < 4; ++i)
+            code[position + i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+};
+
+constexpr uint8_t op_add = 0x58, op_mul = 0x59, op_sub = 0x5C, op_div = 0x5E;
+constexpr uint8_t op_load = 0x10, op_store = 0x11, op_move = 0x28, op_and = 0x54, op_xor = 0x57;
+constexpr uint8_t op_sqrt = 0x51, op_min = 0x5D, op_max = 0x5F;
+constexpr uint8_t op_fmadd213pd = 0xA8, op_fmadd213sd = 0xA9, op_fmadd231pd = 0xB8, op_fmadd231sd = 0xB9;
+
+// Mirrors `Bytecode::run` with `width` rows at a time: the accumulator is
+// xmm0 (or ymm0), the stack, temporaries and per-lane buffers live in the
+// frame, and constants in the pool. Anything that is not plain arithmetic
+// is called one lane at a time through the helpers above.
+//
+// In the scalar function r12 holds `vars`. In the batch function r12 holds
+// `columns`, r13 `n`, r14 `out`, r15 the row and rbx its byte offset.
+class CodeGenerator {
+public:
+    CodeGenerator(Assembler& a, const Bytecode& code) :
+        a_(a),
+        code_(code),
+        functions_(code.functions()),
+        variables_(code.variable_count()) {
+        // Sized for four lanes, whatever the width of each body
+        const int32_t lane = 4 * sizeof(ExprFloat);
+        stack_base_     = 0;
+        temporary_base_ = stack_base_ + static_cast<int32_t>(code.max_stack_depth() + 1) * lane;
+        lhs_lanes_      = temporary_base_ + static_cast<int32_t>(code.temporary_count()) * lane;
+        rhs_lanes_      = lhs_lanes_ + lane;
+        frame_size_     = rhs_lanes_ + lane + 8;
+    }
+
+    void scalar_function() {
+        const int error = a_.label(), division = a_.label(), done = a_.label();
+        prologue();
+        a_.mov(R12, RDI);
+        body(1, false, division, error);
+        a_.jmp(done);
+
+        a_.bind(division);
+        a_.call(reinterpret_cast<const void*>(jit_division_by_zero));
+        a_.bind(error);
+        a_.sse(0xF2, op_load, 0, constant(a_.pool_entry(std::numeric_limits<ExprFloat>::quiet_NaN())));
+        a_.bind(done);
+        epilogue();
+    }
+
+    void batch_function(unsigned width) {
+        const int error = a_.label(), division = a_.label(), done = a_.label();
+        const int packed = a_.label(), tail = a_.label();
+        prologue();
+        a_.mov(R12, RDI);
+        a_.mov(R13, RSI);
+        a_.mov(R14, RDX);
+        a_.zero(RBX);
+        a_.zero(R15);
+
+        if (width > 1) {
+            a_.bind(packed);
+            a_.lea(RAX, at(R15, static_cast<int32_t>(width)));
+            a_.cmp(RAX, R13);
+            a_.jcc(Above, tail);
+            body(width, true, division, error);
+            a_.mov(RAX, R14);
+            store(width, indexed(RAX, RBX), 0);
+            a_.add(R15, static_cast<int32_t>(width));
+            a_.add(RBX, static_cast<int32_t>(width * sizeof(ExprFloat)));
+            a_.jmp(packed);
+        }
+
+        a_.bind(tail);
+        if (width == 4)
+            a_.vzeroupper();
+        const int loop = a_.label();
+        a_.bind(loop);
+        a_.cmp(R15, R13);
+        a_.jcc(AboveOrEqual, done);
+        body(1, true, division, error);
+        a_.mov(RAX, R14);
+        store(1, indexed(RAX, RBX), 0);
+        a_.add(R15, 1);
+        a_.add(RBX, sizeof(ExprFloat));
+        a_.jmp(loop);
+
+        a_.bind(division);
+        if (width == 4)
+            a_.vzeroupper();
+        a_.call(reinterpret_cast<const void*>(jit_division_by_zero));
+        a_.bind(error);
+        a_.bind(done);
+        if (width == 4)
+            a_.vzeroupper();
+        epilogue();
+    }
+
+private:
+    Assembler&                           a_;
+    const Bytecode&                      code_;
+    const std::vector<FunctionEntryPtr>& functions_;
+    size_t                               variables_;
+
+    int32_t stack_base_, temporary_base_, lhs_lanes_, rhs_lanes_, frame_size_;
+
+    // Saves rbp and every callee-saved register used, and aligns the stack
+    // for calls (six pushes after the return address, so the frame size is
+    // 8 modulo 16).
+    void prologue() {
+        a_.push(RBP);
+        a_.mov(RBP, RSP);
+        a_.push(RBX);
+        a_.push(R12);
+        a_.push(R13);
+        a_.push(R14);
+        a_.push(R15);
+        a_.sub(RSP, frame_size_);
+    }
+
+    void epilogue() {
+        a_.add(RSP, frame_size_);
+        a_.pop(R15);
+        a_.pop(R14);
+        a_.pop(R13);
+        a_.pop(R12);
+        a_.pop(RBX);
+        a_.pop(RBP);
+        a_.ret();
+    }
+
+    inline Mem stack_slot(size_t level) const { return at(RSP, stack_base_ + static_cast<int32_t>(level) * 32); }
+
+    // Stack entries are packed 8 bytes apart in the scalar function, so a
+    // call's arguments are contiguous there.
+    inline Mem scalar_stack_slot(size_t level) const { return at(RSP, stack_base_ + static_cast<int32_t>(level * sizeof(ExprFloat))); }
+
+    // Memory holding variable or temporary `slot`; in the batch function
+    // this first loads the column pointer into rax.
+    Mem variable(uint32_t slot, bool batch) {
+        if (slot >= variables_)
+            return at(RSP, temporary_base_ + static_cast<int32_t>(slot - variables_) * 32);
+        if (!batch)
+            return at(R12, static_cast<int32_t>(slot * sizeof(ExprFloat)));
+        a_.load(RAX, at(R12, static_cast<int32_t>(slot * sizeof(ExprFloat))));
+        return indexed(RAX, RBX);
+    }
+
+    void load(unsigned width, int reg, const Mem& m) {
+        if (width == 4)
+            a_.vex(op_load, reg, 0, m);
+        else
+            a_.sse(width == 1 ? 0xF2 : 0x66, op_load, reg, m);
+    }
+
+    void store(unsigned width, const Mem& m, int reg) {
+        if (width == 4)
+            a_.vex(op_store, reg, 0, m);
+        else
+            a_.sse(width == 1 ? 0xF2 : 0x66, op_store, reg, m);
+    }
+
+    void move(unsigned width, int dst, int src) {
+        if (width == 4)
+            a_.vex_rr(op_move, dst, 0, src);
+        else
+            a_.sse_rr(0x66, op_move, dst, src);
+    }
+
+    // dst = dst op src
+    void arithmetic(unsigned width, uint8_t op, int dst, int src) {
+        if (width == 4)
+            a_.vex_rr(op, dst, dst, src);
+        else
+            a_.sse_rr(width == 1 ? 0xF2 : 0x66, op, dst, src);
+    }
+
+    void arithmetic(unsigned width, uint8_t op, int dst, const Mem& src) {
+        if (width == 4)
+            a_.vex(op, dst, dst, src);
+        else
+            a_.sse(width == 1 ? 0xF2 : 0x66, op, dst, src);
+    }
+
+    // Jumps to `division` if any lane of xmm1 is zero.
+    void check_divisor(unsigned width, int division) {
+        if (width == 4) {
+            a_.vex_rr(op_xor, 7, 7, 7);
+            a_.vex_rr(0xC2, 7, 7, 1);
+            a_.byte(0x00);                          // EQ
+            a_.vex_rr(0x50, RAX, 0, 7);             // vmovmskpd eax, ymm7
+        } else {
+            a_.sse_rr(0x66, op_xor, 7, 7);
+            a_.sse_rr(width == 1 ? 0xF2 : 0x66, 0xC2, 7, 1);
+            a_.byte(0x00);
+            a_.sse_rr(0x66, 0x50, RAX, 7);          // movmskpd eax, xmm7
+        }
+        a_.test_eax();
+        a_.jcc(NotEqual, division);
+    }
+
+    // Calls `fn`, whose floating-point arguments are already in xmm0 and
+    // xmm1, and leaves the error path if it reports a failure.
+    void call(const void* fn, bool can_fail, int error) {
+        a_.call(fn);
+        if (can_fail) {
+            a_.test_rax();
+            a_.jcc(NotEqual, error);
+        }
+    }
+
+    // Spills xmm0 (and xmm1 when `binary`) to the lane buffers and calls the
+    // packed helper `fn` on them, after `function` if it is not null. The
+    // results come back in xmm0.
+    void call_lanes(unsigned width, bool binary, const void* fn, const void* function, int error) {
+        store(width, at(RSP, lhs_lanes_), 0);
+        if (binary)
+            store(width, at(RSP, rhs_lanes_), 1);
+        if (width == 4)
+            a_.vzeroupper();
+
+        const int registers[] = { RDI, RSI, RDX, RCX };
+        size_t next = 0;
+        if (function)
+            a_.mov(registers[next++], reinterpret_cast<uint64_t>(function));
+        a_.lea(registers[next++], at(RSP, lhs_lanes_));
+        if (binary)
+            a_.lea(registers[next++], at(RSP, rhs_lanes_));
+        a_.mov32(registers[next], width);
+        call(fn, true, error);
+        load(width, 0, at(RSP, lhs_lanes_));
+    }
+
+    void body(unsigned width, bool batch, int division, int error) {
+        auto slot = [&](size_t level) { return width == 1 ? scalar_stack_slot(level) : stack_slot(level); };
+        size_t sp = 0;
+
+        for (const Instruction& ins : code_.instructions()) {
+            switch (ins.op) {
+                case OpCode::Constant:
+                    store(width, slot(sp++), 0);
+                    load(width, 0, constant(a_.pool_entry(ins.value)));
+                    break;
+                case OpCode::Variable:
+                    store(width, slot(sp++), 0);
+                    load(width, 0, variable(ins.arg, batch));
+                    break;
+
+                case OpCode::Add: case OpCode::Subtract: case OpCode::Multiply: case OpCode::Divide:
+                case OpCode::Modulo: case OpCode::Power:
+                    move(width, 1, 0);
+                    load(width, 0, slot(--sp));
+                    binary(width, ins.op, division, error);
+                    break;
+                case OpCode::AddConstant: case OpCode::SubtractConstant: case OpCode::MultiplyConstant:
+                case OpCode::DivideConstant: case OpCode::ModuloConstant: case OpCode::PowerConstant:
+                    if (ins.op == OpCode::DivideConstant && ins.value == 0.0) {
+                        a_.jmp(division);
+                        break;
+                    }
+                    load(width, 1, constant(a_.pool_entry(ins.value)));
+                    binary(width, static_cast<OpCode>(static_cast<int>(ins.op) - 1), division, error);
+                    break;
+                case OpCode::AddVariable: case OpCode::SubtractVariable: case OpCode::MultiplyVariable:
+                case OpCode::DivideVariable: case OpCode::ModuloVariable: case OpCode::PowerVariable:
+                    load(width, 1, variable(ins.arg, batch));
+                    binary(width, static_cast<OpCode>(static_cast<int>(ins.op) - 2), division, error);
+                    break;
+
+                case OpCode::Negate:
+                    if (width == 4)
+                        a_.vex(op_xor, 0, 0, constant(a_.pool_entry(-0.0)));
+                    else
+                        a_.sse(0x66, op_xor, 0, constant(a_.pool_entry(-0.0)));
+                    break;
+
+                case OpCode::CallUnary: {
+                    const UnaryFunction fn = functions_[ins.arg]->unary;
+                    if (fn == builtins().sqrt) {
+                        if (width == 4)
+                            a_.vex_rr(op_sqrt, 0, 0, 0);
+                        else
+                            a_.sse_rr(width == 1 ? 0xF2 : 0x66, op_sqrt, 0, 0);
+                    } else if (fn == builtins().abs) {
+                        // Clear the sign bit
+                        const uint64_t bits = 0x7FFFFFFFFFFFFFFFull;
+                        ExprFloat mask;
+                        std::memcpy(&mask, &bits, sizeof mask);
+                        load(width, 1, constant(a_.pool_entry(mask)));
+                        if (width == 4)
+                            a_.vex_rr(op_and, 0, 0, 1);
+                        else
+                            a_.sse_rr(0x66, op_and, 0, 1);
+                    } else if (width == 1) {
+                        a_.mov(RDI, reinterpret_cast<uint64_t>(fn));
+                        call(reinterpret_cast<const void*>(jit_unary), true, error);
+                    } else {
+                        call_lanes(width, false, reinterpret_cast<const void*>(jit_unary_lanes), reinterpret_cast<const void*>(fn), error);
+                    }
+                    break;
+                }
+                case OpCode::CallBinary: {
+                    const BinaryFunction fn = functions_[ins.arg]->binary;
+                    move(width, 1, 0);
+                    load(width, 0, slot(--sp));
+                    if (fn == builtins().min || fn == builtins().max) {
+                        // min(a, b) is `b < a ? b : a`, which is minsd b, a
+                        arithmetic(width, fn == builtins().min ? op_min : op_max, 1, 0);
+                        move(width, 0, 1);
+                    } else if (width == 1) {
+                        a_.mov(RDI, reinterpret_cast<uint64_t>(fn));
+                        call(reinterpret_cast<const void*>(jit_binary), true, error);
+                    } else {
+                        call_lanes(width, true, reinterpret_cast<const void*>(jit_binary_lanes), reinterpret_cast<const void*>(fn), error);
+                    }
+                    break;
+                }
+                case OpCode::Call: {
+                    // The arguments are the stack entries from `sp` up, once
+                    // the accumulator is spilled.
+                    const FunctionEntry* fn = functions_[ins.arg].get();
+                    store(width, slot(sp++), 0);
+                    sp -= ins.count;
+                    a_.mov(RDI, reinterpret_cast<uint64_t>(fn));
+                    a_.lea(RSI, slot(sp));
+                    a_.mov32(RDX, ins.count);
+                    if (width == 1) {
+                        call(reinterpret_cast<const void*>(jit_call), true, error);
+                    } else {
+                        if (width == 4)
+                            a_.vzeroupper();
+                        a_.lea(RCX, at(RSP, lhs_lanes_));
+                        a_.mov32(R8, width);
+                        call(reinterpret_cast<const void*>(jit_call_lanes), true, error);
+                        load(width, 0, at(RSP, lhs_lanes_));
+                    }
+                    break;
+                }
+                case OpCode::Store:
+                    store(width, variable(ins.arg, batch), 0);
+                    break;
+                case OpCode::StorePop:
+                    store(width, variable(ins.arg, batch), 0);
+                    load(width, 0, slot(--sp));
+                    break;
+
+                case OpCode::MultiplyAdd:
+                    load(width, 1, slot(--sp));
+                    load(width, 2, slot(--sp));
+                    a_.vex38_rr(width == 1 ? op_fmadd231sd : op_fmadd231pd, 0, 2, 1, width == 4);   // xmm0 = xmm2 * xmm1 + xmm0
+                    break;
+                case OpCode::MultiplyConstantAdd:
+                    load(width, 1, slot(--sp));
+                    load(width, 2, constant(a_.pool_entry(ins.value)));
+                    a_.vex38_rr(width == 1 ? op_fmadd213sd : op_fmadd213pd, 0, 2, 1, width == 4);   // xmm0 = xmm2 * xmm0 + xmm1
+                    break;
+                case OpCode::MultiplyVariableAddConstant:
+                    load(width, 1, variable(ins.arg, batch));
+                    load(width, 2, constant(a_.pool_entry(ins.value)));
+                    a_.vex38_rr(width == 1 ? op_fmadd213sd : op_fmadd213pd, 0, 1, 2, width == 4);   // xmm0 = xmm1 * xmm0 + xmm2
+                    break;
+            }
+        }
+    }
+
+    // xmm0 = xmm0 op xmm1, where `op` is the stack form of the operation.
+    void binary(unsigned width, OpCode op, int division, int error) {
+        switch (op) {
+            case OpCode::Add:      arithmetic(width, op_add, 0, 1); break;
+            case OpCode::Subtract: arithmetic(width, op_sub, 0, 1); break;
+            case OpCode::Multiply: arithmetic(width, op_mul, 0, 1); break;
+            case OpCode::Divide:
+                check_divisor(width, division);
+                arithmetic(width, op_div, 0, 1);
+                break;
+            case OpCode::Modulo:
+                if (width == 1)
+                    call(reinterpret_cast<const void*>(jit_modulo), true, error);
+                else
+                    call_lanes(width, true, reinterpret_cast<const void*>(jit_modulo_lanes), nullptr, error);
+                break;
+            case OpCode::Power:
+                if (width == 1)
+                    call(reinterpret_cast<const void*>(jit_pow), false, error);
+                else
+                    call_lanes(width, true, reinterpret_cast<const void*>(jit_pow_lanes), nullptr, error);
+                break;
+            default:
+                throw std::logic_error("Not a binary operation");
+        }
+    }
+};
+
+std::mutex perf_map_mutex;
+
+void write_perf_map(const void* start, size_t size, const std::string& name) {
+    std::lock_guard<std::mutex> lock(perf_map_mutex);
+    char path[64];
+    std::snprintf(path, sizeof path, "/tmp/perf-%ld.map", static_cast<long>(getpid()));
+    if (FILE* file = std::fopen(path, "a")) {
+        std::fprintf(file, "%lx %zx %s\n", static_cast<unsigned long>(reinterpret_cast<uintptr_t>(start)), size, name.c_str());
+        std::fclose(file);
+    }
+}
+
+}   // namespace
+
+bool JitExpr::available() {
+    return true;
+}
+
+JitExpr::JitExpr(const Bytecode& code, const std::string& name) : bytecode_(code) {
+    const SimdLevel level = get_simd_level();
+    const unsigned width = level >= SimdLevel::AVX2 ? 4 : level >= SimdLevel::SSE2 ? 2 : 1;
+
+    // FastMath emits fused multiply-adds; without FMA3 keep interpreting
+    __builtin_cpu_init();
+    for (const Instruction& ins : bytecode_.instructions()) {
+        const bool fused = ins.op == OpCode::MultiplyAdd || ins.op == OpCode::MultiplyConstantAdd
+            || ins.op == OpCode::MultiplyVariableAddConstant;
+        if (fused && !__builtin_cpu_supports("fma"))
+            return;
+    }
+
+    Assembler a;
+    CodeGenerator generator(a, bytecode_);
+    const size_t scalar_start = a.size();
+    generator.scalar_function();
+    while (a.size() % 16)
+        a.byte(0xCC);
+    const size_t batch_start = a.size();
+    generator.batch_function(width);
+    const size_t code_end = a.size();
+    a.finish();
+
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t size = (a.code.size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return;     // Keep interpreting
+    std::memcpy(memory, a.code.data(), a.code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return;
+    }
+
+    memory_   = memory;
+    size_     = size;
+    char* base = static_cast<char*>(memory);
+    function_ = reinterpret_cast<ScalarFunction>(base + scalar_start);
+    batch_    = reinterpret_cast<BatchFunction>(base + batch_start);
+
+    if (perf_map_wanted()) {
+        write_perf_map(base + scalar_start, batch_start - scalar_start, "cppexprpars::jit::" + name);
+        write_perf_map(base + batch_start, code_end - batch_start, "cppexprpars::jit::" + name + "::batch");
+    }
+}
+
+JitExpr::~JitExpr() {
+    if (memory_)
+        munmap(memory_, size_);
+}
+
+#else
+
+bool JitExpr::available() {
+    return false;
+}
+
+JitExpr::JitExpr(const Bytecode& code, const std::string&) : bytecode_(code) {}
+
+JitExpr::~JitExpr() = default;
+
+#endif
+
+JitExpr::JitExpr(JitExpr&& other) noexcept :
+    bytecode_(std::move(other.bytecode_)),
+    memory_(other.memory_),
+    size_(other.size_),
+    function_(other.function_),
+    batch_(other.batch_) {
+    other.memory_   = nullptr;
+    other.size_     = 0;
+    other.function_ = nullptr;
+    other.batch_    = nullptr;
+}
+
+JitExpr& JitExpr::operator=(JitExpr&& other) noexcept {
+    if (this != &other) {
+        JitExpr old(std::move(*this));
+        bytecode_ = std::move(other.bytecode_);
+        std::swap(memory_, other.memory_);
+        std::swap(size_, other.size_);
+        std::swap(function_, other.function_);
+        std::swap(batch_, other.batch_);
+    }
+    return *this;
+}
+
+ExprFloat JitExpr::execute(const ExprFloat* vars) const {
+    if (!function_)
+        return bytecode_.execute(vars);
+    error_pending = false;
+    const ExprFloat result = function_(vars);
+    if (error_pending)
+        std::rethrow_exception(take_error());
+    return result;
+}
+
+void JitExpr::evaluate_batch(const ExprFloat* const* columns, size_t n, ExprFloat* out) const {
+    bool complete = batch_ != nullptr;
+    for (size_t i = 0; complete && i < bytecode_.variable_count(); ++i)
+        complete = columns && columns[i];
+    if (!complete) {
+        bytecode_.evaluate_batch(columns, n, out);
+        return;
+    }
+
+    error_pending = false;
+    batch_(columns, n, out);
+    if (error_pending)
+        std::rethrow_exception(take_error());
+}
+
+}   // namespace cppexprpars
@@ -0,0 +1,145 @@
+//  memory.cpp - Lightweight C++ Expression Parser (Memory Resources)
+//
+//  This file implements the memory resources expression trees can be built
+//  in, and the allocation functions of expression nodes.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+#include "cppexprpars.hpp"
+#include <new>
+
+
+namespace cppexprpars {
+
+namespace {
+
+class NewDeleteResource : public MemoryResource {
+protected:
+    void* do_allocate(size_t bytes, size_t) override {
+        return ::operator new(bytes);
+    }
+
+    void do_deallocate(void* ptr, size_t, size_t) override {
+        ::operator delete(ptr);
+    }
+};
+
+inline size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+}   // namespace
+
+MemoryResource* new_delete_resource() {
+    static NewDeleteResource resource;
+    return &resource;
+}
+
+
+
+void* Arena::do_allocate(size_t bytes, size_t alignment) {
+    char* ptr = reinterpret_cast<char*>(align_up(reinterpret_cast<uintptr_t>(cursor_), alignment));
+    if (!cursor_ || ptr + bytes > end_) {
+        const size_t header = align_up(sizeof(Block), alignof(std::max_align_t));
+        const size_t size = std::max(next_block_size_, header + bytes + alignment);
+        Block* block = static_cast<Block*>(upstream_->allocate(size, alignof(std::max_align_t)));
+        block->next = blocks_;
+        block->size = size;
+        blocks_ = block;
+        cursor_ = reinterpret_cast<char*>(block) + header;
+        end_    = reinterpret_cast<char*>(block) + size;
+        next_block_size_ = size * 2;
+        ptr = reinterpret_cast<char*>(align_up(reinterpret_cast<uintptr_t>(cursor_), alignment));
+    }
+
+    cursor_ = ptr + bytes;
+    allocated_ += bytes;
+    return ptr;
+}
+
+void Arena::release() {
+    while (blocks_) {
+        Block* next = blocks_->next;
+        upstream_->deallocate(blocks_, blocks_->size, alignof(std::max_align_t));
+        blocks_ = next;
+    }
+    cursor_ = end_ = nullptr;
+    allocated_ = 0;
+    next_block_size_ = initial_block_size_;
+}
+
+
+
+// The resource and the size of the allocation live in a header in front of
+// the node, padded so the node itself keeps the strictest fundamental
+// alignment. The size is needed when a constructor throws, where only the
+// placement form of operator delete is called.
+namespace {
+
+struct NodeHeader {
+    MemoryResource* resource;
+    size_t          size;
+};
+
+constexpr size_t node_header_size = alignof(std::max_align_t);
+static_assert(sizeof(NodeHeader) <= node_header_size, "Node header too large");
+
+void free_node(void* ptr) {
+    NodeHeader* header = reinterpret_cast<NodeHeader*>(static_cast<char*>(ptr) - node_header_size);
+    if (header->resource)
+        header->resource->deallocate(header, header->size, alignof(std::max_align_t));
+    else
+        ::operator delete(header);
+}
+
+}   // namespace
+
+void* ExprNode::operator new(size_t size) {
+    return operator new(size, nullptr);
+}
+
+void* ExprNode::operator new(size_t size, MemoryResource* resource) {
+    const size_t total = node_header_size + size;
+    void* memory = resource ? resource->allocate(total, alignof(std::max_align_t)) : ::operator new(total);
+    NodeHeader* header = static_cast<NodeHeader*>(memory);
+    header->resource = resource;
+    header->size     = total;
+    return static_cast<char*>(memory) + node_header_size;
+}
+
+void ExprNode::operator delete(void* ptr, size_t) {
+    if (ptr)
+        free_node(ptr);
+}
+
+void ExprNode::operator delete(void* ptr, MemoryResource*) {
+    free_node(ptr);
+}
+
+}   // namespace cppexprpars
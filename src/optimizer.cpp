@@ -0,0 +1,462 @@
+//  optimizer.cpp - Lightweight C++ Expression Parser (Optimizer)
+//
+//  This file implements the pass that folds constant subtrees and applies
+//  algebraic simplifications to parsed expression trees before they are
+//  lowered to bytecode.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+#include "cppexprpars.hpp"
+
+
+namespace cppexprpars {
+
+static inline bool is_constant(const ExprNode& node) {
+    return node.type() == ExprNodeType::Constant;
+}
+
+static inline ExprFloat constant_value(const ExprNode& node) {
+    return static_cast<const ConstantExprNode&>(node).value();
+}
+
+// True for a constant equal to `value`, including the sign of zero.
+static bool is_constant(const ExprNode& node, ExprFloat value) {
+    if (!is_constant(node))
+        return false;
+    const ExprFloat c = constant_value(node);
+    return c == value && std::signbit(c) == std::signbit(value);
+}
+
+// A non-zero power of two whose reciprocal is also a normal number, so that
+// `x / c` and `x * (1 / c)` round identically for every `x`.
+static bool has_exact_reciprocal(ExprFloat c) {
+    if (!std::isfinite(c) || c == 0.0)
+        return false;
+    int exponent;
+    if (std::abs(std::frexp(c, &exponent)) != 0.5)
+        return false;
+    const ExprFloat reciprocal = 1.0 / c;
+    return std::isnormal(reciprocal);
+}
+
+// Whether the subtree can be dropped without losing a side effect.
+static bool is_pure(const ExprNode& node) {
+    switch (node.type()) {
+        case ExprNodeType::Constant:
+        case ExprNodeType::Variable:
+            return true;
+        case ExprNodeType::Binary: {
+            const auto& bin = static_cast<const BinaryExprNode&>(node);
+            return is_pure(bin.left()) && is_pure(bin.right());
+        }
+        case ExprNodeType::Unary:
+            return is_pure(static_cast<const UnaryExprNode&>(node).operand());
+        case ExprNodeType::Function: {
+            const auto& fn = static_cast<const FuncExprNode&>(node);
+            if (!fn.function()->pure || !fn.arity_matches())
+                return false;
+            for (const ExprNodePtr& arg : fn.args())
+                if (!is_pure(*arg))
+                    return false;
+            return true;
+        }
+    }
+    return false;
+}
+
+static ExprNodePtr make_constant(ExprFloat value) {
+    return std::make_unique<ConstantExprNode>(value);
+}
+
+template <typename Node>
+static std::unique_ptr<Node> downcast(ExprNodePtr node) {
+    return std::unique_ptr<Node>(static_cast<Node*>(node.release()));
+}
+
+static ExprNodePtr make_binary(BinaryOp op, ExprNodePtr lhs, ExprNodePtr rhs) {
+    return std::make_unique<BinaryExprNode>(op, std::move(lhs), std::move(rhs));
+}
+
+// Holds the `fma` that contractions call, whatever registry the expression
+// was parsed with. The bytecode recognises it and lowers it to its
+// multiply-add instructions, so neither that registry nor the one an image
+// is loaded with (see `ExpressionImage`) needs an `fma` of its own.
+static const FunctionRegistry& builtin_registry() {
+    static const FunctionRegistry registry = FunctionRegistry::default_registry();
+    return registry;
+}
+
+// `fma(a, b, c)`. The factors may come in either order: the bytecode
+// picks whichever one fits its instructions.
+static ExprNodePtr make_fma(ExprNodePtr a, ExprNodePtr b, ExprNodePtr c) {
+    std::vector<ExprNodePtr> args;
+    args.push_back(std::move(a));
+    args.push_back(std::move(b));
+    args.push_back(std::move(c));
+    return std::make_unique<FuncExprNode>("fma", std::move(args), &builtin_registry());
+}
+
+// Integer powers up to this one are expanded into multiplications.
+static constexpr ExprFloat max_power_chain = 8;
+
+// Highest degree of a polynomial rewritten into Horner form.
+static constexpr int max_polynomial_degree = 64;
+
+static inline bool same_variable(const VariableExprNode& a, const VariableExprNode& b) {
+    return a.context() && a.context() == b.context() && a.slot() == b.slot();
+}
+
+// Decomposes `node` as `coefficient * x ^ power`, a product of constants and
+// integer powers of a single variable `x` (null until a term names one).
+static bool monomial(const ExprNode& node, const VariableExprNode*& x, ExprFloat& coefficient, int& power) {
+    switch (node.type()) {
+        case ExprNodeType::Constant:
+            coefficient = constant_value(node);
+            power = 0;
+            return true;
+
+        case ExprNodeType::Variable: {
+            const auto& var = static_cast<const VariableExprNode&>(node);
+            if (!var.context() || (x && !same_variable(*x, var)))
+                return false;
+            x = &var;
+            coefficient = 1.0;
+            power = 1;
+            return true;
+        }
+
+        case ExprNodeType::Unary: {
+            const auto& unary = static_cast<const UnaryExprNode&>(node);
+            if (!monomial(unary.operand(), x, coefficient, power))
+                return false;
+            if (unary.op() == UnaryOp::Minus)
+                coefficient = -coefficient;
+            return true;
+        }
+
+        case ExprNodeType::Binary: {
+            const auto& bin = static_cast<const BinaryExprNode&>(node);
+            ExprFloat c;
+            int p;
+            if (!monomial(bin.left(), x, coefficient, power))
+                return false;
+            if (bin.op() == BinaryOp::Power) {
+                if (!is_constant(bin.right()))
+                    return false;
+                const ExprFloat n = constant_value(bin.right());
+                if (n != std::floor(n) || n < 0 || n * power > max_polynomial_degree)
+                    return false;
+                coefficient = std::pow(coefficient, n);
+                power *= static_cast<int>(n);
+                return true;
+            }
+            if (!monomial(bin.right(), x, c, p))
+                return false;
+            if (bin.op() == BinaryOp::Multiply && power + p <= max_polynomial_degree) {
+                coefficient *= c;
+                power += p;
+                return true;
+            }
+            if (bin.op() == BinaryOp::Divide && p == 0 && c != 0.0) {
+                coefficient /= c;
+                return true;
+            }
+            return false;
+        }
+
+        default:
+            return false;
+    }
+}
+
+// Adds the terms of a sum of monomials, times `sign`, to `coefficients`
+// (indexed by power).
+static bool polynomial(
+    const ExprNode& node,
+    ExprFloat sign,
+    const VariableExprNode*& x,
+    std::vector<ExprFloat>& coefficients,
+    size_t& terms
+) {
+    if (node.type() == ExprNodeType::Binary) {
+        const auto& bin = static_cast<const BinaryExprNode&>(node);
+        if (bin.op() == BinaryOp::Add || bin.op() == BinaryOp::Subtract)
+            return polynomial(bin.left(), sign, x, coefficients, terms) &&
+                   polynomial(bin.right(), bin.op() == BinaryOp::Add ? sign : -sign, x, coefficients, terms);
+    }
+    if (node.type() == ExprNodeType::Unary && static_cast<const UnaryExprNode&>(node).op() == UnaryOp::Minus)
+        return polynomial(static_cast<const UnaryExprNode&>(node).operand(), -sign, x, coefficients, terms);
+
+    ExprFloat coefficient;
+    int power;
+    if (!monomial(node, x, coefficient, power))
+        return false;
+    if (coefficients.size() <= static_cast<size_t>(power))
+        coefficients.resize(power + 1, 0.0);
+    coefficients[power] += sign * coefficient;
+    ++terms;
+    return true;
+}
+
+// Rewrites a polynomial of degree 2 or more in a single variable, written
+// as a sum of terms, into Horner form: `((c3 * x + c2) * x + c1) * x + c0`.
+// Null when `node` is not such a polynomial.
+static ExprNodePtr horner(const ExprNode& node) {
+    const VariableExprNode* x = nullptr;
+    std::vector<ExprFloat> coefficients;
+    size_t terms = 0;
+    if (!polynomial(node, 1.0, x, coefficients, terms) || !x || terms < 2)
+        return nullptr;
+    while (!coefficients.empty() && coefficients.back() == 0.0)
+        coefficients.pop_back();
+    if (coefficients.size() < 3)
+        return nullptr;
+
+    ExprNodePtr result = make_constant(coefficients.back());
+    for (size_t k = coefficients.size() - 1; k-- > 0;) {
+        result = make_binary(BinaryOp::Multiply, std::move(result), std::make_unique<VariableExprNode>(*x));
+        if (coefficients[k] != 0.0)
+            result = make_binary(BinaryOp::Add, std::move(result), make_constant(coefficients[k]));
+    }
+    return result;
+}
+
+ExprNodePtr Optimizer::optimize(ExprNodePtr node) const {
+    return optimize(std::move(node), false);
+}
+
+ExprNodePtr Optimizer::optimize(ExprNodePtr node, bool in_sum) const {
+    if (level_ == OptimizationLevel::None || !node)
+        return node;
+
+    // Polynomials are recognized from the top of their sum, before their
+    // terms are rewritten or contracted. Looking again from every node
+    // inside the sum would make long sums quadratic.
+    if (level_ == OptimizationLevel::FastMath && !in_sum &&
+        (node->type() == ExprNodeType::Binary || node->type() == ExprNodeType::Unary)) {
+        if (ExprNodePtr rewritten = horner(*node))
+            node = std::move(rewritten);
+    }
+
+    switch (node->type()) {
+        case ExprNodeType::Binary:
+            return optimize_binary(downcast<BinaryExprNode>(std::move(node)));
+        case ExprNodeType::Unary:
+            return optimize_unary(downcast<UnaryExprNode>(std::move(node)));
+        case ExprNodeType::Function:
+            return optimize_function(downcast<FuncExprNode>(std::move(node)));
+        default:
+            return node;
+    }
+}
+
+ExprNodePtr Optimizer::optimize_binary(std::unique_ptr<BinaryExprNode> node) const {
+    const bool sum = node->op_ == BinaryOp::Add || node->op_ == BinaryOp::Subtract;
+    node->left_  = optimize(std::move(node->left_), sum);
+    node->right_ = optimize(std::move(node->right_), sum);
+
+    const BinaryOp op = node->op_;
+    ExprNodePtr& lhs = node->left_;
+    ExprNodePtr& rhs = node->right_;
+
+    if (is_constant(*lhs) && is_constant(*rhs)) {
+        const ExprFloat r = constant_value(*rhs);
+        // Leave errors to evaluation time
+        const bool throws =
+            (op == BinaryOp::Divide && r == 0.0) ||
+            (op == BinaryOp::Modulo && (r == 0.0 || (ExprInt)r == 0));
+        if (!throws)
+            return make_constant(node->evaluate());
+    }
+
+    // Identities that hold bit for bit, for every value of the other operand
+    switch (op) {
+        case BinaryOp::Add:
+            if (is_constant(*rhs, -0.0)) return std::move(lhs);
+            if (is_constant(*lhs, -0.0)) return std::move(rhs);
+            break;
+        case BinaryOp::Subtract:
+            if (is_constant(*rhs, 0.0)) return std::move(lhs);
+            break;
+        case BinaryOp::Multiply:
+            if (is_constant(*rhs, 1.0)) return std::move(lhs);
+            if (is_constant(*lhs, 1.0)) return std::move(rhs);
+            break;
+        case BinaryOp::Divide:
+            if (is_constant(*rhs, 1.0)) return std::move(lhs);
+            if (is_constant(*rhs) && has_exact_reciprocal(constant_value(*rhs))) {
+                node->op_ = BinaryOp::Multiply;
+                rhs = make_constant(1.0 / constant_value(*rhs));
+                return optimize_binary(std::move(node));
+            }
+            break;
+        case BinaryOp::Power:
+            if (is_constant(*rhs, 1.0)) return std::move(lhs);
+            break;
+        default:
+            break;
+    }
+
+    if (level_ != OptimizationLevel::FastMath)
+        return node;
+
+    switch (op) {
+        case BinaryOp::Add:
+            if (is_constant(*rhs, 0.0)) return std::move(lhs);
+            if (is_constant(*lhs, 0.0)) return std::move(rhs);
+            break;
+        case BinaryOp::Multiply:
+            if ((is_constant(*rhs, 0.0) && is_pure(*lhs)) || (is_constant(*lhs, 0.0) && is_pure(*rhs)))
+                return make_constant(0.0);
+            break;
+        case BinaryOp::Divide:
+            if (is_constant(*rhs)) {
+                const ExprFloat reciprocal = 1.0 / constant_value(*rhs);
+                if (std::isfinite(reciprocal) && reciprocal != 0.0) {
+                    node->op_ = BinaryOp::Multiply;
+                    rhs = make_constant(reciprocal);
+                    return optimize_binary(std::move(node));
+                }
+            }
+            break;
+        case BinaryOp::Power:
+            // x ^ n as x * x * ... * x
+            if (is_constant(*rhs) && lhs->type() == ExprNodeType::Variable) {
+                const ExprFloat n = constant_value(*rhs);
+                if (n >= 2 && n <= max_power_chain && n == std::floor(n)) {
+                    const auto& var = static_cast<const VariableExprNode&>(*lhs);
+                    ExprNodePtr chain = std::make_unique<VariableExprNode>(var);
+                    for (ExprFloat i = 1; i < n; ++i)
+                        chain = make_binary(BinaryOp::Multiply, std::move(chain), std::make_unique<VariableExprNode>(var));
+                    return chain;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+
+    // Reassociate constant chains: (a op c1) op c2 -> a op (c1 op c2)
+    if ((op == BinaryOp::Add || op == BinaryOp::Multiply) && is_constant(*rhs) &&
+        lhs->type() == ExprNodeType::Binary) {
+        auto& inner = static_cast<BinaryExprNode&>(*lhs);
+        if (inner.op_ == op && (is_constant(*inner.right_) || is_constant(*inner.left_))) {
+            ExprNodePtr& inner_constant = is_constant(*inner.right_) ? inner.right_ : inner.left_;
+            ExprNodePtr& inner_other    = is_constant(*inner.right_) ? inner.left_  : inner.right_;
+            const ExprFloat c1 = constant_value(*inner_constant);
+            const ExprFloat c2 = constant_value(*rhs);
+            rhs = make_constant(op == BinaryOp::Add ? c1 + c2 : c1 * c2);
+            lhs = std::move(inner_other);
+            return optimize_binary(std::move(node));
+        }
+    }
+
+    // Contract `a * b + c`, and `a * b - c` or `c - a * b` when the term to
+    // negate is a constant, into `fma(a, b, c)`: one rounding instead of two.
+    if (op == BinaryOp::Add || op == BinaryOp::Subtract) {
+        auto product = [](const ExprNodePtr& n) -> BinaryExprNode* {
+            if (n->type() != ExprNodeType::Binary || static_cast<BinaryExprNode&>(*n).op_ != BinaryOp::Multiply)
+                return nullptr;
+            return static_cast<BinaryExprNode*>(n.get());
+        };
+        BinaryExprNode* left = product(lhs);
+        BinaryExprNode* right = product(rhs);
+        if (left && (op == BinaryOp::Add || is_constant(*rhs))) {
+            if (op == BinaryOp::Subtract)
+                rhs = make_constant(-constant_value(*rhs));
+            return make_fma(std::move(left->left_), std::move(left->right_), std::move(rhs));
+        }
+        // The addend is evaluated last now
+        if (right && is_pure(*lhs) && (op == BinaryOp::Add || is_constant(*right->left_))) {
+            if (op == BinaryOp::Subtract)
+                right->left_ = make_constant(-constant_value(*right->left_));
+            return make_fma(std::move(right->left_), std::move(right->right_), std::move(lhs));
+        }
+    }
+
+    return node;
+}
+
+ExprNodePtr Optimizer::optimize_unary(std::unique_ptr<UnaryExprNode> node) const {
+    node->operand_ = optimize(std::move(node->operand_), node->op_ == UnaryOp::Minus);
+
+    if (node->op_ == UnaryOp::Plus)
+        return std::move(node->operand_);
+
+    if (is_constant(*node->operand_))
+        return make_constant(node->evaluate());
+
+    // -(-x) -> x
+    if (node->operand_->type() == ExprNodeType::Unary) {
+        auto& inner = static_cast<UnaryExprNode&>(*node->operand_);
+        if (inner.op_ == UnaryOp::Minus)
+            return std::move(inner.operand_);
+    }
+
+    return node;
+}
+
+ExprNodePtr Optimizer::optimize_function(std::unique_ptr<FuncExprNode> node) const {
+    bool all_constant = true;
+    for (ExprNodePtr& arg : node->args_) {
+        arg = optimize(std::move(arg));
+        all_constant = all_constant && is_constant(*arg);
+    }
+
+    if (all_constant && node->function_->pure && node->arity_matches()) {
+        try {
+            return make_constant(node->evaluate());
+        } catch (const std::exception&) {
+            // Keep the call so the error surfaces when it is evaluated
+        }
+    }
+
+    return node;
+}
+
+size_t Optimizer::node_count(const ExprNode& node) {
+    switch (node.type()) {
+        case ExprNodeType::Binary: {
+            const auto& bin = static_cast<const BinaryExprNode&>(node);
+            return 1 + node_count(bin.left()) + node_count(bin.right());
+        }
+        case ExprNodeType::Unary:
+            return 1 + node_count(static_cast<const UnaryExprNode&>(node).operand());
+        case ExprNodeType::Function: {
+            size_t count = 1;
+            for (const ExprNodePtr& arg : static_cast<const FuncExprNode&>(node).args())
+                count += node_count(*arg);
+            return count;
+        }
+        default:
+            return 1;
+    }
+}
+
+}   // namespace cppexprpars
@@ -0,0 +1,254 @@
+//  parallel.cpp - Lightweight C++ Expression Parser (Thread Pool)
+//
+//  This file implements the work-stealing thread pool used to evaluate
+//  batches of rows on several cores.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+
+#include "cppexprpars.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+
+namespace cppexprpars {
+
+struct ThreadPool::State {
+    // Indices [begin, end) still to be run by one worker. The owner takes
+    // from the front, thieves from the back.
+    struct Queue {
+        std::mutex mutex;
+        size_t     begin = 0;
+        size_t     end   = 0;
+    };
+
+    size_t                   workers;
+    std::unique_ptr<Queue[]> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex              run_mutex;      // One `run` at a time
+    std::mutex              mutex;          // Guards everything below
+    std::condition_variable wake;
+    std::condition_variable finished;
+    uint64_t                generation = 0;
+    size_t                  busy       = 0; // Background workers still on the current run
+    bool                    stop       = false;
+    const Task*             task       = nullptr;
+    std::exception_ptr      error;
+    std::atomic<bool>       failed{false};
+
+    explicit State(size_t count) : workers(count), queues(new Queue[count]) {}
+
+    bool pop(size_t worker, size_t& index);
+    bool steal(size_t worker, size_t& index);
+    void work(size_t worker);
+    void loop(size_t worker);
+};
+
+namespace {
+
+// Pool and worker index of the task running on this thread, so that nested
+// runs can be told apart and run inline.
+thread_local const void* active_pool   = nullptr;
+thread_local size_t      active_worker = 0;
+
+struct ActiveGuard {
+    const void* previous_pool;
+    size_t      previous_worker;
+
+    ActiveGuard(const void* pool, size_t worker) :
+        previous_pool(active_pool),
+        previous_worker(active_worker) {
+        active_pool   = pool;
+        active_worker = worker;
+    }
+
+    ~ActiveGuard() {
+        active_pool   = previous_pool;
+        active_worker = previous_worker;
+    }
+};
+
+}   // namespace
+
+bool ThreadPool::State::pop(size_t worker, size_t& index) {
+    Queue& own = queues[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (own.begin == own.end)
+        return false;
+    index = own.begin++;
+    return true;
+}
+
+// Takes the back half of the first non-empty queue after this worker's own:
+// the first index is returned and the rest becomes this worker's queue,
+// which is empty whenever it steals.
+bool ThreadPool::State::steal(size_t worker, size_t& index) {
+    for (size_t k = 1; k < workers; ++k) {
+        Queue& victim = queues[(worker + k) % workers];
+        size_t begin, end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.begin == victim.end)
+                continue;
+            end   = victim.end;
+            begin = victim.begin + (victim.end - victim.begin) / 2;
+            victim.end = begin;
+        }
+
+        index = begin;
+        if (begin + 1 < end) {
+            Queue& own = queues[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.begin = begin + 1;
+            own.end   = end;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Runs indices until there are none left anywhere. After a failure the
+// remaining ones are drained without running them.
+void ThreadPool::State::work(size_t worker) {
+    size_t index;
+    while (pop(worker, index) || steal(worker, index)) {
+        if (failed.load(std::memory_order_relaxed))
+            continue;
+        try {
+            (*task)(index, worker);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+                error = std::current_exception();
+            failed.store(true, std::memory_order_relaxed);
+        }
+    }
+}
+
+void ThreadPool::State::loop(size_t worker) {
+    ActiveGuard guard(this, worker);
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stop || generation != seen; });
+            if (stop)
+                return;
+            seen = generation;
+        }
+
+        work(worker);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0)
+            finished.notify_one();
+    }
+}
+
+
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0)
+        threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    state_.reset(new State(threads));
+    for (size_t worker = 1; worker < threads; ++worker)
+        state_->threads.emplace_back([this, worker] { state_->loop(worker); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->stop = true;
+    }
+    state_->wake.notify_all();
+    for (std::thread& thread : state_->threads)
+        thread.join();
+}
+
+size_t ThreadPool::concurrency() const {
+    return state_->workers;
+}
+
+ThreadPool& ThreadPool::global() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::run(size_t count, const Task& task) {
+    State& state = *state_;
+    if (count == 0)
+        return;
+
+    // Nested in one of this pool's tasks, or not worth waking anyone
+    if (active_pool == &state || state.workers == 1 || count == 1) {
+        const size_t worker = active_pool == &state ? active_worker : 0;
+        ActiveGuard guard(&state, worker);
+        for (size_t index = 0; index < count; ++index)
+            task(index, worker);
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(state.run_mutex);
+    for (size_t worker = 0; worker < state.workers; ++worker) {
+        State::Queue& queue = state.queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.begin = count * worker / state.workers;
+        queue.end   = count * (worker + 1) / state.workers;
+    }
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.task  = &task;
+        state.error = nullptr;
+        state.failed.store(false, std::memory_order_relaxed);
+        state.busy  = state.workers - 1;
+        ++state.generation;
+    }
+    state.wake.notify_all();
+
+    {
+        ActiveGuard guard(&state, 0);
+        state.work(0);
+    }
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(state.mutex);
+        state.finished.wait(lock, [&] { return state.busy == 0; });
+        state.task = nullptr;
+        error = state.error;
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+}   // namespace cppexprpars
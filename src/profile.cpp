@@ -0,0 +1,294 @@
+//  profile.cpp - Lightweight C++ Expression Parser (Profiling)
+//
+//  This file implements the statistics of compiled expressions, their
+//  snapshots and their export as JSON.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+#include "profile.hpp"
+#include <cstdio>
+#include <cstdlib>
+
+
+namespace cppexprpars {
+
+namespace {
+
+// Subtrees this many levels below the root are still timed.
+constexpr size_t max_timed_depth = 3;
+
+std::atomic<uint64_t> sample_period{1024};
+
+template <typename F>
+void for_each_child(const ExprNode& node, F&& visit) {
+    switch (node.type()) {
+        case ExprNodeType::Binary: {
+            const auto& bin = static_cast<const BinaryExprNode&>(node);
+            visit(bin.left());
+            visit(bin.right());
+            break;
+        }
+        case ExprNodeType::Unary:
+            visit(static_cast<const UnaryExprNode&>(node).operand());
+            break;
+        case ExprNodeType::Function:
+            for (const auto& arg : static_cast<const FuncExprNode&>(node).args())
+                visit(*arg);
+            break;
+        default:
+            break;
+    }
+}
+
+// Whether evaluating `node` again has no effect besides its cost.
+bool is_pure(const ExprNode& node) {
+    if (node.type() == ExprNodeType::Function) {
+        const auto& func = static_cast<const FuncExprNode&>(node);
+        if (!func.function() || !func.function()->pure || !func.arity_matches())
+            return false;
+    }
+    bool pure = true;
+    for_each_child(node, [&pure](const ExprNode& child) { pure = pure && is_pure(child); });
+    return pure;
+}
+
+size_t count_nodes(const ExprNode& node, size_t* by_type) {
+    size_t nodes = 1;
+    ++by_type[static_cast<size_t>(node.type())];
+    for_each_child(node, [&](const ExprNode& child) { nodes += count_nodes(child, by_type); });
+    return nodes;
+}
+
+// Number of calls of each function in `node`, in order of appearance.
+void count_calls(const ExprNode& node, std::vector<std::pair<std::string, uint64_t>>& calls) {
+    if (node.type() == ExprNodeType::Function) {
+        const std::string& name = static_cast<const FuncExprNode&>(node).name();
+        auto it = std::find_if(calls.begin(), calls.end(), [&](const std::pair<std::string, uint64_t>& c) {
+            return c.first == name;
+        });
+        if (it == calls.end())
+            calls.emplace_back(name, 1);
+        else
+            ++it->second;
+    }
+    for_each_child(node, [&calls](const ExprNode& child) { count_calls(child, calls); });
+}
+
+std::string label(const ExprNode& node) {
+    switch (node.type()) {
+        case ExprNodeType::Constant: {
+            const ExprFloat value = static_cast<const ConstantExprNode&>(node).value();
+            char text[32];
+            std::snprintf(text, sizeof text, "%.15g", value);
+            if (std::strtod(text, nullptr) != value)
+                std::snprintf(text, sizeof text, "%.17g", value);
+            return text;
+        }
+        case ExprNodeType::Variable:
+            return static_cast<const VariableExprNode&>(node).name();
+        case ExprNodeType::Binary: {
+            static const char* const symbols[] = { "+", "-", "*", "/", "%", "^" };
+            return symbols[static_cast<size_t>(static_cast<const BinaryExprNode&>(node).op())];
+        }
+        case ExprNodeType::Unary:
+            return static_cast<const UnaryExprNode&>(node).op() == UnaryOp::Minus ? "-" : "+";
+        case ExprNodeType::Function:
+            return static_cast<const FuncExprNode&>(node).name();
+    }
+    return {};
+}
+
+void append_string(std::string& out, const std::string& text) {
+    out += '"';
+    for (char ch : text) {
+        if (ch == '"' || ch == '\\') {
+            out += '\\';
+            out += ch;
+        } else if (static_cast<unsigned char>(ch) < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof escape, "\\u%04x", static_cast<unsigned>(ch));
+            out += escape;
+        } else {
+            out += ch;
+        }
+    }
+    out += '"';
+}
+
+void append_number(std::string& out, uint64_t value) {
+    out += std::to_string(value);
+}
+
+const char* const type_names[] = { "constant", "variable", "binary", "unary", "function" };
+
+}   // namespace
+
+void set_profiling_sample_period(uint64_t period) {
+    sample_period.store(period, std::memory_order_relaxed);
+}
+
+uint64_t profiling_sample_period() {
+    return sample_period.load(std::memory_order_relaxed);
+}
+
+
+
+ExpressionProfiler::ExpressionProfiler(const ExprNode& root) : root_(root) {
+    struct Walk {
+        std::vector<Subtree>& subtrees;
+        void operator()(const ExprNode& node, size_t depth) {
+            subtrees.push_back({ &node, depth, is_pure(node) });
+            if (depth < max_timed_depth)
+                for_each_child(node, [&](const ExprNode& child) { (*this)(child, depth + 1); });
+        }
+    };
+    Walk{subtrees_}(root, 0);
+    samples_.reset(new std::atomic<uint64_t>[subtrees_.size()]());
+    total_ns_.reset(new std::atomic<uint64_t>[subtrees_.size()]());
+}
+
+// The period is read again at every sample, so changing it applies to
+// expressions already compiled. Of the threads reaching a sample, the one
+// moving it forward times the subtrees. Evaluations that throw (a division
+// by zero for these values) are not counted; the bytecode reports the error.
+void ExpressionProfiler::sample(uint64_t count, bool tree) {
+    const uint64_t period = profiling_sample_period();
+    uint64_t next = next_sample_[tree].load(std::memory_order_relaxed);
+    if (count < next || !next_sample_[tree].compare_exchange_strong(next, count + (period ? period : 1024)))
+        return;
+    if (!period)
+        return;
+
+    for (size_t i = 0; i < subtrees_.size(); ++i) {
+        if (!subtrees_[i].pure)
+            continue;
+        try {
+            const uint64_t start = profile_clock();
+            volatile ExprFloat value = subtrees_[i].node->evaluate();
+            (void)value;
+            total_ns_[i].fetch_add(profile_clock() - start, std::memory_order_relaxed);
+            samples_[i].fetch_add(1, std::memory_order_relaxed);
+        } catch (...) {
+        }
+    }
+}
+
+ExpressionProfile ExpressionProfiler::snapshot(const Bytecode& bytecode) const {
+    ExpressionProfile profile;
+    profile.parse_ns         = parse_ns.load(std::memory_order_relaxed);
+    profile.evaluations      = evaluations_.load(std::memory_order_relaxed);
+    profile.tree_evaluations = tree_evaluations_.load(std::memory_order_relaxed);
+    count_nodes(root_, profile.node_counts);
+
+    // The calls made by one evaluation of the tree and of the bytecode
+    count_calls(root_, profile.function_calls);
+    for (auto& call : profile.function_calls)
+        call.second *= profile.tree_evaluations;
+    for (const Instruction& ins : bytecode.instructions()) {
+        if (ins.op != OpCode::CallUnary && ins.op != OpCode::CallBinary && ins.op != OpCode::Call)
+            continue;
+        const std::string& name = bytecode.functions()[ins.arg]->name;
+        for (auto& call : profile.function_calls)
+            if (call.first == name)
+                call.second += profile.evaluations;
+    }
+
+    for (size_t i = 0; i < subtrees_.size(); ++i) {
+        SubtreeProfile subtree;
+        size_t by_type[5] = {};
+        subtree.depth    = subtrees_[i].depth;
+        subtree.type     = subtrees_[i].node->type();
+        subtree.label    = label(*subtrees_[i].node);
+        subtree.nodes    = count_nodes(*subtrees_[i].node, by_type);
+        subtree.samples  = samples_[i].load(std::memory_order_relaxed);
+        subtree.total_ns = total_ns_[i].load(std::memory_order_relaxed);
+        profile.subtrees.push_back(std::move(subtree));
+    }
+    return profile;
+}
+
+
+
+ExpressionProfile CompiledExpr::profile() const {
+    if (!root_)
+        return {};
+    if (profiler_)
+        return profiler_->snapshot(bytecode_);
+    return ExpressionProfiler(*root_).snapshot(bytecode_);
+}
+
+std::string ExpressionProfile::to_json() const {
+    std::string out = "{\"profiling\": ";
+    out += profiling_enabled() ? "true" : "false";
+    out += ", \"parse_ns\": ";
+    append_number(out, parse_ns);
+    out += ", \"evaluations\": ";
+    append_number(out, evaluations);
+    out += ", \"tree_evaluations\": ";
+    append_number(out, tree_evaluations);
+
+    out += ", \"node_counts\": {";
+    for (size_t i = 0; i < 5; ++i) {
+        out += i ? ", \"" : "\"";
+        out += type_names[i];
+        out += "\": ";
+        append_number(out, node_counts[i]);
+    }
+
+    out += "}, \"function_calls\": {";
+    for (size_t i = 0; i < function_calls.size(); ++i) {
+        if (i)
+            out += ", ";
+        append_string(out, function_calls[i].first);
+        out += ": ";
+        append_number(out, function_calls[i].second);
+    }
+
+    out += "}, \"subtrees\": [";
+    for (size_t i = 0; i < subtrees.size(); ++i) {
+        const SubtreeProfile& s = subtrees[i];
+        out += i ? ", {\"depth\": " : "{\"depth\": ";
+        append_number(out, s.depth);
+        out += ", \"type\": \"";
+        out += type_names[static_cast<size_t>(s.type)];
+        out += "\", \"label\": ";
+        append_string(out, s.label);
+        out += ", \"nodes\": ";
+        append_number(out, s.nodes);
+        out += ", \"samples\": ";
+        append_number(out, s.samples);
+        out += ", \"total_ns\": ";
+        append_number(out, s.total_ns);
+        out += '}';
+    }
+    out += "]}";
+    return out;
+}
+
+}   // namespace cppexprpars
@@ -0,0 +1,104 @@
+//  profile.hpp - Lightweight C++ Expression Parser (Profiling)
+//
+//  This file declares the statistics kept for each compiled expression when
+//  the library is built with CPPEXPRPARS_PROFILING. It is private to the
+//  library.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+#ifndef CPPEXPRPARS_PROFILE_HPP
+#define CPPEXPRPARS_PROFILE_HPP
+
+#include "cppexprpars.hpp"
+#include <atomic>
+#include <chrono>
+
+// Statements that only exist when profiling, so the hooks cost nothing
+// otherwise.
+#ifdef CPPEXPRPARS_PROFILING
+#define CPPEXPRPARS_PROFILE(...) __VA_ARGS__
+#else
+#define CPPEXPRPARS_PROFILE(...)
+#endif
+
+
+namespace cppexprpars {
+
+inline uint64_t profile_clock() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count());
+}
+
+// Counters of one compiled expression, updated by every thread evaluating
+// it. The subtrees timed are found once, when it is compiled.
+class ExpressionProfiler {
+public:
+    explicit ExpressionProfiler(const ExprNode& root);
+
+    // Counts `n` evaluations of the caller's values (its columns, or a
+    // context of its own), which the subtrees cannot be timed with.
+    inline void evaluated(uint64_t n) {
+        evaluations_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // Counts one evaluation of the context the expression was compiled
+    // against, at its first row, and times the subtrees, which read the
+    // same values, when the count has reached the next sample.
+    inline void evaluated_in_context(bool tree = false) {
+        const uint64_t count = (tree ? tree_evaluations_ : evaluations_).fetch_add(1, std::memory_order_relaxed) + 1;
+        if (count >= next_sample_[tree].load(std::memory_order_relaxed))
+            sample(count, tree);
+    }
+
+    ExpressionProfile snapshot(const Bytecode& bytecode) const;
+
+    std::atomic<uint64_t> parse_ns{0};
+
+private:
+    struct Subtree {
+        const ExprNode* node;
+        size_t          depth;
+        bool            pure;
+    };
+
+    const ExprNode&                          root_;
+    std::vector<Subtree>                     subtrees_;
+    std::unique_ptr<std::atomic<uint64_t>[]> samples_;
+    std::unique_ptr<std::atomic<uint64_t>[]> total_ns_;
+    std::atomic<uint64_t>                    evaluations_{0};
+    std::atomic<uint64_t>                    tree_evaluations_{0};
+    std::atomic<uint64_t>                    next_sample_[2] = {{1}, {1}};   // Bytecode, tree
+
+    void sample(uint64_t count, bool tree);
+};
+
+}   // namespace cppexprpars
+
+#endif
@@ -0,0 +1,67 @@
+//  scratch.hpp - Lightweight C++ Expression Parser (Scratch Buffers)
+//
+//  This file declares the scratch storage the evaluators use for a single
+//  evaluation. It is private to the library.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+#ifndef CPPEXPRPARS_SCRATCH_HPP
+#define CPPEXPRPARS_SCRATCH_HPP
+
+#include "cppexprpars.hpp"
+
+
+namespace cppexprpars {
+
+// Stack storage for one evaluation. Small programs (the common case) live
+// entirely on the native stack; only unusually deep ones touch the heap.
+template <size_t N, typename T = ExprFloat>
+class ScratchBuffer {
+public:
+    explicit ScratchBuffer(size_t size) :
+        data_(size > N ? new T[size] : local_) {}
+
+    ~ScratchBuffer() {
+        if (data_ != local_)
+            delete[] data_;
+    }
+
+    ScratchBuffer(const ScratchBuffer&) = delete;
+    ScratchBuffer& operator=(const ScratchBuffer&) = delete;
+
+    inline T* data() { return data_; }
+
+private:
+    T  local_[N];
+    T* data_;
+};
+
+}   // namespace cppexprpars
+
+#endif
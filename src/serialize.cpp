@@ -0,0 +1,502 @@
+//  serialize.cpp - Lightweight C++ Expression Parser (Binary Images)
+//
+//  This file implements the binary image format of compiled expressions:
+//  the writer, and the loader that runs them straight from the image.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+#include "cppexprpars.hpp"
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CPPEXPRPARS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace cppexprpars {
+
+namespace {
+
+// Layout of an image, version 1. The header comes first; every section
+// starts at an offset that is a multiple of 8 and holds `count` entries:
+//
+//  - expressions: one `ImageExpression` each, in the order they were added
+//  - name index:  `uint32_t` expression indices, sorted by name
+//  - symbols:     one `ImageSymbol` per distinct name, variable or function
+//  - symbol refs: `uint32_t` symbol indices, each expression's variables
+//                 followed by its functions
+//  - outputs:     `uint32_t` output slots of programs
+//  - code:        `Instruction`s exactly as the interpreter reads them
+//  - strings:     the characters of every symbol, back to back
+constexpr char     image_magic[8] = { 'C', 'P', 'P', 'E', 'X', 'P', 'R', '\0' };
+constexpr uint32_t image_version  = 1;
+constexpr uint32_t byte_order     = 0x01020304;
+
+struct ImageSection {
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct ImageHeader {
+    char         magic[8];
+    uint32_t     version;
+    uint32_t     byte_order;
+    uint32_t     instruction_size;
+    uint32_t     reserved;
+    uint64_t     size;
+    ImageSection expressions;
+    ImageSection name_index;
+    ImageSection symbols;
+    ImageSection symbol_refs;
+    ImageSection outputs;
+    ImageSection code;
+    ImageSection strings;
+};
+
+struct ImageExpression {
+    uint32_t name;
+    uint32_t code_first,   code_size;
+    uint32_t symbol_first, variable_count, function_count;
+    uint32_t output_first, output_count;
+    uint32_t max_depth,    temporaries;
+};
+
+struct ImageSymbol {
+    uint32_t offset;
+    uint32_t length;
+};
+
+static_assert(sizeof(Instruction) == 16, "Instructions are stored as they are laid out in memory");
+static_assert(offsetof(Instruction, count) == 2 && offsetof(Instruction, arg) == 4 &&
+              offsetof(Instruction, value) == 8, "Unexpected instruction layout");
+
+inline size_t align8(size_t size) {
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+[[noreturn]] void malformed(const char* what) {
+    throw std::runtime_error(std::string("Malformed expression image: ") + what);
+}
+
+template <typename T>
+inline const T* section(const char* data, const ImageSection& s) {
+    return reinterpret_cast<const T*>(data + s.offset);
+}
+
+inline const ImageHeader& header_of(const char* data) {
+    return *reinterpret_cast<const ImageHeader*>(data);
+}
+
+// Whether `count` entries starting at `first` lie within `total`.
+inline bool in_range(uint64_t first, uint64_t count, uint64_t total) {
+    return first <= total && count <= total - first;
+}
+
+}   // namespace
+
+
+
+uint32_t ExpressionImageWriter::symbol(StringView text) {
+    std::string key = text.to_string();
+    auto it = symbol_ids_.find(key);
+    if (it != symbol_ids_.end())
+        return it->second;
+
+    const uint32_t id = static_cast<uint32_t>(symbols_.size());
+    symbols_.emplace_back(static_cast<uint32_t>(strings_.size()), static_cast<uint32_t>(text.size()));
+    strings_.append(text.data(), text.size());
+    symbol_ids_.emplace(std::move(key), id);
+    return id;
+}
+
+size_t ExpressionImageWriter::add(StringView name, const Bytecode& bytecode) {
+    if (bytecode.instructions().empty())
+        throw std::runtime_error("Cannot save an empty expression");
+    const uint32_t name_id = symbol(name);
+    named_.resize(symbols_.size());
+    if (named_[name_id])
+        throw std::runtime_error("Expression already in the image: " + name.to_string());
+    named_[name_id] = true;
+
+    Expression e;
+    e.name           = name_id;
+    e.code_first     = static_cast<uint32_t>(code_.size());
+    e.code_size      = static_cast<uint32_t>(bytecode.instructions().size());
+    e.symbol_first   = static_cast<uint32_t>(symbol_refs_.size());
+    e.variable_count = static_cast<uint32_t>(bytecode.variables().size());
+    e.function_count = static_cast<uint32_t>(bytecode.functions().size());
+    e.output_first   = static_cast<uint32_t>(outputs_.size());
+    e.output_count   = static_cast<uint32_t>(bytecode.outputs().size());
+    e.max_depth      = static_cast<uint32_t>(bytecode.max_stack_depth());
+    e.temporaries    = static_cast<uint32_t>(bytecode.temporary_count());
+
+    for (const Instruction& ins : bytecode.instructions())
+        code_.push_back(ins);
+    for (const std::string& variable : bytecode.variables())
+        symbol_refs_.push_back(symbol(variable));
+    for (const FunctionEntryPtr& function : bytecode.functions())
+        symbol_refs_.push_back(symbol(function->name));
+    outputs_.insert(outputs_.end(), bytecode.outputs().begin(), bytecode.outputs().end());
+
+    expressions_.push_back(e);
+    return expressions_.size() - 1;
+}
+
+std::string ExpressionImageWriter::data() const {
+    ImageHeader header;
+    std::memset(&header, 0, sizeof header);
+    std::memcpy(header.magic, image_magic, sizeof image_magic);
+    header.version          = image_version;
+    header.byte_order       = byte_order;
+    header.instruction_size = sizeof(Instruction);
+
+    size_t offset = align8(sizeof header);
+    auto place = [&](ImageSection& s, size_t count, size_t entry_size) {
+        s.offset = offset;
+        s.count  = count;
+        offset = align8(offset + count * entry_size);
+    };
+    place(header.expressions, expressions_.size(), sizeof(ImageExpression));
+    place(header.name_index,  expressions_.size(), sizeof(uint32_t));
+    place(header.symbols,     symbols_.size(),     sizeof(ImageSymbol));
+    place(header.symbol_refs, symbol_refs_.size(), sizeof(uint32_t));
+    place(header.outputs,     outputs_.size(),     sizeof(uint32_t));
+    place(header.code,        code_.size(),        sizeof(Instruction));
+    place(header.strings,     strings_.size(),     1);
+    header.size = offset;
+
+    // Padding, including the one inside each instruction, is zeroed, so the
+    // same expressions always give the same bytes.
+    std::string image(offset, '\0');
+    char* out = &image[0];
+    std::memcpy(out, &header, sizeof header);
+
+    ImageExpression* expressions = reinterpret_cast<ImageExpression*>(out + header.expressions.offset);
+    for (size_t i = 0; i < expressions_.size(); ++i) {
+        const Expression& e = expressions_[i];
+        expressions[i] = { e.name, e.code_first, e.code_size, e.symbol_first, e.variable_count, e.function_count,
+                           e.output_first, e.output_count, e.max_depth, e.temporaries };
+    }
+
+    std::vector<uint32_t> by_name(expressions_.size());
+    for (size_t i = 0; i < by_name.size(); ++i)
+        by_name[i] = static_cast<uint32_t>(i);
+    auto name_of = [&](uint32_t i) {
+        const std::pair<uint32_t, uint32_t>& s = symbols_[expressions_[i].name];
+        return StringView(strings_.data() + s.first, s.second);
+    };
+    std::sort(by_name.begin(), by_name.end(), [&](uint32_t a, uint32_t b) {
+        const StringView x = name_of(a), y = name_of(b);
+        const int order = std::char_traits<char>::compare(x.data(), y.data(), std::min(x.size(), y.size()));
+        return order < 0 || (order == 0 && x.size() < y.size());
+    });
+    std::copy(by_name.begin(), by_name.end(), reinterpret_cast<uint32_t*>(out + header.name_index.offset));
+
+    ImageSymbol* symbols = reinterpret_cast<ImageSymbol*>(out + header.symbols.offset);
+    for (size_t i = 0; i < symbols_.size(); ++i)
+        symbols[i] = { symbols_[i].first, symbols_[i].second };
+    std::copy(symbol_refs_.begin(), symbol_refs_.end(), reinterpret_cast<uint32_t*>(out + header.symbol_refs.offset));
+    std::copy(outputs_.begin(), outputs_.end(), reinterpret_cast<uint32_t*>(out + header.outputs.offset));
+
+    char* code = out + header.code.offset;
+    for (size_t i = 0; i < code_.size(); ++i, code += sizeof(Instruction)) {
+        const Instruction& ins = code_[i];
+        std::memcpy(code + offsetof(Instruction, op),    &ins.op,    sizeof ins.op);
+        std::memcpy(code + offsetof(Instruction, count), &ins.count, sizeof ins.count);
+        std::memcpy(code + offsetof(Instruction, arg),   &ins.arg,   sizeof ins.arg);
+        std::memcpy(code + offsetof(Instruction, value), &ins.value, sizeof ins.value);
+    }
+    std::copy(strings_.begin(), strings_.end(), out + header.strings.offset);
+    return image;
+}
+
+void ExpressionImageWriter::write(const std::string& path) const {
+    const std::string image = data();
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.write(image.data(), static_cast<std::streamsize>(image.size())) || !file.flush())
+        throw std::runtime_error("Cannot write expression image: " + path);
+}
+
+
+
+// Checks the header and every table, so that the accessors and `load` can
+// trust them; only the instructions are left to `load`.
+ExpressionImage::ExpressionImage(const void* data, size_t size) :
+    data_(static_cast<const char*>(data)),
+    size_(size) {
+    if (!data_ || reinterpret_cast<uintptr_t>(data_) % 8 != 0)
+        throw std::runtime_error("Expression images must be 8-byte aligned");
+    if (size_ < sizeof(ImageHeader) || std::memcmp(data_, image_magic, sizeof image_magic) != 0)
+        malformed("not an expression image");
+
+    const ImageHeader& h = header_of(data_);
+    if (h.byte_order != byte_order)
+        throw std::runtime_error("Expression image was written with another byte order");
+    if (h.version != image_version)
+        throw std::runtime_error("Unsupported expression image version " + std::to_string(h.version));
+    if (h.instruction_size != sizeof(Instruction))
+        malformed("instruction size");
+    if (h.size > size_)
+        malformed("truncated");
+
+    auto check = [&](const ImageSection& s, size_t entry_size, const char* what) {
+        if (s.offset % 8 != 0 || s.offset < sizeof(ImageHeader) || !in_range(s.offset, 0, h.size) ||
+            s.count > (h.size - s.offset) / entry_size)
+            malformed(what);
+    };
+    check(h.expressions, sizeof(ImageExpression), "expression table");
+    check(h.name_index,  sizeof(uint32_t),        "name index");
+    check(h.symbols,     sizeof(ImageSymbol),     "symbol table");
+    check(h.symbol_refs, sizeof(uint32_t),        "symbol references");
+    check(h.outputs,     sizeof(uint32_t),        "output table");
+    check(h.code,        sizeof(Instruction),     "code");
+    check(h.strings,     1,                       "strings");
+    if (h.name_index.count != h.expressions.count)
+        malformed("name index");
+
+    const ImageSymbol* symbols = section<ImageSymbol>(data_, h.symbols);
+    for (uint64_t i = 0; i < h.symbols.count; ++i)
+        if (!in_range(symbols[i].offset, symbols[i].length, h.strings.count))
+            malformed("symbol table");
+    const uint32_t* refs = section<uint32_t>(data_, h.symbol_refs);
+    for (uint64_t i = 0; i < h.symbol_refs.count; ++i)
+        if (refs[i] >= h.symbols.count)
+            malformed("symbol references");
+    const uint32_t* index = section<uint32_t>(data_, h.name_index);
+    for (uint64_t i = 0; i < h.name_index.count; ++i)
+        if (index[i] >= h.expressions.count)
+            malformed("name index");
+
+    const ImageExpression* expressions = section<ImageExpression>(data_, h.expressions);
+    for (uint64_t i = 0; i < h.expressions.count; ++i) {
+        const ImageExpression& e = expressions[i];
+        if (e.name >= h.symbols.count ||
+            !in_range(e.code_first, e.code_size, h.code.count) ||
+            !in_range(e.symbol_first, uint64_t(e.variable_count) + e.function_count, h.symbol_refs.count) ||
+            !in_range(e.output_first, e.output_count, h.outputs.count))
+            malformed("expression table");
+    }
+    count_ = static_cast<size_t>(h.expressions.count);
+}
+
+ExpressionImage ExpressionImage::map_file(const std::string& path) {
+#ifdef CPPEXPRPARS_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open expression image: " + path);
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size <= 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot read expression image: " + path);
+    }
+    const size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error("Cannot map expression image: " + path);
+
+    std::shared_ptr<const void> storage(mapping, [size](const void* ptr) {
+        ::munmap(const_cast<void*>(ptr), size);
+    });
+    ExpressionImage image(mapping, size);
+    image.storage_ = std::move(storage);
+    return image;
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        throw std::runtime_error("Cannot open expression image: " + path);
+    const size_t size = static_cast<size_t>(file.tellg());
+    auto buffer = std::make_shared<std::vector<uint64_t>>((size + 7) / 8);
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(buffer->data()), static_cast<std::streamsize>(size)))
+        throw std::runtime_error("Cannot read expression image: " + path);
+
+    ExpressionImage image(buffer->data(), size);
+    image.storage_ = std::move(buffer);
+    return image;
+#endif
+}
+
+StringView ExpressionImage::symbol(uint32_t id) const {
+    const ImageHeader& h = header_of(data_);
+    const ImageSymbol& s = section<ImageSymbol>(data_, h.symbols)[id];
+    return StringView(data_ + h.strings.offset + s.offset, s.length);
+}
+
+StringView ExpressionImage::name(size_t index) const {
+    if (index >= count_)
+        throw std::runtime_error("Expression index out of range");
+    return symbol(section<ImageExpression>(data_, header_of(data_).expressions)[index].name);
+}
+
+size_t ExpressionImage::find(StringView name) const {
+    if (count_ == 0)
+        return npos;
+    const uint32_t* index = section<uint32_t>(data_, header_of(data_).name_index);
+    const uint32_t* it = std::lower_bound(index, index + count_, name, [&](uint32_t i, StringView key) {
+        const StringView x = this->name(i);
+        const int order = std::char_traits<char>::compare(x.data(), key.data(), std::min(x.size(), key.size()));
+        return order < 0 || (order == 0 && x.size() < key.size());
+    });
+    return it != index + count_ && this->name(*it) == name ? *it : npos;
+}
+
+std::vector<std::string> ExpressionImage::variables(size_t index) const {
+    if (index >= count_)
+        throw std::runtime_error("Expression index out of range");
+    const ImageHeader& h = header_of(data_);
+    const ImageExpression& e = section<ImageExpression>(data_, h.expressions)[index];
+    const uint32_t* refs = section<uint32_t>(data_, h.symbol_refs) + e.symbol_first;
+    std::vector<std::string> names;
+    names.reserve(e.variable_count);
+    for (uint32_t i = 0; i < e.variable_count; ++i)
+        names.push_back(symbol(refs[i]).to_string());
+    return names;
+}
+
+Bytecode ExpressionImage::load(size_t index, const EvaluationContext& context, const FunctionRegistry& registry) const {
+    if (index >= count_)
+        throw std::runtime_error("Expression index out of range");
+    const ImageHeader& h = header_of(data_);
+    const ImageExpression& e = section<ImageExpression>(data_, h.expressions)[index];
+    const uint32_t* refs = section<uint32_t>(data_, h.symbol_refs) + e.symbol_first;
+
+    Bytecode bytecode;
+    bytecode.image_code_  = section<Instruction>(data_, h.code) + e.code_first;
+    bytecode.image_size_  = e.code_size;
+    bytecode.image_       = storage_;
+    bytecode.max_depth_   = e.max_depth;
+    bytecode.temporaries_ = e.temporaries;
+
+    bytecode.variables_.reserve(e.variable_count);
+    bytecode.variable_names_.reserve(e.variable_count);
+    for (uint32_t i = 0; i < e.variable_count; ++i) {
+        std::string name = symbol(refs[i]).to_string();
+        bytecode.variables_.push_back({ &context, context.slot_of(name), nullptr });
+        bytecode.variable_names_.push_back(std::move(name));
+    }
+    bytecode.functions_.reserve(e.function_count);
+    for (uint32_t i = 0; i < e.function_count; ++i) {
+        const std::string name = symbol(refs[e.variable_count + i]).to_string();
+        FunctionEntryPtr function = registry.find_function(name);
+        if (!function)
+            throw std::runtime_error("Unknown function: " + name);
+        bytecode.functions_.push_back(std::move(function));
+    }
+    const uint32_t* outputs = section<uint32_t>(data_, h.outputs) + e.output_first;
+    bytecode.outputs_.assign(outputs, outputs + e.output_count);
+
+    // The instructions must keep the stack and the frame within the sizes
+    // recorded for them, and call functions the way they were compiled to.
+    // An expression leaves its value on the stack; a program moves each
+    // statement's value into its slot, keeping only the last one's.
+    const uint64_t frame = uint64_t(e.variable_count) + e.temporaries;
+    uint64_t depth = 0, max_depth = 0, stores = 0;
+    auto pop_push = [&](uint64_t needed, uint64_t popped, uint64_t pushed) {
+        if (depth < needed)
+            malformed("stack underflow");
+        depth = depth - popped + pushed;
+        max_depth = std::max(max_depth, depth);
+    };
+    for (const Instruction& ins : bytecode.instructions()) {
+        if (ins.op > OpCode::StorePop)
+            malformed("unknown instruction");
+        switch (ins.op) {
+            case OpCode::Constant:
+                pop_push(0, 0, 1);
+                break;
+            case OpCode::Variable:
+                if (ins.arg >= frame)
+                    malformed("variable slot");
+                pop_push(0, 0, 1);
+                break;
+            case OpCode::Negate:
+                pop_push(1, 0, 0);
+                break;
+            case OpCode::CallUnary:
+            case OpCode::CallBinary:
+            case OpCode::Call: {
+                if (ins.arg >= e.function_count)
+                    malformed("function index");
+                const FunctionEntry& fn = *bytecode.functions_[ins.arg];
+                const size_t nargs = ins.op == OpCode::CallUnary ? 1 : ins.op == OpCode::CallBinary ? 2 : ins.count;
+                if ((ins.op == OpCode::CallUnary && !fn.unary) || (ins.op == OpCode::CallBinary && !fn.binary) ||
+                    (nargs != fn.nargs && !fn.on_invalid_args))
+                    throw std::runtime_error("Function " + fn.name + " does not match the one the expression was compiled with");
+                pop_push(nargs, nargs, 1);
+                break;
+            }
+            case OpCode::Store:
+            case OpCode::StorePop:
+                if (ins.arg < e.variable_count || ins.arg >= frame)
+                    malformed("temporary slot");
+                ++stores;
+                pop_push(1, ins.op == OpCode::StorePop ? 1 : 0, 0);
+                break;
+            case OpCode::MultiplyAdd:
+                pop_push(3, 3, 1);
+                break;
+            case OpCode::MultiplyConstantAdd:
+                pop_push(2, 2, 1);
+                break;
+            case OpCode::MultiplyVariableAddConstant:
+                if (ins.arg >= frame)
+                    malformed("variable slot");
+                pop_push(1, 0, 0);
+                break;
+            default: {
+                // Binary operators: popped, constant and variable forms
+                const int form = (static_cast<int>(ins.op) - static_cast<int>(OpCode::Add)) % 3;
+                if (form == 2 && ins.arg >= frame)
+                    malformed("variable slot");
+                if (form == 0)
+                    pop_push(2, 2, 1);
+                else
+                    pop_push(1, 0, 0);
+                break;
+            }
+        }
+    }
+    if (depth == 0 || max_depth > e.max_depth || e.max_depth > e.code_size || e.temporaries > stores)
+        malformed("stack depth");
+    for (uint32_t slot : bytecode.outputs_)
+        if (slot < e.variable_count || slot >= frame)
+            malformed("output slot");
+
+    bytecode.compute_layout_id();
+    return bytecode;
+}
+
+}   // namespace cppexprpars
@@ -0,0 +1,205 @@
+//  vector_math.cpp - Lightweight C++ Expression Parser (Vectorized Built-ins)
+//
+//  This file implements the vector entry points of the built-in functions,
+//  with AVX2 (4 lanes) and AVX-512 (8 lanes) kernels selected at runtime and
+//  the scalar <cmath> functions as fallback.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+#include "cppexprpars.hpp"
+
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#define CPPEXPRPARS_VECTOR_MATH 1
+#include <immintrin.h>
+#endif
+
+
+namespace cppexprpars {
+
+#ifdef CPPEXPRPARS_VECTOR_MATH
+
+// Each instruction set gets its own copy of the kernels: the primitives below
+// are defined under a `#pragma GCC target`, and vector_math_kernels.inl is
+// compiled against them.
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+namespace avx2 {
+
+using V = __m256d;
+using M = __m256d;
+using I = __m256i;
+constexpr size_t W = 4;
+
+static inline V set1(double x)              { return _mm256_set1_pd(x); }
+static inline V load(const double* p)       { return _mm256_loadu_pd(p); }
+static inline void store(double* p, V x)    { _mm256_storeu_pd(p, x); }
+
+static inline V add(V a, V b)               { return _mm256_add_pd(a, b); }
+static inline V sub(V a, V b)               { return _mm256_sub_pd(a, b); }
+static inline V mul(V a, V b)               { return _mm256_mul_pd(a, b); }
+static inline V div(V a, V b)               { return _mm256_div_pd(a, b); }
+static inline V fmadd(V a, V b, V c)        { return _mm256_fmadd_pd(a, b, c); }     // a * b + c
+static inline V fmsub(V a, V b, V c)        { return _mm256_fmsub_pd(a, b, c); }     // a * b - c
+static inline V fnmadd(V a, V b, V c)       { return _mm256_fnmadd_pd(a, b, c); }    // c - a * b
+static inline V floor_(V x)                 { return _mm256_floor_pd(x); }
+static inline V sqrt_(V x)                  { return _mm256_sqrt_pd(x); }
+static inline V min_(V a, V b)              { return _mm256_min_pd(a, b); }
+static inline V max_(V a, V b)              { return _mm256_max_pd(a, b); }
+static inline V abs_(V x)                   { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), x); }
+
+static inline M lt(V a, V b)                { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+static inline M le(V a, V b)                { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+static inline M gt(V a, V b)                { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+static inline M ge(V a, V b)                { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+static inline M ne(V a, V b)                { return _mm256_cmp_pd(a, b, _CMP_NEQ_OQ); }
+static inline V select(M m, V a, V b)       { return _mm256_blendv_pd(b, a, m); }
+static inline M mask_and(M a, M b)          { return _mm256_and_pd(a, b); }
+static inline M mask_xor(M a, M b)          { return _mm256_xor_pd(a, b); }
+static inline unsigned mask_bits(M m)       { return static_cast<unsigned>(_mm256_movemask_pd(m)); }
+static inline M all_lanes()                 { return _mm256_castsi256_pd(_mm256_set1_epi64x(-1)); }
+
+static inline I as_bits(V x)                { return _mm256_castpd_si256(x); }
+static inline V from_bits(I x)              { return _mm256_castsi256_pd(x); }
+static inline I iset1(int64_t x)            { return _mm256_set1_epi64x(x); }
+static inline I iadd(I a, I b)              { return _mm256_add_epi64(a, b); }
+static inline I isub(I a, I b)              { return _mm256_sub_epi64(a, b); }
+static inline I iand(I a, I b)              { return _mm256_and_si256(a, b); }
+static inline I ior(I a, I b)               { return _mm256_or_si256(a, b); }
+static inline I ixor(I a, I b)              { return _mm256_xor_si256(a, b); }
+static inline I shl52(I x)                  { return _mm256_slli_epi64(x, 52); }
+static inline I shr52(I x)                  { return _mm256_srli_epi64(x, 52); }
+
+#include "vector_math_kernels.inl"
+
+}   // namespace avx2
+
+#pragma GCC pop_options
+
+
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+namespace avx512 {
+
+using V = __m512d;
+using M = __mmask8;
+using I = __m512i;
+constexpr size_t W = 8;
+
+static inline V set1(double x)              { return _mm512_set1_pd(x); }
+static inline V load(const double* p)       { return _mm512_loadu_pd(p); }
+static inline void store(double* p, V x)    { _mm512_storeu_pd(p, x); }
+
+static inline V add(V a, V b)               { return _mm512_add_pd(a, b); }
+static inline V sub(V a, V b)               { return _mm512_sub_pd(a, b); }
+static inline V mul(V a, V b)               { return _mm512_mul_pd(a, b); }
+static inline V div(V a, V b)               { return _mm512_div_pd(a, b); }
+static inline V fmadd(V a, V b, V c)        { return _mm512_fmadd_pd(a, b, c); }
+static inline V fmsub(V a, V b, V c)        { return _mm512_fmsub_pd(a, b, c); }
+static inline V fnmadd(V a, V b, V c)       { return _mm512_fnmadd_pd(a, b, c); }
+static inline V floor_(V x)                 { return _mm512_roundscale_pd(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+static inline V sqrt_(V x)                  { return _mm512_sqrt_pd(x); }
+static inline V min_(V a, V b)              { return _mm512_min_pd(a, b); }
+static inline V max_(V a, V b)              { return _mm512_max_pd(a, b); }
+static inline V abs_(V x)                   { return _mm512_abs_pd(x); }
+
+static inline M lt(V a, V b)                { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+static inline M le(V a, V b)                { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ); }
+static inline M gt(V a, V b)                { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+static inline M ge(V a, V b)                { return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ); }
+static inline M ne(V a, V b)                { return _mm512_cmp_pd_mask(a, b, _CMP_NEQ_OQ); }
+static inline V select(M m, V a, V b)       { return _mm512_mask_blend_pd(m, b, a); }
+static inline M mask_and(M a, M b)          { return static_cast<M>(a & b); }
+static inline M mask_xor(M a, M b)          { return static_cast<M>(a ^ b); }
+static inline unsigned mask_bits(M m)       { return m; }
+static inline M all_lanes()                 { return 0xFF; }
+
+static inline I as_bits(V x)                { return _mm512_castpd_si512(x); }
+static inline V from_bits(I x)              { return _mm512_castsi512_pd(x); }
+static inline I iset1(int64_t x)            { return _mm512_set1_epi64(x); }
+static inline I iadd(I a, I b)              { return _mm512_add_epi64(a, b); }
+static inline I isub(I a, I b)              { return _mm512_sub_epi64(a, b); }
+static inline I iand(I a, I b)              { return _mm512_and_si512(a, b); }
+static inline I ior(I a, I b)               { return _mm512_or_si512(a, b); }
+static inline I ixor(I a, I b)              { return _mm512_xor_si512(a, b); }
+static inline I shl52(I x)                  { return _mm512_slli_epi64(x, 52); }
+static inline I shr52(I x)                  { return _mm512_srli_epi64(x, 52); }
+
+#include "vector_math_kernels.inl"
+
+}   // namespace avx512
+
+#pragma GCC pop_options
+
+#define CPPEXPRPARS_DISPATCH(NAME, ...)                                      \
+    switch (get_simd_level()) {                                             \
+        case SimdLevel::AVX512: return avx512::NAME(__VA_ARGS__);           \
+        case SimdLevel::AVX2:   return avx2::NAME(__VA_ARGS__);             \
+        default:                break;                                      \
+    }
+
+#else
+
+#define CPPEXPRPARS_DISPATCH(NAME, ...)
+
+#endif
+
+#define CPPEXPRPARS_VECTOR_UNARY(NAME, SCALAR)                                   \
+    void vector_math::NAME(const ExprFloat* in, ExprFloat* out, size_t n) {     \
+        CPPEXPRPARS_DISPATCH(NAME, in, out, n)                                  \
+        for (size_t i = 0; i < n; ++i)                                          \
+            out[i] = SCALAR(in[i]);                                             \
+    }
+
+#define CPPEXPRPARS_VECTOR_BINARY(NAME, SCALAR)                                                  \
+    void vector_math::NAME(const ExprFloat* a, const ExprFloat* b, ExprFloat* out, size_t n) {   \
+        CPPEXPRPARS_DISPATCH(NAME, a, b, out, n)                                                \
+        for (size_t i = 0; i < n; ++i)                                                          \
+            out[i] = SCALAR(a[i], b[i]);                                                        \
+    }
+
+CPPEXPRPARS_VECTOR_UNARY(sin,  std::sin)
+CPPEXPRPARS_VECTOR_UNARY(cos,  std::cos)
+CPPEXPRPARS_VECTOR_UNARY(tan,  std::tan)
+CPPEXPRPARS_VECTOR_UNARY(exp,  std::exp)
+CPPEXPRPARS_VECTOR_UNARY(log,  std::log)
+CPPEXPRPARS_VECTOR_UNARY(sqrt, std::sqrt)
+CPPEXPRPARS_VECTOR_UNARY(abs,  std::abs)
+CPPEXPRPARS_VECTOR_BINARY(pow, std::pow)
+CPPEXPRPARS_VECTOR_BINARY(min, std::min)
+CPPEXPRPARS_VECTOR_BINARY(max, std::max)
+
+#undef CPPEXPRPARS_VECTOR_UNARY
+#undef CPPEXPRPARS_VECTOR_BINARY
+#undef CPPEXPRPARS_DISPATCH
+
+}   // namespace cppexprpars
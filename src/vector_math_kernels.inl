@@ -0,0 +1,344 @@
+//  vector_math_kernels.inl - Lightweight C++ Expression Parser (SIMD Math)
+//
+//  Instruction-set independent bodies of the vectorized built-ins. This file
+//  is included once per instruction set by vector_math.cpp, inside a
+//  namespace that provides the lane type `V`, its mask `M`, its 64-bit
+//  integer view `I`, the lane count `W` and the primitive operations used
+//  below. It is not a standalone header.
+//
+//  The polynomial and rational approximations follow Cephes (S. L. Moshier).
+
+
+
+// Elementwise application of `kernel` to `n` values. Lanes the kernel cannot
+// handle (flagged in the returned mask) are recomputed with `fallback`; the
+// tail shorter than a full vector is padded so it goes through the same code.
+template <typename Kernel, typename Fallback>
+static inline void apply_unary(const ExprFloat* in, ExprFloat* out, size_t n, Kernel kernel, Fallback fallback) {
+    auto step = [&](const ExprFloat* src, ExprFloat* dst, size_t count) {
+        M ok;
+        const V x = load(src);
+        const V r = kernel(x, ok);
+        const unsigned bad = ~mask_bits(ok) & ((1u << W) - 1);
+        if (!bad) {
+            store(dst, r);
+            return;
+        }
+        // `dst` may alias `src`; keep the arguments for the fallback.
+        ExprFloat xs[W];
+        store(xs, x);
+        store(dst, r);
+        for (size_t l = 0; l < count; ++l)
+            if (bad & (1u << l))
+                dst[l] = fallback(xs[l]);
+    };
+
+    size_t i = 0;
+    for (; i + W <= n; i += W)
+        step(in + i, out + i, W);
+    if (i < n) {
+        ExprFloat src[W] = {}, dst[W];
+        std::copy(in + i, in + n, src);
+        step(src, dst, n - i);
+        std::copy(dst, dst + (n - i), out + i);
+    }
+}
+
+template <typename Kernel, typename Fallback>
+static inline void apply_binary(const ExprFloat* a, const ExprFloat* b, ExprFloat* out, size_t n, Kernel kernel, Fallback fallback) {
+    auto step = [&](const ExprFloat* x, const ExprFloat* y, ExprFloat* dst, size_t count) {
+        M ok;
+        const V vx = load(x), vy = load(y);
+        const V r = kernel(vx, vy, ok);
+        const unsigned bad = ~mask_bits(ok) & ((1u << W) - 1);
+        if (!bad) {
+            store(dst, r);
+            return;
+        }
+        ExprFloat xs[W], ys[W];
+        store(xs, vx);
+        store(ys, vy);
+        store(dst, r);
+        for (size_t l = 0; l < count; ++l)
+            if (bad & (1u << l))
+                dst[l] = fallback(xs[l], ys[l]);
+    };
+
+    size_t i = 0;
+    for (; i + W <= n; i += W)
+        step(a + i, b + i, out + i, W);
+    if (i < n) {
+        ExprFloat x[W] = {}, y[W] = {}, dst[W];
+        std::copy(a + i, a + n, x);
+        std::copy(b + i, b + n, y);
+        step(x, y, dst, n - i);
+        std::copy(dst, dst + (n - i), out + i);
+    }
+}
+
+// Integer-valued lanes (|x| < 2^51) as 64-bit integers, and back.
+static inline I to_int(V x) {
+    const V magic = set1(6755399441055744.0);      // 2^52 + 2^51
+    return isub(as_bits(add(x, magic)), as_bits(magic));
+}
+
+static inline V to_double(I x) {
+    const V magic = set1(6755399441055744.0);
+    return sub(from_bits(iadd(x, as_bits(magic))), magic);
+}
+
+// 2^n for integer-valued `n` within the normal exponent range.
+static inline V exp2_int(V n) {
+    return from_bits(shl52(iadd(to_int(n), iset1(1023))));
+}
+
+static inline V horner(V x, const double* c, int n) {
+    V r = set1(c[0]);
+    for (int i = 1; i < n; ++i)
+        r = fmadd(r, x, set1(c[i]));
+    return r;
+}
+
+// Horner with an implicit leading coefficient of 1.
+static inline V horner1(V x, const double* c, int n) {
+    V r = add(x, set1(c[0]));
+    for (int i = 1; i < n; ++i)
+        r = fmadd(r, x, set1(c[i]));
+    return r;
+}
+
+static inline V flip_sign(V x, M negate) {
+    return from_bits(ixor(as_bits(x), as_bits(select(negate, set1(-0.0), set1(0.0)))));
+}
+
+
+
+static const double exp_p[] = { 1.26177193074810590878e-4, 3.02994407707441961300e-2, 9.99999999999999999910e-1 };
+static const double exp_q[] = { 3.00198505138664455042e-6, 2.52448340349684104192e-3, 2.27265548208155028766e-1, 2.00000000000000000009e0 };
+
+// exp(hi + lo) for |lo| much smaller than ulp(hi). Valid where the result is
+// a normal number; callers flag the other lanes.
+static inline V exp_dd(V hi, V lo) {
+    const V c1 = set1(6.93145751953125e-1);
+    const V c2 = set1(1.42860682030941723212e-6);
+
+    V n = floor_(fmadd(hi, set1(1.4426950408889634073599), set1(0.5)));
+    V x = sub(fnmadd(n, c1, hi), mul(n, c2));
+    x = add(x, lo);
+
+    V xx = mul(x, x);
+    V px = mul(x, horner(xx, exp_p, 3));
+    x = div(px, sub(horner(xx, exp_q, 4), px));
+    x = fmadd(x, set1(2.0), set1(1.0));
+
+    // Scale in two steps so that 2^n never has to be represented on its own.
+    V n1 = floor_(mul(n, set1(0.5)));
+    return mul(mul(x, exp2_int(n1)), exp2_int(sub(n, n1)));
+}
+
+static inline V exp_kernel(V x, M& ok) {
+    ok = mask_and(ge(x, set1(-7.08396418532264106224e2)), le(x, set1(7.09782712893383996843e2)));
+    return exp_dd(select(ok, x, set1(0.0)), set1(0.0));
+}
+
+
+
+static const double log_p[] = {
+    1.01875663804580931796e-4, 4.97494994976747001425e-1, 4.70579119878881725854e0,
+    1.44989225341610930846e1,  1.79368678507819816313e1,  7.70838733755885391666e0
+};
+static const double log_q[] = {
+    1.12873587189167450590e1, 4.52279145837532221105e1, 8.29875266912776603211e1,
+    7.11544750618563894466e1, 2.31251620126765340583e1
+};
+
+static inline void two_sum(V a, V b, V& s, V& err) {
+    s = add(a, b);
+    V bb = sub(s, a);
+    err = add(sub(a, sub(s, bb)), sub(b, bb));
+}
+
+// log(x) as an unevaluated sum hi + lo, for positive normal finite `x`. The
+// extra precision is what keeps `pow` accurate for large results.
+static inline void log_dd(V x, V& hi, V& lo) {
+    I bits = as_bits(x);
+    V e = sub(to_double(shr52(bits)), set1(1022.0));
+    V m = from_bits(ior(iand(bits, iset1(0x000FFFFFFFFFFFFFLL)), iset1(0x3FE0000000000000LL)));
+
+    // m in [0.5, 1): move it to [sqrt(1/2), sqrt(2)) and take m - 1 exactly.
+    M small = lt(m, set1(7.07106781186547524401e-1));
+    e = select(small, sub(e, set1(1.0)), e);
+    m = sub(select(small, add(m, m), m), set1(1.0));
+
+    V z    = mul(m, m);
+    V z_lo = fmsub(m, m, z);
+    V r    = mul(m, div(mul(z, horner(m, log_p, 6)), horner1(m, log_q, 5)));
+
+    // e * ln2, split so that the leading part is exact.
+    const V ln2_lo = set1(-2.121944400546905827679e-4);
+    V e_hi = mul(e, set1(0.693359375));
+    V c    = mul(e, ln2_lo);
+    V c_lo = fmsub(e, ln2_lo, c);
+
+    V s1, err1, s2, err2, s3, err3;
+    two_sum(e_hi, m, s1, err1);
+    two_sum(s1, mul(z, set1(-0.5)), s2, err2);
+    two_sum(s2, c, s3, err3);
+
+    V tail = add(add(r, c_lo), fmadd(z_lo, set1(-0.5), add(add(err1, err2), err3)));
+    hi = add(s3, tail);
+    lo = sub(tail, sub(hi, s3));
+}
+
+static inline M is_positive_normal(V x) {
+    return mask_and(ge(x, set1(2.2250738585072014e-308)), le(x, set1(1.7976931348623157e308)));
+}
+
+static inline V log_kernel(V x, M& ok) {
+    ok = is_positive_normal(x);
+    V hi, lo;
+    log_dd(select(ok, x, set1(1.0)), hi, lo);
+    return add(hi, lo);
+}
+
+
+
+// pow(x, y) = exp(y * log(x)) with both the logarithm and the product kept
+// in double-double. Handles x positive and normal and results within the
+// normal range; everything else (negative bases, zeros, infinities, NaNs,
+// overflow and underflow) is flagged for the scalar fallback.
+static inline V pow_kernel(V x, V y, M& ok) {
+    M x_ok = is_positive_normal(x);
+    M y_ok = le(abs_(y), set1(1.7976931348623157e308));
+    x = select(x_ok, x, set1(1.0));
+    y = select(y_ok, y, set1(0.0));
+
+    V l_hi, l_lo;
+    log_dd(x, l_hi, l_lo);
+    V p_hi = mul(y, l_hi);
+    V p_lo = fmadd(y, l_lo, fmsub(y, l_hi, p_hi));
+
+    M range = mask_and(ge(p_hi, set1(-7.08396418532264106224e2)), le(p_hi, set1(7.09782712893383996843e2)));
+    ok = mask_and(mask_and(x_ok, y_ok), range);
+    return exp_dd(select(ok, p_hi, set1(0.0)), select(ok, p_lo, set1(0.0)));
+}
+
+
+
+static const double sin_coef[] = {
+    1.58962301576546568060e-10, -2.50507477628578072866e-8, 2.75573136213857245213e-6,
+    -1.98412698295895385996e-4,  8.33333333332211858878e-3, -1.66666666666666307295e-1
+};
+static const double cos_coef[] = {
+    -1.13585365213876817300e-11, 2.08757008419747316778e-9, -2.75573141792967388112e-7,
+    2.48015872888517045348e-5,  -1.38888888888730564116e-3,  4.16666666666665929218e-2
+};
+
+// Beyond this the three-part reduction by pi/4 starts to lose accuracy near
+// the zeros of the functions.
+static const double trig_max = 4194304.0;     // 2^22
+
+// Reduces |x| to z in [-pi/4, pi/4] and returns the octant in `j`.
+static inline V reduce_pi4(V ax, const double* dp, I& j) {
+    V y = floor_(mul(ax, set1(1.27323954473516268615)));
+    j = to_int(y);
+    I odd = iand(j, iset1(1));
+    j = iadd(j, odd);
+    y = add(y, to_double(odd));
+    j = iand(j, iset1(7));
+    return fnmadd(y, set1(dp[2]), fnmadd(y, set1(dp[1]), fnmadd(y, set1(dp[0]), ax)));
+}
+
+static const double sincos_dp[] = { 7.85398125648498535156e-1, 3.77489470793079817668e-8, 2.69515142907905952645e-15 };
+
+// Sine and cosine polynomials on the reduced argument.
+static inline V sin_poly(V z, V zz) { return fmadd(mul(z, zz), horner(zz, sin_coef, 6), z); }
+static inline V cos_poly(V zz) {
+    return fmadd(mul(zz, zz), horner(zz, cos_coef, 6), fnmadd(zz, set1(0.5), set1(1.0)));
+}
+
+static inline M bit_set(I j, int64_t bit) {
+    return ne(to_double(iand(j, iset1(bit))), set1(0.0));
+}
+
+static inline V sin_kernel(V x, M& ok) {
+    V ax = abs_(x);
+    ok = lt(ax, set1(trig_max));
+    I j;
+    V z  = reduce_pi4(select(ok, ax, set1(0.0)), sincos_dp, j);
+    V zz = mul(z, z);
+
+    // `j` is even: octants 2 and 6 use the cosine polynomial, 4 and 6 flip
+    // the sign.
+    M use_cos = bit_set(j, 2);
+    V r = select(use_cos, cos_poly(zz), sin_poly(z, zz));
+    M negative = mask_xor(lt(x, set1(0.0)), bit_set(j, 4));
+    return flip_sign(r, negative);
+}
+
+static inline V cos_kernel(V x, M& ok) {
+    V ax = abs_(x);
+    ok = lt(ax, set1(trig_max));
+    I j;
+    V z  = reduce_pi4(select(ok, ax, set1(0.0)), sincos_dp, j);
+    V zz = mul(z, z);
+
+    M use_sin = bit_set(j, 2);
+    V r = select(use_sin, sin_poly(z, zz), cos_poly(zz));
+    M negative = mask_xor(bit_set(j, 4), bit_set(j, 2));
+    return flip_sign(r, negative);
+}
+
+static const double tan_p[] = { -1.30936939181383777646e4, 1.15351664838587416140e6, -1.79565251976484877988e7 };
+static const double tan_q[] = { 1.36812963470692954678e4, -1.32089234440210967447e6, 2.50083801823357915839e7, -5.38695755929454629881e7 };
+static const double tan_dp[] = { 7.853981554508209228515625e-1, 7.94662735614792836714e-9, 3.06161699786838294307e-17 };
+
+static inline V tan_kernel(V x, M& ok) {
+    V ax = abs_(x);
+    ok = lt(ax, set1(trig_max));
+    I j;
+    V z  = reduce_pi4(select(ok, ax, set1(0.0)), tan_dp, j);
+    V zz = mul(z, z);
+
+    V r = fmadd(mul(z, zz), div(horner(zz, tan_p, 3), horner1(zz, tan_q, 4)), z);
+    r = select(gt(zz, set1(1.0e-14)), r, z);
+    r = select(bit_set(j, 2), div(set1(-1.0), r), r);
+    return flip_sign(r, lt(x, set1(0.0)));
+}
+
+
+
+// Exact operations: these match the scalar built-ins bit for bit.
+static inline V sqrt_kernel(V x, M& ok) { ok = all_lanes(); return sqrt_(x); }
+static inline V abs_kernel(V x, M& ok)  { ok = all_lanes(); return abs_(x); }
+
+// std::min(a, b) is `b < a ? b : a`; min_(b, a) has the same NaN and signed
+// zero behaviour (it returns its second operand when the comparison fails).
+static inline V min_kernel(V a, V b, M& ok) { ok = all_lanes(); return min_(b, a); }
+static inline V max_kernel(V a, V b, M& ok) { ok = all_lanes(); return max_(b, a); }
+
+
+
+#define CPPEXPRPARS_VECTOR_UNARY(NAME, SCALAR)                                      \
+    static void NAME(const ExprFloat* in, ExprFloat* out, size_t n) {               \
+        apply_unary(in, out, n, NAME##_kernel, [](ExprFloat v) { return SCALAR(v); }); \
+    }
+
+#define CPPEXPRPARS_VECTOR_BINARY(NAME, SCALAR)                                               \
+    static void NAME(const ExprFloat* a, const ExprFloat* b, ExprFloat* out, size_t n) {       \
+        apply_binary(a, b, out, n, NAME##_kernel, [](ExprFloat x, ExprFloat y) { return SCALAR(x, y); }); \
+    }
+
+CPPEXPRPARS_VECTOR_UNARY(sin,  std::sin)
+CPPEXPRPARS_VECTOR_UNARY(cos,  std::cos)
+CPPEXPRPARS_VECTOR_UNARY(tan,  std::tan)
+CPPEXPRPARS_VECTOR_UNARY(exp,  std::exp)
+CPPEXPRPARS_VECTOR_UNARY(log,  std::log)
+CPPEXPRPARS_VECTOR_UNARY(sqrt, std::sqrt)
+CPPEXPRPARS_VECTOR_UNARY(abs,  std::abs)
+CPPEXPRPARS_VECTOR_BINARY(pow, std::pow)
+CPPEXPRPARS_VECTOR_BINARY(min, std::min)
+CPPEXPRPARS_VECTOR_BINARY(max, std::max)
+
+#undef CPPEXPRPARS_VECTOR_UNARY
+#undef CPPEXPRPARS_VECTOR_BINARY
@@ -1,6 +1,16 @@
 #include "cppexprpars.hpp"
+#if __cplusplus >= 201703L
+#include "cppexprpars_static.hpp"
+#endif
 #include <iostream>
 #include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <clocale>
+#include <thread>
+#include <atomic>
 
 using namespace cppexprpars;
 
@@ -57,6 +67,1606 @@ void test_binary_expression() {
     std::cout << "test_binary_expression passed!" << std::endl;
 }
 
+void test_tokenizer() {
+    const std::string input = "foo_1 + 2.5e3 % (x) 1e";
+    Tokenizer tokenizer(input);
+    const TokenType expected[] = {
+        TokenType::Identifier, TokenType::Plus, TokenType::Number, TokenType::Percent,
+        TokenType::LeftParen, TokenType::Identifier, TokenType::RightParen,
+        TokenType::Number, TokenType::Identifier, TokenType::End
+    };
+    for (TokenType type : expected) {
+        const Token& token = tokenizer.current();
+        assert(token.type == type);
+        // Tokens point into the input instead of copying it
+        assert(type == TokenType::End || (token.text.data() >= input.data() && token.text.end() <= input.data() + input.size()));
+        tokenizer.next_token();
+    }
+
+    // Numbers round exactly like strtod, whatever their length or exponent
+    uint64_t state = 42;
+    auto next = [&state]() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return state >> 11;
+    };
+    char text[96];
+    for (int i = 0; i < 20000; ++i) {
+        double sample;
+        uint64_t bits = next() << 11 | next() % 2048;
+        std::memcpy(&sample, &bits, sizeof sample);
+        sample = std::abs(sample);
+        switch (i % 4) {
+            case 0: std::snprintf(text, sizeof text, "%.17g", std::isfinite(sample) ? sample : 1.0); break;
+            case 1: std::snprintf(text, sizeof text, "%.3f", static_cast<double>(next() % 1000000) / 7.0); break;
+            case 2: std::snprintf(text, sizeof text, "%llu.%llue-%d", (unsigned long long)next(), (unsigned long long)next(), static_cast<int>(next() % 330)); break;
+            case 3: std::snprintf(text, sizeof text, "%.25e", static_cast<double>(next()) * 1e-5); break;
+        }
+        Tokenizer number(text);
+        assert(number.current().type == TokenType::Number);
+        const double parsed = number.current().number_value;
+        const double reference = std::strtod(text, nullptr);
+        assert(std::memcmp(&parsed, &reference, sizeof parsed) == 0);
+    }
+    assert(Tokenizer("1e999").current().type == TokenType::Invalid);
+    assert(Tokenizer(".").current().type == TokenType::Invalid);
+
+    // The decimal point does not follow the C locale
+    if (std::setlocale(LC_NUMERIC, "de_DE.UTF-8")) {
+        assert(Tokenizer("0.1234567890123456789").current().number_value == 0.1234567890123456789);
+        std::setlocale(LC_NUMERIC, "C");
+    }
+
+    ExprParser parser;
+    parser.set_expression("17 % 5 * 2");
+    assert(parser.evaluate() == 4.0);
+    std::cout << "test_tokenizer passed!" << std::endl;
+}
+
+void test_compiled_expression() {
+    ExprParser parser;
+    parser.set_expression("x * x + y");
+
+    const CompiledExpr& compiled = parser.compile();
+    for (int i = 0; i < 10; ++i) {
+        parser.set_variable("x", i);
+        parser.set_variable("y", 1.0);
+        assert(std::abs(compiled.evaluate() - (i * i + 1.0)) < 1e-6);
+    }
+    assert(&parser.compile() == &compiled);     // Cached until invalidated
+
+    parser.set_expression("x - y");
+    assert(std::abs(parser.evaluate() - 8.0) < 1e-6);  // 9 - 1 = 8
+    std::cout << "test_compiled_expression passed!" << std::endl;
+}
+
+void test_bytecode_matches_tree() {
+    const char* formulas[] = {
+        "2 + 3 * x - y / 4",
+        "-(x - y) ^ 2 ^ 0.5",
+        "sin(x) * cos(y) + sqrt(x * x + y * y)",
+        "min(x, max(y, 3)) - -x",
+    };
+
+    ExprParser parser;
+    parser.set_variable("x", 1.5);
+    parser.set_variable("y", -2.25);
+    for (const char* formula : formulas) {
+        parser.set_expression(formula);
+        const CompiledExpr& compiled = parser.compile();
+        ExprFloat tree = compiled.evaluate_tree();
+        ExprFloat code = compiled.evaluate();
+        assert(tree == code || (std::isnan(tree) && std::isnan(code)));
+    }
+    std::cout << "test_bytecode_matches_tree passed!" << std::endl;
+}
+
+void test_bound_variables() {
+    struct Sample { ExprFloat x; ExprFloat y; };
+    Sample samples[] = { {1.0, 2.0}, {3.0, 4.0}, {5.0, 6.0} };
+
+    ExprParser parser;
+    parser.set_expression("10 * u + v");
+    parser.bind("u", &samples[0].x, sizeof(Sample));
+    parser.bind("v", &samples[0].y, sizeof(Sample));
+
+    assert(std::abs(parser.evaluate() - 12.0) < 1e-6);       // Row 0
+    assert(std::abs(parser.evaluate_at(2) - 56.0) < 1e-6);   // Row 2
+
+    samples[0].x = 7.0;     // Read straight from caller memory
+    assert(std::abs(parser.evaluate() - 72.0) < 1e-6);
+
+    bool rejected = false;
+    try {
+        Tokenizer tokenizer("u + undefined_name");
+        Parser(std::move(tokenizer)).parse();
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    assert(rejected);
+    std::cout << "test_bound_variables passed!" << std::endl;
+}
+
+void test_function_resolution() {
+    ExprParser parser;
+    parser.register_function("sum", [](const ExprFloat* args, size_t nargs) {
+        ExprFloat total = 0.0;
+        for (size_t i = 0; i < nargs; ++i)
+            total += args[i];
+        return total;
+    }, 10);
+    parser.register_function("hypot", [](ExprFloat x, ExprFloat y) { return std::hypot(x, y); });
+
+    parser.set_expression("sum(1, 2, 3, 4, 5, 6, 7, 8, 9, hypot(3, 4))");
+    const CompiledExpr& compiled = parser.compile();
+    assert(compiled.evaluate() == 50.0);
+    assert(compiled.evaluate_tree() == 50.0);
+
+    const char* invalid[] = { "nope(1)", "hypot(1)" };
+    for (const char* formula : invalid) {
+        bool rejected = false;
+        try {
+            parser.set_expression(formula);
+            parser.compile();
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        assert(rejected);
+    }
+    std::cout << "test_function_resolution passed!" << std::endl;
+}
+
+void test_constant_folding() {
+    ExprParser parser;
+    parser.set_variable("x", 1.5);
+    parser.set_variable("r", -0.0);
+    int calls = 0;
+    parser.register_function("counter", [&calls](const ExprFloat* args, size_t) {
+        ++calls;
+        return args[0];
+    }, 1);
+
+    struct Case { const char* formula; size_t safe_nodes; size_t fast_nodes; };
+    const Case cases[] = {
+        { "2 * 3.14159 * r",            3, 3 },
+        { "x * 1 + 0 * 1",              3, 1 },     // x + 0 is not exact for x = -0
+        { "r - 0 + -(-x) / 1",          3, 3 },
+        { "sqrt(16) + max(2, 3) * x",   5, 4 },     // fma(x, 3, 4)
+        { "x / 4 + x ^ 1",              5, 4 },     // fma(x, 0.25, x)
+        { "x * 2 * 3 + x / 3",          9, 6 },
+        { "x ^ 2 + r * 0",              7, 3 },
+        { "counter(1) + 2 * 2",         4, 4 },     // Not pure: not folded
+    };
+
+    for (const Case& c : cases) {
+        parser.set_expression(c.formula);
+        parser.set_compile_options({ OptimizationLevel::None });
+        const ExprFloat unoptimized = parser.evaluate();
+
+        parser.set_compile_options({ OptimizationLevel::Safe });
+        const CompiledExpr& safe = parser.compile();
+        assert(Optimizer::node_count(safe.root()) == c.safe_nodes);
+        const ExprFloat folded = safe.evaluate();
+        assert(std::memcmp(&folded, &unoptimized, sizeof(ExprFloat)) == 0);
+
+        parser.set_compile_options({ OptimizationLevel::FastMath });
+        const CompiledExpr& fast = parser.compile();
+        assert(Optimizer::node_count(fast.root()) == c.fast_nodes);
+        assert(std::abs(fast.evaluate() - unoptimized) <= 1e-12 * std::abs(unoptimized));
+    }
+    assert(calls == 3);
+
+    // Errors are still raised on evaluation, not at compile time
+    parser.set_compile_options({ OptimizationLevel::FastMath });
+    parser.set_expression("x + 1 / 0");
+    assert(Optimizer::node_count(parser.compile().root()) == 5);
+    bool threw = false;
+    try {
+        parser.evaluate();
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+    std::cout << "test_constant_folding passed!" << std::endl;
+}
+
+void test_shared_subexpressions() {
+    ExprFloat t = 0.0;
+    ExprParser parser;
+    parser.bind("t", &t);
+    parser.set_variable("a", 2.5);
+    parser.set_variable("p", 0.25);
+    int calls = 0;
+    parser.register_function("counter", [&calls](const ExprFloat* args, size_t) {
+        ++calls;
+        return args[0];
+    }, 1);
+
+    // sin(a * t + p) is 6 nodes and its 5 extra copies go; so does the copy
+    // of the 5-node a * t + p passed to sqrt
+    const char* formula =
+        "sin(a * t + p) * sin(a * t + p) + sin(a * t + p) / (1 + sin(a * t + p)) - "
+        "sin(a * t + p) ^ 2 + cos(sin(a * t + p)) + sqrt(a * t + p)";
+    parser.set_expression(formula);
+    const ExprFloat reference = parser.compile().evaluate_tree();
+    assert(parser.compile().deduplicated_nodes() == 0);
+    const size_t unshared_size = parser.compile().bytecode().instructions().size();
+
+    CompileOptions options;
+    options.share_subexpressions = true;
+    parser.set_compile_options(options);
+    const CompiledExpr& shared = parser.compile();
+    assert(shared.deduplicated_nodes() == 5 * 6 + 5);
+    assert(shared.bytecode().temporary_count() == 2);
+    assert(shared.bytecode().instructions().size() < unshared_size);
+
+    for (int i = 0; i < 100; ++i) {
+        t = 0.1 * i;
+        const ExprFloat expected = shared.evaluate_tree();
+        const ExprFloat value = shared.evaluate();
+        assert(std::memcmp(&expected, &value, sizeof(ExprFloat)) == 0);
+        const ExprFloat vars[] = { 2.5, t, 0.25 };
+        const ExprFloat executed = shared.bytecode().execute(vars);
+        assert(std::memcmp(&expected, &executed, sizeof(ExprFloat)) == 0);
+    }
+    t = 0.0;
+    assert(shared.evaluate() == reference);
+
+    std::vector<ExprFloat> ts(300), out(300);
+    for (size_t i = 0; i < ts.size(); ++i)
+        ts[i] = 0.01 * static_cast<ExprFloat>(i);
+    parser.bind("t", ts.data(), sizeof(ExprFloat));
+    shared.evaluate_batch(nullptr, ts.size(), out.data());
+    for (size_t i = 0; i < ts.size(); ++i) {
+        const ExprFloat expected = shared.evaluate_at(i);
+        assert(std::memcmp(&expected, &out[i], sizeof(ExprFloat)) == 0);
+    }
+
+    // Functions that are not pure are still called once per occurrence
+    parser.set_expression("counter(a) + counter(a)");
+    assert(parser.compile().deduplicated_nodes() == 1);     // Only `a`
+    parser.evaluate();
+    assert(calls == 2);
+    std::cout << "test_shared_subexpressions passed!" << std::endl;
+}
+
+// Counts the blocks an arena asks for.
+class CountingResource : public MemoryResource {
+public:
+    size_t allocations = 0;
+    size_t live = 0;
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        ++allocations;
+        ++live;
+        return new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override {
+        --live;
+        new_delete_resource()->deallocate(ptr, bytes, alignment);
+    }
+};
+
+void test_arena_allocation() {
+    CountingResource upstream;
+    {
+        Arena arena(4096, &upstream);
+        ExprParser parser;
+        parser.set_memory_resource(&arena);
+        parser.set_variable("x", 3.0);
+        parser.set_variable("y", 4.0);
+        parser.set_compile_options({ OptimizationLevel::None });
+
+        parser.set_expression("sqrt(x * x + y * y) + min(x, y) * max(x, -y) - (x - 1) / (y + 1)");
+        assert(parser.evaluate() == 5.0 + 3.0 * 3.0 - 2.0 / 5.0);
+        assert(upstream.allocations == 1);
+        assert(arena.bytes_allocated() > 0);
+
+        // A node whose constructor throws goes back to the arena too
+        bool rejected = false;
+        try {
+            parser.set_expression("x + nope");
+            parser.compile();
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        assert(rejected);
+
+        // Nodes made on the heap and in the arena can be mixed in one tree
+        ExprNodePtr tree = make_node<BinaryExprNode>(&arena, BinaryOp::Add,
+            make_node<ConstantExprNode>(&arena, 1.0), std::make_unique<ConstantExprNode>(2.0));
+        assert(tree->evaluate() == 3.0);
+        tree.reset();
+
+        parser.set_memory_resource(nullptr);    // Drops the tree built in the arena
+        arena.release();
+        assert(upstream.live == 0);
+
+        parser.set_expression("x * y");
+        assert(parser.evaluate() == 12.0);
+    }
+    assert(upstream.live == 0);
+    std::cout << "test_arena_allocation passed!" << std::endl;
+}
+
+void test_expression_cache() {
+    ExpressionCache cache(4, 2);
+    FunctionRegistry registry = FunctionRegistry::default_registry();
+
+    auto a = cache.get("x*y + sin(z)", registry);
+    auto b = cache.get("x * y+sin( z )", registry);
+    assert(a == b);
+    assert(a->variables().size() == 3);
+
+    const ExprFloat vars[] = { 2.0, 3.0, 0.0 };
+    assert(a->bytecode().execute(vars) == 6.0);
+
+    // Registering a function changes the registry's identity
+    registry.register_function("twice", [](ExprFloat v) { return 2 * v; });
+    auto c = cache.get("x * y + sin(z)", registry);
+    assert(c != a);
+    assert(c->bytecode().execute(vars) == 6.0);
+
+    CacheStats stats = cache.stats();
+    assert(stats.hits == 1 && stats.misses == 2 && stats.evictions == 0 && stats.size == 2);
+
+    for (int i = 0; i < 10; ++i)
+        cache.get("x + " + std::to_string(i), registry);
+    stats = cache.stats();
+    assert(stats.size <= cache.capacity());
+    assert(stats.evictions == 2 + 10 - cache.capacity());
+    assert(a->bytecode().execute(vars) == 6.0);     // Still usable after eviction
+
+    bool rejected = false;
+    try {
+        cache.get("nope(x)", registry);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    assert(rejected);
+
+    // Many threads sharing a small set of formulas
+    ExpressionCache shared(64);
+    const char* formulas[] = { "x + y", "x * y - 1", "sqrt(x * x + y * y)", "max(x, y) / 2" };
+    std::vector<std::thread> threads;
+    std::atomic<int> mismatches(0);
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 2000; ++i) {
+                const char* formula = formulas[(i + t) % 4];
+                auto compiled = shared.get(formula);
+                const ExprFloat xy[] = { static_cast<ExprFloat>(i), static_cast<ExprFloat>(t) };
+                ExprParser reference;
+                if (i % 500 == 0) {
+                    reference.set_variable("x", xy[0]);
+                    reference.set_variable("y", xy[1]);
+                    reference.set_expression(formula);
+                    if (reference.evaluate() != compiled->bytecode().execute(xy))
+                        ++mismatches;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    assert(mismatches == 0);
+    stats = shared.stats();
+    assert(stats.size == 4 && stats.hits + stats.misses == 8 * 2000 && stats.misses >= 4);
+    std::cout << "test_expression_cache passed!" << std::endl;
+}
+
+void test_concurrent_evaluation() {
+    EvaluationContext context = EvaluationContext::default_context();
+    context.set_variable("rate", 0.0);
+    Parser parser(Tokenizer("x * rate + sqrt(y) - min(x, y)"), &context, get_default_registry());
+    const CompiledExpr expr = parser.compile({ OptimizationLevel::Safe, true });
+
+    // A tree keeps the default snapshot it was built against
+    EvaluationContext defaults = *get_default_context();
+    defaults.set_variable("x", 1.0);
+    set_default_context(&defaults);
+    auto before = Parser(Tokenizer("x + 1")).parse();
+    defaults.set_variable("x", 2.0);
+    set_default_context(&defaults);
+    assert(before->evaluate() == 2.0);
+    assert(Parser(Tokenizer("x + 1")).parse()->evaluate() == 3.0);
+
+    // Only copies of the compile context that did not add names qualify
+    EvaluationContext diverged = context;
+    diverged.set_variable("extra", 1.0);
+    bool rejected = false;
+    try {
+        expr.evaluate(diverged);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    assert(rejected);
+
+    // Each thread evaluates the shared expression against its own copy of
+    // the context, while another keeps replacing the defaults and parsing
+    std::atomic<bool> done(false);
+    std::atomic<int> mismatches(0);
+    std::thread configurator([&] {
+        FunctionRegistry registry = FunctionRegistry::default_registry();
+        EvaluationContext replacement = EvaluationContext::default_context();
+        for (int i = 0; i < 200 && !done; ++i) {
+            replacement.set_variable("x", i);
+            set_default_context(&replacement);
+            set_default_registry(&registry);
+            if (Parser(Tokenizer("x * 2 + sqrt(4)")).parse()->evaluate() != i * 2 + 2)
+                ++mismatches;
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t] {
+            EvaluationContext local = context;
+            const size_t x = local.slot_of("x"), y = local.slot_of("y"), rate = local.slot_of("rate");
+            for (int i = 0; i < 20000; ++i) {
+                const ExprFloat xv = i % 97, yv = t + 1, rv = 0.5 * t;
+                local.set_value(x, xv);
+                local.set_value(y, yv);
+                local.set_value(rate, rv);
+                if (expr.evaluate(local) != xv * rv + std::sqrt(yv) - std::min(xv, yv))
+                    ++mismatches;
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    done = true;
+    configurator.join();
+    assert(mismatches == 0);
+    std::cout << "test_concurrent_evaluation passed!" << std::endl;
+}
+
+void test_batch_matches_tree() {
+    const char* formulas[] = {
+        "x + y * 2 - y / 3",
+        "(x - y) * (x + y) / (y * y + 1) - -x",
+        "x ^ 2 + (y - 3) ^ 0.5 + 2 * x ^ -1",
+        "sin(x) * cos(y) + sqrt(x * x + y * y) + min(x, y) - max(1, y)",
+    };
+
+    const size_t n = 1000;     // Not a multiple of the block size or any vector width
+    std::vector<ExprFloat> xs(n), ys(n), out(n);
+    for (size_t i = 0; i < n; ++i) {
+        xs[i] = 0.37 * static_cast<ExprFloat>(i) - 100.0;
+        ys[i] = 1.0 + 0.013 * static_cast<ExprFloat>(i);
+    }
+
+    ExprFloat x = 0.0, y = 0.0;
+    ExprParser parser;
+    parser.bind("x", &x);
+    parser.bind("y", &y);
+
+    const SimdLevel detected = detected_simd_level();
+    for (const char* formula : formulas) {
+        parser.set_expression(formula);
+        const CompiledExpr& compiled = parser.compile();
+
+        std::vector<const ExprFloat*> columns;
+        for (const std::string& name : compiled.variables())
+            columns.push_back(name == "x" ? xs.data() : ys.data());
+
+        for (int level = 0; level <= static_cast<int>(detected); ++level) {
+            set_simd_level(static_cast<SimdLevel>(level));
+            compiled.evaluate_batch(columns.data(), n, out.data());
+            for (size_t i = 0; i < n; ++i) {
+                x = xs[i];
+                y = ys[i];
+                ExprFloat expected = compiled.evaluate_tree();
+                assert(std::memcmp(&expected, &out[i], sizeof(ExprFloat)) == 0);
+            }
+        }
+    }
+    set_simd_level(detected);
+    std::cout << "test_batch_matches_tree passed!" << std::endl;
+}
+
+// Distance between two doubles in units in the last place.
+static uint64_t ulp_distance(ExprFloat a, ExprFloat b) {
+    if (a == b || (std::isnan(a) && std::isnan(b)))
+        return 0;
+    int64_t ia, ib;
+    std::memcpy(&ia, &a, sizeof ia);
+    std::memcpy(&ib, &b, sizeof ib);
+    if (ia < 0) ia = INT64_MIN - ia;
+    if (ib < 0) ib = INT64_MIN - ib;
+    return ia > ib ? static_cast<uint64_t>(ia) - static_cast<uint64_t>(ib)
+                   : static_cast<uint64_t>(ib) - static_cast<uint64_t>(ia);
+}
+
+// Runs the indices in reverse, spreading them over three pretend workers.
+class ReverseExecutor : public Executor {
+public:
+    size_t concurrency() const override { return 3; }
+    void run(size_t count, const Task& task) override {
+        for (size_t i = count; i-- > 0;)
+            task(i, i % 3);
+    }
+};
+
+void test_parallel_evaluation() {
+    const size_t n = 100003;
+    std::vector<ExprFloat> xs(n), ys(n), expected(n), out(n);
+    for (size_t i = 0; i < n; ++i) {
+        xs[i] = 0.001 * static_cast<ExprFloat>(i) - 40.0;
+        ys[i] = 1.0 + static_cast<ExprFloat>(i % 7);
+    }
+
+    EvaluationContext context;
+    context.bind("x", xs.data(), sizeof(ExprFloat));    // Read from the context with a stride
+    context.set_variable("y", 0.0);
+    Parser parser(Tokenizer("sin(x) * exp(-abs(x) / y) + sin(x) * sin(x) - x / y"), &context, get_default_registry());
+    const CompiledExpr expr = parser.compile({ OptimizationLevel::Safe, true });
+    std::vector<const ExprFloat*> columns;
+    for (const std::string& name : expr.variables())
+        columns.push_back(name == "y" ? ys.data() : nullptr);
+
+    ThreadPool pool(4);
+    ReverseExecutor reverse;
+    const unsigned tolerance = get_vector_math_tolerance();
+    for (unsigned max_ulp : { 0u, vector_math::pow_max_ulp }) {
+        set_vector_math_tolerance(max_ulp);
+        expr.evaluate_batch(columns.data(), n, expected.data());
+        for (size_t chunk_rows : { 0, 300, 4096 }) {
+            std::fill(out.begin(), out.end(), 0.0);
+            expr.evaluate_parallel(columns.data(), n, out.data(), pool, chunk_rows);
+            assert(std::memcmp(expected.data(), out.data(), n * sizeof(ExprFloat)) == 0);
+
+            std::fill(out.begin(), out.end(), 0.0);
+            expr.evaluate_parallel(columns.data(), n, out.data(), reverse, chunk_rows);
+            assert(std::memcmp(expected.data(), out.data(), n * sizeof(ExprFloat)) == 0);
+        }
+    }
+    set_vector_math_tolerance(tolerance);
+
+    // Errors in any chunk reach the caller
+    ys[n / 2] = 0.0;
+    Parser divide(Tokenizer("x / y"), &context, get_default_registry());
+    const CompiledExpr quotient = divide.compile();
+    columns.assign({ xs.data(), ys.data() });
+    bool rejected = false;
+    try {
+        quotient.evaluate_parallel(columns.data(), n, out.data(), pool, 256);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    assert(rejected);
+
+    // Every index runs exactly once, nested runs included
+    std::vector<std::atomic<int>> runs(1000);
+    pool.run(runs.size() / 10, [&](size_t outer, size_t) {
+        pool.run(10, [&](size_t inner, size_t) { ++runs[outer * 10 + inner]; });
+    });
+    for (const std::atomic<int>& count : runs)
+        assert(count == 1);
+    std::cout << "test_parallel_evaluation passed!" << std::endl;
+}
+
+void test_jit() {
+    const char* formulas[] = {
+        "x + y * 2 - y / 3",
+        "-(x - y) * (x + y) / (y * y + 1) + 7",
+        "x ^ 2 + y ^ 0.5 + x % 3",
+        "sin(x) * cos(y) + sqrt(x * x + y * y) + abs(-x) + min(x, y) - max(-0.0 * x, y)",
+        "sum3(x, y, 2) * sin(2 * x + y) + sin(2 * x + y) ^ 2",
+    };
+
+    FunctionRegistry registry = FunctionRegistry::default_registry();
+    registry.register_function("sum3", [](const ExprFloat* args, size_t n) { return args[0] + args[1] * n + args[2]; }, 3);
+    registry.register_function("fail", [](ExprFloat) -> ExprFloat { throw std::runtime_error("fail"); });
+    EvaluationContext context;
+    context.set_variable("x", 0.0);
+    context.set_variable("y", 0.0);
+
+    const size_t n = 1003;     // Leaves a tail after the packed rows
+    std::vector<ExprFloat> xs(n), ys(n), expected(n), out(n);
+    for (size_t i = 0; i < n; ++i) {
+        xs[i] = 0.37 * static_cast<ExprFloat>(i) - 100.0;
+        ys[i] = 1.0 + 0.013 * static_cast<ExprFloat>(i);
+    }
+
+    const SimdLevel detected = detected_simd_level();
+    for (int level = 0; level <= static_cast<int>(detected); ++level) {
+        set_simd_level(static_cast<SimdLevel>(level));
+        for (const char* formula : formulas) {
+            Parser parser(Tokenizer(formula), &context, &registry);
+            const CompiledExpr expr = parser.compile({ OptimizationLevel::Safe, true });
+            const JitExpr jit(expr.bytecode(), formula);
+            assert(jit.native() == JitExpr::available());
+
+            std::vector<const ExprFloat*> columns;
+            for (const std::string& name : expr.variables())
+                columns.push_back(name == "x" ? xs.data() : ys.data());
+            expr.evaluate_batch(columns.data(), n, expected.data());
+            jit.evaluate_batch(columns.data(), n, out.data());
+            assert(std::memcmp(expected.data(), out.data(), n * sizeof(ExprFloat)) == 0);
+
+            for (size_t i = 0; i < n; i += 17) {
+                const ExprFloat vars[] = { columns[0][i], columns.size() > 1 ? columns[1][i] : 0.0 };
+                const ExprFloat a = expr.bytecode().execute(vars), b = jit.execute(vars);
+                assert(std::memcmp(&a, &b, sizeof a) == 0);
+            }
+        }
+    }
+    set_simd_level(detected);
+
+    // Errors are rethrown by the wrappers and kept by the raw functions
+    Parser divide(Tokenizer("x / y"), &context, &registry);
+    const JitExpr quotient(divide.compile().bytecode());
+    const ExprFloat by_zero[] = { 1.0, 0.0 };
+    bool rejected = false;
+    try {
+        quotient.execute(by_zero);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    assert(rejected);
+    if (quotient.native()) {
+        assert(std::isnan(quotient.function()(by_zero)));
+        assert(JitExpr::take_error() != nullptr);
+        assert(JitExpr::take_error() == nullptr);
+    }
+
+    Parser failing(Tokenizer("1 + fail(x)"), &context, &registry);
+    const JitExpr thrower(failing.compile().bytecode());
+    rejected = false;
+    try {
+        thrower.execute(by_zero);
+    } catch (const std::runtime_error& e) {
+        rejected = std::string(e.what()) == "fail";
+    }
+    assert(rejected);
+    std::cout << "test_jit passed!" << std::endl;
+}
+
+void test_expression_set() {
+    FunctionRegistry registry = FunctionRegistry::default_registry();
+    int ticks = 0;
+    registry.register_function("tick", [&ticks](const ExprFloat* args, size_t) { return args[0] + ++ticks; }, 1);
+
+    ExpressionSet set(registry);
+    const size_t a = set.add("2 * x + 1");
+    const size_t b = set.add("sin(x) * y + y ^ 2");
+    const size_t c = set.add("sqrt(y * y + z * z) + sin(x)");
+    const size_t d = set.add("w / z");
+    assert(set.size() == 4);
+    assert(set.dependencies(b) == std::vector<std::string>({ "x", "y" }));
+    assert(set.dependencies(d) == std::vector<std::string>({ "w", "z" }));
+    assert(std::isnan(set.value(a)));
+
+    auto expected = [](const char* formula, ExprFloat x, ExprFloat y, ExprFloat z) {
+        ExprParser parser;
+        parser.set_expression(formula);
+        parser.set_variable("x", x);
+        parser.set_variable("y", y);
+        parser.set_variable("z", z);
+        parser.set_variable("w", 3.0);
+        return parser.evaluate();
+    };
+    set.set_variable("x", 0.5);
+    set.set_variable("y", 2.0);
+    set.set_variable("z", 4.0);
+    set.set_variable("w", 3.0);
+    set.update();
+    for (size_t i : { a, b, c, d })
+        assert(set.value(i) == expected(set.expression(i).c_str(), 0.5, 2.0, 4.0));
+
+    // Only what reads `y` is recomputed; `sin(x)` is shared and stays cached
+    set.set_variable("y", 3.0);
+    assert(!set.is_stale(a) && set.is_stale(b) && set.is_stale(c) && !set.is_stale(d));
+    assert(set.update() == 7);     // 3 nodes in b, 4 in c
+    assert(set.value(b) == expected(set.expression(b).c_str(), 0.5, 3.0, 4.0));
+    assert(set.value(c) == expected(set.expression(c).c_str(), 0.5, 3.0, 4.0));
+
+    // Unchanged values mark nothing
+    set.set_variable("y", 3.0);
+    assert(set.update() == 0);
+
+    // A failed update is retried
+    set.set_variable("z", 0.0);
+    bool rejected = false;
+    try {
+        set.update();
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    assert(rejected && set.is_stale(d));
+    set.set_variable("z", 1.5);
+    assert(set.value(d) == 2.0);
+    assert(!set.is_stale(c));
+
+    // Impure calls run on every update
+    const size_t e = set.add("tick(x) + 1");
+    set.update();
+    assert(set.value(e) == 2.5);
+    set.update();
+    assert(set.value(e) == 3.5);
+    std::cout << "test_expression_set passed!" << std::endl;
+}
+
+void test_programs() {
+    EvaluationContext context;
+    context.set_variable("a", 1.5);
+    context.set_variable("b", -2.0);
+    context.set_variable("c", 0.25);
+    auto expected = [&context](const char* formula) {
+        const std::string text(formula);
+        Parser parser(Tokenizer(text), &context, get_default_registry());
+        return parser.compile().evaluate();
+    };
+
+    const std::string source = "t = a * b + c; let u = t * t; out1 = sin(t); out2 = t ^ 2 + u; a = a + 1; out3 = a * t;";
+    for (bool share : { false, true }) {
+        CompileOptions options;
+        options.share_subexpressions = share;
+        Parser parser(Tokenizer(source), &context, get_default_registry());
+        const CompiledProgram program = parser.compile_program(options);
+        assert(program.outputs() == std::vector<std::string>({ "t", "out1", "out2", "a", "out3" }));
+        assert(program.variables() == std::vector<std::string>({ "a", "b", "c" }));
+        assert(program.bytecode().max_stack_depth() == 1);     // Statements do not stack up
+
+        ExprFloat out[5];
+        program.evaluate(out);
+        const ExprFloat t = expected("a * b + c");
+        assert(out[0] == t);
+        assert(out[1] == expected("sin(a * b + c)"));
+        assert(out[2] == expected("(a * b + c) ^ 2 + (a * b + c) * (a * b + c)"));
+        assert(out[3] == 2.5);      // The input `a` is shadowed from here on
+        assert(out[4] == 2.5 * t);
+
+        // Batch and parallel evaluation give the same outputs, row by row
+        const size_t n = 1000;
+        std::vector<ExprFloat> as(n), bs(n), cs(n);
+        for (size_t i = 0; i < n; ++i) {
+            as[i] = 0.01 * i;
+            bs[i] = 1.0 - 0.003 * i;
+            cs[i] = 0.5;
+        }
+        const ExprFloat* columns[] = { as.data(), bs.data(), cs.data() };
+        std::vector<std::vector<ExprFloat>> batch(5, std::vector<ExprFloat>(n)), parallel = batch;
+        ExprFloat* batch_out[5];
+        ExprFloat* parallel_out[5];
+        for (size_t o = 0; o < 5; ++o) {
+            batch_out[o] = batch[o].data();
+            parallel_out[o] = parallel[o].data();
+        }
+        program.evaluate_batch(columns, n, batch_out);
+        program.evaluate_parallel(columns, n, parallel_out, ThreadPool::global(), 300);
+        for (size_t i = 0; i < n; ++i) {
+            const ExprFloat vars[] = { as[i], bs[i], cs[i] };
+            program.bytecode().execute(vars, out);
+            for (size_t o = 0; o < 5; ++o)
+                assert(batch[o][i] == out[o] && parallel[o][i] == out[o]);
+        }
+
+        // The overloads with a single result give the last statement, on
+        // every engine
+        const Bytecode& code = program.bytecode();
+        const JitExpr jit(code);
+        program.evaluate(out);
+        EvalStatus status;
+        assert(code.evaluate() == out[4]);
+        assert(code.evaluate(0, status) == out[4] && status == EvalStatus::Ok);
+        std::vector<ExprFloat> last(n), parallel_last(n), status_last(n), jit_last(n);
+        std::vector<EvalStatus> statuses(n);
+        code.evaluate_batch(columns, n, last.data());
+        code.evaluate_parallel(columns, n, parallel_last.data(), ThreadPool::global(), 300);
+        code.evaluate_batch(columns, n, status_last.data(), statuses.data());
+        jit.evaluate_batch(columns, n, jit_last.data());
+        for (size_t i = 0; i < n; ++i) {
+            const ExprFloat vars[] = { as[i], bs[i], cs[i] };
+            assert(code.execute(vars) == batch[4][i]);
+            assert(code.execute(vars, status) == batch[4][i] && status == EvalStatus::Ok);
+            assert(jit.execute(vars) == batch[4][i]);
+            assert(last[i] == batch[4][i] && parallel_last[i] == batch[4][i]);
+            assert(status_last[i] == batch[4][i] && statuses[i] == EvalStatus::Ok);
+            assert(jit_last[i] == batch[4][i]);
+        }
+    }
+
+    // Even when the last statement is not an output
+    {
+        Parser parser(Tokenizer("t = a * b; let u = t + 1"), &context, get_default_registry());
+        const CompiledProgram program = parser.compile_program();
+        const ExprFloat vars[] = { 2.0, 3.0 };
+        assert(program.bytecode().execute(vars) == 7.0);
+        assert(JitExpr(program.bytecode()).execute(vars) == 7.0);
+    }
+
+    // A repeated right-hand side is computed once
+    {
+        CompileOptions options;
+        options.share_subexpressions = true;
+        Parser parser(Tokenizer("x = sqrt(a * a + b * b); y = sqrt(a * a + b * b) / c"), &context, get_default_registry());
+        const CompiledProgram program = parser.compile_program(options);
+        assert(program.bytecode().deduplicated_nodes() > 0);
+        ExprFloat out[2];
+        program.evaluate(out);
+        assert(out[0] == expected("sqrt(a * a + b * b)"));
+        assert(out[1] == expected("sqrt(a * a + b * b) / c"));
+    }
+
+    for (const char* invalid : { "", "let t = a", "x = a; x = b", "x a", "x = a y = b", "1 = a", "x = ; y = a" }) {
+        bool rejected = false;
+        try {
+            const std::string text(invalid);
+            Parser parser(Tokenizer(text), &context, get_default_registry());
+            parser.compile_program();
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        assert(rejected);
+    }
+    std::cout << "test_programs passed!" << std::endl;
+}
+
+void test_gradients() {
+    EvaluationContext context;
+    context.set_variable("x", 0.75);
+    context.set_variable("y", 2.5);
+    context.set_variable("k", 3.0);
+    auto compile = [&context](const std::string& text, const FunctionRegistry* registry) {
+        Parser parser(Tokenizer(text), &context, registry);
+        return parser.compile(CompileOptions{ OptimizationLevel::None });
+    };
+    auto close = [](ExprFloat a, ExprFloat b) { return std::abs(a - b) <= 1e-12 * std::max(1.0, std::abs(b)); };
+
+    const CompiledExpr expr = compile("x * y + sin(x) / y - x ^ 3 + exp(-y) * k + max(x, y) + sqrt(y) * log(x) + pow(y, x) - x", get_default_registry());
+    const CompiledGradient gradient(expr, { "x", "y", "z" });
+    assert(gradient.variables() == std::vector<std::string>({ "x", "y", "k" }));
+
+    const ExprFloat x = 0.75, y = 2.5, k = 3.0;
+    const ExprFloat dx = y + std::cos(x) / y - 3 * x * x + std::sqrt(y) / x + std::pow(y, x) * std::log(y) - 1;
+    const ExprFloat dy = x - std::sin(x) / (y * y) - std::exp(-y) * k + 1 + std::log(x) / (2 * std::sqrt(y)) + x * std::pow(y, x - 1);
+    ExprFloat g[3];
+    const ExprFloat value = gradient.evaluate(g);
+    assert(value == expr.evaluate());
+    assert(close(g[0], dx) && close(g[1], dy) && g[2] == 0.0);
+
+    // Forward mode gives the derivative along a direction
+    const ExprFloat direction[] = { 0.5, -2.0, 1.0 };
+    ExprFloat along;
+    assert(gradient.evaluate_forward(direction, along) == value);
+    assert(close(along, 0.5 * dx - 2.0 * dy));
+
+    // Batch evaluation matches row by row
+    const size_t n = 150;
+    std::vector<ExprFloat> xs(n), ys(n), values(n), gx(n), gy(n), gz(n);
+    for (size_t i = 0; i < n; ++i) {
+        xs[i] = 0.1 + 0.01 * i;
+        ys[i] = 3.0 - 0.015 * i;
+    }
+    const ExprFloat* columns[] = { xs.data(), ys.data(), nullptr };
+    ExprFloat* gradients[] = { gx.data(), gy.data(), gz.data() };
+    gradient.evaluate_batch(columns, n, values.data(), gradients);
+    for (size_t i = 0; i < n; ++i) {
+        const ExprFloat vars[] = { xs[i], ys[i], k };
+        assert(values[i] == gradient.execute(vars, g));
+        assert(gx[i] == g[0] && gy[i] == g[1] && gz[i] == 0.0);
+    }
+
+    // Custom functions need a derivative, unless they do not depend on `wrt`
+    FunctionRegistry registry = FunctionRegistry::default_registry();
+    registry.register_function("cube", [](const ExprFloat* args, size_t) { return args[0] * args[0] * args[0]; }, 1);
+    registry.register_function("square", [](ExprFloat v) { return v * v; },
+        [](const ExprFloat* args, size_t, ExprFloat* partials) { partials[0] = 2 * args[0]; });
+    const CompiledExpr custom = compile("square(x * y) + cube(k)", &registry);
+    const CompiledGradient custom_gradient(custom, { "x", "y" });
+    assert(custom_gradient.evaluate(g) == custom.evaluate());
+    assert(close(g[0], 2 * x * y * y) && close(g[1], 2 * x * x * y));
+
+    bool rejected = false;
+    try {
+        CompiledGradient(custom, { "k" });
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    assert(rejected);
+    std::cout << "test_gradients passed!" << std::endl;
+}
+
+#if __cplusplus >= 201703L
+// Same results as the interpreter, bit for bit
+template <class Static>
+static void check_static_expression(const Static& fixed, const std::vector<ExprFloat>& xs, const std::vector<ExprFloat>& ys) {
+    EvaluationContext context;
+    context.set_variable("x", 0.0);
+    context.set_variable("y", 0.0);
+    const std::string text(fixed.text());
+    Parser parser(Tokenizer(text), &context, get_default_registry());
+    const CompiledExpr expr = parser.compile();
+
+    const auto names = fixed.variables();
+    assert(names.size() == expr.variables().size());
+    std::vector<const ExprFloat*> columns;
+    for (size_t i = 0; i < names.size(); ++i) {
+        assert(names[i] == expr.variables()[i]);
+        columns.push_back(names[i] == "x" ? xs.data() : ys.data());
+    }
+
+    const size_t n = xs.size();
+    std::vector<ExprFloat> expected(n), out(n);
+    expr.evaluate_batch(columns.data(), n, expected.data());
+    fixed.evaluate_batch(columns.data(), n, out.data());
+    assert(std::memcmp(expected.data(), out.data(), n * sizeof(ExprFloat)) == 0);
+    for (size_t i = 0; i < n; i += 13) {
+        const ExprFloat vars[] = { columns[0][i], columns.size() > 1 ? columns[1][i] : 0.0 };
+        const ExprFloat a = expr.bytecode().execute(vars), b = fixed.evaluate(vars);
+        assert(std::memcmp(&a, &b, sizeof a) == 0);
+    }
+}
+
+void test_static_expressions() {
+    static_assert(CPPEXPRPARS_EXPR("1 + 2 * 3 - 8 / 4")() == 5.0, "Precedence");
+    static_assert(CPPEXPRPARS_EXPR("2 ^ 3 ^ 2")() == 512.0, "Right-associative power");
+    static_assert(CPPEXPRPARS_EXPR("-x ^ 2 + (y - x) * -3")(3.0, 5.0) == -15.0, "Unary minus");
+    static_assert(CPPEXPRPARS_EXPR("0.1 + 2.5e-3")() == 0.1 + 2.5e-3, "Numbers");
+    static_assert(CPPEXPRPARS_EXPR("b * a + a")(2.0, 3.0) == 9.0, "Variables by first appearance");
+
+    const size_t n = 1001;
+    std::vector<ExprFloat> xs(n), ys(n);
+    for (size_t i = 0; i < n; ++i) {
+        xs[i] = 0.37 * static_cast<ExprFloat>(i) + 0.5;
+        ys[i] = 1.0 + 0.013 * static_cast<ExprFloat>(i);
+    }
+    check_static_expression(CPPEXPRPARS_EXPR("x + y * 2 - y / 3"), xs, ys);
+    check_static_expression(CPPEXPRPARS_EXPR("-(x - y) * (x + y) / (y * y + 1) + 7"), xs, ys);
+    check_static_expression(CPPEXPRPARS_EXPR("x ^ 2 + y ^ 0.5 + x % 3 - 2 ^ -y"), xs, ys);
+    check_static_expression(CPPEXPRPARS_EXPR("sin(x) * cos(y) + sqrt(x * x + y * y) + abs(-x) + min(x, y) - max(x, y)"), xs, ys);
+    check_static_expression(CPPEXPRPARS_EXPR("tan(y) + exp(-x) * log(y) + pow(x, 1.5)"), xs, ys);
+
+    // Division by zero throws like the interpreter, after the whole batch
+    constexpr auto quotient = CPPEXPRPARS_EXPR("x / y");
+    bool rejected = false;
+    try {
+        quotient(1.0, 0.0);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    assert(rejected);
+    ys[n / 2] = 0.0;
+    const ExprFloat* columns[] = { xs.data(), ys.data() };
+    std::vector<ExprFloat> out(n);
+    rejected = false;
+    try {
+        quotient.evaluate_batch(columns, n, out.data());
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    assert(rejected);
+
+    // Parsing is constexpr, so the errors that stop compilation can be
+    // checked at run time
+    for (const char* invalid : { "", "1 +", "(x", "foo(x)", "sin(x, y)", "max(1)", "x $ y", "1e400" }) {
+        rejected = false;
+        try {
+            static_expr::parse(invalid);
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        assert(rejected);
+    }
+
+    // Numbers round like the tokenizer, including long and subnormal ones
+    uint64_t state = 777;
+    auto next = [&state]() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return state >> 33;
+    };
+    for (int i = 0; i < 20000; ++i) {
+        std::string number = std::to_string(next() % 1000000000) + "." + std::to_string(next());
+        if (i % 3 == 0)
+            number += std::to_string(next()) + std::to_string(next());
+        number += "e" + std::to_string(static_cast<int>(next() % 660) - 340);
+        Tokenizer tokenizer(number);
+        const Token token = tokenizer.current();
+        ExprFloat value = 0.0;
+        const bool finite = static_expr::detail::parse_decimal(number, value);
+        assert(finite == (token.type == TokenType::Number));
+        if (finite)
+            assert(std::memcmp(&value, &token.number_value, sizeof value) == 0);
+    }
+    std::cout << "test_static_expressions passed!" << std::endl;
+}
+#endif
+
+void test_vector_math_accuracy() {
+    const FunctionRegistry registry = FunctionRegistry::default_registry();
+    const char* names[] = { "sin", "cos", "tan", "exp", "log", "sqrt", "abs", "pow", "min", "max" };
+
+    const size_t n = 4099;
+    std::vector<ExprFloat> xs(n), ys(n), out(n);
+    uint64_t state = 12345;
+    auto next = [&state]() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<ExprFloat>(state >> 11) / 9007199254740992.0;
+    };
+    for (size_t i = 0; i < n; ++i) {
+        xs[i] = (next() - 0.5) * 1400.0;        // Includes exp overflow and log of negatives
+        ys[i] = (next() - 0.5) * 20.0;
+    }
+    xs[0] = 0.0; xs[1] = -0.0; xs[2] = std::numeric_limits<ExprFloat>::infinity();
+    xs[3] = std::numeric_limits<ExprFloat>::quiet_NaN(); xs[4] = 1e-310; xs[5] = 4194303.5;
+
+    const SimdLevel detected = detected_simd_level();
+    for (const char* name : names) {
+        FunctionEntryPtr fn = registry.find_function(name);
+        assert(fn && (fn->unary_array || fn->binary_array));
+        for (int level = 0; level <= static_cast<int>(detected); ++level) {
+            set_simd_level(static_cast<SimdLevel>(level));
+            // Works in place, like the batch engine uses it
+            out = xs;
+            if (fn->unary_array)
+                fn->unary_array(out.data(), out.data(), n);
+            else
+                fn->binary_array(out.data(), ys.data(), out.data(), n);
+            for (size_t i = 0; i < n; ++i) {
+                ExprFloat expected = fn->unary ? fn->unary(xs[i]) : fn->binary(xs[i], ys[i]);
+                assert(ulp_distance(expected, out[i]) <= fn->array_max_ulp);
+            }
+        }
+    }
+    set_simd_level(detected);
+
+    // Within tolerance, batch evaluation switches to the array entry points
+    ExprFloat x = 0.0;
+    ExprParser parser;
+    parser.bind("x", &x);
+    parser.set_expression("exp(x / 100) + log(x + 1) + x ^ 1.5");
+    const CompiledExpr& compiled = parser.compile();
+    const ExprFloat* columns[] = { ys.data() };
+    for (size_t i = 0; i < n; ++i)
+        ys[i] = std::abs(xs[i]);
+    ys[3] = 2.0;
+    set_vector_math_tolerance(vector_math::pow_max_ulp);
+    compiled.evaluate_batch(columns, n, out.data());
+    set_vector_math_tolerance(0);
+    for (size_t i = 0; i < n; ++i) {
+        x = ys[i];
+        ExprFloat expected = compiled.evaluate_tree();
+        assert(expected == out[i] || std::abs(expected - out[i]) <= 1e-13 * std::abs(expected));
+    }
+    std::cout << "test_vector_math_accuracy passed!" << std::endl;
+}
+
+void test_fast_math_rewrites() {
+    FunctionRegistry registry = FunctionRegistry::default_registry();
+    EvaluationContext context;
+    context.set_variable("x", 0.0);
+    context.set_variable("y", 0.0);
+    auto compile = [&](const char* formula, OptimizationLevel level) {
+        Parser parser(Tokenizer(formula), &context, &registry);
+        return parser.compile({ level, true });
+    };
+
+    // The built-in is fused: 0.1 * 10 - 1 rounds to zero, the fma does not
+    assert(compile("fma(2, 3, 1)", OptimizationLevel::None).evaluate() == 7.0);
+    assert(compile("fma(0.1, 10, -1)", OptimizationLevel::None).evaluate() == std::fma(0.1, 10.0, -1.0));
+    assert(compile("0.1 * 10 - 1", OptimizationLevel::None).evaluate() == 0.0);
+
+    // Polynomials become a Horner chain of fused multiply-adds
+    const CompiledExpr safe = compile("1 + 2 * x - 0.5 * x ^ 2 + 3 * x ^ 3", OptimizationLevel::Safe);
+    const CompiledExpr fast = compile("1 + 2 * x - 0.5 * x ^ 2 + 3 * x ^ 3", OptimizationLevel::FastMath);
+    assert(fast.root().type() == ExprNodeType::Function);
+    assert(static_cast<const FuncExprNode&>(fast.root()).name() == "fma");
+    assert(Optimizer::node_count(fast.root()) == 10);
+    assert(Optimizer::node_count(fast.root()) < Optimizer::node_count(safe.root()));
+
+    // Integer powers of a variable become products, only under FastMath
+    assert(Optimizer::node_count(compile("x ^ 5", OptimizationLevel::Safe).root()) == 3);
+    assert(Optimizer::node_count(compile("x ^ 5", OptimizationLevel::FastMath).root()) == 9);
+    assert(Optimizer::node_count(compile("x ^ 9", OptimizationLevel::FastMath).root()) == 3);
+
+    const char* formulas[] = {
+        "1 + 2 * x - 0.5 * x ^ 2 + 3 * x ^ 3",
+        "x ^ 4 - x ^ 2 / 3 + 0.25",
+        "x * y + 2 * x - y * 3",
+        "(x - 1) * (y + 2) + sin(x) * cos(y) - x ^ 6",
+        "fma(x, y, 1) - 7 * y",
+        "3 * x + sin(y) - 2 * y * x",
+    };
+
+    const size_t n = 1003;
+    std::vector<ExprFloat> xs(n), ys(n), expected(n), out(n);
+    for (size_t i = 0; i < n; ++i) {
+        xs[i] = 0.0137 * static_cast<ExprFloat>(i) - 6.0;
+        ys[i] = 1.0 - 0.0071 * static_cast<ExprFloat>(i);
+    }
+
+    const SimdLevel detected = detected_simd_level();
+    for (const char* formula : formulas) {
+        const CompiledExpr reference = compile(formula, OptimizationLevel::Safe);
+        const CompiledExpr expr = compile(formula, OptimizationLevel::FastMath);
+        const JitExpr jit(expr.bytecode(), formula);
+        std::vector<const ExprFloat*> columns;
+        for (const std::string& name : expr.variables())
+            columns.push_back(name == "x" ? xs.data() : ys.data());
+
+        // Every engine rounds the rewritten expression the same way
+        for (int level = 0; level <= static_cast<int>(detected); ++level) {
+            set_simd_level(static_cast<SimdLevel>(level));
+            expr.evaluate_batch(columns.data(), n, expected.data());
+            jit.evaluate_batch(columns.data(), n, out.data());
+            assert(std::memcmp(expected.data(), out.data(), n * sizeof(ExprFloat)) == 0);
+        }
+        set_simd_level(detected);
+
+        for (size_t i = 0; i < n; i += 7) {
+            context.set_variable("x", xs[i]);
+            context.set_variable("y", ys[i]);
+            const ExprFloat vars[] = { columns[0][i], columns.size() > 1 ? columns[1][i] : 0.0 };
+            const ExprFloat tree = expr.evaluate_tree(), code = expr.bytecode().execute(vars), native = jit.execute(vars);
+            assert(std::memcmp(&tree, &code, sizeof tree) == 0);
+            assert(std::memcmp(&tree, &native, sizeof tree) == 0);
+            assert(std::memcmp(&tree, &expected[i], sizeof tree) == 0);
+
+            // And stays close to the unfused result
+            const ExprFloat exact = reference.evaluate_tree();
+            assert(std::abs(tree - exact) <= 1e-12 * (1.0 + std::abs(exact)));
+        }
+    }
+    std::cout << "test_fast_math_rewrites passed!" << std::endl;
+}
+
+void test_profiling() {
+    FunctionRegistry registry = FunctionRegistry::default_registry();
+    int calls = 0;
+    registry.register_function("counter", [&calls](const ExprFloat* args, size_t) {
+        ++calls;
+        return args[0];
+    }, 1);
+    EvaluationContext context;
+    context.set_variable("x", 2.0);
+    context.set_variable("y", 3.0);
+
+    Parser parser(Tokenizer("sin(x) * 2 + sin(x) * y - counter(x) / 4"), &context, &registry);
+    const CompiledExpr expr = parser.compile();
+
+    // The shape is known without profiling; `/ 4` became `* 0.25`
+    ExpressionProfile profile = expr.profile();
+    const size_t expected_nodes[] = { 2, 4, 5, 0, 3 };
+    assert(std::equal(expected_nodes, expected_nodes + 5, profile.node_counts));
+    assert(profile.subtrees.size() == 12);      // Down to three levels below the root
+    assert(profile.subtrees[0].label == "-" && profile.subtrees[0].nodes == 14 && profile.subtrees[0].depth == 0);
+    assert(profile.subtrees[1].label == "+" && profile.subtrees[1].depth == 1);
+    assert(profile.function_calls.size() == 2);
+    assert(profile.function_calls[0].first == "sin" && profile.function_calls[1].first == "counter");
+
+    const uint64_t period = profiling_sample_period();
+    set_profiling_sample_period(10);
+    for (int i = 0; i < 100; ++i)
+        expr.evaluate();
+    for (int i = 0; i < 5; ++i)
+        expr.evaluate_tree();
+    std::vector<ExprFloat> xs(50, 1.0), ys(50, 2.0), out(50);
+    const ExprFloat* columns[] = { xs.data(), ys.data() };
+    expr.evaluate_batch(columns, 50, out.data());
+
+    // Only evaluations of the compiled-against context take samples, as
+    // that is what the subtrees read
+    const uint64_t samples = expr.profile().subtrees[1].samples;
+    EvaluationContext local = context;
+    for (int i = 0; i < 20; ++i)
+        expr.evaluate(local);
+    expr.evaluate_batch(columns, 50, out.data());
+    assert(expr.profile().subtrees[1].samples == samples);
+    expr.evaluate();
+    assert(expr.profile().subtrees[1].samples == samples + (profiling_enabled() ? 1 : 0));
+    set_profiling_sample_period(period);
+    assert(calls == 226);   // Sampling never calls a function not marked pure
+
+    profile = expr.profile();
+    const std::string json = profile.to_json();
+    assert(json.find("\"node_counts\": {\"constant\": 2, \"variable\": 4, \"binary\": 5") != std::string::npos);
+    if (profiling_enabled()) {
+        assert(json.find("\"profiling\": true") != std::string::npos);
+        assert(parser.parse_ns() > 0 && profile.parse_ns == parser.parse_ns());
+        assert(profile.evaluations == 221 && profile.tree_evaluations == 5);
+        assert(profile.function_calls[0].second == 2 * 226);
+        assert(profile.function_calls[1].second == 226);
+        assert(profile.subtrees[0].samples == 0);       // Calls `counter`
+        assert(profile.subtrees[1].samples >= 10 && profile.subtrees[1].total_ns > 0);
+    } else {
+        assert(json.find("\"profiling\": false") != std::string::npos);
+        assert(profile.parse_ns == 0 && profile.evaluations == 0);
+        assert(profile.function_calls[0].second == 0 && profile.subtrees[1].samples == 0);
+    }
+    std::cout << "test_profiling passed!" << std::endl;
+}
+
+void test_status_codes() {
+    FunctionRegistry registry = FunctionRegistry::default_registry();
+    registry.register_function("checked_sqrt", [](const ExprFloat* args, size_t) {
+        if (args[0] < 0.0)
+            throw std::runtime_error("Negative argument");
+        return std::sqrt(args[0]);
+    }, 1);
+    EvaluationContext context;
+    context.set_variable("x", 1.0);
+    context.set_variable("y", 0.0);
+    auto compile = [&](const char* source) {
+        Parser parser(Tokenizer(source), &context, &registry);
+        return parser.compile();
+    };
+    auto throws = [](const CompiledExpr& expr) {
+        try {
+            expr.evaluate();
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+
+    // Division by zero follows IEEE arithmetic
+    EvalStatus status = EvalStatus::Ok;
+    const CompiledExpr quotient = compile("x / y");
+    assert(quotient.evaluate(status) == std::numeric_limits<ExprFloat>::infinity());
+    assert(status == (EvalStatus::DivisionByZero | EvalStatus::NotFinite));
+    assert(throws(quotient));
+    context.set_variable("x", 0.0);
+    assert(std::isnan(quotient.evaluate(status)));
+    assert(status == (EvalStatus::DivisionByZero | EvalStatus::NotFinite));
+    context.set_variable("y", 4.0);
+    assert(quotient.evaluate(status) == 0.0 && status == EvalStatus::Ok);
+
+    // A divisor of `%` that truncates to zero no longer traps
+    context.set_variable("x", 5.0);
+    context.set_variable("y", 0.5);
+    const CompiledExpr remainder = compile("x % y");
+    assert(std::isnan(remainder.evaluate(status)));
+    assert(status == (EvalStatus::DivisionByZero | EvalStatus::NotFinite));
+    assert(throws(remainder));
+    bool threw = false;
+    try {
+        remainder.evaluate_tree();
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    // So does one too large for `ExprInt`, in every engine
+    auto batch_throws = [](const std::function<void()>& run) {
+        try {
+            run();
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    context.set_variable("y", 1e20);
+    const ExprFloat large[] = { 1e20, 3.0, -1e30 };
+    const ExprFloat dividends[] = { 5.0, 5.0, 5.0 };
+    ExprFloat large_out[3];
+    EvalStatus large_status[3];
+    for (const char* source : { "x % y", "x % 1e20" }) {
+        const CompiledExpr huge = compile(source);
+        assert(throws(huge));
+        const ExprFloat* huge_columns[] = { dividends, large };
+        assert(batch_throws([&] { huge.evaluate_batch(huge_columns, 3, large_out); }));
+        huge.evaluate_batch(huge_columns, 3, large_out, large_status);
+        assert(std::isnan(large_out[0]) && (large_status[0] & EvalStatus::DivisionByZero) != EvalStatus::Ok);
+
+        const CompiledGradient gradient(huge, { "x" });
+        ExprFloat g[1], g_column[3];
+        ExprFloat* g_columns[] = { g_column };
+        assert(batch_throws([&] { gradient.evaluate(g); }));
+        assert(batch_throws([&] { gradient.evaluate_batch(huge_columns, 3, large_out, g_columns); }));
+    }
+    context.set_variable("y", 0.5);
+
+    // A function that throws makes the row NaN
+    const CompiledExpr root = compile("checked_sqrt(x - 9) + 1");
+    assert(std::isnan(root.evaluate(status)));
+    assert(status == (EvalStatus::FunctionError | EvalStatus::NotFinite));
+    context.set_variable("x", 25.0);
+    assert(root.evaluate(status) == 5.0 && status == EvalStatus::Ok);
+
+    // Batch rows are flagged one by one, and the clean ones match the
+    // throwing overloads. Evaluating one row stops at the first function
+    // that throws, so only then may it report less.
+    const size_t n = 1000;
+    std::vector<ExprFloat> xs(n), ys(n), out(n), parallel_out(n);
+    std::vector<EvalStatus> statuses(n), parallel_statuses(n);
+    for (size_t i = 0; i < n; ++i) {
+        xs[i] = static_cast<ExprFloat>(i % 7);
+        ys[i] = static_cast<ExprFloat>(i % 5) * 0.5 - 0.5;
+    }
+    const CompiledExpr expr = compile("checked_sqrt(x - 2) / y + x % (y + 1)");
+    std::vector<const ExprFloat*> columns;
+    for (const std::string& name : expr.variables())
+        columns.push_back(name == "x" ? xs.data() : ys.data());
+
+    const SimdLevel detected = detected_simd_level();
+    for (int level = 0; level <= static_cast<int>(detected); ++level) {
+        set_simd_level(static_cast<SimdLevel>(level));
+        expr.evaluate_batch(columns.data(), n, out.data(), statuses.data());
+        size_t flagged = 0;
+        for (size_t i = 0; i < n; ++i) {
+            context.set_variable("x", xs[i]);
+            context.set_variable("y", ys[i]);
+            const ExprFloat expected = expr.evaluate(status);
+            flagged += statuses[i] != EvalStatus::Ok;
+            if ((status & EvalStatus::FunctionError) != EvalStatus::Ok) {
+                assert((statuses[i] & EvalStatus::FunctionError) != EvalStatus::Ok && std::isnan(out[i]));
+                continue;
+            }
+            assert(statuses[i] == status);
+            if (status == EvalStatus::Ok) {
+                const ExprFloat checked = expr.evaluate();
+                assert(std::memcmp(&checked, &out[i], sizeof(ExprFloat)) == 0);
+            } else {
+                assert(std::isnan(expected) ? std::isnan(out[i]) : expected == out[i]);
+            }
+        }
+        assert(flagged > 0 && flagged < n);
+    }
+    set_simd_level(detected);
+
+    ThreadPool pool(4);
+    expr.evaluate_parallel(columns.data(), n, parallel_out.data(), parallel_statuses.data(), pool, 256);
+    assert(std::memcmp(out.data(), parallel_out.data(), n * sizeof(ExprFloat)) == 0);
+    assert(statuses == parallel_statuses);
+
+    // Results that are merely infinite or NaN get `NotFinite` alone, and
+    // only on their own rows
+    const CompiledExpr growth = compile("exp(x) + y");
+    std::vector<const ExprFloat*> growth_columns;
+    for (const std::string& name : growth.variables())
+        growth_columns.push_back(name == "x" ? xs.data() : ys.data());
+    for (size_t i = 0; i < n; ++i)
+        ys[i] = 1.0;
+    xs[300] = 1000.0;
+    xs[301] = -1000.0;
+    ys[999] = std::numeric_limits<ExprFloat>::quiet_NaN();
+    growth.evaluate_batch(growth_columns.data(), n, out.data(), statuses.data());
+    for (size_t i = 0; i < n; ++i)
+        assert(statuses[i] == (i == 300 || i == 999 ? EvalStatus::NotFinite : EvalStatus::Ok));
+
+    const CompiledExpr empty;
+    assert(std::isnan(empty.evaluate(status)));
+    assert(status == (EvalStatus::EmptyExpression | EvalStatus::NotFinite));
+    std::cout << "test_status_codes passed!" << std::endl;
+}
+
+void test_expression_images() {
+    FunctionRegistry registry = FunctionRegistry::default_registry();
+    registry.register_function("clamp01", [](const ExprFloat* args, size_t) {
+        return std::min(std::max(args[0], 0.0), 1.0);
+    }, 1);
+    EvaluationContext context;
+    context.set_variable("x", 0.75);
+    context.set_variable("y", -2.5);
+    context.set_variable("z", 3.0);
+
+    // Every instruction form: calls of each kind, fused multiply-adds and
+    // shared subexpressions kept in temporaries
+    const char* sources[] = {
+        "x * y + z",
+        "sin(x) * sin(x) + max(y, z) ^ 2 - clamp01(x * 3) % 2",
+        "3 * x ^ 3 + 2 * x ^ 2 - x + 1",
+        "(x + y) * (x + y) / (z - (x + y))",
+    };
+    const CompileOptions options[] = {
+        { OptimizationLevel::Safe, false },
+        { OptimizationLevel::Safe, true },
+        { OptimizationLevel::FastMath, false },
+        { OptimizationLevel::Safe, true },
+    };
+    std::vector<CompiledExpr> compiled;
+    ExpressionImageWriter writer;
+    for (size_t i = 0; i < 4; ++i) {
+        Parser parser(Tokenizer(sources[i]), &context, &registry);
+        compiled.push_back(parser.compile(options[i]));
+        assert(writer.add(std::string("f") + std::to_string(3 - i), compiled.back()) == i);
+    }
+    Parser parser(Tokenizer("a = x * y; b = a + z; let c = a * b; out = c - a;"), &context, &registry);
+    const CompiledProgram program = parser.compile_program({ OptimizationLevel::Safe, true });
+    writer.add("program", program.bytecode());
+
+    bool threw = false;
+    try {
+        writer.add("f0", compiled[0]);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    // Loaded from an aligned copy, in a context with another layout
+    const std::string data = writer.data();
+    std::vector<uint64_t> buffer((data.size() + 7) / 8);
+    std::memcpy(buffer.data(), data.data(), data.size());
+    const ExpressionImage image(buffer.data(), data.size());
+    assert(image.size() == 5 && image.name(1) == "f2");
+    assert(image.find("f3") == 0 && image.find("program") == 4 && image.find("f") == ExpressionImage::npos);
+    assert(image.variables(3) == compiled[3].variables());
+
+    EvaluationContext other;
+    other.set_variable("unused", 1.0);
+    other.set_variable("z", 3.0);
+    other.set_variable("y", -2.5);
+    other.set_variable("x", 0.75);
+    for (size_t i = 0; i < 4; ++i) {
+        const Bytecode loaded = image.load(image.find(std::string("f") + std::to_string(3 - i)), other, registry);
+        const char* code = reinterpret_cast<const char*>(loaded.instructions().data());
+        assert(code > reinterpret_cast<const char*>(buffer.data()) && code < reinterpret_cast<const char*>(buffer.data()) + data.size());
+        assert(loaded.instructions().size() == compiled[i].bytecode().instructions().size());
+        assert(loaded.variables() == compiled[i].variables() && loaded.max_stack_depth() == compiled[i].bytecode().max_stack_depth());
+        const ExprFloat expected = compiled[i].evaluate(), value = loaded.evaluate();
+        assert(std::memcmp(&expected, &value, sizeof(ExprFloat)) == 0);
+
+        const size_t n = 300;
+        std::vector<ExprFloat> xs(n), expected_out(n), out(n);
+        for (size_t r = 0; r < n; ++r)
+            xs[r] = 0.01 * static_cast<ExprFloat>(r);
+        std::vector<const ExprFloat*> columns(compiled[i].variables().size(), nullptr);
+        for (size_t v = 0; v < columns.size(); ++v)
+            if (compiled[i].variables()[v] == "x")
+                columns[v] = xs.data();
+        compiled[i].evaluate_batch(columns.data(), n, expected_out.data());
+        loaded.evaluate_batch(columns.data(), n, out.data());
+        assert(std::memcmp(expected_out.data(), out.data(), n * sizeof(ExprFloat)) == 0);
+    }
+    ExprFloat expected_outputs[3], outputs[3];
+    program.evaluate(expected_outputs);
+    image.load(4, other, registry).evaluate_outputs(outputs);
+    assert(std::memcmp(expected_outputs, outputs, sizeof outputs) == 0);
+
+    // Names are resolved on load
+    auto load_fails = [&](const ExpressionImage& from, size_t index, const EvaluationContext& ctx, const FunctionRegistry& reg) {
+        try {
+            from.load(index, ctx, reg);
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    EvaluationContext missing;
+    missing.set_variable("x", 1.0);
+    assert(load_fails(image, 0, missing, registry));
+    assert(load_fails(image, 1, context, FunctionRegistry::default_registry()));      // No clamp01
+    assert(!load_fails(image, 3, context, FunctionRegistry::default_registry()));
+
+    // Contractions into `fma` have instructions of their own, so a FastMath
+    // image loads with a registry that has no `fma`
+    {
+        FunctionRegistry plain;
+        plain.register_function("twice", [](ExprFloat v) { return 2.0 * v; });
+        Parser fast(Tokenizer("twice(x * y + z) - x * 3 + x * y * z"), &context, &plain);
+        const CompiledExpr contracted = fast.compile({ OptimizationLevel::FastMath, false });
+        bool fused = false;
+        for (const Instruction& ins : contracted.bytecode().instructions())
+            fused |= ins.op == OpCode::MultiplyAdd || ins.op == OpCode::MultiplyConstantAdd ||
+                     ins.op == OpCode::MultiplyVariableAddConstant;
+        assert(fused && !plain.find_function("fma") && contracted.bytecode().functions().size() == 1);
+
+        ExpressionImageWriter fast_writer;
+        fast_writer.add("fast", contracted);
+        const std::string fast_data = fast_writer.data();
+        std::vector<uint64_t> fast_buffer((fast_data.size() + 7) / 8);
+        std::memcpy(fast_buffer.data(), fast_data.data(), fast_data.size());
+        const Bytecode loaded = ExpressionImage(fast_buffer.data(), fast_data.size()).load(0, other, plain);
+        const ExprFloat expected = contracted.evaluate(), value = loaded.evaluate();
+        assert(std::memcmp(&expected, &value, sizeof(ExprFloat)) == 0);
+    }
+
+    // A mapped file outlives the image it was opened through
+    const std::string path = "test_expression_images.bin";
+    writer.write(path);
+    Bytecode mapped;
+    {
+        const ExpressionImage file = ExpressionImage::map_file(path);
+        mapped = file.load(file.find("f2"), context, registry);
+    }
+    assert(mapped.evaluate() == compiled[1].evaluate());
+    std::remove(path.c_str());
+
+    // Damaged images are rejected
+    auto rejected = [&](size_t offset, uint8_t byte, size_t size) {
+        std::vector<uint64_t> copy(buffer);
+        reinterpret_cast<uint8_t*>(copy.data())[offset] = byte;
+        try {
+            ExpressionImage(copy.data(), size).load(0, context, registry);
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    assert(!rejected(0, 'C', data.size()));
+    assert(rejected(0, 'X', data.size()));          // Magic
+    assert(rejected(0, 'C', 100));                  // Truncated
+    size_t code_offset = 0;
+    std::memcpy(&code_offset, data.data() + 32 + 5 * 16, sizeof code_offset);
+    assert(rejected(code_offset, 200, data.size()));                // Unknown instruction
+    assert(rejected(code_offset, 20 /* Negate */, data.size()));   // Stack underflow
+    std::cout << "test_expression_images passed!" << std::endl;
+}
+
+void test_compile_all() {
+    FunctionRegistry registry = FunctionRegistry::default_registry();
+    EvaluationContext context;
+    context.set_variable("x", 2.0);
+    context.set_variable("y", 3.0);
+
+    std::vector<std::string> sources;
+    for (int i = 0; i < 500; ++i) {
+        switch (i % 5) {
+            case 0: sources.push_back("x * " + std::to_string(i) + " + y"); break;
+            case 1: sources.push_back("sin(x) + " + std::to_string(i)); break;
+            case 2: sources.push_back("(x + y"); break;
+            case 3: sources.push_back("unknown_" + std::to_string(i) + " * x"); break;
+            case 4: sources.push_back("max(x, y) ^ 2 - " + std::to_string(i)); break;
+        }
+    }
+    auto single = [&](const std::string& source, std::string& error) {
+        try {
+            Parser parser(Tokenizer(source), &context, &registry);
+            return parser.compile();
+        } catch (const std::exception& e) {
+            error = e.what();
+            return CompiledExpr();
+        }
+    };
+
+    // Results come back in input order, failures do not stop the others
+    // and report what a single compilation would
+    ThreadPool pool(4);
+    for (Executor* executor : {static_cast<Executor*>(&pool), static_cast<Executor*>(&ThreadPool::global())}) {
+        const std::vector<CompileResult> results = compile_all(sources, &context, &registry, {}, *executor);
+        assert(results.size() == sources.size());
+        for (size_t i = 0; i < sources.size(); ++i) {
+            std::string error;
+            const CompiledExpr expected = single(sources[i], error);
+            assert(results[i].ok() == error.empty());
+            assert(results[i].error == error);
+            if (results[i].ok())
+                assert(results[i].expression.evaluate() == expected.evaluate());
+        }
+    }
+
+    // The compiled expressions read the shared context
+    context.set_variable("x", 10.0);
+    const std::vector<CompileResult> results = compile_all(sources, &context, &registry);
+    assert(results[0].expression.evaluate() == 3.0);
+    assert(results[5].expression.evaluate() == 10.0 * 5 + 3.0);
+
+    // Nothing to compile
+    assert(compile_all(nullptr, 0, &context, &registry).empty());
+
+    std::cout << "test_compile_all passed!" << std::endl;
+}
+
+void test_parse_decimal() {
+    auto parse = [](const char* text) {
+        ExprFloat value = -12345.0;
+        return parse_decimal(text, value) ? value : -12345.0;
+    };
+    assert(parse("42") == 42.0);
+    assert(parse("-2.5e-3") == -2.5e-3);
+    assert(parse("+.5") == 0.5);
+    assert(parse("7.") == 7.0);
+    assert(parse("1E+2") == 100.0);
+    assert(parse("0.1") == 0.1);
+    assert(parse("123456789012345678901234567890") == 123456789012345678901234567890.0);
+    assert(parse("2.2250738585072014e-308") == 2.2250738585072014e-308);
+
+    // Long numbers round correctly too: only a nonzero digit far past the
+    // halfway point rounds this one up
+    const std::string halfway = "9007199254740993." + std::string(900, '0');
+    assert(parse(halfway.c_str()) == 9007199254740992.0);
+    assert(parse((halfway + "1").c_str()) == 9007199254740994.0);
+    assert(parse((std::string(100, '0') + "1.5").c_str()) == 1.5);
+
+    // The number alone, nothing around it
+    for (const char* text : { "", "-", ".", "1e", "1e+", "1.2.3", " 1", "1 ", "1x", "--1", "e5", "nan", "1e999" })
+        assert(parse(text) == -12345.0);
+
+    std::cout << "test_parse_decimal passed!" << std::endl;
+}
+
 int main(void) {
     try {
         test_constant_expression();
@@ -64,6 +1674,32 @@ int main(void) {
         test_variable_expression_2();
         test_function_expression();
         test_binary_expression();
+        test_tokenizer();
+        test_compiled_expression();
+        test_bytecode_matches_tree();
+        test_bound_variables();
+        test_function_resolution();
+        test_constant_folding();
+        test_shared_subexpressions();
+        test_arena_allocation();
+        test_expression_cache();
+        test_concurrent_evaluation();
+        test_batch_matches_tree();
+        test_parallel_evaluation();
+        test_jit();
+        test_expression_set();
+        test_programs();
+        test_gradients();
+#if __cplusplus >= 201703L
+        test_static_expressions();
+#endif
+        test_vector_math_accuracy();
+        test_fast_math_rewrites();
+        test_profiling();
+        test_status_codes();
+        test_expression_images();
+        test_compile_all();
+        test_parse_decimal();
 
         std::cout << "All tests passed!" << std::endl;
     } catch (const std::exception& e) {
@@ -0,0 +1,698 @@
+//  eval.cpp - Lightweight C++ Expression Parser (Command-Line Evaluator)
+//
+//  This file implements `cppexprpars-eval`, which evaluates expressions over
+//  every row of a CSV file or of raw binary columns, a chunk at a time.
+//
+//  https://github.com/ibnunes/cppexprpars
+//
+//  -------------------------------------------------------------------------
+//
+//  MIT License
+//
+//  Copyright (c) 2025 Igor Nunes
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+
+
+#include "cppexprpars.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<charconv>) && __cplusplus >= 201703L
+#include <charconv>
+#endif
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CPPEXPRPARS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace cppexprpars;
+
+static const char* const usage =
+    "usage: cppexprpars-eval [options] expression...\n"
+    "\n"
+    "Evaluates every expression over each row of the input and writes one\n"
+    "column per expression. Variables are the names of the input columns.\n"
+    "An expression written `name = expression` names its output column.\n"
+    "\n"
+    "  -i FILE      input file (required)\n"
+    "  -f FORMAT    input format: csv (default), f64 or f32; f64 and f32 are\n"
+    "               raw little-endian columns stored one after another\n"
+    "  -c NAMES     comma-separated names of the columns of a binary input\n"
+    "  -d CHAR      delimiter of CSV input and output (default ',')\n"
+    "  -o FILE      output file (default: standard output)\n"
+    "  -F FORMAT    output format: csv (default) or f64, little-endian with\n"
+    "               the results of each row one after another\n"
+    "  -n ROWS      rows per chunk (default 65536)\n"
+    "  -q           do not report the rate and the number of flagged rows\n"
+    "               (division by zero, function error, infinite or NaN\n"
+    "               result) on standard error\n"
+    "  --           the remaining arguments are expressions\n";
+
+namespace {
+
+enum class Format { Csv, F64, F32 };
+
+bool little_endian() {
+    const uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+struct Options {
+    std::string              input;
+    std::string              output;
+    Format                   input_format  = Format::Csv;
+    Format                   output_format = Format::Csv;
+    std::vector<std::string> columns;
+    char                     delimiter     = ',';
+    size_t                   chunk         = 65536;
+    bool                     quiet         = false;
+    std::vector<std::string> expressions;
+};
+
+Format parse_format(const std::string& name) {
+    if (name == "csv") return Format::Csv;
+    if (name == "f64") return Format::F64;
+    if (name == "f32") return Format::F32;
+    throw std::runtime_error("Unknown format: " + name);
+}
+
+std::vector<std::string> split(StringView text, char delimiter) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        if (i == text.size() || text[i] == delimiter) {
+            parts.push_back(text.substr(start, i - start).to_string());
+            start = i + 1;
+        }
+    }
+    return parts;
+}
+
+Options parse_options(int argc, char** argv) {
+    Options options;
+    bool positional = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (positional || arg.size() < 2 || arg[0] != '-' || std::isdigit(static_cast<unsigned char>(arg[1])) || arg[1] == '.') {
+            options.expressions.push_back(arg);
+            continue;
+        }
+        if (arg == "--") {
+            positional = true;
+            continue;
+        }
+        if (arg == "-h" || arg == "--help") {
+            std::fputs(usage, stdout);
+            std::exit(0);
+        }
+        if (arg == "-q") {
+            options.quiet = true;
+            continue;
+        }
+        if (arg.size() == 2 && arg[0] == '-' && std::strchr("ifcdoFn", arg[1])) {
+            if (++i == argc)
+                throw std::runtime_error("Missing value of " + arg);
+            const std::string value = argv[i];
+            switch (arg[1]) {
+                case 'i': options.input = value; break;
+                case 'f': options.input_format = parse_format(value); break;
+                case 'c': options.columns = split(value, ','); break;
+                case 'o': options.output = value; break;
+                case 'F':
+                    options.output_format = parse_format(value);
+                    if (options.output_format == Format::F32)
+                        throw std::runtime_error("Output format must be csv or f64");
+                    break;
+                case 'd':
+                    if (value.size() != 1)
+                        throw std::runtime_error("The delimiter must be one character");
+                    options.delimiter = value[0];
+                    break;
+                case 'n':
+                    options.chunk = std::strtoull(value.c_str(), nullptr, 10);
+                    if (options.chunk == 0)
+                        throw std::runtime_error("Invalid chunk size: " + value);
+                    break;
+            }
+            continue;
+        }
+        throw std::runtime_error("Unknown option: " + arg + " (write `-- expression...` for expressions that start with '-')");
+    }
+    if (options.input.empty())
+        throw std::runtime_error("No input file (-i)");
+    if (options.expressions.empty())
+        throw std::runtime_error("No expressions to evaluate");
+    if (options.input_format != Format::Csv && options.columns.empty())
+        throw std::runtime_error("Binary input needs the names of its columns (-c)");
+    return options;
+}
+
+// The input file, mapped read-only where possible and read whole otherwise.
+// Pages already consumed can be handed back to the system, so a sequential
+// pass keeps only about a chunk of the file resident.
+class InputFile {
+public:
+    explicit InputFile(const std::string& path) {
+#ifdef CPPEXPRPARS_MMAP
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open input: " + path);
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot read input: " + path);
+        }
+        size_ = static_cast<size_t>(info.st_size);
+        if (size_ > 0) {
+            void* mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Cannot map input: " + path);
+            }
+            ::madvise(mapping, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(mapping);
+        }
+        ::close(fd);
+#else
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            throw std::runtime_error("Cannot open input: " + path);
+        size_ = static_cast<size_t>(file.tellg());
+        buffer_.resize((size_ + 7) / 8);
+        file.seekg(0);
+        if (!file.read(reinterpret_cast<char*>(buffer_.data()), static_cast<std::streamsize>(size_)))
+            throw std::runtime_error("Cannot read input: " + path);
+        data_ = reinterpret_cast<const char*>(buffer_.data());
+#endif
+    }
+
+    ~InputFile() {
+#ifdef CPPEXPRPARS_MMAP
+        if (data_)
+            ::munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    inline const char* data() const { return data_; }
+    inline size_t size() const { return size_; }
+
+    // Drops the pages from the one holding `begin` up to the one holding
+    // `end`, excluded, once the caller is done with them for now. Reading
+    // them again faults them back in from the file.
+    void release(size_t begin, size_t end) {
+#ifdef CPPEXPRPARS_MMAP
+        const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        begin -= begin % page;
+        end -= end % page;
+        if (end > begin)
+            ::madvise(const_cast<char*>(data_) + begin, end - begin, MADV_DONTNEED);
+#else
+        (void) begin;
+        (void) end;
+#endif
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t      size_ = 0;
+#ifndef CPPEXPRPARS_MMAP
+    std::vector<uint64_t> buffer_;
+#endif
+};
+
+// A source of rows, read a chunk at a time into one buffer per column that
+// some expression uses. `columns` are the names of the input columns.
+class RowReader {
+public:
+    virtual ~RowReader() = default;
+
+    const std::vector<std::string>& columns() const { return columns_; }
+
+    // Reads up to `n` rows into `out[c]` for every column `c` whose `out[c]`
+    // is not null (whose buffer then has room for `n` values); may replace
+    // `out[c]` by a pointer straight into the input. Returns how many rows
+    // were read, 0 at the end.
+    virtual size_t read(size_t n, const ExprFloat** out, ExprFloat* const* buffers) = 0;
+
+protected:
+    std::vector<std::string> columns_;
+};
+
+class CsvReader : public RowReader {
+public:
+    CsvReader(InputFile& file, char delimiter) :
+        file_(file), delimiter_(delimiter), pos_(file.data()), end_(file.data() + file.size())
+    {
+        if (end_ - pos_ >= 3 && std::memcmp(pos_, "\xEF\xBB\xBF", 3) == 0)
+            pos_ += 3;      // UTF-8 byte order mark
+        skip_blank_lines();
+        if (pos_ == end_)
+            throw std::runtime_error("The input has no header line");
+        const char* eol = line_end(pos_);
+        for (const std::string& name : split(StringView(pos_, static_cast<size_t>(eol - pos_)), delimiter_))
+            columns_.push_back(unquote(name));
+        next_line(eol);
+    }
+
+    size_t read(size_t n, const ExprFloat** out, ExprFloat* const* buffers) override {
+        const size_t count = columns_.size();
+        size_t rows = 0;
+        for (skip_blank_lines(); rows < n && pos_ != end_; skip_blank_lines()) {
+            ++line_;
+            const char* p = pos_;
+            for (size_t c = 0; c < count; ++c) {
+                const char* field = p;
+                while (p != end_ && *p != delimiter_ && *p != '\n' && *p != '\r')
+                    ++p;
+                if (buffers[c])
+                    buffers[c][rows] = parse_field(field, p, c);
+                if (c + 1 < count) {
+                    if (p == end_ || *p != delimiter_)
+                        throw error("expected " + std::to_string(count) + " fields");
+                    ++p;
+                }
+            }
+            if (p != end_ && *p == delimiter_)
+                throw error("expected " + std::to_string(count) + " fields");
+            next_line(p);
+            ++rows;
+        }
+        for (size_t c = 0; c < count; ++c)
+            out[c] = buffers[c];
+        const size_t consumed = static_cast<size_t>(pos_ - file_.data());
+        file_.release(released_, consumed);
+        released_ = consumed;
+        return rows;
+    }
+
+private:
+    InputFile&  file_;
+    char        delimiter_;
+    const char* pos_;
+    const char* end_;
+    size_t      line_     = 1;
+    size_t      released_ = 0;
+
+    const char* line_end(const char* p) const {
+        while (p != end_ && *p != '\n' && *p != '\r')
+            ++p;
+        return p;
+    }
+
+    void next_line(const char* eol) {
+        pos_ = line_end(eol);
+        if (pos_ != end_ && *pos_ == '\r')
+            ++pos_;
+        if (pos_ != end_ && *pos_ == '\n')
+            ++pos_;
+    }
+
+    void skip_blank_lines() {
+        while (pos_ != end_ && (*pos_ == '\n' || *pos_ == '\r')) {
+            line_ += (*pos_ == '\n');
+            ++pos_;
+        }
+    }
+
+    // A number, possibly quoted and padded with spaces; an empty field or
+    // `nan` is NaN and `inf` an infinity. Nothing here allocates.
+    ExprFloat parse_field(const char* first, const char* last, size_t column) const {
+        while (first != last && (*first == ' ' || *first == '\t'))
+            ++first;
+        while (last != first && (last[-1] == ' ' || last[-1] == '\t'))
+            --last;
+        if (last - first >= 2 && *first == '"' && last[-1] == '"') {
+            ++first;
+            --last;
+        }
+        const StringView text(first, static_cast<size_t>(last - first));
+        ExprFloat value;
+        if (parse_decimal(text, value))
+            return value;
+        if (text.size() == 0 || equals_lower(text, "nan"))
+            return std::numeric_limits<ExprFloat>::quiet_NaN();
+        const bool negative = text.size() > 0 && text[0] == '-';
+        const StringView magnitude = (negative || (text.size() > 0 && text[0] == '+')) ? text.substr(1, text.size()) : text;
+        if (equals_lower(magnitude, "inf") || equals_lower(magnitude, "infinity"))
+            return negative ? -std::numeric_limits<ExprFloat>::infinity() : std::numeric_limits<ExprFloat>::infinity();
+        throw error("invalid number in column '" + columns_[column] + "': '" + text.to_string() + "'");
+    }
+
+    static bool equals_lower(StringView text, const char* word) {
+        const size_t length = std::strlen(word);
+        if (text.size() != length)
+            return false;
+        for (size_t i = 0; i < length; ++i)
+            if (std::tolower(static_cast<unsigned char>(text[i])) != word[i])
+                return false;
+        return true;
+    }
+
+    static std::string unquote(const std::string& name) {
+        size_t first = name.find_first_not_of(" \t");
+        size_t last  = name.find_last_not_of(" \t");
+        if (first == std::string::npos)
+            return std::string();
+        if (last > first && name[first] == '"' && name[last] == '"') {
+            ++first;
+            --last;
+        }
+        return name.substr(first, last + 1 - first);
+    }
+
+    std::runtime_error error(const std::string& message) const {
+        return std::runtime_error("Line " + std::to_string(line_) + ": " + message);
+    }
+};
+
+// Raw columns of `width` bytes per value, stored one after another. On a
+// little-endian machine doubles are used in place.
+class BinaryReader : public RowReader {
+public:
+    BinaryReader(InputFile& file, std::vector<std::string> columns, size_t width) :
+        file_(file), width_(width)
+    {
+        columns_ = std::move(columns);
+        const size_t row_size = columns_.size() * width_;
+        if (file_.size() % row_size != 0)
+            throw std::runtime_error("The input size is not a multiple of " + std::to_string(columns_.size()) +
+                                     " columns of " + std::to_string(width_) + " bytes");
+        rows_ = file_.size() / row_size;
+    }
+
+    // The previous chunk is done with by now, even where it was used in
+    // place, so its pages are dropped.
+    size_t read(size_t n, const ExprFloat** out, ExprFloat* const* buffers) override {
+        n = std::min(n, rows_ - row_);
+        for (size_t c = 0; c < columns_.size(); ++c) {
+            if (!buffers[c])
+                continue;
+            file_.release((c * rows_ + released_) * width_, (c * rows_ + row_) * width_);
+            const char* first = file_.data() + (c * rows_ + row_) * width_;
+            if (width_ == sizeof(double) && little_endian() && sizeof(ExprFloat) == sizeof(double)) {
+                out[c] = reinterpret_cast<const ExprFloat*>(first);
+                continue;
+            }
+            for (size_t i = 0; i < n; ++i)
+                buffers[c][i] = value(first + i * width_);
+            out[c] = buffers[c];
+        }
+        released_ = row_;
+        row_ += n;
+        return n;
+    }
+
+private:
+    InputFile& file_;
+    size_t     width_;
+    size_t     rows_     = 0;
+    size_t     row_      = 0;
+    size_t     released_ = 0;      // Rows whose pages were dropped
+
+    ExprFloat value(const char* bytes) const {
+        unsigned char ordered[8];
+        for (size_t i = 0; i < width_; ++i)
+            ordered[i] = static_cast<unsigned char>(bytes[little_endian() ? i : width_ - 1 - i]);
+        if (width_ == sizeof(float)) {
+            float v;
+            std::memcpy(&v, ordered, sizeof(v));
+            return static_cast<ExprFloat>(v);
+        }
+        double v;
+        std::memcpy(&v, ordered, sizeof(v));
+        return static_cast<ExprFloat>(v);
+    }
+};
+
+// Buffered output; writes to the file only when the buffer is full.
+class Output {
+public:
+    explicit Output(const std::string& path) : buffer_(1 << 20) {
+        file_ = path.empty() ? stdout : std::fopen(path.c_str(), "wb");
+        if (!file_)
+            throw std::runtime_error("Cannot open output: " + path);
+    }
+
+    ~Output() {
+        if (file_ && file_ != stdout)
+            std::fclose(file_);
+    }
+
+    Output(const Output&) = delete;
+    Output& operator=(const Output&) = delete;
+
+    void write(const char* data, size_t size) {
+        if (used_ + size > buffer_.size())
+            flush();
+        if (size > buffer_.size()) {
+            put(data, size);
+            return;
+        }
+        std::memcpy(buffer_.data() + used_, data, size);
+        used_ += size;
+    }
+
+    inline void write(char ch) { write(&ch, 1); }
+
+    // The shortest text that reads back as the same value. Without
+    // `std::to_chars`, the shorter of 15 or 17 significant digits.
+    void write(ExprFloat value) {
+        char text[32];
+#if defined(__cpp_lib_to_chars)
+        const size_t length = static_cast<size_t>(std::to_chars(text, text + sizeof(text), static_cast<double>(value)).ptr - text);
+#else
+        int printed = std::snprintf(text, sizeof(text), "%.15g", static_cast<double>(value));
+        ExprFloat back;
+        if (std::isfinite(value) && (!parse_decimal(StringView(text, static_cast<size_t>(printed)), back) || back != value))
+            printed = std::snprintf(text, sizeof(text), "%.17g", static_cast<double>(value));
+        const size_t length = static_cast<size_t>(printed);
+#endif
+        write(text, length);
+    }
+
+    // A little-endian double
+    void write_binary(double value) {
+        char bytes[sizeof(value)];
+        std::memcpy(bytes, &value, sizeof(value));
+        if (!little_endian())
+            std::reverse(bytes, bytes + sizeof(bytes));
+        write(bytes, sizeof(bytes));
+    }
+
+    void flush() {
+        put(buffer_.data(), used_);
+        used_ = 0;
+    }
+
+    void close() {
+        flush();
+        if (std::fflush(file_) != 0)
+            throw std::runtime_error("Cannot write the output");
+    }
+
+private:
+    std::FILE*        file_;
+    std::vector<char> buffer_;
+    size_t            used_ = 0;
+
+    void put(const char* data, size_t size) {
+        if (size > 0 && std::fwrite(data, 1, size, file_) != size)
+            throw std::runtime_error("Cannot write the output");
+    }
+};
+
+// An expression to evaluate: its output column and the input column of each
+// of its variables.
+struct Formula {
+    std::string         name;
+    CompiledExpr        expr;
+    std::vector<size_t> inputs;
+};
+
+// `name = expression` names the output column; otherwise the expression is
+// its own name.
+std::string output_name(const std::string& source, std::string& expression) {
+    size_t i = source.find_first_not_of(" \t");
+    const size_t start = i;
+    if (i != std::string::npos && (std::isalpha(static_cast<unsigned char>(source[i])) || source[i] == '_')) {
+        while (i < source.size() && (std::isalnum(static_cast<unsigned char>(source[i])) || source[i] == '_'))
+            ++i;
+        const size_t end = i;
+        i = source.find_first_not_of(" \t", i);
+        if (i != std::string::npos && source[i] == '=') {
+            expression = source.substr(i + 1);
+            return source.substr(start, end - start);
+        }
+    }
+    expression = source;
+    return source;
+}
+
+void write_header(Output& output, const std::vector<Formula>& formulas, char delimiter) {
+    for (size_t f = 0; f < formulas.size(); ++f) {
+        if (f > 0)
+            output.write(delimiter);
+        const std::string& name = formulas[f].name;
+        if (name.find_first_of(std::string("\"\r\n") + delimiter) == std::string::npos) {
+            output.write(name.data(), name.size());
+            continue;
+        }
+        output.write('"');
+        for (char ch : name) {
+            if (ch == '"')
+                output.write('"');
+            output.write(ch);
+        }
+        output.write('"');
+    }
+    output.write('\n');
+}
+
+int run(const Options& options) {
+    InputFile file(options.input);
+    std::unique_ptr<RowReader> reader;
+    if (options.input_format == Format::Csv)
+        reader.reset(new CsvReader(file, options.delimiter));
+    else
+        reader.reset(new BinaryReader(file, options.columns, options.input_format == Format::F64 ? 8 : 4));
+    const std::vector<std::string>& columns = reader->columns();
+
+    // Every column is a variable; only the ones some expression reads are
+    // parsed
+    EvaluationContext context;
+    for (const std::string& name : columns)
+        context.set_variable(name, 0.0);
+    std::vector<Formula> formulas;
+    std::vector<bool> used(columns.size(), false);
+    for (const std::string& source : options.expressions) {
+        Formula formula;
+        std::string expression;
+        formula.name = output_name(source, expression);
+        try {
+            Parser parser(Tokenizer(expression), &context, get_default_registry());
+            formula.expr = parser.compile();
+        } catch (const std::exception& e) {
+            throw std::runtime_error("In '" + source + "': " + e.what());
+        }
+        for (const std::string& variable : formula.expr.variables()) {
+            const size_t column = static_cast<size_t>(std::find(columns.begin(), columns.end(), variable) - columns.begin());
+            formula.inputs.push_back(column);
+            used[column] = true;
+        }
+        formulas.push_back(std::move(formula));
+    }
+
+    // Memory stays bounded by the chunk: a buffer per used column and one
+    // per expression
+    const size_t chunk = options.chunk;
+    std::vector<std::vector<ExprFloat>> storage(columns.size());
+    std::vector<ExprFloat*> buffers(columns.size(), nullptr);
+    for (size_t c = 0; c < columns.size(); ++c) {
+        if (used[c]) {
+            storage[c].resize(chunk);
+            buffers[c] = storage[c].data();
+        }
+    }
+    std::vector<const ExprFloat*> inputs(columns.size(), nullptr);
+    std::vector<std::vector<ExprFloat>> results(formulas.size(), std::vector<ExprFloat>(chunk));
+    std::vector<const ExprFloat*> arguments;
+    // A row is flagged when any expression reports something other than
+    // `Ok` for it; its result is still written, as IEEE arithmetic gave it
+    std::vector<EvalStatus> statuses(chunk);
+    std::vector<EvalStatus> flags(chunk);
+
+    Output output(options.output);
+    const bool csv = options.output_format == Format::Csv;
+    if (csv)
+        write_header(output, formulas, options.delimiter);
+
+    size_t total = 0;
+    size_t total_flagged = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t rows; (rows = reader->read(chunk, inputs.data(), buffers.data())) > 0; total += rows) {
+        std::fill_n(flags.begin(), rows, EvalStatus::Ok);
+        for (size_t f = 0; f < formulas.size(); ++f) {
+            arguments.clear();
+            for (size_t column : formulas[f].inputs)
+                arguments.push_back(inputs[column]);
+            formulas[f].expr.evaluate_batch(arguments.data(), rows, results[f].data(), statuses.data());
+            for (size_t i = 0; i < rows; ++i)
+                flags[i] |= statuses[i];
+        }
+        total_flagged += rows - static_cast<size_t>(std::count(flags.begin(), flags.begin() + rows, EvalStatus::Ok));
+        for (size_t i = 0; i < rows; ++i) {
+            for (size_t f = 0; f < formulas.size(); ++f) {
+                if (!csv) {
+                    output.write_binary(static_cast<double>(results[f][i]));
+                    continue;
+                }
+                if (f > 0)
+                    output.write(options.delimiter);
+                output.write(results[f][i]);
+            }
+            if (csv)
+                output.write('\n');
+        }
+    }
+    output.close();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!options.quiet)
+        std::fprintf(stderr, "%zu rows in %.3f s (%.0f rows/s), %zu flagged\n",
+                     total, seconds, seconds > 0 ? total / seconds : 0.0, total_flagged);
+    return 0;
+}
+
+}   // namespace
+
+int main(int argc, char** argv) {
+    try {
+        return run(parse_options(argc, argv));
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "cppexprpars-eval: %s\n", e.what());
+        if (argc == 1)
+            std::fputs(usage, stderr);
+        return 1;
+    }
+}